@@ -75,6 +75,78 @@ This DLL is loaded at runtime by the engine to perform cache simulation.
 As such there's no static binding to these functions, they're looked up with GetProcAddress().
 */
 
+namespace CacheSim
+{
+  /// Ways of following the traced threads, selected with CacheSimSetCaptureEngine().
+  enum CaptureEngine
+  {
+    kCaptureEngineSingleStep = 0,   ///< Trap after every instruction. The default, and the only engine on Windows.
+    kCaptureEngineCodeCache = 1,    ///< Run traced threads from instrumented copies of their code. Linux x64 only.
+  };
+
+  /// What to do with instructions matched by a filter, see CacheSimAddModuleFilter().
+  enum FilterAction
+  {
+    kFilterTrace = 0,               ///< Simulate and record. The default.
+    kFilterSimulateOnly = 1,        ///< Update the simulated caches but don't record statistics.
+    kFilterSkip = 2,                ///< Ignore. The code cache engine runs skipped code at full speed.
+  };
+
+  /// How threads without a core set with CacheSimSetThreadCoreMapping() get one, see CacheSimSetThreadCorePolicy().
+  enum ThreadCorePolicy
+  {
+    kThreadCoreExplicit = 0,        ///< They aren't traced. The default.
+    kThreadCoreRoundRobin = 1,      ///< Each gets the next of the 8 cores in turn.
+    kThreadCoreByName = 2,          ///< The core of the first CacheSimAddThreadNameCoreMapping() prefix its name starts with.
+    kThreadCoreByAffinity = 3,      ///< The first CPU its affinity mask allows, modulo 8.
+  };
+
+  /// Results of a sampled capture, see CacheSimSetSampling().
+  /// Rates are per 1000 instructions, averaged over the measurement windows, with the half width of their 95% confidence interval.
+  struct SamplingSummary
+  {
+    uint32_t  m_WindowCount;              ///< Measurement windows completed during the capture
+    uint64_t  m_MeasuredInstructions;     ///< Instructions run in the measurement part of the windows, warmup excluded
+    uint64_t  m_EstimatedInstructions;    ///< Instructions executed by the traced threads during the capture, 0 if they couldn't be counted
+    double    m_Scale;                    ///< Factor the saved statistics were scaled by. 1 if the instructions couldn't be counted.
+    double    m_L2HitsPerKI;
+    double    m_L2HitsPerKIError;
+    double    m_L2IMissesPerKI;
+    double    m_L2IMissesPerKIError;
+    double    m_L2DMissesPerKI;
+    double    m_L2DMissesPerKIError;
+  };
+
+  enum
+  {
+    kMaxCacheConfigs = 8,           ///< Alternative cache hierarchies a capture can simulate, see CacheSimAddCacheConfig()
+    kMaxCacheModules = 8,
+    kMaxCoresPerModule = 16,
+  };
+
+  /// An alternative cache hierarchy to simulate alongside the Jaguar one. Like the Jaguar, each module has a shared,
+  /// inclusive L2 and every core has its own I1 and D1. Sizes are in bytes; each cache must have a power of two
+  /// number of sets of 64 byte lines.
+  struct CacheConfig
+  {
+    uint32_t  m_ModuleCount;
+    uint32_t  m_CoresPerModule;
+    uint32_t  m_I1Size;
+    uint32_t  m_I1Ways;
+    uint32_t  m_D1Size;
+    uint32_t  m_D1Ways;
+    uint32_t  m_L2Size;                   ///< Per module
+    uint32_t  m_L2Ways;
+  };
+
+  /// The simulated Jaguar hierarchy as a CacheConfig, as a starting point for alternatives.
+  inline CacheConfig JaguarCacheConfig()
+  {
+    CacheConfig config = { 2, 4, 32 * 1024, 2, 32 * 1024, 8, 2 * 1024 * 1024, 16 };
+    return config;
+  }
+}
+
 extern "C"
 {
   /// Initializes the API. Only call once.
@@ -84,10 +156,103 @@ extern "C"
   IG_CACHESIM_API uint64_t CacheSimGetCurrentThreadId();
 
   /// Set what Jaguar core (0-7) this Win32 thread ID will map to.
-  /// Threads without a jaguar core id will not be recorded, so you'll need to set up atleast one.
+  /// Threads without a jaguar core id will not be recorded unless a CacheSim::ThreadCorePolicy assigns them one.
   /// A core id of -1 will disable recording the thread (e.g., upon thread completion)
   IG_CACHESIM_API void CacheSimSetThreadCoreMapping(uint64_t thread_id, int logical_core_id);
 
+  /// Select how subsequent captures assign cores to threads without a mapping, one of CacheSim::ThreadCorePolicy.
+  /// Threads that exist when the capture starts are assigned then, threads created during it when they first trap.
+  /// Fails while capturing.
+  IG_CACHESIM_API bool CacheSimSetThreadCorePolicy(int policy);
+
+  /// Map threads whose name starts with `name_prefix` to `logical_core_id` under CacheSim::kThreadCoreByName. Rules
+  /// are tried in the order they were added. Threads matching none are looked at again every few thousand
+  /// instructions, as they are often named after they start. Fails while capturing or if the prefix is 32 characters or longer.
+  IG_CACHESIM_API bool CacheSimAddThreadNameCoreMapping(const char* name_prefix, int logical_core_id);
+
+  /// Remove the rules added with CacheSimAddThreadNameCoreMapping(). Does nothing while capturing.
+  IG_CACHESIM_API void CacheSimClearThreadNameCoreMappings();
+
+  /// Move each traced thread to the core of the CPU it's running on, modulo 8, before every instruction, so the
+  /// simulation follows the OS scheduler. Fails while capturing or if the CPU can't be queried.
+  IG_CACHESIM_API bool CacheSimSetFollowScheduling(bool enable);
+
+  /// Tell CacheSim the calling thread is about to switch to the fiber or coroutine `fiber_id`. Stats are recorded per fiber,
+  /// with 0 meaning none. Switches are also detected without this, from the stack pointer leaving the thread's own stack,
+  /// but switches between fibers whose stacks are within 256KB of each other are only seen with it.
+  IG_CACHESIM_API void CacheSimFiberSwitch(uint32_t fiber_id);
+
+  /// Select the CacheSim::CaptureEngine used by subsequent captures. Fails while capturing or if the engine isn't supported.
+  IG_CACHESIM_API bool CacheSimSetCaptureEngine(int engine);
+
+  /// Trace in bursts instead of continuously. Every `period_us` microseconds of CPU time each mapped thread runs
+  /// `warmup_instructions` that only warm the simulated caches, then records `measure_instructions`, then runs untraced.
+  /// Saved statistics are scaled up to the whole capture where the instructions can be counted.
+  /// A period of zero turns sampling off. Fails while capturing or if sampling isn't supported.
+  IG_CACHESIM_API bool CacheSimSetSampling(uint32_t period_us, uint32_t warmup_instructions, uint32_t measure_instructions);
+
+  /// Apply a CacheSim::FilterAction to the code of every module whose file name or path is `module_name`.
+  /// Modules are looked up again each time a capture starts. Where filters overlap the one added last wins.
+  /// Fails while capturing or when out of filter slots.
+  IG_CACHESIM_API bool CacheSimAddModuleFilter(const char* module_name, int action);
+
+  /// Apply a CacheSim::FilterAction to instructions in [start, end).
+  IG_CACHESIM_API bool CacheSimAddAddressFilter(uint64_t start, uint64_t end, int action);
+
+  /// Set the CacheSim::FilterAction for instructions no filter matches. Defaults to kFilterTrace.
+  IG_CACHESIM_API bool CacheSimSetDefaultFilterAction(int action);
+
+  /// Remove all filters and reset the default action. Does nothing while capturing.
+  IG_CACHESIM_API void CacheSimClearFilters();
+
+  /// Set the granularity of the address space heatmap recorded by subsequent captures. `bytes` must be a power of
+  /// two of at least 64, a cache line, which is the default. Zero turns the heatmap off. Fails while capturing.
+  IG_CACHESIM_API bool CacheSimSetHeatmapCellSize(uint32_t bytes);
+
+  /// Record reuse distances in subsequent captures, tracking only 1 in 2^shift lines (at most 2^16) to bound their
+  /// cost. 0 tracks every line exactly. The default, -1, doesn't record reuse distances. Fails while capturing.
+  IG_CACHESIM_API bool CacheSimSetReuseSampling(int32_t shift);
+
+  /// Split subsequent captures into intervals of `instructions` recorded instructions, counted over all threads, and
+  /// estimate how many distinct lines the data accesses of each interval touch. Defaults to 1000000; zero turns it
+  /// off. Fails while capturing.
+  IG_CACHESIM_API bool CacheSimSetWorkingSetInterval(uint32_t instructions);
+
+  /// Also simulate `config` in subsequent captures, so its statistics can be compared with the Jaguar's from one run.
+  /// Each configuration is simulated on a worker thread of its own. Logical cores are assigned to its modules in
+  /// order, wrapping around. Fails while capturing, if the configuration is invalid, or if there are
+  /// CacheSim::kMaxCacheConfigs already.
+  IG_CACHESIM_API bool CacheSimAddCacheConfig(const CacheSim::CacheConfig* config);
+
+  /// Remove the configurations added with CacheSimAddCacheConfig(). Does nothing while capturing.
+  IG_CACHESIM_API void CacheSimClearCacheConfigs();
+
+  /// Split the simulation of each configuration across `shard_count` worker threads, each simulating the sets of the
+  /// lines whose low bits of line address select it. The results are the same. `shard_count` must be a power of two
+  /// up to 16, and each cache of every configuration must have at least as many sets. Defaults to 1. Fails while
+  /// capturing.
+  IG_CACHESIM_API bool CacheSimSetCacheConfigShards(uint32_t shard_count);
+
+  /// Resolve subsequent saved captures to function names on a background thread once they're written, from the
+  /// symbol tables of the traced modules and dladdr(), so they open resolved. Only names are found; resolving in the
+  /// UI adds file and line information. The modules must stay loaded until CacheSimWaitForSymbolization() returns.
+  /// Fails while capturing or if it isn't supported.
+  IG_CACHESIM_API bool CacheSimSetCaptureSymbolization(bool enable);
+
+  /// Wait for the symbolization of the last saved capture to finish. Starting a capture waits for it too.
+  IG_CACHESIM_API void CacheSimWaitForSymbolization();
+
+  /// Retrieve the results of the last sampled capture. Returns false if it wasn't sampled.
+  IG_CACHESIM_API bool CacheSimGetSamplingSummary(CacheSim::SamplingSummary* summary);
+
+  /// Report a heap allocation, so L2 data misses inside it are charged to `tag` and the calling call stack.
+  /// Allocations live before a capture starts are tracked too, so call this from the allocator at all times.
+  /// `tag` should be a string that outlives the allocation, such as a literal. It may be null.
+  IG_CACHESIM_API void CacheSimOnAlloc(const void* ptr, size_t size, const char* tag);
+
+  /// Report that an allocation reported with CacheSimOnAlloc() was freed.
+  IG_CACHESIM_API void CacheSimOnFree(const void* ptr);
+
   /// Start recording a capture, buffering it to memory.
   IG_CACHESIM_API bool CacheSimStartCapture();
 
@@ -116,7 +281,29 @@ namespace CacheSim
     decltype(&CacheSimEndCapture) m_EndCaptureFn = nullptr;
     decltype(&CacheSimRemoveHandler) m_RemoveHandlerFn = nullptr;
     decltype(&CacheSimSetThreadCoreMapping) m_SetThreadCoreMapping = nullptr;
+    decltype(&CacheSimSetThreadCorePolicy) m_SetThreadCorePolicy = nullptr;
+    decltype(&CacheSimAddThreadNameCoreMapping) m_AddThreadNameCoreMapping = nullptr;
+    decltype(&CacheSimClearThreadNameCoreMappings) m_ClearThreadNameCoreMappings = nullptr;
+    decltype(&CacheSimSetFollowScheduling) m_SetFollowScheduling = nullptr;
+    decltype(&CacheSimFiberSwitch) m_FiberSwitch = nullptr;
     decltype(&CacheSimGetCurrentThreadId) m_GetCurrentThreadId = nullptr;
+    decltype(&CacheSimSetCaptureEngine) m_SetCaptureEngine = nullptr;
+    decltype(&CacheSimSetSampling) m_SetSampling = nullptr;
+    decltype(&CacheSimGetSamplingSummary) m_GetSamplingSummary = nullptr;
+    decltype(&CacheSimSetCaptureSymbolization) m_SetCaptureSymbolization = nullptr;
+    decltype(&CacheSimWaitForSymbolization) m_WaitForSymbolization = nullptr;
+    decltype(&CacheSimAddModuleFilter) m_AddModuleFilter = nullptr;
+    decltype(&CacheSimAddAddressFilter) m_AddAddressFilter = nullptr;
+    decltype(&CacheSimSetDefaultFilterAction) m_SetDefaultFilterAction = nullptr;
+    decltype(&CacheSimClearFilters) m_ClearFilters = nullptr;
+    decltype(&CacheSimSetHeatmapCellSize) m_SetHeatmapCellSize = nullptr;
+    decltype(&CacheSimSetReuseSampling) m_SetReuseSampling = nullptr;
+    decltype(&CacheSimSetWorkingSetInterval) m_SetWorkingSetInterval = nullptr;
+    decltype(&CacheSimAddCacheConfig) m_AddCacheConfig = nullptr;
+    decltype(&CacheSimClearCacheConfigs) m_ClearCacheConfigs = nullptr;
+    decltype(&CacheSimSetCacheConfigShards) m_SetCacheConfigShards = nullptr;
+    decltype(&CacheSimOnAlloc) m_OnAlloc = nullptr;
+    decltype(&CacheSimOnFree) m_OnFree = nullptr;
 
   public:
     DynamicLoader()
@@ -146,8 +333,33 @@ namespace CacheSim
         m_RemoveHandlerFn =       (decltype(&CacheSimRemoveHandler))        IG_GetFuncAddress(m_Module, "CacheSimRemoveHandler");
         m_SetThreadCoreMapping =  (decltype(&CacheSimSetThreadCoreMapping)) IG_GetFuncAddress(m_Module, "CacheSimSetThreadCoreMapping");
         m_GetCurrentThreadId =    (decltype(&CacheSimGetCurrentThreadId))   IG_GetFuncAddress(m_Module, "CacheSimGetCurrentThreadId");
+        m_SetThreadCorePolicy =   (decltype(&CacheSimSetThreadCorePolicy))  IG_GetFuncAddress(m_Module, "CacheSimSetThreadCorePolicy");
+        m_AddThreadNameCoreMapping = (decltype(&CacheSimAddThreadNameCoreMapping)) IG_GetFuncAddress(m_Module, "CacheSimAddThreadNameCoreMapping");
+        m_ClearThreadNameCoreMappings = (decltype(&CacheSimClearThreadNameCoreMappings)) IG_GetFuncAddress(m_Module, "CacheSimClearThreadNameCoreMappings");
+        m_SetFollowScheduling =   (decltype(&CacheSimSetFollowScheduling))  IG_GetFuncAddress(m_Module, "CacheSimSetFollowScheduling");
+        m_FiberSwitch =           (decltype(&CacheSimFiberSwitch))          IG_GetFuncAddress(m_Module, "CacheSimFiberSwitch");
+        m_SetCaptureEngine =      (decltype(&CacheSimSetCaptureEngine))     IG_GetFuncAddress(m_Module, "CacheSimSetCaptureEngine");
+        m_SetSampling =           (decltype(&CacheSimSetSampling))          IG_GetFuncAddress(m_Module, "CacheSimSetSampling");
+        m_GetSamplingSummary =    (decltype(&CacheSimGetSamplingSummary))   IG_GetFuncAddress(m_Module, "CacheSimGetSamplingSummary");
+        m_SetCaptureSymbolization = (decltype(&CacheSimSetCaptureSymbolization)) IG_GetFuncAddress(m_Module, "CacheSimSetCaptureSymbolization");
+        m_WaitForSymbolization =  (decltype(&CacheSimWaitForSymbolization)) IG_GetFuncAddress(m_Module, "CacheSimWaitForSymbolization");
+        m_AddModuleFilter =       (decltype(&CacheSimAddModuleFilter))      IG_GetFuncAddress(m_Module, "CacheSimAddModuleFilter");
+        m_AddAddressFilter =      (decltype(&CacheSimAddAddressFilter))     IG_GetFuncAddress(m_Module, "CacheSimAddAddressFilter");
+        m_SetDefaultFilterAction = (decltype(&CacheSimSetDefaultFilterAction)) IG_GetFuncAddress(m_Module, "CacheSimSetDefaultFilterAction");
+        m_ClearFilters =          (decltype(&CacheSimClearFilters))         IG_GetFuncAddress(m_Module, "CacheSimClearFilters");
+        m_SetHeatmapCellSize =    (decltype(&CacheSimSetHeatmapCellSize))   IG_GetFuncAddress(m_Module, "CacheSimSetHeatmapCellSize");
+        m_SetReuseSampling =      (decltype(&CacheSimSetReuseSampling))     IG_GetFuncAddress(m_Module, "CacheSimSetReuseSampling");
+        m_SetWorkingSetInterval = (decltype(&CacheSimSetWorkingSetInterval)) IG_GetFuncAddress(m_Module, "CacheSimSetWorkingSetInterval");
+        m_AddCacheConfig =        (decltype(&CacheSimAddCacheConfig))       IG_GetFuncAddress(m_Module, "CacheSimAddCacheConfig");
+        m_ClearCacheConfigs =     (decltype(&CacheSimClearCacheConfigs))    IG_GetFuncAddress(m_Module, "CacheSimClearCacheConfigs");
+        m_SetCacheConfigShards =  (decltype(&CacheSimSetCacheConfigShards)) IG_GetFuncAddress(m_Module, "CacheSimSetCacheConfigShards");
+        m_OnAlloc =               (decltype(&CacheSimOnAlloc))              IG_GetFuncAddress(m_Module, "CacheSimOnAlloc");
+        m_OnFree =                (decltype(&CacheSimOnFree))               IG_GetFuncAddress(m_Module, "CacheSimOnFree");
 
-        if (!(m_InitFn && m_StartCaptureFn && m_EndCaptureFn && m_RemoveHandlerFn && m_SetThreadCoreMapping && m_GetCurrentThreadId))
+        if (!(m_InitFn && m_StartCaptureFn && m_EndCaptureFn && m_RemoveHandlerFn && m_SetThreadCoreMapping && m_GetCurrentThreadId && m_SetCaptureEngine &&
+              m_SetThreadCorePolicy && m_AddThreadNameCoreMapping && m_ClearThreadNameCoreMappings && m_SetFollowScheduling && m_FiberSwitch &&
+              m_SetSampling && m_GetSamplingSummary && m_SetCaptureSymbolization && m_WaitForSymbolization && m_AddModuleFilter && m_AddAddressFilter && m_SetDefaultFilterAction && m_ClearFilters &&
+              m_SetHeatmapCellSize && m_SetReuseSampling && m_SetWorkingSetInterval && m_AddCacheConfig && m_ClearCacheConfigs && m_SetCacheConfigShards && m_OnAlloc && m_OnFree))
         {
           PrintError("CacheSim API mismatch");
           IG_UnloadLib(m_Module);
@@ -187,9 +399,119 @@ namespace CacheSim
       m_SetThreadCoreMapping(thread_id, logical_core);
     }
 
+    inline bool SetThreadCorePolicy(CacheSim::ThreadCorePolicy policy)
+    {
+      return m_SetThreadCorePolicy(policy);
+    }
+
+    inline bool AddThreadNameCoreMapping(const char* name_prefix, int logical_core)
+    {
+      return m_AddThreadNameCoreMapping(name_prefix, logical_core);
+    }
+
+    inline void ClearThreadNameCoreMappings()
+    {
+      m_ClearThreadNameCoreMappings();
+    }
+
+    inline bool SetFollowScheduling(bool enable)
+    {
+      return m_SetFollowScheduling(enable);
+    }
+
+    inline void FiberSwitch(uint32_t fiber_id)
+    {
+      m_FiberSwitch(fiber_id);
+    }
+
     inline uint64_t GetCurrentThreadId()
     {
       return m_GetCurrentThreadId();
     }
+
+    inline bool SetCaptureEngine(CaptureEngine engine)
+    {
+      return m_SetCaptureEngine(engine);
+    }
+
+    inline bool SetSampling(uint32_t period_us, uint32_t warmup_instructions, uint32_t measure_instructions)
+    {
+      return m_SetSampling(period_us, warmup_instructions, measure_instructions);
+    }
+
+    inline bool GetSamplingSummary(SamplingSummary* summary)
+    {
+      return m_GetSamplingSummary(summary);
+    }
+
+    inline bool SetCaptureSymbolization(bool enable)
+    {
+      return m_SetCaptureSymbolization(enable);
+    }
+
+    inline void WaitForSymbolization()
+    {
+      m_WaitForSymbolization();
+    }
+
+    inline bool AddModuleFilter(const char* module_name, FilterAction action)
+    {
+      return m_AddModuleFilter(module_name, action);
+    }
+
+    inline bool AddAddressFilter(uint64_t start, uint64_t end, FilterAction action)
+    {
+      return m_AddAddressFilter(start, end, action);
+    }
+
+    inline bool SetDefaultFilterAction(FilterAction action)
+    {
+      return m_SetDefaultFilterAction(action);
+    }
+
+    inline void ClearFilters()
+    {
+      m_ClearFilters();
+    }
+
+    inline bool SetHeatmapCellSize(uint32_t bytes)
+    {
+      return m_SetHeatmapCellSize(bytes);
+    }
+
+    inline bool SetReuseSampling(int32_t shift)
+    {
+      return m_SetReuseSampling(shift);
+    }
+
+    inline bool SetWorkingSetInterval(uint32_t instructions)
+    {
+      return m_SetWorkingSetInterval(instructions);
+    }
+
+    inline bool AddCacheConfig(const CacheSim::CacheConfig& config)
+    {
+      return m_AddCacheConfig(&config);
+    }
+
+    inline void ClearCacheConfigs()
+    {
+      m_ClearCacheConfigs();
+    }
+
+    inline bool SetCacheConfigShards(uint32_t shard_count)
+    {
+      return m_SetCacheConfigShards(shard_count);
+    }
+
+    inline void OnAlloc(const void* ptr, size_t size, const char* tag)
+    {
+      m_OnAlloc(ptr, size, tag);
+    }
+
+    inline void OnFree(const void* ptr)
+    {
+      m_OnFree(ptr);
+    }
   };
 }
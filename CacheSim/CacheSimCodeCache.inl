@@ -0,0 +1,1476 @@
+#pragma once
+
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+///////////
+// Code cache capture engine (Linux x64)
+//
+// Instead of taking a trap per instruction, traced threads run out of a cache of translated basic blocks. Every
+// translated instruction is preceded by a call to a recording trampoline that feeds GenerateMemoryAccesses(), so
+// the simulation sees exactly what the single step engine would. Direct branches between blocks are chained,
+// indirect branches and returns go through a small per-thread lookup table. Return addresses pushed by translated
+// calls are the original ones, so the application never sees a code cache address on its stack.
+//
+// Threads enter the cache from the single step trap handler, and anything the translator can't handle (undecodable
+// instructions, far branches) is single-stepped natively before the thread moves back into the cache.
+//
+// It must be included exactly ONCE, after CacheSimCommon.inl and the CONTEXT declaration.
+//////////
+
+#include <cpuid.h>
+#include <sys/mman.h>
+
+static void RefreshThreadState();
+
+namespace CacheSim
+{
+  enum
+  {
+    kCodeChunkSize          = 16 * 1024 * 1024,
+    kMaxCodeChunks          = 256,
+    kMaxBlockInstructions   = 64,
+    kMaxBlockBytes          = 8192,
+    kBlockTailBytes         = 512,            ///< Room kept free at the end of a block for its exit stubs
+    kIndirectTableSize      = 4096,           ///< Entries in the per-thread indirect branch table, a power of two
+    kMaxShadowFrames        = 1024,
+    kInsnArenaSize          = 1024 * 1024,
+  };
+
+  // Every chunk starts with the addresses of the trampolines, so translated code can reach them RIP-relative
+  // no matter where the library was loaded.
+  enum CodeChunkLiteral
+  {
+    kLiteralRecord,
+    kLiteralDirect,
+    kLiteralIndirect,
+    kLiteralStep,
+    kLiteralCount
+  };
+
+  // The application's RSP, relative to the RSP value the record trampoline pushes: the 128 byte red zone, the
+  // saved RAX and return address pushed by translated code, and 12 registers pushed before RSP itself.
+  static const int64_t kRecordRspAdjust = 128 + 8 + 8 + 12 * 8;
+
+  struct CodeChunk
+  {
+    uint8_t*  m_Base;
+    size_t    m_Used;
+  };
+
+  /// What the recorder needs to know about a translated instruction; a trimmed down copy of its ud_t.
+  struct CodeCacheInsn
+  {
+    uintptr_t             m_Rip;
+    uint32_t              m_Length;
+    enum ud_mnemonic_code m_Mnemonic;
+    uint8_t               m_PfxSeg;
+    bool                  m_Record;     ///< False for kFilterSimulateOnly code, which only updates the caches
+    ud_operand_t          m_Operands[4];
+  };
+
+  /// Blocks are translated separately for each set of filters, as the filters decide what gets instrumented.
+  struct CodeCacheKey
+  {
+    CodeCacheKey() : m_Rip(0), m_FilterGeneration(0) {}
+    CodeCacheKey(uintptr_t rip, uint32_t filter_generation) : m_Rip(rip), m_FilterGeneration(filter_generation) {}
+    uintptr_t m_Rip;
+    uint32_t  m_FilterGeneration;
+  };
+
+  bool operator==(const CodeCacheKey& l, const CodeCacheKey& r)
+  {
+    return l.m_Rip == r.m_Rip && l.m_FilterGeneration == r.m_FilterGeneration;
+  }
+
+  uint32_t HashTypeOverload(const CacheSim::CodeCacheKey& key)
+  {
+    return uint32_t(key.m_Rip ^ (key.m_Rip >> 32)) ^ (key.m_FilterGeneration * 0x9e3779b9u);
+  }
+
+  struct CodeCacheBlock
+  {
+    CodeCacheBlock() : m_Code(nullptr), m_Escape(false) {}
+    uint8_t*  m_Code;
+    bool      m_Escape;     ///< The first instruction can't be translated, the block just single-steps it natively
+  };
+
+  struct ChainedStub
+  {
+    uint64_t* m_Stub;
+    uint64_t  m_Original;
+  };
+
+  struct IndirectEntry
+  {
+    uintptr_t m_Target;
+    uintptr_t m_Code;
+  };
+
+  struct ShadowFrame
+  {
+    uintptr_t m_ReturnAddress;
+    uintptr_t m_Rsp;          ///< Address the return address was pushed to, 0 for frames found by backtrace()
+  };
+
+  /// Per-thread code cache state. Allocated on first use, as it's too big for static TLS.
+  struct CodeCacheThreadData
+  {
+    IndirectEntry m_Table[kIndirectTableSize];    ///< Must come first, the dispatch trampoline reads it directly
+    ShadowFrame   m_Shadow[kMaxShadowFrames];     ///< Return addresses of the calls made by translated code
+    uint32_t      m_ShadowDepth;
+    uint32_t      m_ShadowLost;                   ///< Calls that didn't fit in m_Shadow
+    int32_t       m_ShadowGeneration;
+    uint32_t      m_FilterGeneration;             ///< Filter generation the blocks in m_Table were translated for
+    uint32_t      m_FlushCount;                   ///< Value of s_CodeCacheFlushCount when m_Table was last cleared
+    ud_t          m_Ud;                           ///< Scratch decoder state for the recorder
+  };
+
+  struct CodeCacheThreadState
+  {
+    CodeCacheThreadData*  m_Data;
+    int32_t               m_Busy;       ///< Set while the thread is inside the recorder or dispatcher
+  };
+
+  static thread_local CodeCacheThreadState s_CodeCacheThread __attribute__((tls_model("initial-exec")));
+
+  static int s_CaptureEngine = kCaptureEngineSingleStep;
+  static bool s_CodeCacheInitialized = false;
+
+  /// Protects everything below. Separate from g_Lock, which the recorder takes while translation may be going on.
+  static volatile int32_t s_CodeCacheLock;
+
+  static GenericHashTable<CodeCacheKey, CodeCacheBlock> s_CodeCacheBlocks;
+  static uint32_t s_CodeCacheFlushCount;      ///< Bumped whenever s_CodeCacheBlocks is emptied
+  static unsigned long long s_ModuleAdds;     ///< dl_iterate_phdr() load and unload counts the blocks are valid for
+  static unsigned long long s_ModuleSubs;
+  static CodeChunk s_CodeChunks[kMaxCodeChunks];
+  static int s_CodeChunkCount = 0;
+
+  static struct
+  {
+    uint8_t*  m_Cursor;
+    uint8_t*  m_End;
+  } s_InsnArena;
+
+  static struct
+  {
+    ChainedStub*  m_Stubs;
+    uint32_t      m_Count;
+    uint32_t      m_ReserveCount;
+  } s_ChainedStubs;
+
+  /// The executable segment of this library. It's translated without instrumentation so the API functions can
+  /// take locks the recorder also needs.
+  static uintptr_t s_SelfCodeStart;
+  static uintptr_t s_SelfCodeEnd;
+}
+
+extern "C"
+{
+  // Shared with the trampolines below.
+  int32_t   g_CodeCacheActive;          ///< Cleared to send threads back to native code at their next block exit
+  intptr_t  g_CodeCacheThreadOffset;    ///< FS relative offset of s_CodeCacheThread.m_Data
+  uintptr_t g_CodeCacheXsaveSize;       ///< Bytes of stack needed for an XSAVE image of the enabled state
+
+  extern const uint8_t CacheSimCodeCacheAsmBegin[];
+  extern const uint8_t CacheSimCodeCacheAsmEnd[];
+  void CacheSimCodeCacheRecordEntry();
+  void CacheSimCodeCacheDirectEntry();
+  void CacheSimCodeCacheIndirectEntry();
+  void CacheSimCodeCacheStepEntry();
+}
+
+// Trampolines between translated code and the recorder/dispatcher. They save everything the C++ code could clobber,
+// including the full vector state, and step over the red zone so leaf functions don't lose their locals.
+//
+// CacheSimCodeCacheRecordEntry - called before every translated instruction with the CodeCacheInsn in RAX. The
+//   application's RAX is at 8(%rsp) and its stack pointer at 144(%rsp).
+// CacheSimCodeCacheDirectEntry - called from direct exit stubs. 0(%rsp) points at the branch target stored in the
+//   stub and the application's stack pointer is at 136(%rsp).
+// CacheSimCodeCacheIndirectEntry - jumped to with the branch target at 0(%rsp), application stack as above.
+// CacheSimCodeCacheStepEntry - called like the direct entry. Continues natively at the target with the trap flag set.
+//
+// The dispatch entries overwrite the slot at 0(%rsp) with the translated target and `ret $128` to it.
+//
+// XSAVE leaves the header bits of components outside the requested mask alone, so the whole header is cleared
+// first; XRSTOR faults on stale bits.
+asm(R"(
+  .text
+  .p2align 4
+  .globl CacheSimCodeCacheAsmBegin
+  .hidden CacheSimCodeCacheAsmBegin
+CacheSimCodeCacheAsmBegin:
+
+  .globl CacheSimCodeCacheRecordEntry
+  .hidden CacheSimCodeCacheRecordEntry
+  .type CacheSimCodeCacheRecordEntry, @function
+CacheSimCodeCacheRecordEntry:
+  pushfq
+  push %r15
+  push %r14
+  push %r13
+  push %r12
+  push %r11
+  push %r10
+  push %r9
+  push %r8
+  push %rdi
+  push %rsi
+  push %rbp
+  push %rsp
+  push %rbx
+  push %rdx
+  push %rcx
+  pushq 136(%rsp)
+  mov %rax, %rdi
+  mov %rsp, %rsi
+  mov %rsp, %rbx
+  sub g_CodeCacheXsaveSize(%rip), %rsp
+  and $-64, %rsp
+  movq $0, 512(%rsp)
+  movq $0, 520(%rsp)
+  movq $0, 528(%rsp)
+  movq $0, 536(%rsp)
+  movq $0, 544(%rsp)
+  movq $0, 552(%rsp)
+  movq $0, 560(%rsp)
+  movq $0, 568(%rsp)
+  mov $0xe7, %eax
+  xor %edx, %edx
+  xsave64 (%rsp)
+  mov %rsp, %rdx
+  cld
+  call CacheSimCodeCacheRecord
+  mov $0xe7, %eax
+  xor %edx, %edx
+  xrstor64 (%rsp)
+  mov %rbx, %rsp
+  pop %rax
+  pop %rcx
+  pop %rdx
+  pop %rbx
+  lea 8(%rsp), %rsp
+  pop %rbp
+  pop %rsi
+  pop %rdi
+  pop %r8
+  pop %r9
+  pop %r10
+  pop %r11
+  pop %r12
+  pop %r13
+  pop %r14
+  pop %r15
+  popfq
+  ret
+  .size CacheSimCodeCacheRecordEntry, .-CacheSimCodeCacheRecordEntry
+
+  .p2align 4
+  .globl CacheSimCodeCacheDirectEntry
+  .hidden CacheSimCodeCacheDirectEntry
+  .type CacheSimCodeCacheDirectEntry, @function
+CacheSimCodeCacheDirectEntry:
+  push %rax
+  push %rcx
+  push %rdx
+  push %rsi
+  pushfq
+  mov 40(%rsp), %rcx
+  mov (%rcx), %rax
+  jmp 1f
+  .size CacheSimCodeCacheDirectEntry, .-CacheSimCodeCacheDirectEntry
+
+  .p2align 4
+  .globl CacheSimCodeCacheIndirectEntry
+  .hidden CacheSimCodeCacheIndirectEntry
+  .type CacheSimCodeCacheIndirectEntry, @function
+CacheSimCodeCacheIndirectEntry:
+  push %rax
+  push %rcx
+  push %rdx
+  push %rsi
+  pushfq
+  mov 40(%rsp), %rax
+  xor %ecx, %ecx
+1:
+  # rax = branch target, rcx = stub literal to chain or zero
+  cmpl $0, g_CodeCacheActive(%rip)
+  je 2f
+  mov g_CodeCacheThreadOffset(%rip), %rdx
+  mov %fs:(%rdx), %rdx
+  test %rdx, %rdx
+  jz 2f
+  mov %rax, %rsi
+  shr $12, %rsi
+  xor %rax, %rsi
+  and $4095, %esi
+  shl $4, %rsi
+  add %rdx, %rsi
+  cmp (%rsi), %rax
+  jne 2f
+  mov 8(%rsi), %rax
+  mov %rax, 40(%rsp)
+  popfq
+  pop %rsi
+  pop %rdx
+  pop %rcx
+  pop %rax
+  ret $128
+2:
+  push %rdi
+  push %r8
+  push %r9
+  push %r10
+  push %r11
+  push %rbx
+  mov %rsp, %rbx
+  mov %rax, %rdi
+  mov %rcx, %rsi
+  sub g_CodeCacheXsaveSize(%rip), %rsp
+  and $-64, %rsp
+  movq $0, 512(%rsp)
+  movq $0, 520(%rsp)
+  movq $0, 528(%rsp)
+  movq $0, 536(%rsp)
+  movq $0, 544(%rsp)
+  movq $0, 552(%rsp)
+  movq $0, 560(%rsp)
+  movq $0, 568(%rsp)
+  mov $0xe7, %eax
+  xor %edx, %edx
+  xsave64 (%rsp)
+  cld
+  call CacheSimCodeCacheLookup
+  mov %rax, 88(%rbx)
+  mov $0xe7, %eax
+  xor %edx, %edx
+  xrstor64 (%rsp)
+  mov %rbx, %rsp
+  pop %rbx
+  pop %r11
+  pop %r10
+  pop %r9
+  pop %r8
+  pop %rdi
+  popfq
+  pop %rsi
+  pop %rdx
+  pop %rcx
+  pop %rax
+  ret $128
+  .size CacheSimCodeCacheIndirectEntry, .-CacheSimCodeCacheIndirectEntry
+
+  .p2align 4
+  .globl CacheSimCodeCacheStepEntry
+  .hidden CacheSimCodeCacheStepEntry
+  .type CacheSimCodeCacheStepEntry, @function
+CacheSimCodeCacheStepEntry:
+  push %rax
+  mov 8(%rsp), %rax
+  mov (%rax), %rax
+  mov %rax, 8(%rsp)
+  pop %rax
+  pushfq
+  orq $0x100, (%rsp)
+  popfq
+  ret $128
+  .size CacheSimCodeCacheStepEntry, .-CacheSimCodeCacheStepEntry
+
+  .globl CacheSimCodeCacheAsmEnd
+  .hidden CacheSimCodeCacheAsmEnd
+CacheSimCodeCacheAsmEnd:
+)");
+
+namespace CacheSim
+{
+  class CodeEmitter
+  {
+  public:
+    CodeEmitter(uint8_t* start, size_t size) : m_Cursor(start), m_End(start + size) {}
+
+    uint8_t* Cursor() const { return m_Cursor; }
+    size_t Remaining() const { return m_End - m_Cursor; }
+    void Rewind(uint8_t* pos) { m_Cursor = pos; }
+
+    void Byte(uint8_t value)
+    {
+      if (m_Cursor == m_End)
+        DebugBreak();
+      *m_Cursor++ = value;
+    }
+
+    void Bytes(const void* data, size_t size)
+    {
+      if (size > Remaining())
+        DebugBreak();
+      memcpy(m_Cursor, data, size);
+      m_Cursor += size;
+    }
+
+    void Dword(uint32_t value) { Bytes(&value, sizeof value); }
+    void Qword(uint64_t value) { Bytes(&value, sizeof value); }
+
+    // Emits a 32-bit displacement to `target` relative to the end of the field.
+    bool Rel32(const void* target)
+    {
+      int64_t delta = intptr_t(target) - intptr_t(m_Cursor + 4);
+      if (delta != int32_t(delta))
+        return false;
+      Dword(uint32_t(int32_t(delta)));
+      return true;
+    }
+
+    void Align(size_t alignment)
+    {
+      while (uintptr_t(m_Cursor) & (alignment - 1))
+        Byte(0x90);
+    }
+
+  private:
+    uint8_t* m_Cursor;
+    uint8_t* m_End;
+  };
+}
+
+static bool PatchRel32(uint8_t* field, const uint8_t* target)
+{
+  int64_t delta = intptr_t(target) - intptr_t(field + 4);
+  if (delta != int32_t(delta))
+    return false;
+  int32_t value = int32_t(delta);
+  memcpy(field, &value, sizeof value);
+  return true;
+}
+
+static bool IsCodeCacheAddress(uintptr_t address)
+{
+  using namespace CacheSim;
+
+  for (int i = 0, count = s_CodeChunkCount; i < count; ++i)
+  {
+    if (address >= uintptr_t(s_CodeChunks[i].m_Base) && address < uintptr_t(s_CodeChunks[i].m_Base) + kCodeChunkSize)
+      return true;
+  }
+
+  return uintptr_t(CacheSimCodeCacheAsmBegin) <= address && address < uintptr_t(CacheSimCodeCacheAsmEnd);
+}
+
+// RIP-relative operands only reach +-2GB, so chunks have to be allocated close to the code they hold.
+static bool IsChunkNear(uintptr_t chunk, uintptr_t code)
+{
+  const uintptr_t kReach = 1024u * 1024 * 1024;
+  return chunk < code ? code - chunk < kReach : chunk + CacheSim::kCodeChunkSize - code < kReach;
+}
+
+static CacheSim::CodeChunk* FindCodeChunk(uintptr_t code)
+{
+  using namespace CacheSim;
+
+  for (int i = 0; i < s_CodeChunkCount; ++i)
+  {
+    CodeChunk* chunk = &s_CodeChunks[i];
+    if (IsChunkNear(uintptr_t(chunk->m_Base), code) && chunk->m_Used + kMaxBlockBytes <= kCodeChunkSize)
+      return chunk;
+  }
+
+  if (s_CodeChunkCount == kMaxCodeChunks)
+    DebugBreak(); // Increase kMaxCodeChunks
+
+  // Walk outwards from the code looking for free address space. mmap() takes the hint if the range is free.
+  const uintptr_t start = code & ~uintptr_t(kCodeChunkSize - 1);
+  for (uintptr_t step = 1; step < 64; ++step)
+  {
+    for (int dir = -1; dir <= 1; dir += 2)
+    {
+      uintptr_t hint = start + dir * step * kCodeChunkSize;
+      void* mem = mmap((void*)hint, kCodeChunkSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (MAP_FAILED == mem)
+        continue;
+
+      if (!IsChunkNear(uintptr_t(mem), code))
+      {
+        munmap(mem, kCodeChunkSize);
+        continue;
+      }
+
+      uint64_t* literals = (uint64_t*)mem;
+      literals[kLiteralRecord] = uintptr_t(&CacheSimCodeCacheRecordEntry);
+      literals[kLiteralDirect] = uintptr_t(&CacheSimCodeCacheDirectEntry);
+      literals[kLiteralIndirect] = uintptr_t(&CacheSimCodeCacheIndirectEntry);
+      literals[kLiteralStep] = uintptr_t(&CacheSimCodeCacheStepEntry);
+
+      CodeChunk* chunk = &s_CodeChunks[s_CodeChunkCount];
+      chunk->m_Base = (uint8_t*)mem;
+      chunk->m_Used = 64;
+      // Publish after the chunk is set up, IsCodeCacheAddress() reads the count without the lock.
+      __sync_synchronize();
+      ++s_CodeChunkCount;
+      return chunk;
+    }
+  }
+
+  return nullptr;
+}
+
+static CacheSim::CodeCacheInsn* AllocInsn(const ud_t& ud, uintptr_t rip, int ilen, bool record)
+{
+  using namespace CacheSim;
+
+  if (size_t(s_InsnArena.m_End - s_InsnArena.m_Cursor) < sizeof(CodeCacheInsn))
+  {
+    s_InsnArena.m_Cursor = (uint8_t*)VirtualMemoryAlloc(kInsnArenaSize);
+    s_InsnArena.m_End = s_InsnArena.m_Cursor + kInsnArenaSize;
+  }
+
+  CodeCacheInsn* insn = (CodeCacheInsn*)s_InsnArena.m_Cursor;
+  s_InsnArena.m_Cursor += sizeof(CodeCacheInsn);
+
+  insn->m_Rip = rip;
+  insn->m_Length = ilen;
+  insn->m_Mnemonic = ud.mnemonic;
+  insn->m_PfxSeg = ud.pfx_seg;
+  insn->m_Record = record;
+  memcpy(insn->m_Operands, ud.operand, sizeof insn->m_Operands);
+  return insn;
+}
+
+// Skips legacy prefixes and REX to find the opcode byte.
+static int OpcodeOffset(const uint8_t* bytes, int ilen)
+{
+  int i = 0;
+  for (; i < ilen; ++i)
+  {
+    switch (bytes[i])
+    {
+    case 0x26: case 0x2e: case 0x36: case 0x3e: case 0x64: case 0x65:
+    case 0x66: case 0x67: case 0xf0: case 0xf2: case 0xf3:
+      continue;
+    }
+    break;
+  }
+
+  if (i < ilen && 0x40 == (bytes[i] & 0xf0))
+    ++i;
+
+  return i;
+}
+
+// udis86 predates CET. ENDBR64/ENDBR32 are hint NOPs that start every function in CET enabled binaries.
+static bool IsEndbr(const uint8_t* bytes)
+{
+  return 0xf3 == bytes[0] && 0x0f == bytes[1] && 0x1e == bytes[2] && (0xfa == bytes[3] || 0xfb == bytes[3]);
+}
+
+static int RipRelativeDispOffset(const ud_t& ud)
+{
+  for (int op = 0; op < int(ARRAY_SIZE(ud.operand)) && ud.operand[op].type != UD_NONE; ++op)
+  {
+    if (UD_OP_MEM == ud.operand[op].type && UD_R_RIP == ud.operand[op].base)
+      return ud.modrm_offset + 1;   // mod=00 rm=101: the displacement follows the ModRM byte
+  }
+  return -1;
+}
+
+static bool IsConditionalBranch(enum ud_mnemonic_code mnemonic)
+{
+  switch (mnemonic)
+  {
+  case UD_Ijo:  case UD_Ijno: case UD_Ijb:  case UD_Ijae:
+  case UD_Ije:  case UD_Ijne: case UD_Ijbe: case UD_Ija:
+  case UD_Ijs:  case UD_Ijns: case UD_Ijp:  case UD_Ijnp:
+  case UD_Ijl:  case UD_Ijge: case UD_Ijle: case UD_Ijg:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Branches that only come with an 8-bit displacement.
+static bool IsCounterBranch(enum ud_mnemonic_code mnemonic)
+{
+  switch (mnemonic)
+  {
+  case UD_Ijcxz: case UD_Ijecxz: case UD_Ijrcxz:
+  case UD_Iloop: case UD_Iloope: case UD_Iloopne:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Instructions the translator leaves to the single step engine.
+static bool NeedsNativeStep(const ud_t& ud)
+{
+  switch (ud.mnemonic)
+  {
+  case UD_Iinvalid:
+  case UD_Iiretw:
+  case UD_Iiretd:
+  case UD_Iiretq:
+  case UD_Iretf:
+  case UD_Isysret:
+  case UD_Isysexit:
+    return true;
+  case UD_Ijmp:
+  case UD_Icall:
+    return ud.br_far || UD_OP_PTR == ud.operand[0].type;
+  default:
+    return false;
+  }
+}
+
+static uintptr_t BranchTarget(const ud_t& ud)
+{
+  const ud_operand_t& op = ud.operand[0];
+  switch (op.size)
+  {
+  case 8:  return uintptr_t(ud.pc + op.lval.sbyte);
+  case 16: return uintptr_t(ud.pc + op.lval.sword);
+  default: return uintptr_t(ud.pc + op.lval.sdword);
+  }
+}
+
+static void EmitChunkCall(CacheSim::CodeEmitter& e, const CacheSim::CodeChunk* chunk, int literal, uint8_t modrm)
+{
+  e.Byte(0xff);
+  e.Byte(modrm);
+  if (!e.Rel32(chunk->m_Base + literal * sizeof(uint64_t)))
+    DebugBreak();
+}
+
+// lea disp(%rsp), %rsp - adjusts the stack pointer without touching the flags.
+static void EmitLeaRsp(CacheSim::CodeEmitter& e, int32_t disp)
+{
+  if (disp == int8_t(disp))
+  {
+    const uint8_t code[] = { 0x48, 0x8d, 0x64, 0x24, uint8_t(disp) };
+    e.Bytes(code, sizeof code);
+  }
+  else
+  {
+    const uint8_t code[] = { 0x48, 0x8d, 0xa4, 0x24 };
+    e.Bytes(code, sizeof code);
+    e.Dword(uint32_t(disp));
+  }
+}
+
+// Stores a 64-bit value to (%rsp) as two dword moves, which needs neither a scratch register nor the flags.
+static void EmitStoreToStack(CacheSim::CodeEmitter& e, uint64_t value)
+{
+  const uint8_t lo[] = { 0xc7, 0x04, 0x24 };
+  const uint8_t hi[] = { 0xc7, 0x44, 0x24, 0x04 };
+  e.Bytes(lo, sizeof lo);
+  e.Dword(uint32_t(value));
+  e.Bytes(hi, sizeof hi);
+  e.Dword(uint32_t(value >> 32));
+}
+
+static void EmitRecord(CacheSim::CodeEmitter& e, const CacheSim::CodeChunk* chunk, const CacheSim::CodeCacheInsn* insn)
+{
+  EmitLeaRsp(e, -128);
+  e.Byte(0x50);                   // push %rax
+  e.Byte(0x48);                   // movabs $insn, %rax
+  e.Byte(0xb8);
+  e.Qword(uintptr_t(insn));
+  EmitChunkCall(e, chunk, CacheSim::kLiteralRecord, 0x15);
+  e.Byte(0x58);                   // pop %rax
+  EmitLeaRsp(e, 128);
+}
+
+// Exit stubs are 8-byte aligned so chaining can patch their start with a single atomic store.
+static uint8_t* EmitExitStub(CacheSim::CodeEmitter& e, const CacheSim::CodeChunk* chunk, int literal, uintptr_t target)
+{
+  e.Align(8);
+  uint8_t* stub = e.Cursor();
+  EmitLeaRsp(e, -128);
+  EmitChunkCall(e, chunk, literal, 0x15);
+  e.Qword(target);
+  return stub;
+}
+
+// Emits the instruction at its new address, fixing up a RIP-relative displacement. Fails if the displacement
+// no longer fits.
+static bool EmitRelocated(CacheSim::CodeEmitter& e, const uint8_t* bytes, int ilen, const ud_t& ud)
+{
+  uint8_t* out = e.Cursor();
+  e.Bytes(bytes, ilen);
+
+  const int disp_offset = RipRelativeDispOffset(ud);
+  if (disp_offset >= 0)
+  {
+    int32_t disp;
+    memcpy(&disp, bytes + disp_offset, sizeof disp);
+    if (!PatchRel32(out + disp_offset, (const uint8_t*)uintptr_t(ud.pc + disp) - (ilen - disp_offset - 4)))
+    {
+      e.Rewind(out);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Re-encodes the operand of an indirect `jmp r/m` or `call r/m` as `push r/m`, leaving the branch target on the
+// stack. `rsp_bias` compensates RSP-based operands for stack space reserved before the push.
+static bool EmitPushBranchOperand(CacheSim::CodeEmitter& e, const uint8_t* bytes, int ilen, const ud_t& ud, int32_t rsp_bias)
+{
+  const int modrm_offset = ud.modrm_offset;
+  if (!ud.have_modrm || modrm_offset < 1 || 0xff != bytes[modrm_offset - 1])
+    return false;
+
+  uint8_t* out = e.Cursor();
+
+  // Branch hint, NOTRACK and BND prefixes mean something else on a push.
+  for (int i = 0; i < modrm_offset - 1; ++i)
+  {
+    if (0xf2 != bytes[i] && 0x2e != bytes[i] && 0x3e != bytes[i])
+      e.Byte(bytes[i]);
+  }
+  e.Byte(0xff);
+
+  const ud_operand_t& op = ud.operand[0];
+  const uint8_t modrm = bytes[modrm_offset];
+
+  if (rsp_bias && UD_OP_MEM == op.type && UD_R_RSP == op.base)
+  {
+    // RSP as a base always needs a SIB byte. Re-encode with a 32-bit displacement.
+    int32_t disp = 0;
+    if (1 == (modrm >> 6))
+      disp = int8_t(bytes[modrm_offset + 2]);
+    else if (2 == (modrm >> 6))
+      memcpy(&disp, bytes + modrm_offset + 2, sizeof disp);
+
+    e.Byte(0x80 | (6 << 3) | 4);
+    e.Byte(bytes[modrm_offset + 1]);
+    e.Dword(uint32_t(disp + rsp_bias));
+    return true;
+  }
+
+  e.Byte((modrm & 0xc7) | (6 << 3));
+  uint8_t* tail = e.Cursor();
+  e.Bytes(bytes + modrm_offset + 1, ilen - modrm_offset - 1);
+
+  if (UD_OP_MEM == op.type && UD_R_RIP == op.base)
+  {
+    int32_t disp;
+    memcpy(&disp, tail, sizeof disp);
+    if (!PatchRel32(tail, (const uint8_t*)uintptr_t(ud.pc + disp)))
+    {
+      e.Rewind(out);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Translates the basic block starting at `rip`. Must be called with s_CodeCacheLock held.
+static bool TranslateBlock(uintptr_t rip, CacheSim::CodeCacheBlock* block)
+{
+  using namespace CacheSim;
+
+  CodeChunk* chunk = FindCodeChunk(rip);
+  if (!chunk)
+    return false;
+
+  CodeEmitter e(chunk->m_Base + chunk->m_Used, kMaxBlockBytes);
+  block->m_Code = e.Cursor();
+  block->m_Escape = false;
+
+  const bool instrument = rip < s_SelfCodeStart || rip >= s_SelfCodeEnd;
+
+  ud_t ud;
+  ud_init(&ud);
+  ud_set_mode(&ud, 64);
+
+  uintptr_t pc = rip;
+  for (int count = 0; ; ++count)
+  {
+    if (kMaxBlockInstructions == count || e.Remaining() < kBlockTailBytes)
+    {
+      EmitExitStub(e, chunk, kLiteralDirect, pc);
+      break;
+    }
+
+    const uint8_t* bytes = (const uint8_t*)pc;
+    int ilen;
+
+    if (IsEndbr(bytes))
+    {
+      ilen = 4;
+      ud.mnemonic = UD_Inop;
+      ud.pfx_seg = 0;
+      ud.operand[0].type = UD_NONE;
+    }
+    else
+    {
+      ud_set_input_buffer(&ud, bytes, 16);
+      ud_set_pc(&ud, pc);
+      ilen = ud_disassemble(&ud);
+
+      if (0 == ilen || ud.error || NeedsNativeStep(ud))
+      {
+        block->m_Escape = 0 == count;
+        EmitExitStub(e, chunk, kLiteralStep, pc);
+        break;
+      }
+    }
+
+    uint8_t* insn_start = e.Cursor();
+    const uintptr_t next_pc = pc + ilen;
+    const int opcode_offset = OpcodeOffset(bytes, ilen);
+    const uint8_t opcode = bytes[opcode_offset];
+    const bool rep_string = (ud.pfx_rep || ud.pfx_repe || ud.pfx_repne) &&
+                            ((opcode >= 0xa4 && opcode <= 0xa7) || (opcode >= 0xaa && opcode <= 0xaf));
+
+    // Skipped code is copied without recording calls, so it runs at native speed.
+    const int action = instrument ? GetFilterAction(pc) : kFilterSkip;
+    CodeCacheInsn* insn = kFilterSkip != action ? AllocInsn(ud, pc, ilen, kFilterTrace == action) : nullptr;
+
+    if (rep_string && insn)
+    {
+      // Every iteration of a REP string instruction is a separate step for the trap flag, so loop over the
+      // instruction without its prefix and record each iteration.
+      //    top:  jrcxz done
+      //          <record>
+      //          <insn>
+      //          lea -1(%rcx), %rcx
+      //          jnz/jz done         (REPE/REPNE CMPS and SCAS only)
+      //          jmp top
+      //    done:
+      uint8_t* top = e.Cursor();
+      e.Byte(0xe3);
+      e.Byte(0);
+      uint8_t* exit_field = e.Cursor() - 1;
+
+      EmitRecord(e, chunk, insn);
+      for (int i = 0; i < ilen; ++i)
+      {
+        if (0xf2 != bytes[i] && 0xf3 != bytes[i])
+          e.Byte(bytes[i]);
+      }
+
+      const uint8_t dec_rcx[] = { 0x48, 0x8d, 0x49, 0xff };
+      e.Bytes(dec_rcx, sizeof dec_rcx);
+
+      uint8_t* cond_field = nullptr;
+      const bool compares = (opcode >= 0xa6 && opcode <= 0xa7) || (opcode >= 0xae && opcode <= 0xaf);
+      if (compares)
+      {
+        e.Byte(ud.pfx_repne ? 0x74 : 0x75);
+        e.Byte(0);
+        cond_field = e.Cursor() - 1;
+      }
+
+      e.Byte(0xeb);
+      e.Byte(uint8_t(top - (e.Cursor() + 1)));
+
+      *exit_field = uint8_t(e.Cursor() - (exit_field + 1));
+      if (cond_field)
+        *cond_field = uint8_t(e.Cursor() - (cond_field + 1));
+
+      pc = next_pc;
+      continue;
+    }
+
+    if (insn)
+    {
+      EmitRecord(e, chunk, insn);
+    }
+
+    if (IsConditionalBranch(ud.mnemonic))
+    {
+      const uint8_t cc = (0x0f == opcode ? bytes[opcode_offset + 1] : opcode) & 0x0f;
+      e.Byte(0x0f);
+      e.Byte(0x80 | cc);
+      e.Dword(0);
+      uint8_t* taken_field = e.Cursor() - 4;
+
+      EmitExitStub(e, chunk, kLiteralDirect, next_pc);
+      PatchRel32(taken_field, EmitExitStub(e, chunk, kLiteralDirect, BranchTarget(ud)));
+      break;
+    }
+
+    if (IsCounterBranch(ud.mnemonic))
+    {
+      //    <op> taken
+      //    jmp fallthrough_stub
+      // taken:
+      //    jmp taken_stub
+      e.Bytes(bytes, ilen - 1);
+      e.Byte(5);
+      e.Byte(0xe9);
+      e.Dword(0);
+      uint8_t* fall_field = e.Cursor() - 4;
+      e.Byte(0xe9);
+      e.Dword(0);
+      uint8_t* taken_field = e.Cursor() - 4;
+
+      PatchRel32(fall_field, EmitExitStub(e, chunk, kLiteralDirect, next_pc));
+      PatchRel32(taken_field, EmitExitStub(e, chunk, kLiteralDirect, BranchTarget(ud)));
+      break;
+    }
+
+    if (UD_Ijmp == ud.mnemonic && UD_OP_JIMM == ud.operand[0].type)
+    {
+      EmitExitStub(e, chunk, kLiteralDirect, BranchTarget(ud));
+      break;
+    }
+
+    if (UD_Icall == ud.mnemonic && UD_OP_JIMM == ud.operand[0].type)
+    {
+      // Push the original return address, then leave for the callee.
+      EmitLeaRsp(e, -8);
+      EmitStoreToStack(e, next_pc);
+      EmitExitStub(e, chunk, kLiteralDirect, BranchTarget(ud));
+      break;
+    }
+
+    if (UD_Ijmp == ud.mnemonic)
+    {
+      //    lea -136(%rsp), %rsp
+      //    push <operand>
+      //    pop (%rsp)
+      //    jmp *indirect
+      EmitLeaRsp(e, -136);
+      if (EmitPushBranchOperand(e, bytes, ilen, ud, 136))
+      {
+        const uint8_t pop_slot[] = { 0x8f, 0x04, 0x24 };
+        e.Bytes(pop_slot, sizeof pop_slot);
+        EmitChunkCall(e, chunk, kLiteralIndirect, 0x25);
+        break;
+      }
+    }
+    else if (UD_Icall == ud.mnemonic)
+    {
+      // Like the jmp, the target is only ever stored at or above RSP, where a signal frame can't overwrite it.
+      //    lea -8(%rsp), %rsp
+      //    <store return address to (%rsp)>
+      //    lea -136(%rsp), %rsp
+      //    push <operand>
+      //    pop (%rsp)
+      //    jmp *indirect
+      EmitLeaRsp(e, -8);
+      EmitStoreToStack(e, next_pc);
+      EmitLeaRsp(e, -136);
+      if (EmitPushBranchOperand(e, bytes, ilen, ud, 144))
+      {
+        const uint8_t pop_slot[] = { 0x8f, 0x04, 0x24 };
+        e.Bytes(pop_slot, sizeof pop_slot);
+        EmitChunkCall(e, chunk, kLiteralIndirect, 0x25);
+        break;
+      }
+    }
+    else if (UD_Iret == ud.mnemonic)
+    {
+      // Move the return address below the red zone of the stack as it will be after the return.
+      //    push (%rsp)
+      //    pop imm-128(%rsp)
+      //    lea imm-128(%rsp), %rsp
+      //    jmp *indirect
+      const int32_t disp = (UD_OP_IMM == ud.operand[0].type ? ud.operand[0].lval.uword : 0) - 128;
+      const uint8_t push_ret[] = { 0xff, 0x34, 0x24 };
+      e.Bytes(push_ret, sizeof push_ret);
+      if (disp == int8_t(disp))
+      {
+        const uint8_t pop_slot[] = { 0x8f, 0x44, 0x24, uint8_t(disp) };
+        e.Bytes(pop_slot, sizeof pop_slot);
+      }
+      else
+      {
+        const uint8_t pop_slot[] = { 0x8f, 0x84, 0x24 };
+        e.Bytes(pop_slot, sizeof pop_slot);
+        e.Dword(uint32_t(disp));
+      }
+      EmitLeaRsp(e, disp);
+      EmitChunkCall(e, chunk, kLiteralIndirect, 0x25);
+      break;
+    }
+    else if (EmitRelocated(e, bytes, ilen, ud))
+    {
+      pc = next_pc;
+      continue;
+    }
+
+    // Couldn't re-encode this one. Undo the recording call too, the step handler records it instead.
+    e.Rewind(insn_start);
+    block->m_Escape = 0 == count;
+    EmitExitStub(e, chunk, kLiteralStep, pc);
+    break;
+  }
+
+  chunk->m_Used = (e.Cursor() - chunk->m_Base + 15) & ~size_t(15);
+  return true;
+}
+
+static CacheSim::CodeCacheBlock* LookupBlock(uintptr_t rip)
+{
+  using namespace CacheSim;
+
+  CodeCacheKey key(rip, s_FilterGeneration);
+  if (CodeCacheBlock* existing = s_CodeCacheBlocks.Find(key))
+    return existing;
+
+  CodeCacheBlock block;
+  if (!TranslateBlock(rip, &block))
+  {
+    DebugBreak(); // Out of address space near the code
+    return nullptr;
+  }
+
+  CodeCacheBlock* result = s_CodeCacheBlocks.Insert(key);
+  *result = block;
+  return result;
+}
+
+// Points a direct exit stub straight at its target block. `literal` is the target address stored in the stub.
+static void ChainStub(uint64_t* literal, const CacheSim::CodeCacheBlock* block)
+{
+  using namespace CacheSim;
+
+  uint8_t* stub = (uint8_t*)literal - 11;   // lea -128(%rsp), %rsp; call *direct(%rip)
+  if (uintptr_t(stub) & 7 || 0xe9 == stub[0])
+    return;
+
+  uint64_t original;
+  memcpy(&original, stub, sizeof original);
+
+  uint8_t patched[8];
+  memcpy(patched, stub, sizeof patched);
+  patched[0] = 0xe9;
+  if (!PatchRel32(patched + 1, block->m_Code - (stub - patched)))
+    return;
+
+  if (s_ChainedStubs.m_Count == s_ChainedStubs.m_ReserveCount)
+  {
+    uint32_t new_reserve = s_ChainedStubs.m_ReserveCount ? 2 * s_ChainedStubs.m_ReserveCount : 4096;
+    if (s_ChainedStubs.m_Stubs)
+    {
+      s_ChainedStubs.m_Stubs = (ChainedStub*)VirtualMemoryRealloc(s_ChainedStubs.m_Stubs,
+                                                                 s_ChainedStubs.m_ReserveCount * sizeof(ChainedStub),
+                                                                 new_reserve * sizeof(ChainedStub));
+    }
+    else
+    {
+      s_ChainedStubs.m_Stubs = (ChainedStub*)VirtualMemoryAlloc(new_reserve * sizeof(ChainedStub));
+    }
+    s_ChainedStubs.m_ReserveCount = new_reserve;
+  }
+
+  ChainedStub& entry = s_ChainedStubs.m_Stubs[s_ChainedStubs.m_Count++];
+  entry.m_Stub = (uint64_t*)stub;
+  entry.m_Original = original;
+
+  uint64_t value;
+  memcpy(&value, patched, sizeof value);
+  __atomic_store_n((uint64_t*)stub, value, __ATOMIC_RELEASE);
+}
+
+static CacheSim::CodeCacheThreadData* GetCodeCacheThreadData()
+{
+  using namespace CacheSim;
+
+  CodeCacheThreadData* data = s_CodeCacheThread.m_Data;
+  if (!data)
+  {
+    data = s_CodeCacheThread.m_Data = (CodeCacheThreadData*)VirtualMemoryAlloc(sizeof(CodeCacheThreadData));
+    data->m_FilterGeneration = s_FilterGeneration;
+    data->m_FlushCount = s_CodeCacheFlushCount;
+  }
+  else if (data->m_FilterGeneration != s_FilterGeneration || data->m_FlushCount != s_CodeCacheFlushCount)
+  {
+    // The filters changed or the blocks were flushed since the thread last ran translated code, forget the blocks
+    // it found.
+    memset(data->m_Table, 0, sizeof data->m_Table);
+    data->m_FilterGeneration = s_FilterGeneration;
+    data->m_FlushCount = s_CodeCacheFlushCount;
+  }
+
+  return data;
+}
+
+static uint32_t ShadowBacktrace(const CacheSim::CodeCacheThreadData* data, uintptr_t rip, uintptr_t frames[])
+{
+  using namespace CacheSim;
+
+  uint32_t count = 0;
+  frames[count++] = rip;
+  for (uint32_t i = data->m_ShadowDepth; i > 0 && count < kMaxCalls; --i)
+  {
+    frames[count++] = data->m_Shadow[i - 1].m_ReturnAddress;
+  }
+  return count;
+}
+
+// Drops frames below the stack pointer. They were returned from in code that isn't recorded, or abandoned by
+// longjmp or exceptions. Returns true if any were dropped.
+static bool PruneShadowStack(CacheSim::CodeCacheThreadData* data, uintptr_t rsp)
+{
+  const uint32_t depth = data->m_ShadowDepth;
+  while (data->m_ShadowDepth && data->m_Shadow[data->m_ShadowDepth - 1].m_Rsp && data->m_Shadow[data->m_ShadowDepth - 1].m_Rsp < rsp)
+    --data->m_ShadowDepth;
+  return depth != data->m_ShadowDepth;
+}
+
+static void UpdateShadowStack(CacheSim::CodeCacheThreadData* data, const CacheSim::CodeCacheInsn* insn, uintptr_t rsp)
+{
+  using namespace CacheSim;
+
+  if (UD_Icall == insn->m_Mnemonic)
+  {
+    if (data->m_ShadowDepth == kMaxShadowFrames)
+    {
+      ++data->m_ShadowLost;
+      return;
+    }
+
+    ShadowFrame& frame = data->m_Shadow[data->m_ShadowDepth++];
+    frame.m_ReturnAddress = insn->m_Rip + insn->m_Length;
+    frame.m_Rsp = rsp - 8;
+  }
+  else if (UD_Iret == insn->m_Mnemonic)
+  {
+    if (data->m_ShadowLost)
+    {
+      --data->m_ShadowLost;
+      return;
+    }
+
+    PruneShadowStack(data, rsp);
+
+    // Don't pop a frame for a call that wasn't seen, such as a callback from skipped code.
+    if (data->m_ShadowDepth && data->m_Shadow[data->m_ShadowDepth - 1].m_Rsp <= rsp)
+      --data->m_ShadowDepth;
+  }
+}
+
+namespace CacheSim
+{
+  /// Shadow stack of a suspended fiber, by slot of s_SuspendedFibers. The frames are kept for reuse.
+  struct FiberShadowStack
+  {
+    ShadowFrame*  m_Frames;
+    uint32_t      m_Depth;
+    uint32_t      m_Lost;
+    uint32_t      m_ReserveCount;
+  };
+
+  static FiberShadowStack s_FiberShadowStacks[kMaxSuspendedFibers];
+}
+
+static void SaveFiberShadowStack(uint32_t slot)
+{
+  using namespace CacheSim;
+
+  CodeCacheThreadData* data = s_CodeCacheThread.m_Data;
+  if (!g_CodeCacheActive || !data)
+    return;
+
+  FiberShadowStack& fiber = s_FiberShadowStacks[slot];
+  GrowArray(&fiber.m_Frames, 0, &fiber.m_ReserveCount, data->m_ShadowDepth, 64);
+  if (data->m_ShadowDepth)
+    memcpy(fiber.m_Frames, data->m_Shadow, data->m_ShadowDepth * sizeof data->m_Shadow[0]);
+  fiber.m_Depth = data->m_ShadowDepth;
+  fiber.m_Lost = data->m_ShadowLost;
+}
+
+static void RestoreFiberShadowStack(int slot)
+{
+  using namespace CacheSim;
+
+  CodeCacheThreadData* data = s_CodeCacheThread.m_Data;
+  if (!g_CodeCacheActive || !data)
+    return;
+
+  if (slot < 0)
+  {
+    data->m_ShadowDepth = 0;
+    data->m_ShadowLost = 0;
+    return;
+  }
+
+  const FiberShadowStack& fiber = s_FiberShadowStacks[slot];
+  if (fiber.m_Depth)
+    memcpy(data->m_Shadow, fiber.m_Frames, fiber.m_Depth * sizeof data->m_Shadow[0]);
+  data->m_ShadowDepth = fiber.m_Depth;
+  data->m_ShadowLost = fiber.m_Lost;
+}
+
+// Called by the record trampoline before each translated instruction executes.
+extern "C" void CacheSimCodeCacheRecord(const CacheSim::CodeCacheInsn* insn, const int64_t* regs, uint8_t* xsave_area)
+{
+  using namespace CacheSim;
+
+  if (!g_TraceEnabled)
+    return;
+
+  s_CodeCacheThread.m_Busy = 1;
+
+  RefreshThreadState();
+
+  const int core_index = UpdateScheduledCore();
+  CodeCacheThreadData* data = GetCodeCacheThreadData();
+
+  if (core_index >= 0)
+  {
+    // The trampoline pushed the registers in CONTEXT order.
+    CONTEXT context;
+    memcpy(&context, regs, 16 * sizeof regs[0]);
+    context.Rsp += kRecordRspAdjust;
+    context.Rip = insn->m_Rip;
+
+    // ReadVectorReg() expects the extended state tagged the way the kernel does it in signal frames.
+    _fpx_sw_bytes* sw = (_fpx_sw_bytes*)(xsave_area + 464);
+    sw->magic1 = FP_XSTATE_MAGIC1;
+    context.FltSave = (fpregset_t)xsave_area;
+
+    TrackFiberSwitch(context.Rsp);
+    if (PruneShadowStack(data, context.Rsp))
+      InvalidateStack();
+
+    if (insn->m_Record && ~0u == s_ThreadState.m_StackIndex)
+    {
+      uintptr_t callstack[kMaxCalls];
+      uint32_t frame_count = ShadowBacktrace(data, insn->m_Rip, callstack);
+
+      AutoSpinLock lock;
+      s_ThreadState.m_StackIndex = InsertStack(callstack, frame_count);
+    }
+
+    ud_t* ud = &data->m_Ud;
+    ud->mnemonic = insn->m_Mnemonic;
+    ud->pfx_seg = insn->m_PfxSeg;
+    memcpy(ud->operand, insn->m_Operands, sizeof insn->m_Operands);
+
+    GenerateMemoryAccesses(core_index, ud, insn->m_Rip, insn->m_Length, &context, insn->m_Record);
+    UpdateShadowStack(data, insn, context.Rsp);
+  }
+
+  s_CodeCacheThread.m_Busy = 0;
+}
+
+// Called by the dispatch trampolines when a branch target isn't in the thread's table. Returns the address to
+// continue at, which is the original target once the capture has ended.
+extern "C" uintptr_t CacheSimCodeCacheLookup(uintptr_t target, uint64_t* literal)
+{
+  using namespace CacheSim;
+
+  if (!g_CodeCacheActive)
+    return target;
+
+  s_CodeCacheThread.m_Busy = 1;
+
+  uintptr_t code;
+  {
+    AutoSpinLock lock(&s_CodeCacheLock);
+    CodeCacheBlock* block = LookupBlock(target);
+    code = uintptr_t(block->m_Code);
+
+    if (literal)
+      ChainStub(literal, block);
+  }
+
+  CodeCacheThreadData* data = GetCodeCacheThreadData();
+  IndirectEntry& entry = data->m_Table[(target ^ (target >> 12)) & (kIndirectTableSize - 1)];
+  entry.m_Target = target;
+  entry.m_Code = code;
+
+  s_CodeCacheThread.m_Busy = 0;
+  return code;
+}
+
+// Moves a thread that took a single step trap into the code cache. Returns false if the instruction at the trap
+// address has to be single-stepped instead.
+static bool EnterCodeCache(ucontext_t* uc)
+{
+  using namespace CacheSim;
+
+  greg_t* gregs = uc->uc_mcontext.gregs;
+  const uintptr_t rip = gregs[REG_RIP];
+
+  if (s_CodeCacheThread.m_Busy || IsCodeCacheAddress(rip))
+  {
+    // Still running translated code from an earlier capture. It records from here on.
+    gregs[REG_EFL] &= ~0x100ull;
+    GetCodeCacheThreadData();
+    return true;
+  }
+
+  if (!g_CodeCacheActive)
+    return false;
+
+  uintptr_t code;
+  {
+    AutoSpinLock lock(&s_CodeCacheLock);
+    CodeCacheBlock* block = LookupBlock(rip);
+    if (block->m_Escape)
+      return false;
+    code = uintptr_t(block->m_Code);
+  }
+
+  CodeCacheThreadData* data = GetCodeCacheThreadData();
+  if (data->m_ShadowGeneration != g_Generation)
+  {
+    // Seed the shadow stack with the frames the thread is already in.
+    void* callstack[kMaxCalls];
+    int frame_count = backtrace(callstack, kMaxCalls);
+
+    int first = 1;
+    for (int i = 0; i < frame_count; ++i)
+    {
+      if (uintptr_t(callstack[i]) == rip)
+      {
+        first = i + 1;
+        break;
+      }
+    }
+
+    data->m_ShadowDepth = 0;
+    data->m_ShadowLost = 0;
+    for (int i = frame_count - 1; i >= first; --i)
+    {
+      ShadowFrame& frame = data->m_Shadow[data->m_ShadowDepth++];
+      frame.m_ReturnAddress = uintptr_t(callstack[i]);
+      frame.m_Rsp = 0;
+    }
+    data->m_ShadowGeneration = g_Generation;
+  }
+
+  InvalidateStack();
+  gregs[REG_RIP] = code;
+  gregs[REG_EFL] &= ~0x100ull;
+  return true;
+}
+
+// Sends all threads back to native code at their next block exit.
+static void LeaveCodeCache()
+{
+  using namespace CacheSim;
+
+  if (!g_CodeCacheActive)
+    return;
+
+  g_CodeCacheActive = 0;
+
+  AutoSpinLock lock(&s_CodeCacheLock);
+  for (uint32_t i = 0; i < s_ChainedStubs.m_Count; ++i)
+  {
+    __atomic_store_n(s_ChainedStubs.m_Stubs[i].m_Stub, s_ChainedStubs.m_Stubs[i].m_Original, __ATOMIC_RELEASE);
+  }
+  s_ChainedStubs.m_Count = 0;
+}
+
+static int ReadModuleCounts(struct dl_phdr_info* info, size_t size, void* data)
+{
+  unsigned long long* counts = (unsigned long long*)data;
+  if (size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof info->dlpi_subs)
+  {
+    counts[0] = info->dlpi_adds;
+    counts[1] = info->dlpi_subs;
+  }
+  return 1;
+}
+
+// Throws away the translated blocks if modules were loaded or unloaded since they were translated, as a library
+// loaded where an unloaded one was would otherwise run the old library's code. Called when a capture starts, after
+// LeaveCodeCache() has unchained the blocks of the last one.
+//
+// Threads still running old blocks (blocked in a system call since the last capture, say) leave them at their next
+// block exit, so the chunks they live in are never reused.
+static void FlushCodeCacheIfModulesChanged()
+{
+  using namespace CacheSim;
+
+  if (!s_CodeCacheInitialized)
+    return;
+
+  unsigned long long counts[2] = { 0, 0 };
+  dl_iterate_phdr(ReadModuleCounts, counts);
+
+  AutoSpinLock lock(&s_CodeCacheLock);
+  if (counts[0] == s_ModuleAdds && counts[1] == s_ModuleSubs)
+    return;
+
+  s_ModuleAdds = counts[0];
+  s_ModuleSubs = counts[1];
+
+  if (s_CodeCacheBlocks.GetCount())
+  {
+    s_CodeCacheBlocks.FreeAll();
+    __sync_fetch_and_add(&s_CodeCacheFlushCount, 1);
+  }
+}
+
+static int FindSelfSegment(struct dl_phdr_info* info, size_t size, void* data)
+{
+  (void)size;
+  const uintptr_t self = *(const uintptr_t*)data;
+
+  for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++)
+  {
+    const ElfW(Phdr)& header = info->dlpi_phdr[i];
+    const uintptr_t start = info->dlpi_addr + header.p_vaddr;
+
+    if (PT_LOAD == header.p_type && (header.p_flags & PF_X) && self >= start && self < start + header.p_memsz)
+    {
+      CacheSim::s_SelfCodeStart = start;
+      CacheSim::s_SelfCodeEnd = start + header.p_memsz;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static bool InitCodeCache()
+{
+  using namespace CacheSim;
+
+  if (s_CodeCacheInitialized)
+    return true;
+
+  // The trampolines save the vector state with XSAVE.
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || 0 == (ecx & bit_OSXSAVE))
+    return false;
+
+  __cpuid_count(0xd, 0, eax, ebx, ecx, edx);
+  g_CodeCacheXsaveSize = (ebx + 63) & ~63u;
+
+  uintptr_t thread_pointer;
+  asm volatile("mov %%fs:0, %0" : "=r"(thread_pointer));
+  g_CodeCacheThreadOffset = intptr_t(uintptr_t(&s_CodeCacheThread.m_Data) - thread_pointer);
+
+  uintptr_t self = uintptr_t(&InitCodeCache);
+  dl_iterate_phdr(FindSelfSegment, &self);
+  if (!s_SelfCodeEnd)
+    return false;
+
+  s_CodeCacheBlocks.Init();
+  s_CodeCacheInitialized = true;
+  return true;
+}
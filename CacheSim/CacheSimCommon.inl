@@ -13,6 +13,8 @@
 #include "GenericHashTable.h"
 #include "Md5.h"
 
+#include <math.h>
+
 extern "C"
 {
 #include "udis86/udis86.h"
@@ -66,6 +68,18 @@ namespace CacheSim
     ud_t        m_Disassembler;
     uint32_t    m_StackIndex;                 ///< Index of current stack in callstack data. Recomputed whenever the call stack contents changes.
     int         m_LogicalCoreIndex;           ///< Index of logical core, -1
+    uint32_t    m_CoreRetryCountdown;         ///< Traps until an untraced thread looks for a core again, see ShouldRetryLogicalCore()
+    uintptr_t   m_LastRsp;                    ///< Stack pointer at the last traced instruction, 0 after a generation change
+    AddressRange m_ThreadStack;               ///< Stack the thread was on at its first traced instruction, see IsStackSwitch()
+    AddressRange m_SignalStack;               ///< Its alternate signal stack at that point
+    uint32_t    m_FiberId;                    ///< Fiber the thread is running, see CacheSimFiberSwitch(). 0 if not known
+    uint32_t    m_PendingFiberId;             ///< Fiber the next stack switch goes to, if m_FiberSwitchPending
+    bool        m_FiberSwitchPending;
+    uintptr_t   m_FsBase;                     ///< FS segment base, refreshed on generation change where it can't be read directly
+    uintptr_t   m_GsBase;                     ///< GS segment base, refreshed on generation change where it can't be read directly
+    uint32_t    m_SampleRemaining;            ///< Instructions left in the current sampling window, 0 when not in one
+    uint32_t    m_SampleStats[kAccessResultCount];  ///< Stats recorded so far in the measurement part of the sampling window
+    bool        m_InAllocHook;                ///< Set while the thread updates the allocation index
   };
 
 #if defined(_MSC_VER)
@@ -81,16 +95,36 @@ namespace CacheSim
   static volatile int32_t g_Lock;
   static CacheSim::JaguarCacheSim g_Cache;
 
-  static int s_CoreMappingCount = 0;
-  static struct { uint64_t m_ThreadId; int m_LogicalCore; } s_CoreMappings[128];
+  /// Hash table key for thread IDs.
+  struct ThreadIdKey
+  {
+    ThreadIdKey() : m_ThreadId(0) {}
+    explicit ThreadIdKey(uint64_t thread_id) : m_ThreadId(thread_id) {}
+    uint64_t m_ThreadId;
+  };
+
+  bool operator==(const ThreadIdKey& l, const ThreadIdKey& r)
+  {
+    return l.m_ThreadId == r.m_ThreadId;
+  }
+
+  uint32_t HashTypeOverload(const CacheSim::ThreadIdKey& key)
+  {
+    return uint32_t((key.m_ThreadId ^ (key.m_ThreadId >> 32)) * 0x9e3779b1u);
+  }
+
+  /// Logical cores set with CacheSimSetThreadCoreMapping(). Protected by g_Lock.
+  static GenericHashTable<ThreadIdKey, int> s_CoreMappings;
+  /// Logical cores the thread core policy picked during the current capture. Protected by g_Lock.
+  static GenericHashTable<ThreadIdKey, int> s_AutoCoreMappings;
 
   class AutoSpinLock
   {
   public:
-    AutoSpinLock()
+    explicit AutoSpinLock(volatile int32_t* lock = &g_Lock) : m_Lock(lock)
     {
       int count = 0;
-      while (AtomicCompareExchange(&g_Lock, 1, 0) == 1)
+      while (AtomicCompareExchange(m_Lock, 1, 0) == 1)
       {
         if (count++ == 1000)
         {
@@ -102,8 +136,11 @@ namespace CacheSim
 
     ~AutoSpinLock()
     {
-      g_Lock = 0;
+      *m_Lock = 0;
     }
+
+  private:
+    volatile int32_t* m_Lock;
   };
 
   struct StackValue
@@ -116,15 +153,16 @@ namespace CacheSim
 
   struct RipKey
   {
-    RipKey() : m_Rip(0), m_StackOffset(0) {}
-    RipKey(uintptr_t rip, uint32_t stack_offset) : m_Rip(rip), m_StackOffset(stack_offset) {}
+    RipKey() : m_Rip(0), m_StackOffset(0), m_FiberId(0) {}
+    RipKey(uintptr_t rip, uint32_t stack_offset, uint32_t fiber_id) : m_Rip(rip), m_StackOffset(stack_offset), m_FiberId(fiber_id) {}
     uintptr_t m_Rip;
     uint32_t  m_StackOffset;
+    uint32_t  m_FiberId;
   };
 
   bool operator==(const RipKey& l, const RipKey& r)
   {
-    return l.m_Rip == r.m_Rip && l.m_StackOffset == r.m_StackOffset;
+    return l.m_Rip == r.m_Rip && l.m_StackOffset == r.m_StackOffset && l.m_FiberId == r.m_FiberId;
   }
 
   struct RipStats
@@ -146,7 +184,7 @@ namespace CacheSim
 
   uint32_t HashTypeOverload(const CacheSim::RipKey& key)
   {
-    return uint32_t(key.m_Rip ^ (key.m_Rip >> 32) * 33 + 61 * key.m_StackOffset);
+    return uint32_t(key.m_Rip ^ ((key.m_Rip >> 32) * 33 + 61 * key.m_StackOffset + 0x9e3779b1u * key.m_FiberId));
   }
 
   /// Maps 128-bit hash digests to call stacks.
@@ -161,9 +199,27 @@ namespace CacheSim
     uint32_t    m_ReserveCount;
   } g_StackData;
 
-  RipStats* GetRipNode(uintptr_t pc, uint32_t stack_offset)
+  /// Sampling configuration, see CacheSimSetSampling(). Only changes between captures.
+  static struct
+  {
+    uint32_t    m_PeriodUs;
+    uint32_t    m_WarmupInstructions;
+    uint32_t    m_MeasureInstructions;
+  } g_Sampling;
+
+  /// Stats of each completed measurement window of the current capture.
+  static struct
+  {
+    RipStats*   m_Windows;
+    uint32_t    m_Count;
+    uint32_t    m_ReserveCount;
+  } g_SampleWindows;
+
+  static SamplingSummary g_SamplingSummary;
+
+  RipStats* GetRipNode(uintptr_t pc, uint32_t stack_offset, uint32_t fiber_id)
   {
-    return g_Stats.Insert(RipKey(pc, stack_offset));
+    return g_Stats.Insert(RipKey(pc, stack_offset, fiber_id));
   }
 
   uint32_t InsertStack(const uintptr_t frames[], uint32_t frame_count)
@@ -206,448 +262,2737 @@ namespace CacheSim
   }
 }
 
-static intptr_t ReadReg(ud_type_t reg, const CONTEXT* ctx)
+//--------------------------------------------------------------------------------------------------
+// Allocation tracking. CacheSimOnAlloc() and CacheSimOnFree() maintain an index of the live heap
+// allocations, which is consulted for the address of every recorded L2 data miss so misses can be
+// charged to the allocation's tag and the call stack that allocated it.
+//
+// The index outlives captures, as most data touched during a capture is allocated before it. It's
+// protected by its own lock, which the recorder only takes after releasing g_Lock.
+
+static int CaptureAllocStack(uintptr_t frames[], int max_frames);
+
+namespace CacheSim
 {
-  switch (reg)
+  enum
   {
-  case  UD_R_AL:  return (int8_t)(ctx->Rax);
-  case  UD_R_AH:  return (int8_t)(ctx->Rax >> 8);
-  case  UD_R_AX:  return (int16_t)(ctx->Rax);
-  case UD_R_EAX:  return (int32_t)(ctx->Rax);
-  case UD_R_RAX:  return          (ctx->Rax);
+    kMaxAllocTags = 1024,
+    kMaxAllocFrames = 32,
+  };
 
-  case  UD_R_BL:  return (int8_t)(ctx->Rbx);
-  case  UD_R_BH:  return (int8_t)(ctx->Rbx >> 8);
-  case  UD_R_BX:  return (int16_t)(ctx->Rbx);
-  case UD_R_EBX:  return (int32_t)(ctx->Rbx);
-  case UD_R_RBX:  return          (ctx->Rbx);
+  /// A live allocation. Nodes of a treap ordered by start address, so the allocation containing an
+  /// address can be found in logarithmic time.
+  struct LiveAllocation
+  {
+    uintptr_t   m_Start;
+    uintptr_t   m_End;
+    uint32_t    m_Site;
+    uint32_t    m_Priority;
+    uint32_t    m_Child[2];               ///< Node indices, 0 for none. m_Child[0] links the free list.
+  };
 
-  case  UD_R_CL:  return (int8_t)(ctx->Rcx);
-  case  UD_R_CH:  return (int8_t)(ctx->Rcx >> 8);
-  case  UD_R_CX:  return (int16_t)(ctx->Rcx);
-  case UD_R_ECX:  return (int32_t)(ctx->Rcx);
-  case UD_R_RCX:  return          (ctx->Rcx);
+  /// A distinct tag and call stack allocations were made from.
+  struct AllocSite
+  {
+    uint32_t    m_FrameOffset;            ///< Into s_AllocSiteFrames
+    uint32_t    m_FrameCount;
+    uint32_t    m_Tag;
+    uint32_t    m_L2DMisses;              ///< During the current capture
+  };
 
-  case  UD_R_DL:  return (int8_t)(ctx->Rdx);
-  case  UD_R_DH:  return (int8_t)(ctx->Rdx >> 8);
-  case  UD_R_DX:  return (int16_t)(ctx->Rdx);
-  case UD_R_EDX:  return (int32_t)(ctx->Rdx);
-  case UD_R_RDX:  return          (ctx->Rdx);
+  struct AllocTag
+  {
+    char        m_Name[64];
+    uint32_t    m_L2DMisses;              ///< During the current capture
+  };
 
-  case UD_R_SIL:  return (int8_t)(ctx->Rsi);
-  case UD_R_SI:   return (int16_t)(ctx->Rsi);
-  case UD_R_ESI:  return (int32_t)(ctx->Rsi);
-  case UD_R_RSI:  return          (ctx->Rsi);
+  struct AllocTagKey
+  {
+    AllocTagKey() : m_Pointer(nullptr) {}
+    explicit AllocTagKey(const char* pointer) : m_Pointer(pointer) {}
+    const char* m_Pointer;
+  };
 
-  case UD_R_DIL:  return (int8_t)(ctx->Rdi);
-  case UD_R_DI:   return (int16_t)(ctx->Rdi);
-  case UD_R_EDI:  return (int32_t)(ctx->Rdi);
-  case UD_R_RDI:  return          (ctx->Rdi);
+  bool operator==(const AllocTagKey& l, const AllocTagKey& r)
+  {
+    return l.m_Pointer == r.m_Pointer;
+  }
 
-  case UD_R_BPL:  return (int8_t)(ctx->Rbp);
-  case UD_R_BP:   return (int16_t)(ctx->Rbp);
-  case UD_R_EBP:  return (int32_t)(ctx->Rbp);
-  case UD_R_RBP:  return          (ctx->Rbp);
+  uint32_t HashTypeOverload(const CacheSim::AllocTagKey& key)
+  {
+    return uint32_t(uintptr_t(key.m_Pointer) ^ (uintptr_t(key.m_Pointer) >> 32));
+  }
 
-  case UD_R_SPL:  return (int8_t)(ctx->Rsp);
-  case UD_R_SP:   return (int16_t)(ctx->Rsp);
-  case UD_R_ESP:  return (int32_t)(ctx->Rsp);
-  case UD_R_RSP:  return          (ctx->Rsp);
+  static volatile int32_t s_AllocLock;
 
-  case UD_R_R8B:  return (int8_t)(ctx->R8);
-  case UD_R_R8W:  return (int16_t)(ctx->R8);
-  case UD_R_R8D:  return (int32_t)(ctx->R8);
-  case UD_R_R8:   return          (ctx->R8);
+  static struct
+  {
+    LiveAllocation* m_Nodes;              ///< Node 0 is unused so 0 can mean none
+    uint32_t        m_Count;
+    uint32_t        m_ReserveCount;
+    uint32_t        m_FreeList;
+    uint32_t        m_Root;
+    uint32_t        m_Seed;
+  } s_LiveAllocs;
+
+  static AllocTag s_AllocTags[kMaxAllocTags];
+  static uint32_t s_AllocTagCount = 0;
+  /// Maps tag string pointers to indices in s_AllocTags.
+  static GenericHashTable<AllocTagKey, uint32_t> s_AllocTagLookup;
 
-  case UD_R_R9B:  return (int8_t)(ctx->R9);
-  case UD_R_R9W:  return (int16_t)(ctx->R9);
-  case UD_R_R9D:  return (int32_t)(ctx->R9);
-  case UD_R_R9:   return          (ctx->R9);
+  static struct
+  {
+    AllocSite*  m_Sites;
+    uint32_t    m_Count;
+    uint32_t    m_ReserveCount;
+  } s_AllocSites;
 
-  case UD_R_R10B: return (int8_t)(ctx->R10);
-  case UD_R_R10W: return (int16_t)(ctx->R10);
-  case UD_R_R10D: return (int32_t)(ctx->R10);
-  case UD_R_R10:  return          (ctx->R10);
+  static struct
+  {
+    uintptr_t*  m_Frames;
+    uint32_t    m_Count;
+    uint32_t    m_ReserveCount;
+  } s_AllocSiteFrames;
 
-  case UD_R_R11B: return (int8_t)(ctx->R11);
-  case UD_R_R11W: return (int16_t)(ctx->R11);
-  case UD_R_R11D: return (int32_t)(ctx->R11);
-  case UD_R_R11:  return          (ctx->R11);
+  /// Maps hashes of the frames and tag of allocation sites to indices in s_AllocSites.
+  static GenericHashTable<StackKey, uint32_t> s_AllocSiteLookup;
 
-  case UD_R_R12B: return (int8_t)(ctx->R12);
-  case UD_R_R12W: return (int16_t)(ctx->R12);
-  case UD_R_R12D: return (int32_t)(ctx->R12);
-  case UD_R_R12:  return          (ctx->R12);
+  /// Holds the thread's m_InAllocHook flag and the allocation lock, in that order. The flag tells the
+  /// trap handler not to attribute misses, since that would need the lock the interrupted code holds.
+  class AutoAllocLock
+  {
+  public:
+    AutoAllocLock()
+    {
+      s_ThreadState.m_InAllocHook = true;
+      while (AtomicCompareExchange(&s_AllocLock, 1, 0) == 1)
+      {
+        IG_ThreadYield();
+      }
+    }
 
-  case UD_R_R13B: return (int8_t)(ctx->R13);
-  case UD_R_R13W: return (int16_t)(ctx->R13);
-  case UD_R_R13D: return (int32_t)(ctx->R13);
-  case UD_R_R13:  return          (ctx->R13);
+    ~AutoAllocLock()
+    {
+      s_AllocLock = 0;
+      s_ThreadState.m_InAllocHook = false;
+    }
+  };
 
-  case UD_R_R14B: return (int8_t)(ctx->R14);
-  case UD_R_R14W: return (int16_t)(ctx->R14);
-  case UD_R_R14D: return (int32_t)(ctx->R14);
-  case UD_R_R14:  return          (ctx->R14);
+  template <typename T>
+  static void GrowArray(T** items, uint32_t count, uint32_t* reserve_count, uint32_t needed, uint32_t initial_reserve)
+  {
+    if (count + needed <= *reserve_count)
+      return;
 
-  case UD_R_R15B: return (int8_t)(ctx->R15);
-  case UD_R_R15W: return (int16_t)(ctx->R15);
-  case UD_R_R15D: return (int32_t)(ctx->R15);
-  case UD_R_R15:  return          (ctx->R15);
+    uint32_t new_reserve = *reserve_count ? 2 * *reserve_count : initial_reserve;
+    while (new_reserve < count + needed)
+      new_reserve *= 2;
+
+    if (*items)
+    {
+      *items = (T*)VirtualMemoryRealloc(*items, *reserve_count * sizeof(T), new_reserve * sizeof(T));
+    }
+    else
+    {
+      *items = (T*)VirtualMemoryAlloc(new_reserve * sizeof(T));
+    }
+    *reserve_count = new_reserve;
+  }
+}
 
+static uint32_t FindAllocTag(const char* tag)
+{
+  using namespace CacheSim;
 
-  case UD_R_RIP:  return          (ctx->Rip);
+  if (!tag)
+    tag = "(untagged)";
+
+  if (uint32_t* existing = s_AllocTagLookup.Find(AllocTagKey(tag)))
+    return *existing;
+
+  // Tags are usually string literals, but the same name can live at several addresses.
+  uint32_t index = 0;
+  while (index < s_AllocTagCount && 0 != strncmp(s_AllocTags[index].m_Name, tag, sizeof s_AllocTags[index].m_Name - 1))
+    ++index;
+
+  if (index == s_AllocTagCount)
+  {
+    if (kMaxAllocTags == s_AllocTagCount)
+      return kMaxAllocTags - 1;       // Out of tags, lump the rest in with the last one.
+
+    AllocTag& entry = s_AllocTags[s_AllocTagCount++];
+    strncpy(entry.m_Name, tag, sizeof entry.m_Name - 1);
+    entry.m_L2DMisses = 0;
   }
 
-  DebugBreak();
-  return 0;
+  *s_AllocTagLookup.Insert(AllocTagKey(tag)) = index;
+  return index;
 }
 
-static uintptr_t AdjustFsSegment(uintptr_t address);
-static uintptr_t AdjustGsSegment(uintptr_t address);
+static uint32_t FindAllocSite(uintptr_t frames[], uint32_t frame_count, uint32_t tag)
+{
+  using namespace CacheSim;
+
+  // Hash the tag along with the frames so one stack allocating under two tags gives two sites.
+  frames[frame_count] = tag;
+  StackKey key(frames, frame_count + 1);
 
-static uintptr_t ComputeEa(const ud_t* ud, int operand_index, const CONTEXT* ctx)
+  if (uint32_t* existing = s_AllocSiteLookup.Find(key))
+    return *existing;
+
+  GrowArray(&s_AllocSiteFrames.m_Frames, s_AllocSiteFrames.m_Count, &s_AllocSiteFrames.m_ReserveCount, frame_count, 65536);
+  GrowArray(&s_AllocSites.m_Sites, s_AllocSites.m_Count, &s_AllocSites.m_ReserveCount, 1, 4096);
+
+  AllocSite& site = s_AllocSites.m_Sites[s_AllocSites.m_Count];
+  site.m_FrameOffset = s_AllocSiteFrames.m_Count;
+  site.m_FrameCount = frame_count;
+  site.m_Tag = tag;
+  site.m_L2DMisses = 0;
+
+  memcpy(s_AllocSiteFrames.m_Frames + s_AllocSiteFrames.m_Count, frames, frame_count * sizeof frames[0]);
+  s_AllocSiteFrames.m_Count += frame_count;
+
+  *s_AllocSiteLookup.Insert(key) = s_AllocSites.m_Count;
+  return s_AllocSites.m_Count++;
+}
+
+static uint32_t TreapInsert(uint32_t root, uint32_t node)
 {
-  uintptr_t addr = 0;
-  const ud_operand_t& op = ud->operand[operand_index];
+  using namespace CacheSim;
 
-  switch (op.offset)
-  {
-  case 8:  addr += op.lval.sbyte; break;
-  case 16: addr += op.lval.sword; break;
-  case 32: addr += op.lval.sdword; break;
-  case 64: addr += op.lval.sqword; break;
-  }
+  if (!root)
+    return node;
 
-  if (op.base != UD_NONE)
+  LiveAllocation* nodes = s_LiveAllocs.m_Nodes;
+  const int dir = nodes[node].m_Start > nodes[root].m_Start;
+  const uint32_t child = nodes[root].m_Child[dir] = TreapInsert(nodes[root].m_Child[dir], node);
+
+  if (nodes[child].m_Priority > nodes[root].m_Priority)
   {
-    addr += ReadReg(op.base, ctx);
+    nodes[root].m_Child[dir] = nodes[child].m_Child[!dir];
+    nodes[child].m_Child[!dir] = root;
+    return child;
   }
 
-  if (op.index != UD_NONE)
+  return root;
+}
+
+static uint32_t TreapMerge(uint32_t left, uint32_t right)
+{
+  using namespace CacheSim;
+
+  if (!left || !right)
+    return left | right;
+
+  LiveAllocation* nodes = s_LiveAllocs.m_Nodes;
+  if (nodes[left].m_Priority > nodes[right].m_Priority)
   {
-    intptr_t regval = ReadReg(op.index, ctx);
-    if (UD_NONE != op.scale)
-      addr += regval * op.scale;
-    else
-      addr += regval;
+    nodes[left].m_Child[1] = TreapMerge(nodes[left].m_Child[1], right);
+    return left;
   }
 
-  switch (ud->pfx_seg)
+  nodes[right].m_Child[0] = TreapMerge(left, nodes[right].m_Child[0]);
+  return right;
+}
+
+static uint32_t TreapRemove(uint32_t root, uintptr_t start, uint32_t* removed)
+{
+  using namespace CacheSim;
+
+  if (!root)
+    return 0;
+
+  LiveAllocation* nodes = s_LiveAllocs.m_Nodes;
+  if (nodes[root].m_Start != start)
   {
-  case UD_R_FS:
-    addr = AdjustFsSegment(addr);
-    break;
-  case UD_R_GS:
-    addr = AdjustGsSegment(addr);
-    break;
+    const int dir = start > nodes[root].m_Start;
+    nodes[root].m_Child[dir] = TreapRemove(nodes[root].m_Child[dir], start, removed);
+    return root;
   }
 
-  return addr;
+  *removed = root;
+  return TreapMerge(nodes[root].m_Child[0], nodes[root].m_Child[1]);
 }
 
-static void InvalidateStack()
+static void RemoveLiveAllocation(uintptr_t start)
 {
   using namespace CacheSim;
-  s_ThreadState.m_StackIndex = ~0u;
+
+  uint32_t removed = 0;
+  s_LiveAllocs.m_Root = TreapRemove(s_LiveAllocs.m_Root, start, &removed);
+
+  if (removed)
+  {
+    s_LiveAllocs.m_Nodes[removed].m_Child[0] = s_LiveAllocs.m_FreeList;
+    s_LiveAllocs.m_FreeList = removed;
+  }
 }
 
-static void GenerateMemoryAccesses(int core_index, const ud_t* ud, uint64_t rip, int ilen, const CONTEXT* ctx)
+static void AddLiveAllocation(uintptr_t start, size_t size, uint32_t site)
 {
   using namespace CacheSim;
-  int read_count = 0;
-  int write_count = 0;
 
-  struct MemOp { uintptr_t ea; size_t sz; };
-  MemOp prefetch_op = { 0, 0 };
-  MemOp reads[4];
-  MemOp writes[4];
+  // An allocation at the same address whose free we never saw can't be live any more.
+  RemoveLiveAllocation(start);
 
-  auto data_r = [&](uintptr_t addr, size_t sz) -> void
+  uint32_t node = s_LiveAllocs.m_FreeList;
+  if (node)
   {
-    if (sz == 0)
-      DebugBreak();
-    if (intptr_t(addr) < 0)
-      DebugBreak();
-    if (addr)
+    s_LiveAllocs.m_FreeList = s_LiveAllocs.m_Nodes[node].m_Child[0];
+  }
+  else
+  {
+    if (0 == s_LiveAllocs.m_Count)
+      s_LiveAllocs.m_Count = 1;
+    GrowArray(&s_LiveAllocs.m_Nodes, s_LiveAllocs.m_Count, &s_LiveAllocs.m_ReserveCount, 1, 65536);
+    node = s_LiveAllocs.m_Count++;
+  }
+
+  // xorshift32
+  uint32_t seed = s_LiveAllocs.m_Seed ? s_LiveAllocs.m_Seed : 0x9e3779b9u;
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  s_LiveAllocs.m_Seed = seed;
+
+  LiveAllocation& entry = s_LiveAllocs.m_Nodes[node];
+  entry.m_Start = start;
+  entry.m_End = start + (size ? size : 1);
+  entry.m_Site = site;
+  entry.m_Priority = seed;
+  entry.m_Child[0] = entry.m_Child[1] = 0;
+
+  s_LiveAllocs.m_Root = TreapInsert(s_LiveAllocs.m_Root, node);
+}
+
+static const CacheSim::LiveAllocation* FindLiveAllocation(uintptr_t addr)
+{
+  using namespace CacheSim;
+
+  const LiveAllocation* nodes = s_LiveAllocs.m_Nodes;
+  uint32_t best = 0;
+  for (uint32_t i = s_LiveAllocs.m_Root; i; )
+  {
+    if (nodes[i].m_Start <= addr)
     {
-      reads[read_count].ea = addr;
-      reads[read_count].sz = sz;
-      ++read_count;
+      best = i;
+      i = nodes[i].m_Child[1];
     }
-  };
+    else
+    {
+      i = nodes[i].m_Child[0];
+    }
+  }
 
-  auto data_w = [&](uintptr_t addr, size_t sz) -> void
+  return best && addr < nodes[best].m_End ? &nodes[best] : nullptr;
+}
+
+namespace CacheSim
+{
+  /// Collects the addresses of an instruction's L2 data misses and charges them to allocations when it
+  /// goes out of scope. Declare it before taking g_Lock so that happens after g_Lock is released.
+  class MissAttribution
   {
-    if (sz == 0)
-      DebugBreak();
-    if (intptr_t(addr) < 0)
-      DebugBreak();
-    if (addr)
+  public:
+    MissAttribution() : m_Count(0) {}
+
+    void Add(uintptr_t addr)
     {
-      writes[write_count].ea = addr;
-      writes[write_count].sz = sz;
-      ++write_count;
+      if (m_Count < ARRAY_SIZE(m_Addresses))
+        m_Addresses[m_Count++] = addr;
     }
-  };
 
-  //const int dir = ctx->EFlags & (1 << 10) ? -1 : 1;
+    ~MissAttribution()
+    {
+      if (!m_Count || !s_LiveAllocs.m_Root || s_ThreadState.m_InAllocHook)
+        return;
 
-  uint32_t existing_stack_index = s_ThreadState.m_StackIndex;
+      AutoAllocLock lock;
+      for (uint32_t i = 0; i < m_Count; ++i)
+      {
+        if (const LiveAllocation* alloc = FindLiveAllocation(m_Addresses[i]))
+        {
+          AllocSite& site = s_AllocSites.m_Sites[alloc->m_Site];
+          site.m_L2DMisses += 1;
+          s_AllocTags[site.m_Tag].m_L2DMisses += 1;
+        }
+      }
+    }
 
-  // Handle instructions with implicit memory operands.
-  switch (ud->mnemonic)
+  private:
+    uint32_t  m_Count;
+    uintptr_t m_Addresses[16];
+  };
+
+  /// Allocation statistics of a capture, copied out so they can be saved without holding the allocation lock.
+  struct AllocSnapshot
   {
-    // String instructions.
-  case UD_Ilodsb:
-  case UD_Iscasb:
-    data_r(ctx->Rsi, 1);
+    AllocTag    m_Tags[kMaxAllocTags];
+    uint32_t    m_TagCount;
+    AllocSite*  m_Sites;                  ///< Only sites with misses. Frame offsets point into m_Frames.
+    uint32_t    m_SiteCount;
+    uintptr_t*  m_Frames;
+    uint32_t    m_FrameCount;
+  };
+}
+
+// Copies the allocation statistics of the capture that just ended to `snapshot`, if given, and resets them.
+static void TakeAllocSnapshot(CacheSim::AllocSnapshot* snapshot)
+{
+  using namespace CacheSim;
+
+  AutoAllocLock lock;
+
+  if (snapshot)
+  {
+    memcpy(snapshot->m_Tags, s_AllocTags, s_AllocTagCount * sizeof s_AllocTags[0]);
+    snapshot->m_TagCount = s_AllocTagCount;
+
+    uint32_t site_count = 0, frame_count = 0;
+    for (uint32_t i = 0; i < s_AllocSites.m_Count; ++i)
+    {
+      if (s_AllocSites.m_Sites[i].m_L2DMisses)
+      {
+        site_count += 1;
+        frame_count += s_AllocSites.m_Sites[i].m_FrameCount;
+      }
+    }
+
+    snapshot->m_Sites = site_count ? (AllocSite*)VirtualMemoryAlloc(site_count * sizeof(AllocSite)) : nullptr;
+    snapshot->m_Frames = frame_count ? (uintptr_t*)VirtualMemoryAlloc(frame_count * sizeof(uintptr_t)) : nullptr;
+    snapshot->m_SiteCount = 0;
+    snapshot->m_FrameCount = 0;
+
+    for (uint32_t i = 0; i < s_AllocSites.m_Count; ++i)
+    {
+      const AllocSite& site = s_AllocSites.m_Sites[i];
+      if (!site.m_L2DMisses)
+        continue;
+
+      AllocSite& copy = snapshot->m_Sites[snapshot->m_SiteCount++];
+      copy = site;
+      copy.m_FrameOffset = snapshot->m_FrameCount;
+      memcpy(snapshot->m_Frames + snapshot->m_FrameCount, s_AllocSiteFrames.m_Frames + site.m_FrameOffset, site.m_FrameCount * sizeof(uintptr_t));
+      snapshot->m_FrameCount += site.m_FrameCount;
+    }
+  }
+
+  for (uint32_t i = 0; i < s_AllocTagCount; ++i)
+    s_AllocTags[i].m_L2DMisses = 0;
+  for (uint32_t i = 0; i < s_AllocSites.m_Count; ++i)
+    s_AllocSites.m_Sites[i].m_L2DMisses = 0;
+}
+
+static void FreeAllocSnapshot(CacheSim::AllocSnapshot* snapshot)
+{
+  if (snapshot->m_Sites)
+    VirtualMemoryFree(snapshot->m_Sites, snapshot->m_SiteCount * sizeof snapshot->m_Sites[0]);
+  if (snapshot->m_Frames)
+    VirtualMemoryFree(snapshot->m_Frames, snapshot->m_FrameCount * sizeof snapshot->m_Frames[0]);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Address space heatmap. Recorded data accesses, L2 misses and L2 evictions are counted per cell of
+// 2^s_HeatmapCellShift bytes, along with the instructions that access each cell the most. Only cells
+// that were accessed are stored, evictions of lines in other cells aren't counted.
+
+namespace CacheSim
+{
+  /// Hash table key for lines, heatmap cells and other values derived from addresses.
+  struct AddressKey
+  {
+    AddressKey() : m_Value(0) {}
+    explicit AddressKey(uint64_t value) : m_Value(value) {}
+    uint64_t m_Value;
+  };
+
+  bool operator==(const AddressKey& l, const AddressKey& r)
+  {
+    return l.m_Value == r.m_Value;
+  }
+
+  uint32_t HashTypeOverload(const CacheSim::AddressKey& key)
+  {
+    return uint32_t((key.m_Value ^ (key.m_Value >> 32)) * 0x9e3779b1u);
+  }
+
+  struct HeatmapStats
+  {
+    HeatmapStats() { memset(this, 0, sizeof *this); }
+
+    uint32_t    m_Accesses;
+    uint32_t    m_L2Misses;
+    uint32_t    m_Evictions;
+    uint64_t    m_Rips[kHeatmapMaxRips];
+    uint32_t    m_RipAccesses[kHeatmapMaxRips];   ///< 0 for unused slots
+    uint32_t    m_RipL2Misses[kHeatmapMaxRips];
+  };
+
+  /// Log2 of the cell size used by subsequent captures, 0 if they don't record a heatmap. See CacheSimSetHeatmapCellSize().
+  static uint32_t s_HeatmapCellShift = 6;
+  /// Maps cells (address >> s_HeatmapCellShift) to their stats.
+  static GenericHashTable<AddressKey, HeatmapStats> s_Heatmap;
+}
+
+// Must be called with g_Lock held.
+static void RecordHeatmapLine(uint64_t rip, uint64_t line_addr, CacheSim::AccessResult result, uint64_t evicted_line)
+{
+  using namespace CacheSim;
+
+  const uint32_t miss = kL2DMiss == result ? 1 : 0;
+
+  HeatmapStats* cell = s_Heatmap.Insert(AddressKey(line_addr >> s_HeatmapCellShift));
+  cell->m_Accesses += 1;
+  cell->m_L2Misses += miss;
+
+  // Keep the instructions with the most accesses with the space saving algorithm: an instruction that isn't
+  // tracked replaces the one with the fewest accesses and inherits its count, so counts are upper bounds.
+  uint32_t slot = 0;
+  for (uint32_t i = 0; i < kHeatmapMaxRips; ++i)
+  {
+    if (cell->m_RipAccesses[i] && cell->m_Rips[i] == rip)
+    {
+      slot = i;
+      break;
+    }
+
+    if (cell->m_RipAccesses[i] < cell->m_RipAccesses[slot])
+      slot = i;
+  }
+
+  if (cell->m_Rips[slot] != rip || !cell->m_RipAccesses[slot])
+  {
+    cell->m_Rips[slot] = rip;
+    cell->m_RipL2Misses[slot] = 0;
+  }
+
+  cell->m_RipAccesses[slot] += 1;
+  cell->m_RipL2Misses[slot] += miss;
+
+  if (evicted_line)
+  {
+    if (HeatmapStats* victim = s_Heatmap.Find(AddressKey(evicted_line >> s_HeatmapCellShift)))
+      victim->m_Evictions += 1;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Reuse distances. The reuse (LRU stack) distance of an access is the number of distinct lines
+// accessed since the previous access to the same line; a fully associative LRU cache of N lines
+// hits exactly the accesses with a distance below N. Distances are computed over the data accesses
+// of all threads by a ReuseTree.
+//
+// To bound the cost, SHARDS spatial sampling can restrict this to lines whose hash falls in a
+// 1/2^s_ReuseSampleShift subset. Distances within the sample are scaled back up by the same factor.
+
+namespace CacheSim
+{
+  struct ReuseLine
+  {
+    ReuseLine() : m_Time(0) {}
+    uint64_t    m_Time;                   ///< Of the last access, 0 if not accessed yet
+  };
+
+  struct ReuseHistogram
+  {
+    ReuseHistogram() { memset(m_Buckets, 0, sizeof m_Buckets); }
+    uint32_t    m_Buckets[kReuseBucketCount];
+  };
+
+  /// Log2 of the SHARDS sampling rate used by subsequent captures, -1 if they don't record reuse distances.
+  /// Off by default, as every access to a tracked line costs a tree update. See CacheSimSetReuseSampling().
+  static int32_t s_ReuseSampleShift = -1;
+
+  static ReuseTree s_ReuseTree;
+  /// Maps sampled lines (address >> 6) to the time of their last access.
+  static GenericHashTable<AddressKey, ReuseLine> s_ReuseLines;
+  /// Maps instruction addresses to their reuse distance histograms.
+  static GenericHashTable<AddressKey, ReuseHistogram> s_ReuseHistograms;
+}
+
+// Must be called with g_Lock held.
+static void RecordReuse(uint64_t rip, uint64_t line_addr)
+{
+  using namespace CacheSim;
+
+  const uint64_t line = line_addr >> 6;
+  const uint32_t shift = uint32_t(s_ReuseSampleShift);
+  if (!ReuseTree::IsSampled(line, shift))
+    return;
+
+  ReuseLine* entry = s_ReuseLines.Insert(AddressKey(line));
+
+  uint64_t distance;
+  entry->m_Time = s_ReuseTree.Access(entry->m_Time, shift, &distance);
+
+  const uint32_t bucket = ReuseTree::kColdDistance == distance ? kReuseColdBucket : ReuseDistanceBucket(distance);
+  s_ReuseHistograms.Insert(AddressKey(rip))->m_Buckets[bucket] += 1;
+}
+
+static void FreeReuseData()
+{
+  using namespace CacheSim;
+
+  s_ReuseTree.Free();
+
+  s_ReuseLines.FreeAll();
+  s_ReuseHistograms.FreeAll();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Working set sizes. Recorded instructions are split into intervals of s_WorkingSetInterval
+// instructions, counted over all threads, and the distinct lines the data accesses of each interval
+// touch are estimated with HyperLogLog sketches, for all cores and for each simulated core.
+
+namespace CacheSim
+{
+  enum
+  {
+    kHllRegisterBits = 10,
+    kHllRegisterCount = 1 << kHllRegisterBits,   ///< Standard error is 1.04 / sqrt(kHllRegisterCount), about 3%
+  };
+
+  struct HyperLogLog
+  {
+    uint8_t     m_Registers[kHllRegisterCount];
+
+    void Add(uint64_t value)
+    {
+      // splitmix64 finalizer, so nearby lines spread over the registers
+      uint64_t h = value;
+      h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+      h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+      h ^= h >> 31;
+
+      const uint32_t index = uint32_t(h >> (64 - kHllRegisterBits));
+      const uint64_t rest = h << kHllRegisterBits;
+
+      uint8_t rank = 1;
+      for (uint64_t bit = 1ull << 63; rank <= 64 - kHllRegisterBits && !(rest & bit); bit >>= 1)
+        ++rank;
+
+      if (rank > m_Registers[index])
+        m_Registers[index] = rank;
+    }
+
+    uint32_t Estimate() const
+    {
+      double sum = 0.0;
+      uint32_t zeros = 0;
+      for (uint8_t reg : m_Registers)
+      {
+        sum += 1.0 / double(1ull << reg);
+        zeros += 0 == reg;
+      }
+
+      const double m = kHllRegisterCount;
+      double estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+
+      // Linear counting is more accurate for small sets.
+      if (estimate <= 2.5 * m && zeros)
+        estimate = m * log(m / zeros);
+
+      return uint32_t(estimate + 0.5);
+    }
+  };
+
+  /// Instructions per interval used by subsequent captures, 0 if they don't record working sets. See CacheSimSetWorkingSetInterval().
+  static uint32_t s_WorkingSetInterval = 1000000;
+
+  static struct
+  {
+    HyperLogLog m_All;
+    HyperLogLog m_Cores[kWorkingSetCoreCount];
+    uint32_t    m_Instructions;           ///< Recorded so far in the current interval
+  } s_WorkingSet;
+
+  static struct
+  {
+    SerializedWorkingSet* m_Intervals;
+    uint32_t    m_Count;
+    uint32_t    m_ReserveCount;
+  } s_WorkingSetIntervals;
+}
+
+// Must be called with g_Lock held.
+static void FinishWorkingSetInterval()
+{
+  using namespace CacheSim;
+
+  if (!s_WorkingSet.m_Instructions)
+    return;
+
+  GrowArray(&s_WorkingSetIntervals.m_Intervals, s_WorkingSetIntervals.m_Count, &s_WorkingSetIntervals.m_ReserveCount, 1, 4096);
+
+  SerializedWorkingSet& interval = s_WorkingSetIntervals.m_Intervals[s_WorkingSetIntervals.m_Count++];
+  interval.m_Instructions = s_WorkingSet.m_Instructions;
+  interval.m_Lines = s_WorkingSet.m_All.Estimate();
+  for (int i = 0; i < kWorkingSetCoreCount; ++i)
+  {
+    interval.m_CoreLines[i] = s_WorkingSet.m_Cores[i].Estimate();
+  }
+
+  memset(&s_WorkingSet, 0, sizeof s_WorkingSet);
+}
+
+// Must be called with g_Lock held.
+static void CountWorkingSetInstruction()
+{
+  using namespace CacheSim;
+
+  if (++s_WorkingSet.m_Instructions >= s_WorkingSetInterval)
+    FinishWorkingSetInterval();
+}
+
+// Must be called with g_Lock held.
+static void RecordWorkingSetLine(int core_index, uint64_t line_addr)
+{
+  using namespace CacheSim;
+
+  const uint64_t line = line_addr >> 6;
+  s_WorkingSet.m_All.Add(line);
+  s_WorkingSet.m_Cores[core_index & (kWorkingSetCoreCount - 1)].Add(line);
+}
+
+static void FreeWorkingSetData()
+{
+  using namespace CacheSim;
+
+  if (s_WorkingSetIntervals.m_Intervals)
+    VirtualMemoryFree(s_WorkingSetIntervals.m_Intervals, s_WorkingSetIntervals.m_ReserveCount * sizeof(SerializedWorkingSet));
+  memset(&s_WorkingSetIntervals, 0, sizeof s_WorkingSetIntervals);
+  memset(&s_WorkingSet, 0, sizeof s_WorkingSet);
+}
+
+namespace CacheSim
+{
+  /// Feeds the lines touched by an instruction's recorded data accesses to the heatmap, reuse distance
+  /// and working set tracking. Must be used with g_Lock held.
+  class DataLineRecorder : public LineObserver
+  {
+  public:
+    DataLineRecorder(uint64_t rip, int core_index) : m_Rip(rip), m_CoreIndex(core_index) {}
+
+    static bool IsEnabled()
+    {
+      return s_HeatmapCellShift || s_ReuseSampleShift >= 0 || s_WorkingSetInterval;
+    }
+
+    void OnLineAccess(uint64_t line_addr, AccessResult result, uint64_t evicted_line) override
+    {
+      if (s_HeatmapCellShift)
+        RecordHeatmapLine(m_Rip, line_addr, result, evicted_line);
+
+      if (s_ReuseSampleShift >= 0)
+        RecordReuse(m_Rip, line_addr);
+
+      if (s_WorkingSetInterval)
+        RecordWorkingSetLine(m_CoreIndex, line_addr);
+    }
+
+  private:
+    uint64_t m_Rip;
+    int m_CoreIndex;
+  };
+}
+
+static intptr_t ReadReg(ud_type_t reg, const CONTEXT* ctx)
+{
+  switch (reg)
+  {
+  case  UD_R_AL:  return (int8_t)(ctx->Rax);
+  case  UD_R_AH:  return (int8_t)(ctx->Rax >> 8);
+  case  UD_R_AX:  return (int16_t)(ctx->Rax);
+  case UD_R_EAX:  return (int32_t)(ctx->Rax);
+  case UD_R_RAX:  return          (ctx->Rax);
+
+  case  UD_R_BL:  return (int8_t)(ctx->Rbx);
+  case  UD_R_BH:  return (int8_t)(ctx->Rbx >> 8);
+  case  UD_R_BX:  return (int16_t)(ctx->Rbx);
+  case UD_R_EBX:  return (int32_t)(ctx->Rbx);
+  case UD_R_RBX:  return          (ctx->Rbx);
+
+  case  UD_R_CL:  return (int8_t)(ctx->Rcx);
+  case  UD_R_CH:  return (int8_t)(ctx->Rcx >> 8);
+  case  UD_R_CX:  return (int16_t)(ctx->Rcx);
+  case UD_R_ECX:  return (int32_t)(ctx->Rcx);
+  case UD_R_RCX:  return          (ctx->Rcx);
+
+  case  UD_R_DL:  return (int8_t)(ctx->Rdx);
+  case  UD_R_DH:  return (int8_t)(ctx->Rdx >> 8);
+  case  UD_R_DX:  return (int16_t)(ctx->Rdx);
+  case UD_R_EDX:  return (int32_t)(ctx->Rdx);
+  case UD_R_RDX:  return          (ctx->Rdx);
+
+  case UD_R_SIL:  return (int8_t)(ctx->Rsi);
+  case UD_R_SI:   return (int16_t)(ctx->Rsi);
+  case UD_R_ESI:  return (int32_t)(ctx->Rsi);
+  case UD_R_RSI:  return          (ctx->Rsi);
+
+  case UD_R_DIL:  return (int8_t)(ctx->Rdi);
+  case UD_R_DI:   return (int16_t)(ctx->Rdi);
+  case UD_R_EDI:  return (int32_t)(ctx->Rdi);
+  case UD_R_RDI:  return          (ctx->Rdi);
+
+  case UD_R_BPL:  return (int8_t)(ctx->Rbp);
+  case UD_R_BP:   return (int16_t)(ctx->Rbp);
+  case UD_R_EBP:  return (int32_t)(ctx->Rbp);
+  case UD_R_RBP:  return          (ctx->Rbp);
+
+  case UD_R_SPL:  return (int8_t)(ctx->Rsp);
+  case UD_R_SP:   return (int16_t)(ctx->Rsp);
+  case UD_R_ESP:  return (int32_t)(ctx->Rsp);
+  case UD_R_RSP:  return          (ctx->Rsp);
+
+  case UD_R_R8B:  return (int8_t)(ctx->R8);
+  case UD_R_R8W:  return (int16_t)(ctx->R8);
+  case UD_R_R8D:  return (int32_t)(ctx->R8);
+  case UD_R_R8:   return          (ctx->R8);
+
+  case UD_R_R9B:  return (int8_t)(ctx->R9);
+  case UD_R_R9W:  return (int16_t)(ctx->R9);
+  case UD_R_R9D:  return (int32_t)(ctx->R9);
+  case UD_R_R9:   return          (ctx->R9);
+
+  case UD_R_R10B: return (int8_t)(ctx->R10);
+  case UD_R_R10W: return (int16_t)(ctx->R10);
+  case UD_R_R10D: return (int32_t)(ctx->R10);
+  case UD_R_R10:  return          (ctx->R10);
+
+  case UD_R_R11B: return (int8_t)(ctx->R11);
+  case UD_R_R11W: return (int16_t)(ctx->R11);
+  case UD_R_R11D: return (int32_t)(ctx->R11);
+  case UD_R_R11:  return          (ctx->R11);
+
+  case UD_R_R12B: return (int8_t)(ctx->R12);
+  case UD_R_R12W: return (int16_t)(ctx->R12);
+  case UD_R_R12D: return (int32_t)(ctx->R12);
+  case UD_R_R12:  return          (ctx->R12);
+
+  case UD_R_R13B: return (int8_t)(ctx->R13);
+  case UD_R_R13W: return (int16_t)(ctx->R13);
+  case UD_R_R13D: return (int32_t)(ctx->R13);
+  case UD_R_R13:  return          (ctx->R13);
+
+  case UD_R_R14B: return (int8_t)(ctx->R14);
+  case UD_R_R14W: return (int16_t)(ctx->R14);
+  case UD_R_R14D: return (int32_t)(ctx->R14);
+  case UD_R_R14:  return          (ctx->R14);
+
+  case UD_R_R15B: return (int8_t)(ctx->R15);
+  case UD_R_R15W: return (int16_t)(ctx->R15);
+  case UD_R_R15D: return (int32_t)(ctx->R15);
+  case UD_R_R15:  return          (ctx->R15);
+
+
+  case UD_R_RIP:  return          (ctx->Rip);
+
+  default:        break;
+  }
+
+  DebugBreak();
+  return 0;
+}
+
+static uintptr_t AdjustFsSegment(uintptr_t address);
+static uintptr_t AdjustGsSegment(uintptr_t address);
+
+// Copies XMM/YMM register `reg_index` out of the trap context. The upper 16 bytes are zeroed for XMM reads.
+static void ReadVectorReg(int reg_index, bool ymm, const CONTEXT* ctx, uint8_t out[32]);
+
+static bool IsVectorReg(ud_type_t reg)
+{
+  return reg >= UD_R_XMM0 && reg <= UD_R_YMM15;
+}
+
+// Computes the effective address of a memory operand. For VSIB operands (gathers) the caller supplies the
+// value of the index lane in `vsib_index`, as there is no single index register value to read.
+static uintptr_t ComputeEa(const ud_t* ud, int operand_index, const CONTEXT* ctx, intptr_t vsib_index = 0)
+{
+  uintptr_t addr = 0;
+  const ud_operand_t& op = ud->operand[operand_index];
+
+  switch (op.offset)
+  {
+  case 8:  addr += op.lval.sbyte; break;
+  case 16: addr += op.lval.sword; break;
+  case 32: addr += op.lval.sdword; break;
+  case 64: addr += op.lval.sqword; break;
+  }
+
+  if (op.base != UD_NONE)
+  {
+    addr += ReadReg(op.base, ctx);
+  }
+
+  if (op.index != UD_NONE)
+  {
+    intptr_t regval = IsVectorReg(op.index) ? vsib_index : ReadReg(op.index, ctx);
+    if (UD_NONE != op.scale)
+      addr += regval * op.scale;
+    else
+      addr += regval;
+  }
+
+  switch (ud->pfx_seg)
+  {
+  case UD_R_FS:
+    addr = AdjustFsSegment(addr);
+    break;
+  case UD_R_GS:
+    addr = AdjustGsSegment(addr);
+    break;
+  }
+
+  return addr;
+}
+
+static void InvalidateStack()
+{
+  using namespace CacheSim;
+  s_ThreadState.m_StackIndex = ~0u;
+}
+
+namespace CacheSim
+{
+  struct MemOp { uintptr_t ea; size_t sz; };
+
+  // Accesses generated by a single instruction. This lives on the stack of the trap handler, so it can't grow;
+  // the capacity covers the widest gather (8 lanes) with room to spare.
+  struct MemOpList
+  {
+    enum
+    {
+      kCapacity = 16
+    };
+
+    MemOpList() : m_Count(0) {}
+
+    void Add(uintptr_t ea, size_t sz)
+    {
+      if (m_Count == kCapacity)
+        DebugBreak();
+      m_Ops[m_Count].ea = ea;
+      m_Ops[m_Count].sz = sz;
+      ++m_Count;
+    }
+
+    int   m_Count;
+    MemOp m_Ops[kCapacity];
+  };
+}
+
+//--------------------------------------------------------------------------------------------------
+// Alternative cache configurations. Each one is split into 2^s_ConfigShardShift shards by the low bits
+// of the line address, which pick a fixed set of sets at every cache level, so the shards can be simulated
+// independently. Each shard runs on a worker thread of its own, fed through a queue with the accesses of the
+// recorded instructions. Whichever traced thread holds g_Lock takes tickets, the queue positions, for its
+// accesses, so they keep the order they were simulated in. An access is written right away if its slot is free.
+// Otherwise the thread writes it once it has released g_Lock, waiting for the worker to free the slot, so
+// traced threads never wait for a worker while holding g_Lock. The worker reads the slots in ticket order.
+//
+// An access that straddles lines of different shards is split into one access per line. The shards log
+// the results of the parts, and the parts are combined when the capture ends.
+
+namespace CacheSim
+{
+  enum
+  {
+    kConfigQueueSize = 1 << 16,           ///< Accesses per queue, a power of two
+    kConfigIdleSpins = 1000,              ///< Times an idle worker yields before it starts sleeping
+    kConfigWorkerBatch = 4096,            ///< Accesses a worker reads before it frees their slots
+    kMaxConfigShardShift = 4,
+  };
+
+  enum ConfigAccessFlags
+  {
+    kConfigAccessRecord = 1 << 0,         ///< Count the result, otherwise the access only warms the caches
+    kConfigAccessInstruction = 1 << 1,    ///< The code fetch starting an instruction
+    kConfigAccessPrefetch = 1 << 2,
+    kConfigAccessSplit = 1 << 3,          ///< One line of an access split across shards, see m_Sequence
+  };
+
+  struct ConfigAccess
+  {
+    uint64_t    m_Addr;
+    uint64_t    m_Rip;
+    uint64_t    m_Sequence;               ///< Identifies the access a split part belongs to
+    uint32_t    m_Size;
+    int16_t     m_CoreIndex;
+    uint8_t     m_Mode;
+    uint8_t     m_Flags;
+  };
+
+  struct ConfigQueueSlot
+  {
+    ConfigAccess          m_Access;
+    std::atomic<uint32_t> m_Ready;        ///< Ticket of the access plus one, once it's written
+  };
+
+  /// Result of a line of a split access.
+  struct ConfigSplitResult
+  {
+    uint64_t    m_Sequence;
+    uint64_t    m_Rip;
+    uint8_t     m_Flags;
+    uint8_t     m_Result;
+  };
+
+  struct ConfigRipStats
+  {
+    ConfigRipStats() { memset(m_Stats, 0, sizeof m_Stats); }
+
+    uint32_t    m_Stats[kAccessResultCount];
+  };
+
+  /// Simulates one shard of one configuration.
+  struct ConfigWorker
+  {
+    ConfigurableCacheSim  m_Sim;
+    ConfigQueueSlot*      m_Queue;
+    std::atomic<uint32_t> m_Head;         ///< Next access the worker reads, slots of the accesses before it are free
+    uint32_t              m_NextTicket;   ///< Protected by g_Lock
+    std::atomic<bool>     m_Stop;
+    std::thread*          m_Thread;       ///< Allocated, so forked children and exit() without ending the capture don't terminate
+    std::atomic<uint64_t> m_ThreadId;     ///< OS thread ID, so the worker is never given a core and traced
+
+    // Owned by the worker until it's joined.
+    GenericHashTable<AddressKey, ConfigRipStats> m_Stats;   ///< By instruction
+    ConfigSplitResult*    m_SplitResults;
+    uint32_t              m_SplitCount;
+    uint32_t              m_SplitReserveCount;
+  };
+
+  static CacheConfig s_CacheConfigs[kMaxCacheConfigs];
+  static int s_CacheConfigCount = 0;
+  /// See CacheSimSetCacheConfigShards().
+  static uint32_t s_ConfigShardShift = 0;
+
+  /// Workers of the current or last capture, the shards of each configuration in turn.
+  static ConfigWorker* s_ConfigWorkers = nullptr;
+  static int s_ConfigWorkerCount = 0;
+  static uint32_t s_ConfigWorkerShardShift = 0;
+  static uint64_t s_ConfigSplitSequence = 0;
+}
+
+static void CountConfigAccess(CacheSim::ConfigRipStats* stats, uint8_t flags, CacheSim::AccessResult r)
+{
+  using namespace CacheSim;
+
+  if (flags & kConfigAccessInstruction)
+    stats->m_Stats[kInstructionsExecuted] += 1;
+
+  if (!(flags & kConfigAccessPrefetch))
+    stats->m_Stats[r] += 1;
+  else if (kD1Hit == r)
+    stats->m_Stats[kPrefetchHitD1] += 1;
+  else if (kL2Hit == r)
+    stats->m_Stats[kPrefetchHitL2] += 1;
+}
+
+// Implemented by the platform layer.
+static uint64_t GetCurrentOsThreadId();
+
+static void RunConfigWorker(CacheSim::ConfigWorker* worker)
+{
+  using namespace CacheSim;
+
+  worker->m_ThreadId.store(GetCurrentOsThreadId(), std::memory_order_release);
+
+  uint32_t head = worker->m_Head.load(std::memory_order_relaxed);
+  int idle = 0;
+
+  for (;;)
+  {
+    if (worker->m_Queue[head & (kConfigQueueSize - 1)].m_Ready.load(std::memory_order_acquire) != head + 1)
+    {
+      // No tickets are taken once m_Stop is set, but the last ones may still be written.
+      if (worker->m_Stop.load(std::memory_order_acquire) && head == worker->m_NextTicket)
+        return;
+
+      if (++idle < kConfigIdleSpins)
+        IG_ThreadYield();
+      else
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+
+    idle = 0;
+
+    uint64_t stats_rip = 0;
+    ConfigRipStats* stats = nullptr;
+
+    for (const uint32_t end = head + kConfigWorkerBatch; head != end; ++head)
+    {
+      const ConfigQueueSlot& slot = worker->m_Queue[head & (kConfigQueueSize - 1)];
+      if (slot.m_Ready.load(std::memory_order_acquire) != head + 1)
+        break;
+
+      const ConfigAccess& access = slot.m_Access;
+      const AccessResult r = worker->m_Sim.Access(access.m_CoreIndex, access.m_Addr, access.m_Size, AccessMode(access.m_Mode));
+
+      if (!(access.m_Flags & kConfigAccessRecord))
+        continue;
+
+      if (access.m_Flags & kConfigAccessSplit)
+      {
+        GrowArray(&worker->m_SplitResults, worker->m_SplitCount, &worker->m_SplitReserveCount, 1, 4096);
+        ConfigSplitResult& split = worker->m_SplitResults[worker->m_SplitCount++];
+        split.m_Sequence = access.m_Sequence;
+        split.m_Rip = access.m_Rip;
+        split.m_Flags = access.m_Flags;
+        split.m_Result = uint8_t(r);
+        continue;
+      }
+
+      // Accesses arrive grouped by instruction.
+      if (!stats || access.m_Rip != stats_rip)
+      {
+        stats = worker->m_Stats.Insert(AddressKey(access.m_Rip));
+        stats_rip = access.m_Rip;
+      }
+
+      CountConfigAccess(stats, access.m_Flags, r);
+    }
+
+    worker->m_Head.store(head, std::memory_order_release);
+  }
+}
+
+static void WriteConfigAccess(CacheSim::ConfigWorker& worker, uint32_t ticket, const CacheSim::ConfigAccess& access)
+{
+  using namespace CacheSim;
+
+  ConfigQueueSlot& slot = worker.m_Queue[ticket & (kConfigQueueSize - 1)];
+  slot.m_Access = access;
+  slot.m_Ready.store(ticket + 1, std::memory_order_release);
+}
+
+static bool IsConfigSlotFree(const CacheSim::ConfigWorker& worker, uint32_t ticket)
+{
+  using namespace CacheSim;
+
+  return ticket - worker.m_Head.load(std::memory_order_acquire) < kConfigQueueSize;
+}
+
+namespace CacheSim
+{
+  /// Accesses of an instruction whose queue slots weren't free yet. They're written when it goes out of
+  /// scope. Declare it before taking g_Lock so that happens after g_Lock is released.
+  class ConfigAccessStage
+  {
+  public:
+    ConfigAccessStage() : m_Accesses(nullptr), m_Count(0), m_ReserveCount(0) {}
+
+    void Add(ConfigWorker* worker, uint32_t ticket, const ConfigAccess& access)
+    {
+      GrowArray(&m_Accesses, m_Count, &m_ReserveCount, 1, 64);
+      StagedAccess& staged = m_Accesses[m_Count++];
+      staged.m_Worker = worker;
+      staged.m_Ticket = ticket;
+      staged.m_Access = access;
+    }
+
+    ~ConfigAccessStage()
+    {
+      if (!m_Accesses)
+        return;
+
+      // In ticket order. Each wait is for slots of earlier tickets, which are written already or by a thread
+      // that only waits for still earlier ones.
+      for (uint32_t i = 0; i < m_Count; ++i)
+      {
+        const StagedAccess& staged = m_Accesses[i];
+        while (!IsConfigSlotFree(*staged.m_Worker, staged.m_Ticket))
+          IG_ThreadYield();
+
+        WriteConfigAccess(*staged.m_Worker, staged.m_Ticket, staged.m_Access);
+      }
+
+      VirtualMemoryFree(m_Accesses, m_ReserveCount * sizeof(StagedAccess));
+    }
+
+  private:
+    struct StagedAccess
+    {
+      ConfigWorker* m_Worker;
+      uint32_t      m_Ticket;
+      ConfigAccess  m_Access;
+    };
+
+    StagedAccess* m_Accesses;
+    uint32_t      m_Count;
+    uint32_t      m_ReserveCount;
+  };
+}
+
+// Must be called with g_Lock held.
+static void PushConfigAccessToWorker(CacheSim::ConfigAccessStage* stage, CacheSim::ConfigWorker& worker, int core_index, uint64_t rip, uint64_t addr, size_t size, CacheSim::AccessMode mode, uint8_t flags, uint64_t sequence)
+{
+  using namespace CacheSim;
+
+  ConfigAccess access;
+  access.m_Addr = addr;
+  access.m_Rip = rip;
+  access.m_Sequence = sequence;
+  access.m_Size = uint32_t(size);
+  access.m_CoreIndex = int16_t(core_index);
+  access.m_Mode = uint8_t(mode);
+  access.m_Flags = flags;
+
+  const uint32_t ticket = worker.m_NextTicket++;
+  if (IsConfigSlotFree(worker, ticket))
+    WriteConfigAccess(worker, ticket, access);
+  else
+    stage->Add(&worker, ticket, access);
+}
+
+// Must be called with g_Lock held.
+static void PushConfigAccess(CacheSim::ConfigAccessStage* stage, int core_index, uint64_t rip, uint64_t addr, size_t size, CacheSim::AccessMode mode, uint8_t flags)
+{
+  using namespace CacheSim;
+
+  const uint32_t shard_count = 1u << s_ConfigWorkerShardShift;
+  const uint64_t shard_mask = shard_count - 1;
+
+  // The lines JaguarCacheSim::Access() and ConfigurableCacheSim::Access() visit.
+  const uint64_t first_line = addr >> 6;
+  const uint64_t last_line = (addr + (size ? size - 1 : 0)) >> 6;
+
+  for (int i = 0; i < s_ConfigWorkerCount; i += shard_count)
+  {
+    ConfigWorker* shards = s_ConfigWorkers + i;
+
+    if (first_line == last_line || 1 == shard_count)
+    {
+      PushConfigAccessToWorker(stage, shards[first_line & shard_mask], core_index, rip, addr, size, mode, flags, 0);
+      continue;
+    }
+
+    const uint64_t sequence = s_ConfigSplitSequence++;
+    for (uint64_t line = first_line; line <= last_line; ++line)
+    {
+      PushConfigAccessToWorker(stage, shards[line & shard_mask], core_index, rip, line << 6, 1, mode, flags | kConfigAccessSplit, sequence);
+    }
+  }
+}
+
+// Called by the platform layer when a capture starts, before any thread is traced, so the workers aren't.
+static void StartConfigWorkers()
+{
+  using namespace CacheSim;
+
+  if (!s_CacheConfigCount)
+    return;
+
+  const uint32_t shard_count = 1u << s_ConfigShardShift;
+  s_ConfigWorkerShardShift = s_ConfigShardShift;
+  s_ConfigWorkerCount = s_CacheConfigCount * shard_count;
+  s_ConfigWorkers = new ConfigWorker[s_ConfigWorkerCount];
+  s_ConfigSplitSequence = 0;
+
+  for (int i = 0; i < s_ConfigWorkerCount; ++i)
+  {
+    ConfigWorker& worker = s_ConfigWorkers[i];
+    worker.m_Sim.Init(s_CacheConfigs[i / shard_count], s_ConfigWorkerShardShift);
+    worker.m_Queue = (ConfigQueueSlot*)VirtualMemoryAlloc(kConfigQueueSize * sizeof(ConfigQueueSlot));
+    worker.m_Head.store(0, std::memory_order_relaxed);
+    worker.m_NextTicket = 0;
+    worker.m_Stop.store(false, std::memory_order_relaxed);
+    worker.m_Stats.Init();
+    worker.m_SplitResults = nullptr;
+    worker.m_SplitCount = 0;
+    worker.m_SplitReserveCount = 0;
+    worker.m_ThreadId.store(0, std::memory_order_relaxed);
+    worker.m_Thread = new std::thread(RunConfigWorker, &worker);
+  }
+
+  // Threads are given cores right after this, the workers must be known by then.
+  for (int i = 0; i < s_ConfigWorkerCount; ++i)
+  {
+    while (!s_ConfigWorkers[i].m_ThreadId.load(std::memory_order_acquire))
+      IG_ThreadYield();
+  }
+}
+
+// Whether a thread simulates cache configurations for the capture. Those must never be traced: they would trap
+// into the simulator they run, and traced threads wait for them.
+static bool IsConfigWorkerThread(uint64_t thread_id)
+{
+  using namespace CacheSim;
+
+  for (int i = 0; i < s_ConfigWorkerCount; ++i)
+  {
+    if (s_ConfigWorkers[i].m_Thread && s_ConfigWorkers[i].m_ThreadId.load(std::memory_order_relaxed) == thread_id)
+      return true;
+  }
+  return false;
+}
+
+// Adds the results of split accesses, and the statistics of the other shards, to the first shard of each configuration.
+static void MergeConfigShards()
+{
+  using namespace CacheSim;
+
+  const uint32_t shard_count = 1u << s_ConfigWorkerShardShift;
+
+  for (int i = 0; i < s_ConfigWorkerCount; i += shard_count)
+  {
+    ConfigWorker& first = s_ConfigWorkers[i];
+
+    for (uint32_t shard = 1; shard < shard_count; ++shard)
+    {
+      ConfigWorker& other = s_ConfigWorkers[i + shard];
+      for (const AddressKey& key : other.m_Stats.Keys())
+      {
+        const ConfigRipStats& from = *other.m_Stats.Find(key);
+        ConfigRipStats* to = first.m_Stats.Insert(key);
+        for (int k = 0; k < kAccessResultCount; ++k)
+        {
+          to->m_Stats[k] += from.m_Stats[k];
+        }
+      }
+      other.m_Stats.FreeAll();
+    }
+
+    // Gather the parts of the split accesses in the first shard's log, then count each access once with the worst result.
+    for (uint32_t shard = 1; shard < shard_count; ++shard)
+    {
+      ConfigWorker& other = s_ConfigWorkers[i + shard];
+      if (!other.m_SplitCount)
+        continue;
+
+      GrowArray(&first.m_SplitResults, first.m_SplitCount, &first.m_SplitReserveCount, other.m_SplitCount, 4096);
+      memcpy(first.m_SplitResults + first.m_SplitCount, other.m_SplitResults, other.m_SplitCount * sizeof(ConfigSplitResult));
+      first.m_SplitCount += other.m_SplitCount;
+      VirtualMemoryFree(other.m_SplitResults, other.m_SplitReserveCount * sizeof(ConfigSplitResult));
+      other.m_SplitResults = nullptr;
+      other.m_SplitCount = other.m_SplitReserveCount = 0;
+    }
+
+    ConfigSplitResult* splits = first.m_SplitResults;
+    std::sort(splits, splits + first.m_SplitCount, [](const ConfigSplitResult& a, const ConfigSplitResult& b) { return a.m_Sequence < b.m_Sequence; });
+
+    for (uint32_t s = 0; s < first.m_SplitCount; )
+    {
+      uint8_t result = splits[s].m_Result;
+      uint32_t end = s + 1;
+      for (; end < first.m_SplitCount && splits[end].m_Sequence == splits[s].m_Sequence; ++end)
+      {
+        if (splits[end].m_Result > result)
+          result = splits[end].m_Result;
+      }
+
+      CountConfigAccess(first.m_Stats.Insert(AddressKey(splits[s].m_Rip)), splits[s].m_Flags, AccessResult(result));
+      s = end;
+    }
+  }
+}
+
+// Waits for the workers to finish the queued accesses and merges their shards. The statistics stay
+// around until FreeConfigStats().
+static void StopConfigWorkers()
+{
+  using namespace CacheSim;
+
+  {
+    // No traced thread takes tickets once it sees the capture has ended.
+    AutoSpinLock lock;
+
+    for (int i = 0; i < s_ConfigWorkerCount; ++i)
+    {
+      s_ConfigWorkers[i].m_Stop.store(true, std::memory_order_release);
+    }
+  }
+
+  bool joined = false;
+  for (int i = 0; i < s_ConfigWorkerCount; ++i)
+  {
+    ConfigWorker& worker = s_ConfigWorkers[i];
+    if (!worker.m_Thread)
+      continue;
+
+    worker.m_Thread->join();
+    delete worker.m_Thread;
+    worker.m_Thread = nullptr;
+    worker.m_Sim.Free();
+    VirtualMemoryFree(worker.m_Queue, kConfigQueueSize * sizeof(ConfigQueueSlot));
+    worker.m_Queue = nullptr;
+    joined = true;
+  }
+
+  if (joined)
+    MergeConfigShards();
+}
+
+static void FreeConfigStats()
+{
+  using namespace CacheSim;
+
+  for (int i = 0; i < s_ConfigWorkerCount; ++i)
+  {
+    ConfigWorker& worker = s_ConfigWorkers[i];
+    worker.m_Stats.FreeAll();
+    if (worker.m_SplitResults)
+      VirtualMemoryFree(worker.m_SplitResults, worker.m_SplitReserveCount * sizeof(ConfigSplitResult));
+  }
+
+  delete[] s_ConfigWorkers;
+  s_ConfigWorkers = nullptr;
+  s_ConfigWorkerCount = 0;
+}
+
+// AVX2 gathers load one element per active lane, each from base + index[lane] * scale.
+// A lane is active when the sign bit of the corresponding mask element is set.
+template <typename Fn>
+static void GenerateGatherAccesses(const ud_t* ud, const CONTEXT* ctx, Fn& data_r)
+{
+  const ud_operand_t& dest = ud->operand[0];
+  const ud_operand_t& mem  = ud->operand[1];
+  const ud_operand_t& mask = ud->operand[2];
+
+  if (UD_OP_MEM != mem.type || !IsVectorReg(mem.index))
+    DebugBreak();
+
+  bool qword_index;
+  switch (ud->mnemonic)
+  {
+  case UD_Ivgatherqps:
+  case UD_Ivgatherqpd:
+  case UD_Ivpgatherqd:
+  case UD_Ivpgatherqq:
+    qword_index = true;
+    break;
+  default:
+    qword_index = false;
+    break;
+  }
+
+  const int  elem_bytes = mem.size / 8;
+  const bool index_ymm  = mem.index >= UD_R_YMM0;
+  const int  index_reg  = mem.index - (index_ymm ? UD_R_YMM0 : UD_R_XMM0);
+  const int  index_lanes = (index_ymm ? 32 : 16) / (qword_index ? 8 : 4);
+  const int  dest_lanes  = (dest.size / 8) / elem_bytes;
+  const int  lanes = index_lanes < dest_lanes ? index_lanes : dest_lanes;
+
+  uint8_t index_bytes[32];
+  uint8_t mask_bytes[32];
+  ReadVectorReg(index_reg, index_ymm, ctx, index_bytes);
+  ReadVectorReg(mask.base - (mask.base >= UD_R_YMM0 ? UD_R_YMM0 : UD_R_XMM0), mask.base >= UD_R_YMM0, ctx, mask_bytes);
+
+  for (int lane = 0; lane < lanes; ++lane)
+  {
+    if (0 == (mask_bytes[(lane + 1) * elem_bytes - 1] & 0x80))
+      continue;
+
+    intptr_t index;
+    if (qword_index)
+    {
+      int64_t v;
+      memcpy(&v, index_bytes + lane * 8, sizeof v);
+      index = intptr_t(v);
+    }
+    else
+    {
+      int32_t v;
+      memcpy(&v, index_bytes + lane * 4, sizeof v);
+      index = intptr_t(v);
+    }
+
+    data_r(ComputeEa(ud, 1, ctx, index), elem_bytes);
+  }
+}
+
+// With `record` false the accesses only update the simulated caches.
+static void GenerateMemoryAccesses(int core_index, const ud_t* ud, uint64_t rip, int ilen, const CONTEXT* ctx, bool record = true)
+{
+  using namespace CacheSim;
+
+  MemOp prefetch_op = { 0, 0 };
+  MemOpList reads;
+  MemOpList writes;
+
+  auto data_r = [&](uintptr_t addr, size_t sz) -> void
+  {
+    if (sz == 0)
+      DebugBreak();
+    if (intptr_t(addr) < 0)
+      DebugBreak();
+    if (addr)
+    {
+      reads.Add(addr, sz);
+    }
+  };
+
+  auto data_w = [&](uintptr_t addr, size_t sz) -> void
+  {
+    if (sz == 0)
+      DebugBreak();
+    if (intptr_t(addr) < 0)
+      DebugBreak();
+    if (addr)
+    {
+      writes.Add(addr, sz);
+    }
+  };
+
+  //const int dir = ctx->EFlags & (1 << 10) ? -1 : 1;
+
+  uint32_t existing_stack_index = s_ThreadState.m_StackIndex;
+
+  // Handle instructions with implicit memory operands.
+  switch (ud->mnemonic)
+  {
+    // String instructions.
+  case UD_Ilodsb:
+  case UD_Iscasb:
+    data_r(ctx->Rsi, 1);
+    break;
+  case UD_Ilodsw:
+  case UD_Iscasw:
+    data_r(ctx->Rsi, 2);
+    break;
+  case UD_Ilodsd:
+  case UD_Iscasd:
+    data_r(ctx->Rsi, 4);
+    break;
+  case UD_Ilodsq:
+  case UD_Iscasq:
+    data_r(ctx->Rsi, 8);
+    break;
+  case UD_Istosb:
+    data_w(ctx->Rdi, 1);
+    break;
+  case UD_Istosw:
+    data_w(ctx->Rdi, 2);
+    break;
+  case UD_Istosd:
+    data_w(ctx->Rdi, 4);
+    break;
+  case UD_Istosq:
+    data_w(ctx->Rdi, 8);
+    break;
+  case UD_Imovsb:
+    data_r(ctx->Rsi, 1);
+    data_w(ctx->Rdi, 1);
+    break;
+  case UD_Imovsw:
+    data_r(ctx->Rsi, 2);
+    data_w(ctx->Rdi, 2);
+    break;
+  case UD_Imovsd:
+    data_r(ctx->Rsi, 4);
+    data_w(ctx->Rdi, 4);
+    break;
+  case UD_Imovsq:
+    data_r(ctx->Rsi, 8);
+    data_w(ctx->Rdi, 8);
+    break;
+
+    // Stack operations.
+  case UD_Ipush:    data_w(ctx->Rsp, ud->operand[0].size / 8); break;
+  case UD_Ipop:     data_w(ctx->Rsp, ud->operand[0].size / 8); break;
+  case UD_Icall:    data_w(ctx->Rsp, 8); InvalidateStack(); break;
+  case UD_Iret:     data_r(ctx->Rsp, 8); InvalidateStack(); break;
+
+  default:
+    break;
+  }
+
+  // Handle special memory ops operands
+  switch (ud->mnemonic)
+  {
+  case UD_Ipause:
+    // This helps to avoid deadlocks.
+  {
+    static volatile int32_t do_ms_step = 0;
+    int32_t val = AtomicIncrement(&do_ms_step);
+    SleepMilliseconds((val & 0x1fff) == 0 ? 1 : 0);
+  }
+  break;
+  case UD_Ilea:
+  case UD_Inop:
+    // LEA doesn't actually access memory even though it has memory operands.
+    // There also seem to be NOPs that do crazy things with memory operands.
     break;
-  case UD_Ilodsw:
-  case UD_Iscasw:
-    data_r(ctx->Rsi, 2);
+  case UD_Iprefetch:
+  case UD_Iprefetchnta:
+  case UD_Iprefetcht0:
+  case UD_Iprefetcht1:
+  case UD_Iprefetcht2:
+    prefetch_op.ea = ComputeEa(ud, 0, ctx);
+    prefetch_op.sz = 64;
     break;
-  case UD_Ilodsd:
-  case UD_Iscasd:
-    data_r(ctx->Rsi, 4);
+
+  case UD_Imovntq:
+    // TODO: Handle this specially?
+    data_w(ComputeEa(ud, 0, ctx), 8);
     break;
-  case UD_Ilodsq:
-  case UD_Iscasq:
-    data_r(ctx->Rsi, 8);
+
+  case UD_Imovntdq:
+  case UD_Imovntdqa:
+    // TODO: Handle this specially?
+    data_w(ComputeEa(ud, 0, ctx), 16);
     break;
-  case UD_Istosb:
-    data_w(ctx->Rdi, 1);
+
+  case UD_Ifxsave:
+    data_w(ComputeEa(ud, 0, ctx), 512);
     break;
-  case UD_Istosw:
-    data_w(ctx->Rdi, 2);
+
+  case UD_Ifxrstor:
+    data_r(ComputeEa(ud, 0, ctx), 512);
     break;
-  case UD_Istosd:
-    data_w(ctx->Rdi, 4);
+
+  // The disassembler gives the x87 environment and state operands no size. swapcontext() uses these.
+  case UD_Ifnstenv:
+    data_w(ComputeEa(ud, 0, ctx), 28);
     break;
-  case UD_Istosq:
-    data_w(ctx->Rdi, 8);
+
+  case UD_Ifldenv:
+    data_r(ComputeEa(ud, 0, ctx), 28);
     break;
-  case UD_Imovsb:
-    data_r(ctx->Rsi, 1);
-    data_w(ctx->Rdi, 1);
+
+  case UD_Ifnsave:
+    data_w(ComputeEa(ud, 0, ctx), 108);
     break;
-  case UD_Imovsw:
-    data_r(ctx->Rsi, 2);
-    data_w(ctx->Rdi, 2);
+
+  case UD_Ifrstor:
+    data_r(ComputeEa(ud, 0, ctx), 108);
     break;
-  case UD_Imovsd:
-    data_r(ctx->Rsi, 4);
-    data_w(ctx->Rdi, 4);
+
+  // The XSAVE area size depends on the enabled state components. Model the legacy area, the header and the
+  // AVX state, which is everything Jaguar has. The dynamic linker's lazy binding trampoline uses these.
+  case UD_Ixsave:
+    data_w(ComputeEa(ud, 0, ctx), 512 + 64 + 256);
     break;
-  case UD_Imovsq:
-    data_r(ctx->Rsi, 8);
-    data_w(ctx->Rdi, 8);
+
+  case UD_Ixrstor:
+    data_r(ComputeEa(ud, 0, ctx), 512 + 64 + 256);
+    break;
+
+  case UD_Ivgatherdps:
+  case UD_Ivgatherdpd:
+  case UD_Ivgatherqps:
+  case UD_Ivgatherqpd:
+  case UD_Ivpgatherdd:
+  case UD_Ivpgatherdq:
+  case UD_Ivpgatherqd:
+  case UD_Ivpgatherqq:
+    GenerateGatherAccesses(ud, ctx, data_r);
     break;
 
-    // Stack operations.
-  case UD_Ipush:    data_w(ctx->Rsp, ud->operand[0].size / 8); break;
-  case UD_Ipop:     data_w(ctx->Rsp, ud->operand[0].size / 8); break;
-  case UD_Icall:    data_w(ctx->Rsp, 8); InvalidateStack(); break;
-  case UD_Iret:     data_r(ctx->Rsp, 8); InvalidateStack(); break;
+  default:
+    for (int op = 0; op < int(ARRAY_SIZE(ud->operand)) && ud->operand[op].type != UD_NONE; ++op)
+    {
+      if (UD_OP_MEM != ud->operand[op].type)
+        continue;
+
+      // Read-modify-write operands generate both a read and a write.
+      if (ud->operand[op].access & UD_OP_ACCESS_READ)
+        data_r(ComputeEa(ud, op, ctx), ud->operand[op].size / 8);
+      if (ud->operand[op].access & UD_OP_ACCESS_WRITE)
+        data_w(ComputeEa(ud, op, ctx), ud->operand[op].size / 8);
+    }
+  }
+
+#if 0
+  // This is a good thing to have while developing, but not in production.
+  // It's not safe to call printf() here, because the thread we're tracing might be inside printf() too.
+  // Hello reentrancy.
+  static volatile int64_t insns = 0;
+  int64_t count = AtomicInc64(&insns);
+  if (0 == (count % 1'000'000))
+  {
+    printf("%lld million instructions traced\n", count / 1'000'000);
+  }
+#endif
+
+  MissAttribution misses;
+  ConfigAccessStage config_stage;
+
+  // Commit stats for this instruction in a critical section.
+  AutoSpinLock lock;
+
+  if (!g_TraceEnabled)
+    return;
+
+  // Find stats line for the instruction pointer. Instructions in the warmup part of a sampling window only
+  // warm the caches, their stats are thrown away.
+  const bool sampling = 0 != s_ThreadState.m_SampleRemaining;
+  const bool warming_up = s_ThreadState.m_SampleRemaining > g_Sampling.m_MeasureInstructions;
+  const bool keep_stats = record && !warming_up;
+
+  RipStats discarded_stats;
+  RipStats* stats = keep_stats ? GetRipNode(rip, existing_stack_index, s_ThreadState.m_FiberId) : &discarded_stats;
+
+  DataLineRecorder line_recorder(rip, core_index);
+  LineObserver* data_observer = keep_stats && DataLineRecorder::IsEnabled() ? &line_recorder : nullptr;
+
+  RipStats stats_before;
+  if (sampling && keep_stats)
+  {
+    stats_before = *stats;
+  }
+
+  stats->m_Stats[CacheSim::kInstructionsExecuted] += 1;
+
+  // Simulate the code fetch, the prefetch and the data accesses as one batch, so the simulator can overlap its
+  // own cache misses.
+  CacheSim::CacheAccess batch[2 + 2 * MemOpList::kCapacity];
+  CacheSim::AccessResult results[2 + 2 * MemOpList::kCapacity];
+  int batch_count = 0;
+
+  auto add_access = [&](uintptr_t addr, size_t size, CacheSim::AccessMode mode, bool observe)
+  {
+    CacheSim::CacheAccess& access = batch[batch_count++];
+    access.m_Addr = addr;
+    access.m_Size = uint32_t(size);
+    access.m_CoreIndex = uint8_t(core_index);
+    access.m_Mode = uint8_t(mode);
+    access.m_Observe = observe;
+  };
+
+  add_access(rip, ilen, CacheSim::kCodeRead, false);
+  if (prefetch_op.ea)
+    add_access(prefetch_op.ea, prefetch_op.sz, CacheSim::kRead, false);
+  for (int i = 0; i < reads.m_Count; ++i)
+    add_access(reads.m_Ops[i].ea, reads.m_Ops[i].sz, CacheSim::kRead, true);
+  for (int i = 0; i < writes.m_Count; ++i)
+    add_access(writes.m_Ops[i].ea, writes.m_Ops[i].sz, CacheSim::kWrite, true);
+
+  g_Cache.AccessBatch(batch, batch_count, results, data_observer);
+
+  // I-cache traffic.
+  int result_index = 0;
+  stats->m_Stats[results[result_index++]] += 1;
+
+  // Pretend prefetches are immediate reads and record how effective they were.
+  if (prefetch_op.ea)
+  {
+    switch (results[result_index++])
+    {
+    case CacheSim::kD1Hit:
+      stats->m_Stats[CacheSim::kPrefetchHitD1] += 1;
+      break;
+    case CacheSim::kL2Hit:
+      stats->m_Stats[CacheSim::kPrefetchHitL2] += 1;
+      break;
+    default:
+      break;
+    }
+  }
+
+  // D-cache traffic.
+  for (; result_index < batch_count; ++result_index)
+  {
+    CacheSim::AccessResult r = results[result_index];
+    stats->m_Stats[r] += 1;
+    if (CacheSim::kL2DMiss == r && keep_stats)
+      misses.Add(batch[result_index].m_Addr);
+  }
+
+  if (keep_stats && s_WorkingSetInterval)
+    CountWorkingSetInstruction();
+
+  // Replay the same accesses in the alternative cache configurations.
+  if (s_ConfigWorkerCount)
+  {
+    const uint8_t flags = keep_stats ? kConfigAccessRecord : 0;
+
+    PushConfigAccess(&config_stage, core_index, rip, rip, ilen, CacheSim::kCodeRead, flags | kConfigAccessInstruction);
+    if (prefetch_op.ea)
+      PushConfigAccess(&config_stage, core_index, rip, prefetch_op.ea, prefetch_op.sz, CacheSim::kRead, flags | kConfigAccessPrefetch);
+    for (int i = 0; i < reads.m_Count; ++i)
+      PushConfigAccess(&config_stage, core_index, rip, reads.m_Ops[i].ea, reads.m_Ops[i].sz, CacheSim::kRead, flags);
+    for (int i = 0; i < writes.m_Count; ++i)
+      PushConfigAccess(&config_stage, core_index, rip, writes.m_Ops[i].ea, writes.m_Ops[i].sz, CacheSim::kWrite, flags);
+  }
+
+  if (sampling && keep_stats)
+  {
+    for (int i = 0; i < kAccessResultCount; ++i)
+    {
+      s_ThreadState.m_SampleStats[i] += stats->m_Stats[i] - stats_before.m_Stats[i];
+    }
+  }
+}
+
+// Called by the platform layer when the calling thread has recorded the last instruction of a sampling window.
+static void EndSampleWindow()
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (g_SampleWindows.m_Count == g_SampleWindows.m_ReserveCount)
+  {
+    uint32_t new_reserve = g_SampleWindows.m_ReserveCount ? 2 * g_SampleWindows.m_ReserveCount : 4096;
+    if (g_SampleWindows.m_Windows)
+    {
+      g_SampleWindows.m_Windows = (RipStats*)VirtualMemoryRealloc(g_SampleWindows.m_Windows,
+                                                                  g_SampleWindows.m_ReserveCount * sizeof(RipStats),
+                                                                  new_reserve * sizeof(RipStats));
+    }
+    else
+    {
+      g_SampleWindows.m_Windows = (RipStats*)VirtualMemoryAlloc(new_reserve * sizeof(RipStats));
+    }
+
+    g_SampleWindows.m_ReserveCount = new_reserve;
+  }
+
+  memcpy(g_SampleWindows.m_Windows[g_SampleWindows.m_Count++].m_Stats, s_ThreadState.m_SampleStats, sizeof s_ThreadState.m_SampleStats);
+  memset(s_ThreadState.m_SampleStats, 0, sizeof s_ThreadState.m_SampleStats);
+}
+
+// Mean and 95% confidence interval half width of a per-window rate, using the normal approximation.
+static void SampleRate(CacheSim::AccessResult result, double* mean, double* error)
+{
+  using namespace CacheSim;
+
+  const uint32_t n = g_SampleWindows.m_Count;
+  double sum = 0.0, sum_sq = 0.0;
+
+  for (uint32_t i = 0; i < n; ++i)
+  {
+    // Per measured instruction, whether it was recorded or not, like the scaled statistics. Warmup isn't measured.
+    const uint32_t* stats = g_SampleWindows.m_Windows[i].m_Stats;
+    double rate = 1000.0 * stats[result] / g_Sampling.m_MeasureInstructions;
+    sum += rate;
+    sum_sq += rate * rate;
+  }
+
+  *mean = n ? sum / n : 0.0;
+  *error = 0.0;
+
+  if (n > 1)
+  {
+    double variance = (sum_sq - n * *mean * *mean) / (n - 1);
+    *error = 1.96 * sqrt(variance > 0.0 ? variance / n : 0.0);
+  }
+}
+
+// Summarizes the windows of a sampled capture. The platform layer has filled in m_EstimatedInstructions already.
+static void FinishSampling()
+{
+  using namespace CacheSim;
+
+  SamplingSummary& summary = g_SamplingSummary;
+  summary.m_WindowCount = g_SampleWindows.m_Count;
+
+  // Windows only end once their measurement part has run, skipped and unrecorded instructions included. Those stand
+  // for all the instructions executed, the warmup ones too, as the warmup's statistics are thrown away.
+  summary.m_MeasuredInstructions = uint64_t(g_SampleWindows.m_Count) * g_Sampling.m_MeasureInstructions;
+
+  summary.m_Scale = 1.0;
+  if (summary.m_EstimatedInstructions && summary.m_MeasuredInstructions)
+  {
+    summary.m_Scale = double(summary.m_EstimatedInstructions) / summary.m_MeasuredInstructions;
+  }
+
+  SampleRate(kL2Hit, &summary.m_L2HitsPerKI, &summary.m_L2HitsPerKIError);
+  SampleRate(kL2IMiss, &summary.m_L2IMissesPerKI, &summary.m_L2IMissesPerKIError);
+  SampleRate(kL2DMiss, &summary.m_L2DMissesPerKI, &summary.m_L2DMissesPerKIError);
+
+  if (g_SampleWindows.m_Windows)
+  {
+    VirtualMemoryFree(g_SampleWindows.m_Windows, g_SampleWindows.m_ReserveCount * sizeof(RipStats));
+  }
+  memset(&g_SampleWindows, 0, sizeof g_SampleWindows);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Thread to core mapping. Threads mapped with CacheSimSetThreadCoreMapping() keep their core. Other threads
+// get one from the policy set with CacheSimSetThreadCorePolicy(), when the capture starts or the first time
+// they trap during it, and lose it when the capture ends.
+
+// Implemented by the platform layer. They return false or -1 if the information isn't available.
+static bool GetThreadName(uint64_t thread_id, char* name, size_t name_size);
+static int GetThreadFirstCpu(uint64_t thread_id);
+static int GetCurrentCpu();
+
+namespace CacheSim
+{
+  enum
+  {
+    kLogicalCoreCount = 8,                ///< Cores the Jaguar simulation distinguishes
+    kMaxThreadNameRules = 64,
+    kNameRuleRetryInterval = 4096,        ///< Traps between looking at the name of a thread no rule matched again
+  };
+
+  struct ThreadNameRule
+  {
+    char  m_Prefix[32];
+    int   m_LogicalCore;
+  };
+
+  static int s_ThreadCorePolicy = kThreadCoreExplicit;
+  static ThreadNameRule s_ThreadNameRules[kMaxThreadNameRules];
+  static int s_ThreadNameRuleCount = 0;
+  static int s_NextAutoCore = 0;
+  static bool s_FollowScheduling = false;
+}
+
+// Picks a core for a thread without an explicit mapping, or -1 to leave it untraced. Must be called with g_Lock held.
+static int ChooseLogicalCore(uint64_t thread_id)
+{
+  using namespace CacheSim;
+
+  switch (s_ThreadCorePolicy)
+  {
+  case kThreadCoreRoundRobin:
+    return s_NextAutoCore++ % kLogicalCoreCount;
+
+  case kThreadCoreByName:
+    {
+      char name[64];
+      if (!GetThreadName(thread_id, name, sizeof name))
+        return -1;
+
+      // The first matching rule wins.
+      for (int i = 0; i < s_ThreadNameRuleCount; ++i)
+      {
+        const ThreadNameRule& rule = s_ThreadNameRules[i];
+        if (0 == strncmp(name, rule.m_Prefix, strlen(rule.m_Prefix)))
+          return rule.m_LogicalCore;
+      }
+      return -1;
+    }
+
+  case kThreadCoreByAffinity:
+    {
+      const int cpu = GetThreadFirstCpu(thread_id);
+      return cpu >= 0 ? cpu % kLogicalCoreCount : -1;
+    }
+
+  default:
+    return -1;
+  }
+}
+
+// Called by the platform layer for every thread of the process when a capture starts, so the threads the
+// policy picks can be set up for tracing along with the explicitly mapped ones.
+static void AssignLogicalCore(uint64_t thread_id)
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  const ThreadIdKey key(thread_id);
+  if (kThreadCoreExplicit == s_ThreadCorePolicy || s_CoreMappings.Find(key) || s_AutoCoreMappings.Find(key) || IsConfigWorkerThread(thread_id))
+    return;
+
+  const int core = ChooseLogicalCore(thread_id);
+  if (core >= 0)
+    *s_AutoCoreMappings.Insert(key) = core;
+}
+
+// Returns the logical core of a thread, or -1 if it isn't traced. Threads first seen during a capture are
+// assigned a core by the policy.
+static int FindLogicalCoreIndex(uint64_t thread_id)
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  const ThreadIdKey key(thread_id);
+  if (const int* core = s_CoreMappings.Find(key))
+    return *core;
+
+  if (const int* core = s_AutoCoreMappings.Find(key))
+    return *core;
+
+  if (!g_TraceEnabled || kThreadCoreExplicit == s_ThreadCorePolicy || IsConfigWorkerThread(thread_id))
+    return -1;
+
+  // Threads are usually named after they start, so names are looked at again later if no rule matched.
+  const int core = ChooseLogicalCore(thread_id);
+  if (core >= 0 || kThreadCoreByName != s_ThreadCorePolicy)
+    *s_AutoCoreMappings.Insert(key) = core;
+
+  return core;
+}
+
+// Whether an untraced thread should look for a core again, see FindLogicalCoreIndex().
+static bool ShouldRetryLogicalCore(uint32_t* countdown)
+{
+  using namespace CacheSim;
+
+  if (kThreadCoreByName != s_ThreadCorePolicy || --*countdown)
+    return false;
+
+  *countdown = kNameRuleRetryInterval;
+  return true;
+}
+
+// Returns the core of the calling thread for the next instruction. With CacheSimSetFollowScheduling() on,
+// traced threads move to the core of the CPU they run on.
+static int UpdateScheduledCore()
+{
+  using namespace CacheSim;
+
+  if (s_FollowScheduling && s_ThreadState.m_LogicalCoreIndex >= 0)
+  {
+    const int cpu = GetCurrentCpu();
+    if (cpu >= 0)
+      s_ThreadState.m_LogicalCoreIndex = cpu % kLogicalCoreCount;
+  }
+
+  return s_ThreadState.m_LogicalCoreIndex;
+}
+
+// Calls `fn(thread_id, logical_core)` for every traced thread, explicit mappings first. Must be called with g_Lock held,
+// or while no thread can trap.
+template <typename Fn>
+static void ForEachMappedThread(Fn fn)
+{
+  using namespace CacheSim;
+
+  for (const ThreadIdKey& key : s_CoreMappings.Keys())
+  {
+    fn(key.m_ThreadId, *s_CoreMappings.Find(key));
+  }
+
+  for (const ThreadIdKey& key : s_AutoCoreMappings.Keys())
+  {
+    const int core = *s_AutoCoreMappings.Find(key);
+    if (core >= 0 && !s_CoreMappings.Find(key))
+      fn(key.m_ThreadId, core);
+  }
+}
+
+static int CountMappedThreads()
+{
+  int count = 0;
+  ForEachMappedThread([&](uint64_t, int) { ++count; });
+  return count;
+}
+
+// Forgets the cores the policy picked, when the capture ends.
+static void FreeAutoCoreMappings()
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+  s_AutoCoreMappings.FreeAll();
+  s_NextAutoCore = 0;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+void CacheSimSetThreadCoreMapping(uint64_t thread_id, int logical_core_id)
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (logical_core_id == -1)
+  {
+    // Remove the mapping
+    s_CoreMappings.Remove(ThreadIdKey(thread_id));
+    return;
   }
 
-  // Handle special memory ops operands
-  switch (ud->mnemonic)
+  *s_CoreMappings.Insert(ThreadIdKey(thread_id)) = logical_core_id;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+bool CacheSimSetThreadCorePolicy(int policy)
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (g_TraceEnabled || policy < kThreadCoreExplicit || policy > kThreadCoreByAffinity)
+    return false;
+
+  s_ThreadCorePolicy = policy;
+  return true;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+bool CacheSimAddThreadNameCoreMapping(const char* name_prefix, int logical_core_id)
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (g_TraceEnabled || s_ThreadNameRuleCount == kMaxThreadNameRules || logical_core_id < 0 ||
+      !name_prefix || strlen(name_prefix) >= sizeof s_ThreadNameRules[0].m_Prefix)
+    return false;
+
+  ThreadNameRule& rule = s_ThreadNameRules[s_ThreadNameRuleCount++];
+  strcpy(rule.m_Prefix, name_prefix);
+  rule.m_LogicalCore = logical_core_id;
+  return true;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+void CacheSimClearThreadNameCoreMappings()
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (!g_TraceEnabled)
+    s_ThreadNameRuleCount = 0;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+bool CacheSimSetFollowScheduling(bool enable)
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (g_TraceEnabled || (enable && GetCurrentCpu() < 0))
+    return false;
+
+  s_FollowScheduling = enable;
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Fibers. Call stacks are only recomputed after calls and returns, so a thread that switches stacks in between
+// would go on charging its accesses to the stack it left. The stack pointer leaving the thread's own stack, or a
+// move between other stacks further than any stack frame plausibly goes, is taken as a switch to another fiber, as
+// is any move of a page or more after CacheSimFiberSwitch(); see IsStackSwitch(). The fiber switched away from is remembered with its stack pointer, which is where it will be when it's resumed,
+// possibly on another thread, and its call stack. Its call stack is restored rather than recomputed, as unwinding
+// in the middle of the switch code doesn't work.
+
+// Implemented by the platform layer. They keep the shadow stack of the running fiber in the suspended fiber slot, and
+// restore it, or start an empty one for a slot of -1.
+static void SaveFiberShadowStack(uint32_t slot);
+static void RestoreFiberShadowStack(int slot);
+
+// Also implemented by the platform layer. Finds the bounds of the stack holding `rsp` and of the thread's alternate
+// signal stack, leaving either empty if it can't tell.
+static void GetThreadStacks(uintptr_t rsp, CacheSim::AddressRange* stack, CacheSim::AddressRange* signal_stack);
+
+namespace CacheSim
+{
+  enum
   {
-  case UD_Ipause:
-    // This helps to avoid deadlocks.
+    kMaxSuspendedFibers = 1024,           ///< The least recently suspended fibers are forgotten beyond this
+    kFiberResumeSlack = 256,              ///< How far from its stack pointer at suspension a fiber may resume
+  };
+
+  struct SuspendedFiber
   {
-    static volatile int32_t do_ms_step = 0;
-    int32_t val = AtomicIncrement(&do_ms_step);
-    SleepMilliseconds((val & 0x1fff) == 0 ? 1 : 0);
+    uintptr_t   m_Rsp;                    ///< 0 for a free slot
+    uint32_t    m_FiberId;
+    uint32_t    m_StackIndex;
+    uint32_t    m_Age;                    ///< Order of suspension, to pick a slot to reuse
+  };
+
+  /// Protected by g_Lock.
+  static SuspendedFiber s_SuspendedFibers[kMaxSuspendedFibers];
+  static uint32_t s_SuspendedFiberCount;  ///< Slots ever used, all free slots beyond this
+  static uint32_t s_FiberSuspendCount;
+}
+
+static int FindSuspendedFiber(uintptr_t rsp)
+{
+  using namespace CacheSim;
+
+  int best = -1;
+  uintptr_t best_distance = kFiberResumeSlack + 1;
+  for (uint32_t i = 0; i < s_SuspendedFiberCount; ++i)
+  {
+    const uintptr_t fiber_rsp = s_SuspendedFibers[i].m_Rsp;
+    const uintptr_t distance = fiber_rsp > rsp ? fiber_rsp - rsp : rsp - fiber_rsp;
+    if (fiber_rsp && distance < best_distance)
+    {
+      best = int(i);
+      best_distance = distance;
+    }
   }
-  break;
-  case UD_Ilea:
-  case UD_Inop:
-    // LEA doesn't actually access memory even though it has memory operands.
-    // There also seem to be NOPs that do crazy things with memory operands.
-    break;
-  case UD_Iprefetch:
-  case UD_Iprefetchnta:
-  case UD_Iprefetcht0:
-  case UD_Iprefetcht1:
-  case UD_Iprefetcht2:
-    prefetch_op.ea = ComputeEa(ud, 0, ctx);
-    prefetch_op.sz = 64;
-    break;
+  return best;
+}
 
-  case UD_Imovntq:
-    // TODO: Handle this specially?
-    data_w(ComputeEa(ud, 0, ctx), 8);
-    break;
+// Picks a slot for a fiber being suspended: a free one, or else the one suspended longest ago. Never `keep`.
+static uint32_t AllocSuspendedFiber(int keep)
+{
+  using namespace CacheSim;
 
-  case UD_Imovntdq:
-  case UD_Imovntdqa:
-    // TODO: Handle this specially?
-    data_w(ComputeEa(ud, 0, ctx), 16);
-    break;
+  uint32_t oldest = ~0u;
+  for (uint32_t i = 0; i < s_SuspendedFiberCount; ++i)
+  {
+    if (int(i) == keep)
+      continue;
+    if (!s_SuspendedFibers[i].m_Rsp)
+      return i;
+    if (~0u == oldest || s_SuspendedFibers[i].m_Age < s_SuspendedFibers[oldest].m_Age)
+      oldest = i;
+  }
 
-  case UD_Ifxsave:
-    data_w(ComputeEa(ud, 0, ctx), 512);
-    break;
+  if (s_SuspendedFiberCount < kMaxSuspendedFibers)
+    return s_SuspendedFiberCount++;
 
-  case UD_Ifxrstor:
-    data_r(ComputeEa(ud, 0, ctx), 512);
-    break;
+  return oldest;
+}
+
+// Called with the stack pointer of every traced instruction, before its call stack is looked at.
+static void TrackFiberSwitch(uintptr_t rsp)
+{
+  using namespace CacheSim;
+
+  const uintptr_t last_rsp = s_ThreadState.m_LastRsp;
+  s_ThreadState.m_LastRsp = rsp;
+
+  if (!last_rsp)
+  {
+    GetThreadStacks(rsp, &s_ThreadState.m_ThreadStack, &s_ThreadState.m_SignalStack);
+    return;
+  }
+
+  if (!IsStackSwitch(last_rsp, rsp, s_ThreadState.m_FiberSwitchPending, s_ThreadState.m_ThreadStack, s_ThreadState.m_SignalStack))
+    return;
+
+  {
+    AutoSpinLock lock;
+
+    const int resumed = FindSuspendedFiber(rsp);
+    const uint32_t slot = AllocSuspendedFiber(resumed);
+
+    SuspendedFiber& suspended = s_SuspendedFibers[slot];
+    suspended.m_Rsp = last_rsp;
+    suspended.m_FiberId = s_ThreadState.m_FiberId;
+    suspended.m_StackIndex = s_ThreadState.m_StackIndex;
+    suspended.m_Age = s_FiberSuspendCount++;
+    SaveFiberShadowStack(slot);
+
+    RestoreFiberShadowStack(resumed);
+    if (resumed >= 0)
+    {
+      s_ThreadState.m_FiberId = s_SuspendedFibers[resumed].m_FiberId;
+      s_ThreadState.m_StackIndex = s_SuspendedFibers[resumed].m_StackIndex;
+      s_SuspendedFibers[resumed].m_Rsp = 0;
+    }
+    else
+    {
+      // A fiber starting, or one suspended before the capture. Its frames are found after the next call or return.
+      const uintptr_t no_frames[1] = { 0 };
+      s_ThreadState.m_FiberId = 0;
+      s_ThreadState.m_StackIndex = InsertStack(no_frames, 0);
+    }
+  }
+
+  if (s_ThreadState.m_FiberSwitchPending)
+  {
+    s_ThreadState.m_FiberId = s_ThreadState.m_PendingFiberId;
+    s_ThreadState.m_FiberSwitchPending = false;
+  }
+}
+
+// Forgets the suspended fibers when the capture ends, as they may be resumed untraced.
+static void FreeSuspendedFibers()
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+  memset(s_SuspendedFibers, 0, sizeof s_SuspendedFibers);
+  s_SuspendedFiberCount = 0;
+  s_FiberSuspendCount = 0;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+void CacheSimFiberSwitch(uint32_t fiber_id)
+{
+  using namespace CacheSim;
+
+  if (g_TraceEnabled && s_ThreadState.m_Generation == g_Generation && s_ThreadState.m_LogicalCoreIndex >= 0)
+  {
+    // The switch is seen when the stack pointer moves.
+    s_ThreadState.m_PendingFiberId = fiber_id;
+    s_ThreadState.m_FiberSwitchPending = true;
+  }
+  else
+  {
+    s_ThreadState.m_FiberId = fiber_id;
+  }
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+bool CacheSimGetSamplingSummary(CacheSim::SamplingSummary* summary)
+{
+  using namespace CacheSim;
+
+  if (!g_Sampling.m_PeriodUs || g_TraceEnabled)
+    return false;
+
+  *summary = g_SamplingSummary;
+  return true;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+void CacheSimOnAlloc(const void* ptr, size_t size, const char* tag)
+{
+  using namespace CacheSim;
+
+  // Ignore allocations made while capturing the stack.
+  if (!ptr || s_ThreadState.m_InAllocHook)
+    return;
+
+  uintptr_t frames[kMaxAllocFrames + 1];
+  s_ThreadState.m_InAllocHook = true;
+  int frame_count = CaptureAllocStack(frames, kMaxAllocFrames);
+  s_ThreadState.m_InAllocHook = false;
+
+  AutoAllocLock lock;
+  uint32_t site = FindAllocSite(frames, frame_count, FindAllocTag(tag));
+  AddLiveAllocation(uintptr_t(ptr), size, site);
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+void CacheSimOnFree(const void* ptr)
+{
+  using namespace CacheSim;
+
+  if (!ptr || s_ThreadState.m_InAllocHook)
+    return;
+
+  AutoAllocLock lock;
+  RemoveLiveAllocation(uintptr_t(ptr));
+}
+
+struct ModuleInfo
+{
+  char m_Filename[512];
+  void* m_StartAddrInMemory;
+  void* m_SegmentOffset;
+  size_t m_Length;
+};
+
+struct ModuleList
+{
+  ModuleInfo m_Infos[1024];
+  int m_Count = 0;
+  int m_ModuleCallbacks = 0;
+};
+
+static ModuleList g_ModuleList;
+
+static void ClearModuleList()
+{
+  // Value-initialize in place; the list is too large for a temporary on the stack.
+  new (&g_ModuleList) ModuleList();
+}
+
+static void DisableTrapFlag();
+static void GetFilenameForSave(char* filename, size_t bufferSize);
+static void GetModuleList(ModuleList* moduleList);
+static void OnCaptureSaved(const char* filename);
+
+namespace CacheSim
+{
+  /// A filter added with CacheSimAddModuleFilter() or CacheSimAddAddressFilter().
+  struct FilterRule
+  {
+    uintptr_t   m_Start;
+    uintptr_t   m_End;
+    int         m_Action;
+    char        m_Module[256];            ///< Module file name or path, empty for address filters
+  };
+
+  /// A range of code with a filter action other than the default. Sorted and disjoint.
+  struct FilterRange
+  {
+    uintptr_t   m_Start;
+    uintptr_t   m_End;
+    int         m_Action;
+  };
+
+  static FilterRule s_FilterRules[256];
+  static int s_FilterRuleCount = 0;
+  static int s_DefaultFilterAction = kFilterTrace;
+
+  static FilterRange s_FilterRanges[2 * ARRAY_SIZE(s_FilterRules) + 1];
+  static int s_FilterRangeCount = 0;
+
+  /// Bumped whenever the resolved ranges change, so translated code can tell it's stale.
+  static uint32_t s_FilterGeneration = 0;
+  static bool s_FiltersDirty = false;       ///< The rules or the default action changed since the last resolve
+  static int s_ModuleFilterCount = 0;       ///< Rules in s_FilterRules that name a module
+}
+
+static bool IsValidFilterAction(int action)
+{
+  return action >= CacheSim::kFilterTrace && action <= CacheSim::kFilterSkip;
+}
+
+static CacheSim::FilterRule* AddFilterRule(int action)
+{
+  using namespace CacheSim;
+
+  if (g_TraceEnabled || !IsValidFilterAction(action) || ARRAY_SIZE(s_FilterRules) == s_FilterRuleCount)
+    return nullptr;
+
+  FilterRule* rule = &s_FilterRules[s_FilterRuleCount++];
+  memset(rule, 0, sizeof *rule);
+  rule->m_Action = action;
+  s_FiltersDirty = true;
+  return rule;
+}
+
+static bool ModuleNameMatches(const char* path, const char* name)
+{
+  if (0 == strcmp(path, name))
+    return true;
+
+  const char* file_name = path;
+  for (const char* p = path; *p; ++p)
+  {
+    if ('/' == *p || '\\' == *p)
+      file_name = p + 1;
+  }
+
+  return 0 == strcmp(file_name, name);
+}
+
+// Turns the filter rules into sorted, disjoint ranges. Later rules win where they overlap.
+// Called when every capture starts, as the modules named by module rules may have been loaded, unloaded or moved
+// since the last one. Modules loaded during a capture aren't filtered.
+static void ResolveFilters()
+{
+  using namespace CacheSim;
+
+  if (!s_FiltersDirty && !s_ModuleFilterCount)
+    return;
+
+  static FilterRange ranges[ARRAY_SIZE(s_FilterRanges)];
+  int range_count = 0;
+
+  // Module rules can match several modules, so resolve everything to plain ranges first.
+  static FilterRule resolved[ARRAY_SIZE(s_FilterRules)];
+  int resolved_count = 0;
+
+  ClearModuleList();
+  GetModuleList(&g_ModuleList);
 
-  default:
-    for (int op = 0; op < ARRAY_SIZE(ud->operand) && ud->operand[op].type != UD_NONE; ++op)
+  for (int i = 0; i < s_FilterRuleCount; ++i)
+  {
+    const FilterRule& rule = s_FilterRules[i];
+    if (!rule.m_Module[0])
     {
-      if (UD_OP_MEM != ud->operand[op].type)
+      if (resolved_count < int(ARRAY_SIZE(resolved)))
+        resolved[resolved_count++] = rule;
+      continue;
+    }
+
+    for (int m = 0; m < g_ModuleList.m_Count; ++m)
+    {
+      const ModuleInfo& module = g_ModuleList.m_Infos[m];
+      if (!ModuleNameMatches(module.m_Filename, rule.m_Module) || resolved_count == int(ARRAY_SIZE(resolved)))
         continue;
 
-      switch (ud->operand[op].access)
-      {
-      case UD_OP_ACCESS_READ:
-        data_r(ComputeEa(ud, op, ctx), ud->operand[op].size / 8);
-        break;
-      case UD_OP_ACCESS_WRITE:
-        data_w(ComputeEa(ud, op, ctx), ud->operand[op].size / 8);
-        break;
-      }
+      FilterRule& range = resolved[resolved_count++];
+      range.m_Start = uintptr_t(module.m_StartAddrInMemory) + uintptr_t(module.m_SegmentOffset);
+      range.m_End = range.m_Start + module.m_Length;
+      range.m_Action = rule.m_Action;
+      range.m_Module[0] = '\0';
     }
   }
 
-#if 0
-  // This is a good thing to have while developing, but not in production.
-  // It's not safe to call printf() here, because the thread we're tracing might be inside printf() too.
-  // Hello reentrancy.
-  static volatile int64_t insns = 0;
-  int64_t count = AtomicInc64(&insns);
-  if (0 == (count % 1'000'000))
+  ClearModuleList();
+
+  // Split the address space at every range boundary and give each piece the action of the last rule covering it.
+  static uintptr_t bounds[2 * ARRAY_SIZE(s_FilterRules)];
+  int bound_count = 0;
+  for (int i = 0; i < resolved_count; ++i)
   {
-    printf("%lld million instructions traced\n", count / 1'000'000);
+    bounds[bound_count++] = resolved[i].m_Start;
+    bounds[bound_count++] = resolved[i].m_End;
   }
-#endif
-
-  // Commit stats for this instruction in a critical section.
-  AutoSpinLock lock;
-
-  if (!g_TraceEnabled)
-    return;
+  std::sort(bounds, bounds + bound_count);
 
-  // Find stats line for the instruction pointer
-  RipStats* stats = GetRipNode(rip, existing_stack_index);
-
-  stats->m_Stats[CacheSim::kInstructionsExecuted] += 1;
-
-  // Generate I-cache traffic.
+  for (int b = 0; b + 1 < bound_count; ++b)
   {
-    CacheSim::AccessResult r = g_Cache.Access(core_index, rip, ilen, CacheSim::kCodeRead);
-    stats->m_Stats[r] += 1;
+    const uintptr_t start = bounds[b], end = bounds[b + 1];
+    if (start == end)
+      continue;
 
-    // Generate prefetch traffic. Pretend prefetches are immediate reads and record how effective they were.
-    if (prefetch_op.ea)
+    int action = s_DefaultFilterAction;
+    for (int i = resolved_count - 1; i >= 0; --i)
     {
-      switch (g_Cache.Access(core_index, prefetch_op.ea, prefetch_op.sz, CacheSim::kRead))
+      if (resolved[i].m_Start <= start && end <= resolved[i].m_End)
       {
-      case CacheSim::kD1Hit:
-        stats->m_Stats[CacheSim::kPrefetchHitD1] += 1;
-        break;
-      case CacheSim::kL2Hit:
-        stats->m_Stats[CacheSim::kPrefetchHitL2] += 1;
+        action = resolved[i].m_Action;
         break;
       }
     }
+
+    if (action == s_DefaultFilterAction)
+      continue;
+
+    FilterRange* last = range_count ? &ranges[range_count - 1] : nullptr;
+    if (last && last->m_End == start && last->m_Action == action)
+    {
+      last->m_End = end;
+    }
+    else
+    {
+      FilterRange& range = ranges[range_count++];
+      range.m_Start = start;
+      range.m_End = end;
+      range.m_Action = action;
+    }
   }
 
-  // Generate D-cache traffic.
-  for (int i = 0; i < read_count; ++i)
+  // Code translated for the old ranges may have the wrong action baked in.
+  bool changed = s_FiltersDirty || range_count != s_FilterRangeCount;
+  for (int i = 0; i < range_count && !changed; ++i)
   {
-    CacheSim::AccessResult r = g_Cache.Access(core_index, reads[i].ea, reads[i].sz, CacheSim::kRead);
-    stats->m_Stats[r] += 1;
+    changed = ranges[i].m_Start != s_FilterRanges[i].m_Start || ranges[i].m_End != s_FilterRanges[i].m_End ||
+              ranges[i].m_Action != s_FilterRanges[i].m_Action;
   }
 
-  for (int i = 0; i < write_count; ++i)
+  if (changed)
   {
-    CacheSim::AccessResult r = g_Cache.Access(core_index, writes[i].ea, writes[i].sz, CacheSim::kWrite);
-    stats->m_Stats[r] += 1;
+    ++s_FilterGeneration;
+    memcpy(s_FilterRanges, ranges, range_count * sizeof ranges[0]);
+    s_FilterRangeCount = range_count;
   }
+
+  s_FiltersDirty = false;
 }
 
-static int FindLogicalCoreIndex(uint64_t thread_id)
+static int GetFilterAction(uintptr_t rip)
 {
   using namespace CacheSim;
 
-  int count = s_CoreMappingCount;
-
-  for (int i = 0; i < count; ++i)
+  // Find the last range starting at or before rip.
+  int lo = 0, hi = s_FilterRangeCount;
+  while (lo < hi)
   {
-    if (s_CoreMappings[i].m_ThreadId == thread_id)
-    {
-      return s_CoreMappings[i].m_LogicalCore;
-    }
+    int mid = (lo + hi) / 2;
+    if (s_FilterRanges[mid].m_Start <= rip)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
 
-  return -1;
+  if (lo > 0 && rip < s_FilterRanges[lo - 1].m_End)
+    return s_FilterRanges[lo - 1].m_Action;
+
+  return s_DefaultFilterAction;
 }
 
 #if defined(_MSC_VER)
 __declspec(dllexport)
 #endif
-void CacheSimSetThreadCoreMapping(uint64_t thread_id, int logical_core_id)
+bool CacheSimAddModuleFilter(const char* module_name, int action)
 {
   using namespace CacheSim;
 
+  if (!module_name || !module_name[0] || strlen(module_name) >= ARRAY_SIZE(s_FilterRules[0].m_Module))
+    return false;
+
   AutoSpinLock lock;
 
-  int count = s_CoreMappingCount;
+  FilterRule* rule = AddFilterRule(action);
+  if (!rule)
+    return false;
 
-  for (int i = 0; i < count; ++i)
-  {
-    if (s_CoreMappings[i].m_ThreadId == thread_id)
-    {
-      if (logical_core_id == -1)
-      {
-        // Remove the mapping
-        s_CoreMappings[i] = s_CoreMappings[count - 1];
-        --s_CoreMappingCount;
-      }
-      else
-      {
-        s_CoreMappings[i].m_LogicalCore = logical_core_id;
-      }
-      return;
-    }
-  }
+  strcpy(rule->m_Module, module_name);
+  ++s_ModuleFilterCount;
+  return true;
+}
 
-  if (count == ARRAY_SIZE(s_CoreMappings))
-  {
-    DebugBreak(); // Increase array size
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+bool CacheSimAddAddressFilter(uint64_t start, uint64_t end, int action)
+{
+  using namespace CacheSim;
+
+  if (start >= end)
+    return false;
+
+  AutoSpinLock lock;
+
+  FilterRule* rule = AddFilterRule(action);
+  if (!rule)
+    return false;
+
+  rule->m_Start = uintptr_t(start);
+  rule->m_End = uintptr_t(end);
+  return true;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+bool CacheSimSetDefaultFilterAction(int action)
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (g_TraceEnabled || !IsValidFilterAction(action))
+    return false;
+
+  s_DefaultFilterAction = action;
+  s_FiltersDirty = true;
+  return true;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+void CacheSimClearFilters()
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (g_TraceEnabled)
     return;
+
+  s_FilterRuleCount = 0;
+  s_ModuleFilterCount = 0;
+  s_DefaultFilterAction = kFilterTrace;
+  s_FiltersDirty = true;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+bool CacheSimSetHeatmapCellSize(uint32_t bytes)
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (g_TraceEnabled)
+    return false;
+
+  if (0 == bytes)
+  {
+    s_HeatmapCellShift = 0;
+    return true;
   }
 
-  s_CoreMappings[count].m_ThreadId = thread_id;
-  s_CoreMappings[count].m_LogicalCore = logical_core_id;
+  if (bytes < 64 || (bytes & (bytes - 1)))
+    return false;
 
-  ++s_CoreMappingCount;
+  uint32_t shift = 0;
+  while ((1u << shift) < bytes)
+    ++shift;
+
+  s_HeatmapCellShift = shift;
+  return true;
 }
 
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+bool CacheSimSetReuseSampling(int32_t shift)
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (g_TraceEnabled || shift < -1 || shift > 16)
+    return false;
 
-struct ModuleInfo
+  s_ReuseSampleShift = shift;
+  return true;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+bool CacheSimSetWorkingSetInterval(uint32_t instructions)
 {
-  char m_Filename[512];
-  void* m_StartAddrInMemory;
-  void* m_SegmentOffset;
-  size_t m_Length;
-};
+  using namespace CacheSim;
 
-struct ModuleList
+  AutoSpinLock lock;
+
+  if (g_TraceEnabled)
+    return false;
+
+  s_WorkingSetInterval = instructions;
+  return true;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+bool CacheSimAddCacheConfig(const CacheSim::CacheConfig* config)
 {
-  ModuleInfo m_Infos[1024];
-  int m_Count = 0;
-  int m_ModuleCallbacks = 0;
-};
+  using namespace CacheSim;
 
-static ModuleList g_ModuleList;
+  AutoSpinLock lock;
 
-static void DisableTrapFlag();
-static void GetFilenameForSave(char* filename, size_t bufferSize);
-static void GetModuleList(ModuleList* moduleList);
+  if (g_TraceEnabled || s_CacheConfigCount == kMaxCacheConfigs || !ConfigurableCacheSim::IsValid(*config, s_ConfigShardShift))
+    return false;
+
+  s_CacheConfigs[s_CacheConfigCount++] = *config;
+  return true;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+void CacheSimClearCacheConfigs()
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (g_TraceEnabled)
+    return;
+
+  s_CacheConfigCount = 0;
+}
+
+#if defined(_MSC_VER)
+__declspec(dllexport)
+#endif
+bool CacheSimSetCacheConfigShards(uint32_t shard_count)
+{
+  using namespace CacheSim;
+
+  AutoSpinLock lock;
+
+  if (g_TraceEnabled || !shard_count || (shard_count & (shard_count - 1)))
+    return false;
+
+  uint32_t shift = 0;
+  while ((1u << shift) < shard_count)
+    ++shift;
+
+  if (shift > kMaxConfigShardShift)
+    return false;
+
+  // Every configuration must have enough sets in each cache to go around.
+  for (int i = 0; i < s_CacheConfigCount; ++i)
+  {
+    if (!ConfigurableCacheSim::IsValid(s_CacheConfigs[i], shift))
+      return false;
+  }
+
+  s_ConfigShardShift = shift;
+  return true;
+}
 
 namespace
 {
@@ -655,6 +3000,21 @@ namespace
   {
     fwrite(&val, 1, sizeof val, f);
   }
+
+  // Sampled captures save stats estimated for the whole capture.
+  CacheSim::RipStats ScaleStats(const CacheSim::RipStats& stats, double scale)
+  {
+    CacheSim::RipStats result = stats;
+    if (scale != 1.0)
+    {
+      for (uint32_t& value : result.m_Stats)
+      {
+        double scaled = value * scale + 0.5;
+        value = scaled < 4294967295.0 ? uint32_t(scaled) : UINT32_MAX;
+      }
+    }
+    return result;
+  }
 }
 
 #ifdef _MSC_VER
@@ -667,8 +3027,26 @@ void CacheSimEndCapture(bool save)
 
   DisableTrapFlag();
 
+  if (g_Sampling.m_PeriodUs)
+  {
+    FinishSampling();
+  }
+
+  StopConfigWorkers();
+  FreeAutoCoreMappings();
+  FreeSuspendedFibers();
+
+  static AllocSnapshot allocs;
+  TakeAllocSnapshot(save ? &allocs : nullptr);
+
   if (!save)
+  {
+    s_Heatmap.FreeAll();
+    FreeReuseData();
+    FreeWorkingSetData();
+    FreeConfigStats();
     return;
+  }
 
   // It's tempting to remove the signal handler here
   //
@@ -705,7 +3083,7 @@ void CacheSimEndCapture(bool save)
       long m_Offset;
       FILE* m_File;
 
-      explicit PatchWord(FILE* f) : m_File(f), m_Offset(ftell(f))
+      explicit PatchWord(FILE* f) : m_Offset(ftell(f)), m_File(f)
       {
         static const uint8_t placeholder[] = { 0xcc, 0xdd, 0xee, 0xff };
         fwrite(placeholder, 1, sizeof placeholder, f);
@@ -725,7 +3103,7 @@ void CacheSimEndCapture(bool save)
     };
 
     welem(0xcace51afu);
-    welem(0x00000002u);
+    welem(kCurrentVersion);
 
     PatchWord module_offset{ f };
     PatchWord module_count{ f };
@@ -742,6 +3120,31 @@ void CacheSimEndCapture(bool save)
     welem(0u); // symbol_count
     welem(0u); // symbol_text_offset
 
+    PatchWord data_tag_offset{ f };
+    PatchWord data_tag_count{ f };
+    PatchWord data_tag_str_offset{ f };
+    PatchWord data_site_offset{ f };
+    PatchWord data_site_count{ f };
+
+    PatchWord heatmap_offset{ f };
+    PatchWord heatmap_size{ f };
+    PatchWord heatmap_cell_count{ f };
+    welem(s_HeatmapCellShift);
+
+    PatchWord reuse_offset{ f };
+    PatchWord reuse_count{ f };
+    welem(uint32_t(s_ReuseSampleShift > 0 ? s_ReuseSampleShift : 0));
+
+    PatchWord working_set_offset{ f };
+    PatchWord working_set_count{ f };
+    welem(s_WorkingSetInterval);
+
+    PatchWord config_offset{ f };
+    welem(uint32_t(s_ConfigWorkerCount >> s_ConfigWorkerShardShift));
+
+    welem(0u); // node_symbol_offset
+    welem(0u); // frame_symbol_offset
+
     GetModuleList(&g_ModuleList);
 
     if (g_ModuleList.m_Count > 0)
@@ -752,7 +3155,7 @@ void CacheSimEndCapture(bool save)
       module_count.Update(static_cast<uint32_t>(g_ModuleList.m_Count));
       uint32_t str_section_size = 0;
 
-      for (size_t i = 0; i < g_ModuleList.m_Count; ++i)
+      for (int i = 0; i < g_ModuleList.m_Count; ++i)
       {
         ModuleInfo& info = g_ModuleList.m_Infos[i];
         size_t len = strlen(info.m_Filename) + 1;
@@ -764,13 +3167,21 @@ void CacheSimEndCapture(bool save)
       }
 
       module_str_offset.Update(ftell(f));
-      for (size_t i = 0; i < g_ModuleList.m_Count; ++i)
+      for (int i = 0; i < g_ModuleList.m_Count; ++i)
       {
         wdata(g_ModuleList.m_Infos[i].m_Filename, strlen(g_ModuleList.m_Infos[i].m_Filename) + 1);
       }
     }
     align();
 
+    // Allocation site stacks go in with the code stacks, so they get resolved along with them.
+    uint32_t* site_stacks = allocs.m_SiteCount ? (uint32_t*)VirtualMemoryAlloc(allocs.m_SiteCount * sizeof(uint32_t)) : nullptr;
+    for (uint32_t i = 0; i < allocs.m_SiteCount; ++i)
+    {
+      const AllocSite& site = allocs.m_Sites[i];
+      site_stacks[i] = InsertStack(allocs.m_Frames + site.m_FrameOffset, site.m_FrameCount);
+    }
+
     // Write raw values for stack frames
     frame_offset.Update(ftell(f));
     frame_count.Update(g_StackData.m_Count);
@@ -785,21 +3196,185 @@ void CacheSimEndCapture(bool save)
     {
       welem(key.m_Rip);
       welem(key.m_StackOffset);
-      welem(*g_Stats.Find(key));
+      welem(ScaleStats(*g_Stats.Find(key), g_Sampling.m_PeriodUs ? g_SamplingSummary.m_Scale : 1.0));
+      welem(key.m_FiberId);
+    }
+
+    // Write allocation tags and the allocation sites that had misses.
+    const double scale = g_Sampling.m_PeriodUs ? g_SamplingSummary.m_Scale : 1.0;
+    auto scale_count = [scale](uint32_t count) -> uint32_t
+    {
+      double scaled = count * scale + 0.5;
+      return scaled < 4294967295.0 ? uint32_t(scaled) : UINT32_MAX;
+    };
+
+    align();
+    data_tag_offset.Update(ftell(f));
+    data_tag_count.Update(allocs.m_TagCount);
+    uint32_t tag_str_size = 0;
+    for (uint32_t i = 0; i < allocs.m_TagCount; ++i)
+    {
+      welem(tag_str_size);
+      welem(scale_count(allocs.m_Tags[i].m_L2DMisses));
+      tag_str_size += uint32_t(strlen(allocs.m_Tags[i].m_Name) + 1);
+    }
+
+    data_tag_str_offset.Update(ftell(f));
+    for (uint32_t i = 0; i < allocs.m_TagCount; ++i)
+    {
+      wdata(allocs.m_Tags[i].m_Name, strlen(allocs.m_Tags[i].m_Name) + 1);
+    }
+
+    align();
+    data_site_offset.Update(ftell(f));
+    data_site_count.Update(allocs.m_SiteCount);
+    for (uint32_t i = 0; i < allocs.m_SiteCount; ++i)
+    {
+      welem(site_stacks[i]);
+      welem(allocs.m_Sites[i].m_Tag);
+      welem(scale_count(allocs.m_Sites[i].m_L2DMisses));
       welem(static_cast<uint32_t>(0));
     }
 
+    if (site_stacks)
+      VirtualMemoryFree(site_stacks, allocs.m_SiteCount * sizeof(uint32_t));
+
+    // Write the heatmap in address order, see HeatmapReader for the encoding.
+    heatmap_offset.Update(ftell(f));
+    heatmap_cell_count.Update((uint32_t)s_Heatmap.GetCount());
+    if (size_t cell_count = s_Heatmap.GetCount())
+    {
+      uint64_t* cells = (uint64_t*)VirtualMemoryAlloc(cell_count * sizeof(uint64_t));
+      size_t index = 0;
+      for (const AddressKey& key : s_Heatmap.Keys())
+      {
+        cells[index++] = key.m_Value;
+      }
+      std::sort(cells, cells + cell_count);
+
+      uint32_t size = 0;
+      uint64_t prev_cell = 0;
+      uint64_t prev_rip = 0;
+      for (size_t i = 0; i < cell_count; ++i)
+      {
+        const HeatmapStats& cell = *s_Heatmap.Find(AddressKey(cells[i]));
+
+        uint8_t buffer[10 * (5 + 3 * kHeatmapMaxRips)];
+        int len = 0;
+        len += EncodeVarint(buffer + len, cells[i] - prev_cell);
+        len += EncodeVarint(buffer + len, scale_count(cell.m_Accesses));
+        len += EncodeVarint(buffer + len, scale_count(cell.m_L2Misses));
+        len += EncodeVarint(buffer + len, scale_count(cell.m_Evictions));
+
+        uint32_t rip_count = 0;
+        for (uint32_t r = 0; r < kHeatmapMaxRips; ++r)
+        {
+          rip_count += cell.m_RipAccesses[r] ? 1 : 0;
+        }
+        len += EncodeVarint(buffer + len, rip_count);
+
+        for (uint32_t r = 0; r < kHeatmapMaxRips; ++r)
+        {
+          if (!cell.m_RipAccesses[r])
+            continue;
+
+          int64_t delta = int64_t(cell.m_Rips[r] - prev_rip);
+          len += EncodeVarint(buffer + len, (uint64_t(delta) << 1) ^ uint64_t(delta >> 63));
+          len += EncodeVarint(buffer + len, scale_count(cell.m_RipAccesses[r]));
+          len += EncodeVarint(buffer + len, scale_count(cell.m_RipL2Misses[r]));
+          prev_rip = cell.m_Rips[r];
+        }
+
+        wdata(buffer, len);
+        size += len;
+        prev_cell = cells[i];
+      }
+
+      heatmap_size.Update(size);
+      VirtualMemoryFree(cells, cell_count * sizeof(uint64_t));
+    }
+    else
+    {
+      heatmap_size.Update(0);
+    }
+
+    // Write reuse distance histograms
+    align();
+    reuse_offset.Update(ftell(f));
+    reuse_count.Update((uint32_t)s_ReuseHistograms.GetCount());
+    for (const AddressKey& key : s_ReuseHistograms.Keys())
+    {
+      const ReuseHistogram& histogram = *s_ReuseHistograms.Find(key);
+      welem(key.m_Value);
+      for (uint32_t count : histogram.m_Buckets)
+      {
+        welem(scale_count(count));
+      }
+    }
+
+    // Write working set intervals, including the partial last one
+    FinishWorkingSetInterval();
+    align();
+    working_set_offset.Update(ftell(f));
+    working_set_count.Update(s_WorkingSetIntervals.m_Count);
+    wdata(s_WorkingSetIntervals.m_Intervals, s_WorkingSetIntervals.m_Count * sizeof(SerializedWorkingSet));
+
+    // Write the alternative cache configurations, followed by the statistics of each
+    align();
+    config_offset.Update(ftell(f));
+    // The shards of each configuration were merged into its first.
+    const int config_shard_count = 1 << s_ConfigWorkerShardShift;
+    const int config_count = s_ConfigWorkerCount / config_shard_count;
+    uint32_t config_stats_offset = uint32_t(ftell(f)) + config_count * sizeof(SerializedCacheConfig);
+    for (int i = 0; i < config_count; ++i)
+    {
+      const CacheConfig& config = s_CacheConfigs[i];
+      const uint32_t stats_count = (uint32_t)s_ConfigWorkers[i * config_shard_count].m_Stats.GetCount();
+      welem(config.m_ModuleCount);
+      welem(config.m_CoresPerModule);
+      welem(config.m_I1Size);
+      welem(config.m_I1Ways);
+      welem(config.m_D1Size);
+      welem(config.m_D1Ways);
+      welem(config.m_L2Size);
+      welem(config.m_L2Ways);
+      welem(config_stats_offset);
+      welem(stats_count);
+      config_stats_offset += stats_count * sizeof(SerializedConfigStats);
+    }
+
+    for (int i = 0; i < config_count; ++i)
+    {
+      ConfigWorker& worker = s_ConfigWorkers[i * config_shard_count];
+      for (const AddressKey& key : worker.m_Stats.Keys())
+      {
+        const ConfigRipStats& stats = *worker.m_Stats.Find(key);
+        welem(key.m_Value);
+        for (uint32_t count : stats.m_Stats)
+        {
+          welem(scale_count(count));
+        }
+      }
+    }
+
     fclose(f);
+    OnCaptureSaved(filename);
   }
   else
   {
     fprintf(stderr, "Failed to open %s for writing", filename);
   }
 
+  FreeAllocSnapshot(&allocs);
+
   g_Stats.FreeAll();
   g_Stacks.FreeAll();
+  s_Heatmap.FreeAll();
+  FreeReuseData();
+  FreeWorkingSetData();
+  FreeConfigStats();
 
   VirtualMemoryFree(g_StackData.m_Frames, g_StackData.m_ReserveCount);
   memset(&g_StackData, 0, sizeof g_StackData);
-  memset(&g_ModuleList, 0, sizeof g_ModuleList);
+  ClearModuleList();
 }
\ No newline at end of file
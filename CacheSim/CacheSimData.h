@@ -28,6 +28,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "CacheSimInternals.h"
 #include <algorithm>
+#include <stddef.h>
 
 /// Describes structures that go in the output standard DataFileWriter-based files
 /// after a cache simulation has been run.
@@ -48,7 +49,7 @@ namespace CacheSim
     uint64_t m_Rip;
     uint32_t m_StackIndex;
     uint32_t m_Stats[kAccessResultCount];
-    uint32_t m_Padding;
+    uint32_t m_FiberId;       // See CacheSimFiberSwitch(), 0 if none
   };
   static_assert(sizeof(SerializedNode) == 48, "bump version if you're changing this");
 
@@ -71,7 +72,205 @@ namespace CacheSim
   };
   static_assert(sizeof(SerializedSymbol) == 32, "bump version if you're changing this");
 
-  static constexpr uint32_t kCurrentVersion = 0x2;
+  /// An allocation tag passed to CacheSimOnAlloc().
+  struct SerializedDataTag
+  {
+    uint32_t    m_NameOffset;             ///< Into the data tag string section
+    uint32_t    m_L2DMisses;
+  };
+  static_assert(sizeof(SerializedDataTag) == 8, "bump version if you're changing this");
+
+  /// A call stack and tag allocations were made from. Only sites whose allocations had misses are saved.
+  struct SerializedDataSite
+  {
+    uint32_t    m_StackIndex;             ///< Offset of the allocating call stack in the frame data, like SerializedNode::m_StackIndex
+    uint32_t    m_Tag;
+    uint32_t    m_L2DMisses;
+    uint32_t    m_Padding;
+  };
+  static_assert(sizeof(SerializedDataSite) == 16, "bump version if you're changing this");
+
+  /// Most instructions remembered per heatmap cell.
+  static constexpr uint32_t kHeatmapMaxRips = 4;
+
+  /// A cell of the address space heatmap, as decoded by HeatmapReader.
+  struct HeatmapCell
+  {
+    uint64_t    m_Address;                      ///< First byte the cell covers
+    uint32_t    m_Accesses;                     ///< Data reads and writes of lines in the cell
+    uint32_t    m_L2Misses;
+    uint32_t    m_Evictions;                    ///< Lines of the cell pushed out of an L2
+    uint32_t    m_RipCount;
+    uint64_t    m_Rips[kHeatmapMaxRips];        ///< Instructions that accessed the cell the most, approximately
+    uint32_t    m_RipAccesses[kHeatmapMaxRips];
+    uint32_t    m_RipL2Misses[kHeatmapMaxRips];
+  };
+
+  /// Writes `value` as a LEB128 varint, returns the number of bytes used (at most 10).
+  inline int EncodeVarint(uint8_t* out, uint64_t value)
+  {
+    int len = 0;
+    while (value >= 0x80)
+    {
+      out[len++] = uint8_t(value | 0x80);
+      value >>= 7;
+    }
+    out[len++] = uint8_t(value);
+    return len;
+  }
+
+  /// Decodes the heatmap section, which is a stream of cells sorted by address.
+  /// Every value is a LEB128 varint. Cells are stored as the difference of their index (address >> cell shift) to the
+  /// previous cell's, and RIPs as the zigzag encoded difference to the previous RIP in the stream:
+  ///
+  ///    cell delta, accesses, L2 misses, evictions, RIP count, { RIP delta, accesses, L2 misses } * RIP count
+  class HeatmapReader
+  {
+  public:
+    HeatmapReader(const uint8_t* data, uint32_t size, uint32_t cell_shift)
+      : m_Cursor(data)
+      , m_End(data + size)
+      , m_CellShift(cell_shift)
+    {}
+
+    /// Returns false at the end of the section or if it's malformed.
+    bool Next(HeatmapCell* cell)
+    {
+      if (m_Cursor == m_End)
+        return false;
+
+      m_Cell += Read();
+      cell->m_Address = m_Cell << m_CellShift;
+      cell->m_Accesses = uint32_t(Read());
+      cell->m_L2Misses = uint32_t(Read());
+      cell->m_Evictions = uint32_t(Read());
+      cell->m_RipCount = uint32_t(Read());
+
+      if (cell->m_RipCount > kHeatmapMaxRips)
+      {
+        m_Error = true;
+        return false;
+      }
+
+      for (uint32_t i = 0; i < cell->m_RipCount; ++i)
+      {
+        uint64_t zigzag = Read();
+        m_Rip += (zigzag >> 1) ^ (0 - (zigzag & 1));
+        cell->m_Rips[i] = m_Rip;
+        cell->m_RipAccesses[i] = uint32_t(Read());
+        cell->m_RipL2Misses[i] = uint32_t(Read());
+      }
+
+      return !m_Error;
+    }
+
+    bool HasError() const { return m_Error; }
+
+  private:
+    uint64_t Read()
+    {
+      uint64_t value = 0;
+      for (int shift = 0; shift < 64; shift += 7)
+      {
+        if (m_Cursor == m_End)
+          break;
+
+        uint8_t byte = *m_Cursor++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (0 == (byte & 0x80))
+          return value;
+      }
+
+      m_Error = true;
+      m_Cursor = m_End;
+      return 0;
+    }
+
+  private:
+    const uint8_t*  m_Cursor;
+    const uint8_t*  m_End;
+    uint32_t        m_CellShift;
+    uint64_t        m_Cell = 0;
+    uint64_t        m_Rip = 0;
+    bool            m_Error = false;
+  };
+
+  /// Reuse distance histograms have a bucket for distance 0, buckets for distances in [2^(i-1), 2^i) lines for
+  /// i = 1..30, the last of which also holds longer distances, and a bucket for first accesses.
+  static constexpr uint32_t kReuseBucketCount = 32;
+  static constexpr uint32_t kReuseColdBucket = kReuseBucketCount - 1;
+
+  inline uint32_t ReuseDistanceBucket(uint64_t distance)
+  {
+    uint32_t bucket = 0;
+    while (distance && bucket < kReuseColdBucket - 1)
+    {
+      distance >>= 1;
+      ++bucket;
+    }
+    return bucket;
+  }
+
+  /// Accesses a fully associative LRU cache of 2^cache_lines_log2 lines would miss, given a reuse distance histogram.
+  template <typename T>
+  inline uint64_t ReuseMisses(const T (&buckets)[kReuseBucketCount], uint32_t cache_lines_log2)
+  {
+    uint64_t misses = 0;
+    for (uint32_t i = cache_lines_log2 + 1; i < kReuseBucketCount; ++i)
+    {
+      misses += buckets[i];
+    }
+    return misses;
+  }
+
+  /// Reuse distances of the data accesses of an instruction.
+  struct SerializedReuseHistogram
+  {
+    uint64_t    m_Rip;
+    uint32_t    m_Buckets[kReuseBucketCount];
+  };
+  static_assert(sizeof(SerializedReuseHistogram) == 136, "bump version if you're changing this");
+
+  /// Simulated cores working sets are broken down by.
+  static constexpr int kWorkingSetCoreCount = 8;
+
+  /// Estimated number of distinct lines the data accesses of an interval of a capture touched.
+  struct SerializedWorkingSet
+  {
+    uint32_t    m_Instructions;       // Recorded instructions in the interval, only the last one is short
+    uint32_t    m_Lines;
+    uint32_t    m_CoreLines[kWorkingSetCoreCount];
+  };
+  static_assert(sizeof(SerializedWorkingSet) == 40, "bump version if you're changing this");
+
+  /// An alternative cache hierarchy simulated during the capture, see CacheSimAddCacheConfig().
+  struct SerializedCacheConfig
+  {
+    uint32_t    m_ModuleCount;
+    uint32_t    m_CoresPerModule;
+    uint32_t    m_I1Size;
+    uint32_t    m_I1Ways;
+    uint32_t    m_D1Size;
+    uint32_t    m_D1Ways;
+    uint32_t    m_L2Size;
+    uint32_t    m_L2Ways;
+    uint32_t    m_StatsOffset;
+    uint32_t    m_StatsCount;
+  };
+  static_assert(sizeof(SerializedCacheConfig) == 40, "bump version if you're changing this");
+
+  /// Statistics of an instruction in an alternative cache hierarchy, summed over all call stacks.
+  struct SerializedConfigStats
+  {
+    uint64_t    m_Rip;
+    uint32_t    m_Stats[kAccessResultCount];
+  };
+  static_assert(sizeof(SerializedConfigStats) == 40, "bump version if you're changing this");
+
+  static constexpr uint32_t kCurrentVersion = 0x8;
+
+  /// Entry of the symbol index sections for addresses without a symbol.
+  static constexpr uint32_t kNoSymbolIndex = ~0u;
 
   template <typename T>
   const T* serializedOffset(const void* base, uint32_t offset)
@@ -98,7 +297,56 @@ namespace CacheSim
 
     uint32_t    m_SymbolTextOffset;
 
+    // Version 3 and later.
+    uint32_t    m_DataTagOffset;
+    uint32_t    m_DataTagCount;
+    uint32_t    m_DataTagStringOffset;
+    uint32_t    m_DataSiteOffset;
+    uint32_t    m_DataSiteCount;
+
+    // Version 4 and later.
+    uint32_t    m_HeatmapOffset;
+    uint32_t    m_HeatmapSize;        // In bytes
+    uint32_t    m_HeatmapCellCount;
+    uint32_t    m_HeatmapCellShift;   // Log2 of the bytes per cell
+
+    // Version 5 and later.
+    uint32_t    m_ReuseOffset;
+    uint32_t    m_ReuseCount;
+    uint32_t    m_ReuseSampleShift;   // Only 1 in 2^m_ReuseSampleShift lines were sampled
+
+    // Version 6 and later.
+    uint32_t    m_WorkingSetOffset;
+    uint32_t    m_WorkingSetCount;
+    uint32_t    m_WorkingSetInterval; // Recorded instructions per interval
+
+    // Version 7 and later.
+    uint32_t    m_CacheConfigOffset;
+    uint32_t    m_CacheConfigCount;
+
+    // Version 8 and later. Written along with the symbols, 0 if the file has no symbol index.
+    uint32_t    m_NodeSymbolOffset;   // Index of each node's symbol, kNoSymbolIndex if it has none
+    uint32_t    m_FrameSymbolOffset;  // Index of each frame's symbol in the stack data, kNoSymbolIndex for terminators
+
   public:
+    /// Size of the header in this file, which is smaller than SerializedHeader for old versions.
+    size_t GetSize() const
+    {
+      if (m_Version >= 8)
+        return sizeof(SerializedHeader);
+      if (m_Version == 7)
+        return offsetof(SerializedHeader, m_NodeSymbolOffset);
+      if (m_Version == 6)
+        return offsetof(SerializedHeader, m_CacheConfigOffset);
+      if (m_Version == 5)
+        return offsetof(SerializedHeader, m_WorkingSetOffset);
+      if (m_Version == 4)
+        return offsetof(SerializedHeader, m_ReuseOffset);
+      if (m_Version == 3)
+        return offsetof(SerializedHeader, m_HeatmapOffset);
+      return offsetof(SerializedHeader, m_DataTagOffset);
+    }
+
     uint32_t GetModuleCount() const { return m_ModuleCount; }
     const SerializedModuleEntry* GetModules() const { return serializedOffset<SerializedModuleEntry>(this, m_ModuleOffset); }
 
@@ -116,6 +364,34 @@ namespace CacheSim
     const SerializedSymbol* GetSymbols() const { return serializedOffset<SerializedSymbol>(this, m_SymbolOffset); }
     uint32_t GetSymbolCount() const { return m_SymbolCount; }
 
+    uint32_t GetDataTagCount() const { return m_Version >= 3 ? m_DataTagCount : 0; }
+    const SerializedDataTag* GetDataTags() const { return serializedOffset<SerializedDataTag>(this, m_DataTagOffset); }
+    const char* GetDataTagName(const SerializedDataTag& tag) const { return serializedOffset<char>(this, m_DataTagStringOffset + tag.m_NameOffset); }
+
+    uint32_t GetDataSiteCount() const { return m_Version >= 3 ? m_DataSiteCount : 0; }
+    const SerializedDataSite* GetDataSites() const { return serializedOffset<SerializedDataSite>(this, m_DataSiteOffset); }
+
+    uint32_t GetHeatmapCellCount() const { return m_Version >= 4 ? m_HeatmapCellCount : 0; }
+    uint32_t GetHeatmapCellShift() const { return m_HeatmapCellShift; }
+    uint32_t GetReuseHistogramCount() const { return m_Version >= 5 ? m_ReuseCount : 0; }
+    const SerializedReuseHistogram* GetReuseHistograms() const { return serializedOffset<SerializedReuseHistogram>(this, m_ReuseOffset); }
+    uint32_t GetReuseSampleShift() const { return m_ReuseSampleShift; }
+    uint32_t GetWorkingSetCount() const { return m_Version >= 6 ? m_WorkingSetCount : 0; }
+    const SerializedWorkingSet* GetWorkingSets() const { return serializedOffset<SerializedWorkingSet>(this, m_WorkingSetOffset); }
+    uint32_t GetWorkingSetInterval() const { return m_WorkingSetInterval; }
+    uint32_t GetCacheConfigCount() const { return m_Version >= 7 ? m_CacheConfigCount : 0; }
+    bool HasSymbolIndex() const { return m_Version >= 8 && m_SymbolCount && m_NodeSymbolOffset && m_FrameSymbolOffset; }
+    const uint32_t* GetNodeSymbolIndex() const { return serializedOffset<uint32_t>(this, m_NodeSymbolOffset); }
+    const uint32_t* GetFrameSymbolIndex() const { return serializedOffset<uint32_t>(this, m_FrameSymbolOffset); }
+    const SerializedCacheConfig* GetCacheConfigs() const { return serializedOffset<SerializedCacheConfig>(this, m_CacheConfigOffset); }
+    const SerializedConfigStats* GetConfigStats(const SerializedCacheConfig& config) const { return serializedOffset<SerializedConfigStats>(this, config.m_StatsOffset); }
+
+    HeatmapReader GetHeatmap() const
+    {
+      uint32_t size = GetHeatmapCellCount() ? m_HeatmapSize : 0;
+      return HeatmapReader(serializedOffset<uint8_t>(this, m_HeatmapOffset), size, m_HeatmapCellShift);
+    }
+
     const SerializedSymbol* FindSymbol(const uintptr_t rip) const
     {
       const SerializedSymbol* b = GetSymbols();
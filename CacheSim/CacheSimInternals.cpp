@@ -26,9 +26,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Precompiled.h"
 #include "CacheSim/CacheSimInternals.h"
+#include "CacheSim/Platform.h"
 
-CacheSim::AccessResult CacheSim::JaguarModule::Access(int core_index, uintptr_t addr, AccessMode mode)
+#include <xmmintrin.h>
+
+CacheSim::AccessResult CacheSim::JaguarModule::Access(int core_index, uintptr_t addr, AccessMode mode, uint64_t* l2_evicted)
 {
+  if (l2_evicted)
+    *l2_evicted = 0;
+
   if (kWrite == mode)
   {
     // Kick the line out of every other L1 and the other L2 package.
@@ -45,7 +51,7 @@ CacheSim::AccessResult CacheSim::JaguarModule::Access(int core_index, uintptr_t
   }
 
   // Start at the L2, because the cache hierarchy is inclusive.
-  bool l2_hit = m_Level2.Access(addr);
+  bool l2_hit = m_Level2.Access(addr, l2_evicted);
   bool l1_hit = false;
 
   if (kCodeRead == mode)
@@ -77,22 +83,336 @@ CacheSim::AccessResult CacheSim::JaguarModule::Access(int core_index, uintptr_t
   }
 }
 
-CacheSim::AccessResult CacheSim::JaguarCacheSim::Access(int core_index, uintptr_t addr, size_t size, AccessMode mode)
+void CacheSim::JaguarModule::Prefetch(uintptr_t addr) const
+{
+  // The L1 tags are 4 KB per core and stay in the host's L1. An L2 set is 128 bytes, which may straddle three host lines.
+  const char* l2_set = (const char*)m_Level2.GetSet(addr);
+  _mm_prefetch(l2_set, _MM_HINT_T0);
+  _mm_prefetch(l2_set + 64, _MM_HINT_T0);
+  _mm_prefetch(l2_set + sizeof(*m_Level2.GetSet(addr)) - 1, _MM_HINT_T0);
+}
+
+CacheSim::AccessResult CacheSim::JaguarCacheSim::Access(int core_index, uintptr_t addr, size_t size, AccessMode mode, LineObserver* observer)
+{
+  JaguarModule& module = m_Modules[(core_index / 4) & 1];
+  const uint64_t line_base = addr & ~63ull;
+
+  // The line holding the last byte, so an access ending exactly on a line boundary doesn't touch the next line.
+  const uint64_t line_end = (addr + (size ? size - 1 : 0)) & ~63ull;
+
+  // Nearly every access stays within one line.
+  if (line_base == line_end)
+  {
+    if (!observer)
+      return module.Access(core_index & 3, line_base, mode);
+
+    uint64_t evicted;
+    AccessResult r = module.Access(core_index & 3, line_base, mode, &evicted);
+    observer->OnLineAccess(line_base, r, evicted);
+    return r;
+  }
+
+  return AccessLines(module, core_index & 3, line_base, line_end, mode, observer);
+}
+
+CacheSim::AccessResult CacheSim::JaguarCacheSim::AccessLines(JaguarModule& module, int core_index, uint64_t line_base, uint64_t line_end, AccessMode mode, LineObserver* observer)
+{
+  // Straddling accesses and wide operands like FXSAVE. Each line updates the LRU state the next one may look at,
+  // so they are simulated one after another; the result is the worst of any line.
+  AccessResult r = AccessResult::kD1Hit;
+
+  if (!observer)
+  {
+    for (; line_base <= line_end; line_base += 64)
+    {
+      AccessResult r2 = module.Access(core_index, line_base, mode);
+      if (r2 > r)
+        r = r2;
+    }
+    return r;
+  }
+
+  for (; line_base <= line_end; line_base += 64)
+  {
+    uint64_t evicted;
+    AccessResult r2 = module.Access(core_index, line_base, mode, &evicted);
+    observer->OnLineAccess(line_base, r2, evicted);
+    if (r2 > r)
+      r = r2;
+  }
+  return r;
+}
+
+bool CacheSim::ConfigurableCache::IsValid(uint32_t size_bytes, uint32_t ways, uint32_t index_shift)
+{
+  if (0 == ways || 0 != size_bytes % (ways << kSetSizeShift))
+    return false;
+
+  const uint32_t set_count = size_bytes / (ways << kSetSizeShift);
+  return set_count && 0 == (set_count & (set_count - 1)) && set_count >= (1u << index_shift);
+}
+
+void CacheSim::ConfigurableCache::Init(uint32_t size_bytes, uint32_t ways, uint32_t index_shift)
+{
+  m_WayCount = ways;
+  m_IndexShift = index_shift;
+  m_SetMask = (size_bytes / (ways << kSetSizeShift) >> index_shift) - 1;
+
+  // Fresh pages are zeroed, which marks every way invalid.
+  m_Ways = (uint64_t*)VirtualMemoryAlloc((m_SetMask + 1) * m_WayCount * sizeof(uint64_t));
+}
+
+void CacheSim::ConfigurableCache::Free()
+{
+  if (m_Ways)
+  {
+    VirtualMemoryFree(m_Ways, (m_SetMask + 1) * m_WayCount * sizeof(uint64_t));
+  }
+  m_Ways = nullptr;
+}
+
+bool CacheSim::ConfigurableCacheSim::IsValid(const CacheConfig& config, uint32_t shard_shift)
+{
+  return config.m_ModuleCount >= 1 && config.m_ModuleCount <= kMaxCacheModules &&
+         config.m_CoresPerModule >= 1 && config.m_CoresPerModule <= kMaxCoresPerModule &&
+         ConfigurableCache::IsValid(config.m_I1Size, config.m_I1Ways, shard_shift) &&
+         ConfigurableCache::IsValid(config.m_D1Size, config.m_D1Ways, shard_shift) &&
+         ConfigurableCache::IsValid(config.m_L2Size, config.m_L2Ways, shard_shift);
+}
+
+void CacheSim::ConfigurableCacheSim::Init(const CacheConfig& config, uint32_t shard_shift)
+{
+  m_Config = config;
+
+  for (uint32_t m = 0; m < config.m_ModuleCount; ++m)
+  {
+    m_Level2[m].Init(config.m_L2Size, config.m_L2Ways, shard_shift);
+    for (uint32_t c = 0; c < config.m_CoresPerModule; ++c)
+    {
+      m_CoreD1[m * kMaxCoresPerModule + c].Init(config.m_D1Size, config.m_D1Ways, shard_shift);
+      m_CoreI1[m * kMaxCoresPerModule + c].Init(config.m_I1Size, config.m_I1Ways, shard_shift);
+    }
+  }
+}
+
+void CacheSim::ConfigurableCacheSim::Free()
+{
+  for (uint32_t m = 0; m < m_Config.m_ModuleCount; ++m)
+  {
+    m_Level2[m].Free();
+    for (uint32_t c = 0; c < m_Config.m_CoresPerModule; ++c)
+    {
+      m_CoreD1[m * kMaxCoresPerModule + c].Free();
+      m_CoreI1[m * kMaxCoresPerModule + c].Free();
+    }
+  }
+}
+
+// Same policy as JaguarModule::Access().
+CacheSim::AccessResult CacheSim::ConfigurableCacheSim::AccessLine(int module_index, int core_index, uint64_t addr, AccessMode mode)
+{
+  ConfigurableCache* d1 = &m_CoreD1[module_index * kMaxCoresPerModule];
+  ConfigurableCache* i1 = &m_CoreI1[module_index * kMaxCoresPerModule];
+
+  if (kWrite == mode)
+  {
+    // Kick the line out of every other L1 in the module and every other L2.
+    for (int i = 0; i < int(m_Config.m_CoresPerModule); ++i)
+    {
+      if (i == core_index)
+        continue;
+
+      d1[i].Invalidate(addr);
+      i1[i].Invalidate(addr);
+    }
+
+    for (int m = 0; m < int(m_Config.m_ModuleCount); ++m)
+    {
+      if (m != module_index)
+        m_Level2[m].Invalidate(addr);
+    }
+  }
+
+  // Start at the L2, because the cache hierarchy is inclusive.
+  bool l2_hit = m_Level2[module_index].Access(addr);
+  bool l1_hit = kCodeRead == mode ? i1[core_index].Access(addr) : d1[core_index].Access(addr);
+
+  if (l2_hit && l1_hit)
+    return kCodeRead == mode ? kI1Hit : kD1Hit;
+  else if (l2_hit)
+    return kL2Hit;
+  else
+    return kCodeRead == mode ? kL2IMiss : kL2DMiss;
+}
+
+CacheSim::AccessResult CacheSim::ConfigurableCacheSim::Access(int core_index, uintptr_t addr, size_t size, AccessMode mode)
 {
   AccessResult r = AccessResult::kD1Hit;
 
-  // Handle straddling cache lines by looping.
+  // Logical cores fill the first module, then the next, wrapping around.
+  const uint32_t core_count = m_Config.m_ModuleCount * m_Config.m_CoresPerModule;
+  const uint32_t core = uint32_t(core_index) % core_count;
+  const int module_index = int(core / m_Config.m_CoresPerModule);
+  const int module_core = int(core % m_Config.m_CoresPerModule);
+
+  // Handle straddling cache lines by looping, as JaguarCacheSim::Access() does.
   uint64_t line_base = addr & ~63ull;
-  uint64_t line_end = (addr + size) & ~63ull;
+  const uint64_t line_end = (addr + (size ? size - 1 : 0)) & ~63ull;
+
+  if (line_base == line_end)
+    return AccessLine(module_index, module_core, line_base, mode);
 
-  int module_index = (core_index / 4) & 1;
-  while (line_base <= line_end)
+  for (; line_base <= line_end; line_base += 64)
   {
-    AccessResult r2 = m_Modules[module_index].Access(core_index & 3, line_base, mode);
+    AccessResult r2 = AccessLine(module_index, module_core, line_base, mode);
     if (r2 > r)
       r = r2;
-    line_base += 64;
   }
 
   return r;
 }
+
+void CacheSim::JaguarCacheSim::AccessBatch(const CacheAccess* accesses, size_t count, AccessResult* results, LineObserver* observer)
+{
+  enum { kPrefetchDistance = 8 };
+
+  // Short batches, like the accesses of one instruction, don't leave time for a prefetch to land.
+  if (count <= kPrefetchDistance)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      const CacheAccess& a = accesses[i];
+      results[i] = Access(a.m_CoreIndex, a.m_Addr, a.m_Size, AccessMode(a.m_Mode), a.m_Observe ? observer : nullptr);
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < kPrefetchDistance; ++i)
+  {
+    m_Modules[(accesses[i].m_CoreIndex / 4) & 1].Prefetch(accesses[i].m_Addr);
+  }
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (i + kPrefetchDistance < count)
+    {
+      const CacheAccess& next = accesses[i + kPrefetchDistance];
+      m_Modules[(next.m_CoreIndex / 4) & 1].Prefetch(next.m_Addr);
+    }
+
+    const CacheAccess& a = accesses[i];
+    results[i] = Access(a.m_CoreIndex, a.m_Addr, a.m_Size, AccessMode(a.m_Mode), a.m_Observe ? observer : nullptr);
+  }
+}
+
+void CacheSim::ReuseTree::Update(uint32_t node)
+{
+  Node& n = m_Nodes[node];
+  n.m_Size = 1 + Size(n.m_Child[0]) + Size(n.m_Child[1]);
+}
+
+uint32_t CacheSim::ReuseTree::Merge(uint32_t left, uint32_t right)
+{
+  if (!left || !right)
+    return left | right;
+
+  if (m_Nodes[left].m_Priority > m_Nodes[right].m_Priority)
+  {
+    m_Nodes[left].m_Child[1] = Merge(m_Nodes[left].m_Child[1], right);
+    Update(left);
+    return left;
+  }
+
+  m_Nodes[right].m_Child[0] = Merge(left, m_Nodes[right].m_Child[0]);
+  Update(right);
+  return right;
+}
+
+uint32_t CacheSim::ReuseTree::Remove(uint32_t root, uint64_t time, uint32_t* removed)
+{
+  if (!root)
+    return 0;
+
+  if (m_Nodes[root].m_Time != time)
+  {
+    const int dir = time > m_Nodes[root].m_Time;
+    m_Nodes[root].m_Child[dir] = Remove(m_Nodes[root].m_Child[dir], time, removed);
+    Update(root);
+    return root;
+  }
+
+  *removed = root;
+  return Merge(m_Nodes[root].m_Child[0], m_Nodes[root].m_Child[1]);
+}
+
+// Number of lines accessed after `time`.
+uint32_t CacheSim::ReuseTree::CountNewer(uint64_t time) const
+{
+  uint32_t count = 0;
+  for (uint32_t i = m_Root; i; )
+  {
+    if (m_Nodes[i].m_Time > time)
+    {
+      count += 1 + Size(m_Nodes[i].m_Child[1]);
+      i = m_Nodes[i].m_Child[0];
+    }
+    else
+    {
+      i = m_Nodes[i].m_Child[1];
+    }
+  }
+  return count;
+}
+
+uint64_t CacheSim::ReuseTree::Access(uint64_t time, uint32_t sample_shift, uint64_t* distance)
+{
+  uint32_t node = 0;
+  *distance = kColdDistance;
+
+  if (time)
+  {
+    *distance = uint64_t(CountNewer(time)) << sample_shift;
+    m_Root = Remove(m_Root, time, &node);
+  }
+
+  if (!node)
+  {
+    if (0 == m_Count)
+      m_Count = 1;
+
+    if (m_Count >= m_ReserveCount)
+    {
+      const uint32_t new_reserve = m_ReserveCount ? 2 * m_ReserveCount : 65536;
+      m_Nodes = (Node*)(m_Nodes ? VirtualMemoryRealloc(m_Nodes, m_ReserveCount * sizeof(Node), new_reserve * sizeof(Node))
+                                : VirtualMemoryAlloc(new_reserve * sizeof(Node)));
+      m_ReserveCount = new_reserve;
+    }
+    node = m_Count++;
+  }
+
+  // xorshift32
+  uint32_t seed = m_Seed ? m_Seed : 0x9e3779b9u;
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  m_Seed = seed;
+
+  // The new time is the latest, so the node goes in at the right edge.
+  Node& n = m_Nodes[node];
+  n.m_Time = ++m_Clock;
+  n.m_Priority = seed;
+  n.m_Size = 1;
+  n.m_Child[0] = n.m_Child[1] = 0;
+  m_Root = Merge(m_Root, node);
+
+  return n.m_Time;
+}
+
+void CacheSim::ReuseTree::Free()
+{
+  if (m_Nodes)
+  {
+    VirtualMemoryFree(m_Nodes, m_ReserveCount * sizeof(Node));
+  }
+  memset(this, 0, sizeof *this);
+}
@@ -52,6 +52,58 @@ namespace CacheSim
     kWrite
   };
 
+  /// Look up line `base` in a set of `way_count` ways, ordered most recently used first, and make it the MRU.
+  /// Returns true on a hit. On a miss the LRU way is replaced and `evicted` receives the line it held, or zero.
+  inline bool AccessSet(uint64_t* ways, size_t way_count, uint64_t base, uint64_t* evicted)
+  {
+    for (size_t way = 0; way < way_count; ++way)
+    {
+      const uint64_t stored_addr = ways[way];
+
+      if (stored_addr == base)
+      {
+        // Shift the hit way to the front of the set to reflect MRU status.
+        // This isn't optimal, but it doesn't really matter much in the grand scheme of things.
+        while (way > 0)
+        {
+          std::swap(ways[way], ways[way-1]);
+          --way;
+        }
+        return true;
+      }
+    }
+
+    *evicted = ways[way_count - 1];
+
+    // Miss: Move everything in the way to the right and insert this thing as the MRU.
+    for (size_t i = way_count - 1; i > 0; --i)
+    {
+      ways[i] = ways[i - 1];
+    }
+    ways[0] = base;
+    return false;
+  }
+
+  /// Remove line `base` from a set of `way_count` ways, if it's there.
+  inline void InvalidateSet(uint64_t* ways, size_t way_count, uint64_t base)
+  {
+    for (size_t way = 0; way < way_count; ++way)
+    {
+      if (ways[way] == base)
+      {
+        // Take the invalidated way out of the array by moving in elements from the right (that then survive longer)
+        for (size_t rw = way; rw < way_count - 1; ++rw)
+        {
+          ways[rw] = ways[rw + 1];
+        }
+
+        // Mark the last way as 0 so we don't hit it later.
+        ways[way_count - 1] = 0;
+        break;
+      }
+    }
+  }
+
   template <size_t kWays>
   struct SetData
   {
@@ -79,38 +131,21 @@ namespace CacheSim
 
     SetData<kWays> m_Sets[kSetCount];
 
-    bool Access(uint64_t addr)
+    /// Returns true on a hit. On a miss, `evicted` receives the address of the line pushed out of the set, or zero if a way was free.
+    bool Access(uint64_t addr, uint64_t* evicted = nullptr)
     {
       uint64_t base = addr >> kSetSizeShift;
 
       const uint32_t line_index = base & kSetMask;
 
-      SetData<kWays>* set = &m_Sets[line_index];
+      uint64_t evicted_base;
+      if (AccessSet(m_Sets[line_index].m_Addr, kWays, base, &evicted_base))
+        return true;
 
-      for (size_t way = 0; way < kWays; ++way)
+      if (evicted)
       {
-        const uint64_t stored_addr = set->m_Addr[way];
-
-        if (stored_addr == base)
-        {
-          // Shift the hit way to the front of the set to reflect MRU status.
-          // This isn't optimal, but it doesn't really matter much in the grand scheme of things.
-          while (way > 0)
-          {
-            std::swap(set->m_Addr[way], set->m_Addr[way-1]);
-            --way;
-          }
-          return true;
-        }
+        *evicted = evicted_base << kSetSizeShift;
       }
-
-      // Miss: Move everything in the way to the right and insert this thing as the MRU.
-      for (size_t i = kWays - 1; i > 0; --i)
-      {
-        set->m_Addr[i] = set->m_Addr[i - 1];
-
-      }
-      set->m_Addr[0] = base;
       return false;
     }
 
@@ -120,24 +155,65 @@ namespace CacheSim
 
       const uint32_t line_index = base & kSetMask;
 
-      SetData<kWays>* set = &m_Sets[line_index];
+      InvalidateSet(m_Sets[line_index].m_Addr, kWays, base);
+    }
 
-      for (size_t way = 0; way < kWays; ++way)
-      {
-        if (set->m_Addr[way] == base)
-        {
-          // Take the invalidated way out of the array by moving in elements from the right (that then survive longer)
-          for (size_t rw = way; rw < kWays - 1; ++rw)
-          {
-            set->m_Addr[rw] = set->m_Addr[rw + 1];
-          }
-
-          // Mark the last way as 0 so we don't hit it later.
-          set->m_Addr[kWays - 1] = 0;
-          break;
-        }
-      }
+    /// The tags of the set `addr` maps to, for prefetching.
+    const SetData<kWays>* GetSet(uint64_t addr) const
+    {
+      return &m_Sets[(addr >> kSetSizeShift) & kSetMask];
+    }
+  };
+
+  /// A cache like Cache, sized at runtime. It can hold just one shard of the sets: the lines whose low
+  /// `index_shift` bits of line address are the same, which is a fixed set of sets at every cache level.
+  class ConfigurableCache
+  {
+  public:
+    static constexpr size_t  kSetSizeShift = 6;
+
+    /// Returns false if `size_bytes` isn't a power of two number of sets of `ways` 64 byte lines, of at least 2^index_shift sets.
+    static bool IsValid(uint32_t size_bytes, uint32_t ways, uint32_t index_shift = 0);
+
+    void Init(uint32_t size_bytes, uint32_t ways, uint32_t index_shift = 0);
+    void Free();
+
+    bool Access(uint64_t addr)
+    {
+      uint64_t base = addr >> kSetSizeShift;
+      uint64_t evicted_base;
+      return AccessSet(m_Ways + ((base >> m_IndexShift) & m_SetMask) * m_WayCount, m_WayCount, base, &evicted_base);
+    }
+
+    void Invalidate(uint64_t addr)
+    {
+      uint64_t base = addr >> kSetSizeShift;
+      InvalidateSet(m_Ways + ((base >> m_IndexShift) & m_SetMask) * m_WayCount, m_WayCount, base);
     }
+
+  private:
+    uint64_t*   m_Ways = nullptr;         ///< m_WayCount addresses per set
+    uint32_t    m_WayCount = 0;
+    uint32_t    m_IndexShift = 0;
+    uint64_t    m_SetMask = 0;
+  };
+
+  /// Receives every cache line touched by JaguarCacheSim::Access(), for per-address statistics.
+  class LineObserver
+  {
+  public:
+    /// `evicted_line` is the line the access pushed out of the L2, or zero if it didn't evict anything.
+    virtual void OnLineAccess(uint64_t line_addr, AccessResult result, uint64_t evicted_line) = 0;
+  };
+
+  /// One access of a batch, see JaguarCacheSim::AccessBatch().
+  struct CacheAccess
+  {
+    uintptr_t   m_Addr;
+    uint32_t    m_Size;
+    uint8_t     m_CoreIndex;
+    uint8_t     m_Mode;                 ///< AccessMode
+    uint8_t     m_Observe;              ///< Nonzero to report the lines touched to the batch's LineObserver
   };
 
   /// Simulate the Jaguar 32 KB L1 cache
@@ -171,7 +247,10 @@ namespace CacheSim
       m_OtherModule = other_module;
     }
 
-    IG_CACHESIM_API AccessResult Access(int core_index, uintptr_t addr, AccessMode mode);
+    IG_CACHESIM_API AccessResult Access(int core_index, uintptr_t addr, AccessMode mode, uint64_t* l2_evicted = nullptr);
+
+    /// Starts loading the L2 set Access() will look at into the host's caches.
+    void Prefetch(uintptr_t addr) const;
   };
 
   class JaguarCacheSim
@@ -186,7 +265,128 @@ namespace CacheSim
       m_Modules[1].Init(&m_Modules[0]);
     }
 
+    /// Simulates the lines `size` bytes at `addr` touch, returning the worst result. Accesses of zero bytes touch the line at `addr`.
+    IG_CACHESIM_API AccessResult Access(int core_index, uintptr_t addr, size_t size, AccessMode mode, LineObserver* observer = nullptr);
+
+    /// Makes `count` accesses in order, as if by calling Access() for each, storing the results in `results`. In long
+    /// batches the L2 sets of upcoming accesses are prefetched while earlier ones are simulated.
+    IG_CACHESIM_API void AccessBatch(const CacheAccess* accesses, size_t count, AccessResult* results, LineObserver* observer = nullptr);
+
+  private:
+    AccessResult AccessLines(JaguarModule& module, int core_index, uint64_t line_base, uint64_t line_end, AccessMode mode, LineObserver* observer);
+  };
+
+  /// Simulates a CacheConfig the way JaguarCacheSim simulates the Jaguar, but with the sizes set at runtime.
+  class ConfigurableCacheSim
+  {
+  private:
+    CacheConfig       m_Config;
+    ConfigurableCache m_CoreD1[kMaxCacheModules * kMaxCoresPerModule];
+    ConfigurableCache m_CoreI1[kMaxCacheModules * kMaxCoresPerModule];
+    ConfigurableCache m_Level2[kMaxCacheModules];
+
+  public:
+    /// Also checks the configuration can be split into 2^shard_shift shards, see Init().
+    IG_CACHESIM_API static bool IsValid(const CacheConfig& config, uint32_t shard_shift = 0);
+
+    /// Allocates the caches, which must be released with Free(). With a nonzero `shard_shift` only the sets of lines
+    /// whose low `shard_shift` bits of line address are the same are allocated, and only those lines may be accessed.
+    /// As every level is indexed by the low bits of the line address, shards can be simulated independently.
+    IG_CACHESIM_API void Init(const CacheConfig& config, uint32_t shard_shift = 0);
+    IG_CACHESIM_API void Free();
+
     IG_CACHESIM_API AccessResult Access(int core_index, uintptr_t addr, size_t size, AccessMode mode);
+
+  private:
+    AccessResult AccessLine(int module_index, int core_index, uint64_t addr, AccessMode mode);
   };
 
+  /// Reuse (LRU stack) distances of lines, with Olken's algorithm: the time of every tracked line's last access is a
+  /// node in a treap ordered by time and sized by subtree, so the distance of an access is the number of nodes newer
+  /// than its line's. The caller keeps the time of each line's last access.
+  ///
+  /// With SHARDS spatial sampling only the lines whose hash falls in a 1/2^sample_shift subset are tracked, and their
+  /// distances are scaled back up by the same factor. Zero initialized state is an empty tree.
+  class ReuseTree
+  {
+  public:
+    static constexpr uint64_t kColdDistance = ~0ull;
+
+    /// Whether the line (address >> 6) is in the sampled subset.
+    static bool IsSampled(uint64_t line, uint32_t sample_shift)
+    {
+      return !sample_shift || 0 == ((line * 0x9e3779b97f4a7c15ull) >> (64 - sample_shift));
+    }
+
+    /// Records an access to a sampled line last accessed at `time`, 0 for its first access, and returns the time of
+    /// this one. `distance` is set to the number of distinct lines accessed in between, or kColdDistance.
+    IG_CACHESIM_API uint64_t Access(uint64_t time, uint32_t sample_shift, uint64_t* distance);
+
+    IG_CACHESIM_API void Free();
+
+  private:
+    struct Node
+    {
+      uint64_t    m_Time;
+      uint32_t    m_Priority;
+      uint32_t    m_Size;                   ///< Nodes in this subtree
+      uint32_t    m_Child[2];               ///< Node indices, 0 for none
+    };
+
+    uint32_t Size(uint32_t node) const { return node ? m_Nodes[node].m_Size : 0; }
+    void Update(uint32_t node);
+    uint32_t Merge(uint32_t left, uint32_t right);
+    uint32_t Remove(uint32_t root, uint64_t time, uint32_t* removed);
+    uint32_t CountNewer(uint64_t time) const;
+
+    Node*       m_Nodes;                    ///< Node 0 is unused so 0 can mean none
+    uint32_t    m_Count;
+    uint32_t    m_ReserveCount;
+    uint32_t    m_Root;
+    uint32_t    m_Seed;
+    uint64_t    m_Clock;
+  };
+
+  /// A range of addresses. Zeroed when not known.
+  struct AddressRange
+  {
+    uintptr_t m_Start;
+    uintptr_t m_End;
+
+    bool Contains(uintptr_t address) const { return address >= m_Start && address < m_End; }
+  };
+
+  enum
+  {
+    kStackSwitchDistance = 256 * 1024,    ///< Stack pointer move taken as a switch between two stacks the thread doesn't own
+    kPendingSwitchDistance = 4096,        ///< Smallest move taken as a switch, after CacheSimFiberSwitch()
+  };
+
+  /// Whether the stack pointer moving from `last_rsp` to `rsp` is a switch to another fiber. `thread_stack` is the stack
+  /// the thread was on when tracing started and `signal_stack` its alternate signal stack.
+  ///
+  /// Leaving the thread's stack or coming back to it is a switch, while moves within it never are, however large the
+  /// frame. Moves to and from the signal stack are signal handlers, not switches. Between other stacks, or when the
+  /// thread's stack isn't known, only moves too large for a frame are taken as switches. After CacheSimFiberSwitch()
+  /// (`pending`) any move of a page or more is.
+  inline bool IsStackSwitch(uintptr_t last_rsp, uintptr_t rsp, bool pending, const AddressRange& thread_stack, const AddressRange& signal_stack)
+  {
+    const uintptr_t distance = rsp > last_rsp ? rsp - last_rsp : last_rsp - rsp;
+    if (distance < kPendingSwitchDistance)
+      return false;
+
+    if (signal_stack.Contains(last_rsp) || signal_stack.Contains(rsp))
+      return false;
+
+    if (pending)
+      return true;
+
+    const bool was_on_thread_stack = thread_stack.Contains(last_rsp);
+    const bool is_on_thread_stack = thread_stack.Contains(rsp);
+    if (was_on_thread_stack || is_on_thread_stack)
+      return was_on_thread_stack != is_on_thread_stack;
+
+    return distance >= kStackSwitchDistance;
+  }
+
 }
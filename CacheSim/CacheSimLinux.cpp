@@ -31,11 +31,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <errno.h>
 #include <time.h>
 #include <asm/prctl.h>
+#include <dirent.h>
 #include <execinfo.h>
+#include <fcntl.h>
 #include <link.h>
 #include <signal.h>
+#include <linux/perf_event.h>
 #include <sys/auxv.h>
+#include <sys/ioctl.h>
 #include <sys/prctl.h>
+#include <sys/resource.h>
 #include <sys/ptrace.h>
 #include <sys/syscall.h>
 #include <sys/user.h>
@@ -60,10 +65,12 @@ struct CONTEXT
   int64_t R14;
   int64_t R15;
   int64_t Rip;
+  fpregset_t FltSave;   ///< FXSAVE image (followed by the XSAVE area) saved by the kernel in the signal frame
 };
 
 
 static struct sigaction g_OldSigAction;
+static struct sigaction g_OldSampleSigAction;
 static bool g_SignalHandlerInstalled = false;
 extern "C" void CacheSimRemoveHandler();
 
@@ -78,6 +85,8 @@ static void DebugBreak()
 
 // Must include this AFTER declaring CONTEXT
 #include "CacheSimCommon.inl"
+#include "CacheSimCodeCache.inl"
+#include "CacheSimSymbolize.inl"
 
 // Missing libc syscalls
 static int arch_prctl(int code, unsigned long* addr)
@@ -109,59 +118,356 @@ static void ConvertToWinStyleContext(CONTEXT* out, const mcontext_t* in)
   out->R14 = in->gregs[REG_R14];
   out->R15 = in->gregs[REG_R15];
   out->Rip = in->gregs[REG_RIP];
+  out->FltSave = in->fpregs;
 }
 
-static uintptr_t AdjustFsSegment(uintptr_t address)
+static void ReadVectorReg(int reg_index, bool ymm, const CONTEXT* ctx, uint8_t out[32])
 {
-  unsigned long fsbase;
-  arch_prctl(ARCH_GET_FS, &fsbase);
-  return (uintptr_t)fsbase + address;
+  if (!ctx->FltSave)
+    DebugBreak();
+
+  memcpy(out, ctx->FltSave->_xmm[reg_index].element, 16);
+  memset(out + 16, 0, 16);
+
+  if (ymm)
+  {
+    // The upper YMM halves are in the XSAVE area that follows the 512 byte FXSAVE image.
+    // The kernel marks the extended frame with a magic number in the FXSAVE software-reserved bytes.
+    const uint8_t* base = (const uint8_t*)ctx->FltSave;
+    const _fpx_sw_bytes* sw = (const _fpx_sw_bytes*)(base + 464);
+    if (FP_XSTATE_MAGIC1 != sw->magic1)
+      DebugBreak();
+
+    // XSTATE_BV bit 2 clear means the upper halves are in their initial (zero) state.
+    uint64_t xstate_bv;
+    memcpy(&xstate_bv, base + 512, sizeof xstate_bv);
+    if (xstate_bv & 4)
+    {
+      memcpy(out + 16, base + 576 + 16 * reg_index, 16);
+    }
+  }
 }
 
-static uintptr_t AdjustGsSegment(uintptr_t address)
+#ifndef HWCAP2_FSGSBASE
+#define HWCAP2_FSGSBASE (1 << 1)
+#endif
+
+// Set when the kernel allows RDFSBASE/RDGSBASE from user mode (Linux 5.9+).
+static bool s_HaveFsGsBase = false;
+
+// Without FSGSBASE the segment bases can only be read with a syscall, which is far too slow to do per access.
+// They're cached in the thread state instead and only refreshed when the generation changes.
+static void RefreshSegmentBases()
 {
-  unsigned long gsbase;
+  using namespace CacheSim;
+
+  if (s_HaveFsGsBase)
+    return;
+
+  unsigned long fsbase = 0, gsbase = 0;
+  arch_prctl(ARCH_GET_FS, &fsbase);
   arch_prctl(ARCH_GET_GS, &gsbase);
-  return (uintptr_t)gsbase + address;
+  s_ThreadState.m_FsBase = fsbase;
+  s_ThreadState.m_GsBase = gsbase;
 }
 
-static void HandleTrap(int signo, siginfo_t* siginfo, void* ucontext_param)
+static uintptr_t AdjustFsSegment(uintptr_t address)
 {
-  using namespace CacheSim;
+  if (s_HaveFsGsBase)
+  {
+    uintptr_t fsbase;
+    asm volatile("rdfsbase %0" : "=r"(fsbase));
+    return fsbase + address;
+  }
 
-  if (g_TraceEnabled == false)
+  return CacheSim::s_ThreadState.m_FsBase + address;
+}
+
+static uintptr_t AdjustGsSegment(uintptr_t address)
+{
+  if (s_HaveFsGsBase)
   {
-    // Clear the trap bit
-    ((ucontext_t*)ucontext_param)->uc_mcontext.gregs[REG_EFL] &= ~(0x100ull);
-    return;
+    uintptr_t gsbase;
+    asm volatile("rdgsbase %0" : "=r"(gsbase));
+    return gsbase + address;
   }
 
-  // Make sure the thread state is up to date.
+  return CacheSim::s_ThreadState.m_GsBase + address;
+}
+
+// Make sure the thread state is up to date.
+static void RefreshThreadState()
+{
+  using namespace CacheSim;
+
   int curr_gen = g_Generation;
-  ud_t* ud = &s_ThreadState.m_Disassembler;
 
   if (s_ThreadState.m_Generation != curr_gen)
   {
+    ud_t* ud = &s_ThreadState.m_Disassembler;
     ud_init(ud);
     ud_set_mode(ud, 64);
 
     s_ThreadState.m_LogicalCoreIndex = FindLogicalCoreIndex(CacheSimGetCurrentThreadId());
+    s_ThreadState.m_CoreRetryCountdown = kNameRuleRetryInterval;
+    s_ThreadState.m_LastRsp = 0;
+
+    RefreshSegmentBases();
+
+    s_ThreadState.m_SampleRemaining = 0;
+    memset(s_ThreadState.m_SampleStats, 0, sizeof s_ThreadState.m_SampleStats);
 
     s_ThreadState.m_Generation = curr_gen;
     InvalidateStack();
   }
+  else if (s_ThreadState.m_LogicalCoreIndex < 0 && ShouldRetryLogicalCore(&s_ThreadState.m_CoreRetryCountdown))
+  {
+    s_ThreadState.m_LogicalCoreIndex = FindLogicalCoreIndex(CacheSimGetCurrentThreadId());
+  }
+}
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+// Sampled captures get a timer tick on this signal every period of CPU time of each traced thread.
+static const int kSampleSignal = SIGPROF;
+
+// Sampling timer and instruction counter of a traced thread, set up when a sampled capture starts.
+struct SampleThread
+{
+  pid_t   m_ThreadId;
+  timer_t m_Timer;
+  int     m_CounterFd;          ///< Counts the thread's user mode instructions outside sampling windows, -1 if unavailable
+};
+
+static SampleThread* s_SampleThreads = nullptr;
+static int s_SampleThreadCount = 0;
+static uint32_t s_SampleThreadReserveCount = 0;
+/// Instructions run in completed windows. The instruction counters are off during windows, so the warmup is counted
+/// here for the total, but only the measurement part is extrapolated from, see FinishSampling().
+static uint64_t s_SampleTracedInstructions = 0;
+
+static int FindSampleCounter()
+{
+  const pid_t tid = (pid_t)CacheSimGetCurrentThreadId();
+  for (int i = 0; i < s_SampleThreadCount; ++i)
+  {
+    if (s_SampleThreads[i].m_ThreadId == tid)
+      return s_SampleThreads[i].m_CounterFd;
+  }
+  return -1;
+}
+
+static void HandleSampleTimer(int signo, siginfo_t* siginfo, void* ucontext_param)
+{
+  (void)signo;
+  (void)siginfo;
+  using namespace CacheSim;
+
+  if (!g_TraceEnabled)
+    return;
+
+  RefreshThreadState();
+
+  // Ticks that arrive while the previous window is still being traced are dropped.
+  if (s_ThreadState.m_LogicalCoreIndex < 0 || s_ThreadState.m_SampleRemaining)
+    return;
+
+  int counter = FindSampleCounter();
+  if (counter >= 0)
+    ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+
+  s_ThreadState.m_SampleRemaining = g_Sampling.m_WarmupInstructions + g_Sampling.m_MeasureInstructions;
+
+  // The thread has been running untraced, its call stack is stale.
+  InvalidateStack();
+
+  ((ucontext_t*)ucontext_param)->uc_mcontext.gregs[REG_EFL] |= 0x100;
+}
+
+// Run untraced until the next timer tick.
+static void EndSampleBurst(ucontext_t* uc)
+{
+  using namespace CacheSim;
 
+  EndSampleWindow();
+  __sync_fetch_and_add(&s_SampleTracedInstructions, uint64_t(g_Sampling.m_WarmupInstructions) + g_Sampling.m_MeasureInstructions);
 
-  const int core_index = s_ThreadState.m_LogicalCoreIndex;
+  int counter = FindSampleCounter();
+  if (counter >= 0)
+    ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+
+  uc->uc_mcontext.gregs[REG_EFL] &= ~0x100ull;
+}
+
+// Skipped instructions count too, or a window that lands in skipped code would never end.
+static void CountSampledInstruction(ucontext_t* uc)
+{
+  using namespace CacheSim;
+
+  if (s_ThreadState.m_SampleRemaining && 0 == --s_ThreadState.m_SampleRemaining)
+  {
+    EndSampleBurst(uc);
+  }
+}
+
+static int OpenInstructionCounter(pid_t tid)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof attr);
+  attr.size = sizeof attr;
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void StartSampling()
+{
+  using namespace CacheSim;
+
+  s_SampleThreadCount = 0;
+  s_SampleTracedInstructions = 0;
+  memset(&g_SamplingSummary, 0, sizeof g_SamplingSummary);
+
+  // Take a copy of the traced threads first, timers can't be set up with g_Lock held.
+  {
+    AutoSpinLock lock;
+    GrowArray(&s_SampleThreads, 0, &s_SampleThreadReserveCount, CountMappedThreads(), 64);
+    ForEachMappedThread([](uint64_t thread_id, int) { s_SampleThreads[s_SampleThreadCount++].m_ThreadId = (pid_t)thread_id; });
+  }
+
+  const int thread_count = s_SampleThreadCount;
+  s_SampleThreadCount = 0;
+
+  for (int i = 0; i < thread_count; ++i)
+  {
+    const pid_t tid = s_SampleThreads[i].m_ThreadId;
+
+    // Tick on the thread's own CPU time, so blocked threads aren't sampled.
+    const clockid_t clock = ((~clockid_t(tid)) << 3) | 6;   // MAKE_THREAD_CPUCLOCK(tid, CPUCLOCK_SCHED)
+
+    struct sigevent event;
+    memset(&event, 0, sizeof event);
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = kSampleSignal;
+    event.sigev_notify_thread_id = tid;
+
+    auto& thread = s_SampleThreads[s_SampleThreadCount];
+    if (0 != timer_create(clock, &event, &thread.m_Timer))
+    {
+      fprintf(stderr, "Failed to create sampling timer for thread %d: %s\n", tid, strerror(errno));
+      continue;
+    }
+
+    thread.m_ThreadId = tid;
+    thread.m_CounterFd = OpenInstructionCounter(tid);
+    ++s_SampleThreadCount;
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = g_Sampling.m_PeriodUs / 1000000;
+    spec.it_interval.tv_nsec = (g_Sampling.m_PeriodUs % 1000000) * 1000;
+    spec.it_value = spec.it_interval;
+    timer_settime(thread.m_Timer, 0, &spec, nullptr);
+  }
+}
+
+static void StopSampling()
+{
+  using namespace CacheSim;
+
+  // The instruction count is only known if every thread could be counted.
+  uint64_t instructions = s_SampleTracedInstructions;
+  bool counted = s_SampleThreadCount > 0;
+
+  for (int i = 0; i < s_SampleThreadCount; ++i)
+  {
+    timer_delete(s_SampleThreads[i].m_Timer);
+
+    uint64_t value = 0;
+    if (s_SampleThreads[i].m_CounterFd >= 0 && sizeof value == read(s_SampleThreads[i].m_CounterFd, &value, sizeof value))
+      instructions += value;
+    else
+      counted = false;
+
+    if (s_SampleThreads[i].m_CounterFd >= 0)
+      close(s_SampleThreads[i].m_CounterFd);
+  }
+
+  s_SampleThreadCount = 0;
+  g_SamplingSummary.m_EstimatedInstructions = counted ? instructions : 0;
+}
+
+// glibc blocks all signals around creating a thread and as a thread exits, and a single-step trap arriving while
+// SIGTRAP is blocked kills the whole process. Single-stepped sigprocmask calls are pointed at a copy of their signal
+// set that leaves SIGTRAP out, and the argument register is put back on the next trap before any code can see it.
+struct SigprocmaskPatch
+{
+  uint64_t  m_Set;            ///< Signal set passed to the kernel instead
+  uintptr_t m_OriginalSet;    ///< Set the code passed, 0 if the last instruction wasn't patched
+};
+
+static thread_local SigprocmaskPatch s_SigprocmaskPatch __attribute__((tls_model("initial-exec")));
+
+static void KeepTrapSignalUnblocked(ucontext_t* uc)
+{
+  greg_t* regs = uc->uc_mcontext.gregs;
+
+  if (s_SigprocmaskPatch.m_OriginalSet)
+  {
+    regs[REG_RSI] = s_SigprocmaskPatch.m_OriginalSet;
+    s_SigprocmaskPatch.m_OriginalSet = 0;
+  }
+
+  const uint8_t* code = (const uint8_t*)regs[REG_RIP];
+  if (0 == (regs[REG_EFL] & 0x100) || code[0] != 0x0f || code[1] != 0x05 || SYS_rt_sigprocmask != regs[REG_RAX])
+    return;
+
+  const uint64_t* set = (const uint64_t*)regs[REG_RSI];
+  const uint64_t trap_bit = 1ull << (SIGTRAP - 1);
+  if (!set || SIG_UNBLOCK == regs[REG_RDI] || 0 == (*set & trap_bit))
+    return;
+
+  s_SigprocmaskPatch.m_Set = *set & ~trap_bit;
+  s_SigprocmaskPatch.m_OriginalSet = (uintptr_t)set;
+  regs[REG_RSI] = (greg_t)&s_SigprocmaskPatch.m_Set;
+}
+
+static void TraceInstruction(void* ucontext_param)
+{
+  using namespace CacheSim;
+
+  RefreshThreadState();
+
+  ud_t* ud = &s_ThreadState.m_Disassembler;
+  const int core_index = UpdateScheduledCore();
+
+  // Traced threads run from the code cache where possible and only single-step what it can't translate.
+  // Sampled captures always single-step.
+  if (core_index >= 0 && kCaptureEngineCodeCache == s_CaptureEngine && !g_Sampling.m_PeriodUs && EnterCodeCache((ucontext_t*)ucontext_param))
+    return;
 
   // Only trace threads we've mapped to cores. Ignore all others.
   if (g_TraceEnabled && core_index >= 0)
   {
+    uintptr_t rip = ((ucontext_t*)ucontext_param)->uc_mcontext.gregs[REG_RIP];
+    TrackFiberSwitch(((ucontext_t*)ucontext_param)->uc_mcontext.gregs[REG_RSP]);
+
+    const int action = GetFilterAction(rip);
+    if (kFilterSkip == action)
+    {
+      // Calls and returns aren't seen while skipping, so the stack must be recomputed afterwards.
+      InvalidateStack();
+      CountSampledInstruction((ucontext_t*)ucontext_param);
+      return;
+    }
+
     CONTEXT context;
     ConvertToWinStyleContext(&context, &((ucontext_t*)ucontext_param)->uc_mcontext);
 
-    uintptr_t rip = context.Rip;
-    if (~0u == s_ThreadState.m_StackIndex)
+    if (kFilterTrace == action && ~0u == s_ThreadState.m_StackIndex)
     {
       // Recompute call stack
       void* callstack[kMaxCalls];
@@ -177,10 +483,32 @@ static void HandleTrap(int signo, siginfo_t* siginfo, void* ucontext_param)
     ud_set_input_buffer(ud, (const uint8_t*)rip, 16);
     ud_set_pc(ud, rip);
     int ilen = ud_disassemble(ud);
-    GenerateMemoryAccesses(core_index, ud, rip, ilen, &context);
+    GenerateMemoryAccesses(core_index, ud, rip, ilen, &context, kFilterTrace == action);
+    CountSampledInstruction((ucontext_t*)ucontext_param);
   }
 }
 
+static void HandleTrap(int signo, siginfo_t* siginfo, void* ucontext_param)
+{
+  (void)signo;
+  (void)siginfo;
+  using namespace CacheSim;
+
+  ucontext_t* uc = (ucontext_t*)ucontext_param;
+
+  if (g_TraceEnabled == false)
+  {
+    // Clear the trap bit
+    uc->uc_mcontext.gregs[REG_EFL] &= ~(0x100ull);
+  }
+  else
+  {
+    TraceInstruction(uc);
+  }
+
+  KeepTrapSignalUnblocked(uc);
+}
+
 static char executable_filepath[512];
 
 void CacheSimInit()
@@ -199,12 +527,46 @@ void CacheSimInit()
 
   executable_filepath[len] = '\0';
 
+  s_HaveFsGsBase = 0 != (getauxval(AT_HWCAP2) & HWCAP2_FSGSBASE);
+
   // Force backtrace to do its initialization here, outside of the signal handler
   void* callstack[kMaxCalls];
   backtrace(callstack, kMaxCalls);
 
 }
 
+static void InstallSignalHandlers()
+{
+  if (g_SignalHandlerInstalled)
+    return;
+
+  // The trap and sampling handlers both update the thread's sampling state, so they block each other.
+  struct sigaction action;
+  action.sa_sigaction = HandleTrap;
+  sigemptyset(&action.sa_mask);
+  sigaddset(&action.sa_mask, kSampleSignal);
+  action.sa_flags = SA_SIGINFO;
+  int ok = sigaction(SIGTRAP, &action, &g_OldSigAction);
+
+  if (ok != 0)
+  {
+    DebugBreak(); // Failed to install signal handler
+  }
+
+  action.sa_sigaction = HandleSampleTimer;
+  sigemptyset(&action.sa_mask);
+  sigaddset(&action.sa_mask, SIGTRAP);
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  ok = sigaction(kSampleSignal, &action, &g_OldSampleSigAction);
+
+  if (ok != 0)
+  {
+    DebugBreak(); // Failed to install signal handler
+  }
+
+  g_SignalHandlerInstalled = true;
+}
+
 static void ContinueProcess(const pid_t pid)
 {
   int   status;
@@ -233,6 +595,157 @@ static void ContinueProcess(const pid_t pid)
   return;
 }
 
+static uint64_t GetCurrentOsThreadId()
+{
+  return CacheSimGetCurrentThreadId();
+}
+
+static bool GetThreadName(uint64_t thread_id, char* name, size_t name_size)
+{
+  // Open and read are safe in signal handlers, unlike pthread_getname_np().
+  char path[64];
+  snprintf(path, sizeof path, "/proc/self/task/%ld/comm", (long)thread_id);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  ssize_t len = read(fd, name, name_size - 1);
+  close(fd);
+  if (len <= 0)
+    return false;
+
+  // Drop the trailing newline.
+  if ('\n' == name[len - 1])
+    --len;
+  name[len] = '\0';
+  return true;
+}
+
+static uintptr_t ParseHex(const char** cursor)
+{
+  uintptr_t value = 0;
+  for (const char* p = *cursor;; ++p)
+  {
+    const char c = *p;
+    if (c >= '0' && c <= '9')
+      value = value * 16 + (c - '0');
+    else if (c >= 'a' && c <= 'f')
+      value = value * 16 + (c - 'a' + 10);
+    else
+    {
+      *cursor = p;
+      return value;
+    }
+  }
+}
+
+// Reads /proc/self/maps with open and read rather than stdio, as this runs in the trap handler.
+static void GetThreadStacks(uintptr_t rsp, CacheSim::AddressRange* stack, CacheSim::AddressRange* signal_stack)
+{
+  memset(stack, 0, sizeof *stack);
+  memset(signal_stack, 0, sizeof *signal_stack);
+
+  stack_t alt_stack;
+  if (0 == sigaltstack(nullptr, &alt_stack) && !(alt_stack.ss_flags & SS_DISABLE))
+  {
+    signal_stack->m_Start = uintptr_t(alt_stack.ss_sp);
+    signal_stack->m_End = uintptr_t(alt_stack.ss_sp) + alt_stack.ss_size;
+  }
+
+  int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  char buffer[4096];
+  size_t used = 0;
+  bool found = false;
+  while (!found)
+  {
+    ssize_t len = read(fd, buffer + used, sizeof buffer - 1 - used);
+    if (len <= 0)
+      break;
+    used += len;
+    buffer[used] = '\0';
+
+    char* line = buffer;
+    while (char* newline = strchr(line, '\n'))
+    {
+      *newline = '\0';
+
+      const char* cursor = line;
+      const uintptr_t start = ParseHex(&cursor);
+      ++cursor;
+      const uintptr_t end = ParseHex(&cursor);
+      if (rsp >= start && rsp < end)
+      {
+        stack->m_Start = start;
+        stack->m_End = end;
+
+        // The main thread's stack grows down on demand, up to the stack size limit.
+        struct rlimit limit;
+        const size_t name_length = newline - line;
+        if (name_length > 7 && 0 == strcmp(newline - 7, "[stack]") && 0 == getrlimit(RLIMIT_STACK, &limit) &&
+            RLIM_INFINITY != limit.rlim_cur && limit.rlim_cur > end - start && limit.rlim_cur < end)
+        {
+          stack->m_Start = end - limit.rlim_cur;
+        }
+
+        found = true;
+        break;
+      }
+
+      line = newline + 1;
+    }
+
+    // Keep the partial line for the next read.
+    used = buffer + used - line;
+    memmove(buffer, line, used);
+  }
+
+  close(fd);
+}
+
+static int GetThreadFirstCpu(uint64_t thread_id)
+{
+  cpu_set_t cpus;
+  if (0 != sched_getaffinity((pid_t)thread_id, sizeof cpus, &cpus))
+    return -1;
+
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+  {
+    if (CPU_ISSET(cpu, &cpus))
+      return cpu;
+  }
+  return -1;
+}
+
+static int GetCurrentCpu()
+{
+  return sched_getcpu();
+}
+
+// Gives the threads of the process a core by policy before they're set up for tracing.
+static void AssignThreadCores()
+{
+  using namespace CacheSim;
+
+  if (kThreadCoreExplicit == s_ThreadCorePolicy)
+    return;
+
+  DIR* dir = opendir("/proc/self/task");
+  if (!dir)
+    return;
+
+  while (struct dirent* entry = readdir(dir))
+  {
+    if (entry->d_name[0] >= '0' && entry->d_name[0] <= '9')
+      AssignLogicalCore(strtoull(entry->d_name, nullptr, 10));
+  }
+
+  closedir(dir);
+}
+
 bool CacheSimStartCapture()
 {
   using namespace CacheSim;
@@ -241,34 +754,39 @@ bool CacheSimStartCapture()
     return false;
   }
 
+  // The symbolization thread of the last capture would be traced along with the rest.
+  CacheSimWaitForSymbolization();
+
   // Reset.
   g_Cache.Init();
+  ResolveFilters();
+  StartConfigWorkers();
+  AssignThreadCores();
 
-  pid_t child = fork();
-  if (child != 0)
+  FlushCodeCacheIfModulesChanged();
+  g_CodeCacheActive = kCaptureEngineCodeCache == s_CaptureEngine && !g_Sampling.m_PeriodUs;
+
+  if (g_Sampling.m_PeriodUs)
   {
-    // Parent process
+    // Sampled captures don't trace from the start. The timer ticks set the trap flag on each thread.
     __sync_fetch_and_add(&g_Generation, 1);
+    InstallSignalHandlers();
 
     g_TraceEnabled = 1;
+    StartSampling();
+    return true;
+  }
 
-    if (g_SignalHandlerInstalled == false)
-    {
-      struct sigaction action;
-      action.sa_sigaction = HandleTrap;
-      sigemptyset(&action.sa_mask);
-      action.sa_flags = SA_SIGINFO;
-      int ok = sigaction(SIGTRAP, &action, &g_OldSigAction);
-
-      if (ok != 0)
-      {
-        DebugBreak(); // Failed to install signal handler
-      }
-
-      g_SignalHandlerInstalled = true;
-    }
+  // The handlers must be live before fork() returns here: the child can set the trap flag on this thread while
+  // it is still inside fork().
+  __sync_fetch_and_add(&g_Generation, 1);
+  g_TraceEnabled = 1;
+  InstallSignalHandlers();
 
-    // We're in the main process. We need to make ourselves traceable
+  pid_t child = fork();
+  if (child != 0)
+  {
+    // Parent process. We need to make ourselves traceable
     prctl(PR_SET_DUMPABLE, (long)1);
     prctl(PR_SET_PTRACER, (long)child);
 
@@ -281,36 +799,34 @@ bool CacheSimStartCapture()
   }
   else
   {
-    // Trace parent and then die.
-    pid_t tids[ARRAY_SIZE(s_CoreMappings)];
+    // Trace parent and then die. Nothing else runs in this process, so the mappings can be read without g_Lock.
+    pid_t* tids = (pid_t*)VirtualMemoryAlloc((CountMappedThreads() + 1) * sizeof(pid_t));
     int thread_count = 0;
 
-    for (int i = 0, count = s_CoreMappingCount; i < count; ++i)
+    ForEachMappedThread([&](uint64_t thread_id, int)
     {
-      const auto& mapping = s_CoreMappings[i];
-
       int ok = -1;
       do
       {
-        ok = ptrace(PTRACE_ATTACH, mapping.m_ThreadId, nullptr, nullptr);
+        ok = ptrace(PTRACE_ATTACH, thread_id, nullptr, nullptr);
         if (errno == ESRCH)
         {
-          fprintf(stderr, "Thread %ld no longer exists.\n", mapping.m_ThreadId);
+          fprintf(stderr, "Thread %ld no longer exists.\n", (long)thread_id);
         }
       } while (ok == -1 && (errno == EFAULT || errno == ESRCH));
 
       if (ok != -1)
       {
-        tids[thread_count++] = mapping.m_ThreadId;
+        tids[thread_count++] = (pid_t)thread_id;
         // Wait for the attachment to thread to stop
         int status;
-        waitpid((pid_t)mapping.m_ThreadId, &status, 0);
+        waitpid((pid_t)thread_id, &status, 0);
       }
       else
       {
-        fprintf(stderr, "Failed to stop thread %ld: %s\n", mapping.m_ThreadId, strerror(errno));
+        fprintf(stderr, "Failed to stop thread %ld: %s\n", (long)thread_id, strerror(errno));
       }
-    }
+    });
 
     for (int i = 0; i < thread_count; i++)
     {
@@ -340,6 +856,7 @@ bool CacheSimStartCapture()
 
 static int RecordModule(struct dl_phdr_info* info, size_t size, void* data)
 {
+  (void)size;
   ModuleList* modules = reinterpret_cast<ModuleList*>(data);
   modules->m_ModuleCallbacks++;
   if (modules->m_Count == ARRAY_SIZE(modules->m_Infos))
@@ -391,6 +908,11 @@ static int RecordModule(struct dl_phdr_info* info, size_t size, void* data)
 
 void DisableTrapFlag()
 {
+  // Threads running translated code don't have the trap flag set. Send them back to native code.
+  LeaveCodeCache();
+
+  StopSampling();
+
   // Clear our trap flag
   asm volatile("pushf\n"
                "andl $0xFFFFFFFFFFFFFEFF, (%rsp)\n"
@@ -403,6 +925,20 @@ void DisableTrapFlag()
   usleep(0);
 }
 
+// Must not be inlined, as it skips its own frame and CacheSimOnAlloc()'s.
+__attribute__((noinline)) static int CaptureAllocStack(uintptr_t frames[], int max_frames)
+{
+  void* callstack[CacheSim::kMaxAllocFrames + 2];
+  int frame_count = backtrace(callstack, std::min(max_frames, int(CacheSim::kMaxAllocFrames)) + 2);
+
+  int count = 0;
+  for (int i = 2; i < frame_count; ++i)
+  {
+    frames[count++] = uintptr_t(callstack[i]);
+  }
+  return count;
+}
+
 void GetFilenameForSave(char* filename, size_t bufferSize)
 {
   const char* executable_name = "unknown";
@@ -428,5 +964,42 @@ void GetModuleList(ModuleList* moduleList)
 void CacheSimRemoveHandler()
 {
   sigaction(SIGTRAP, &g_OldSigAction, nullptr);
+  sigaction(kSampleSignal, &g_OldSampleSigAction, nullptr);
   g_SignalHandlerInstalled = false;
 }
+
+bool CacheSimSetCaptureEngine(int engine)
+{
+  using namespace CacheSim;
+
+  if (g_TraceEnabled)
+    return false;
+
+  switch (engine)
+  {
+  case kCaptureEngineSingleStep:
+    break;
+  case kCaptureEngineCodeCache:
+    if (!InitCodeCache())
+      return false;
+    break;
+  default:
+    return false;
+  }
+
+  s_CaptureEngine = engine;
+  return true;
+}
+
+bool CacheSimSetSampling(uint32_t period_us, uint32_t warmup_instructions, uint32_t measure_instructions)
+{
+  using namespace CacheSim;
+
+  if (g_TraceEnabled || (period_us && !measure_instructions))
+    return false;
+
+  g_Sampling.m_PeriodUs = period_us;
+  g_Sampling.m_WarmupInstructions = warmup_instructions;
+  g_Sampling.m_MeasureInstructions = measure_instructions;
+  return true;
+}
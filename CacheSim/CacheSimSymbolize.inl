@@ -0,0 +1,502 @@
+#pragma once
+
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+///////////
+// Capture-time symbolization (Linux)
+//
+// With CacheSimSetCaptureSymbolization(), every saved capture is resolved on a background thread once it's written,
+// while the traced modules are still loaded. Each unique instruction is named from the symbol table of its module's
+// file, which has the local functions too, and failing that with dladdr(), which sees the dynamic symbols of the
+// module as loaded. The symbols and the symbol index are appended to the file and the header is patched last, so
+// the file reads as unresolved until they are complete. Only names are found; the UI's resolver adds file and line
+// information.
+//
+// It must be included exactly ONCE, after CacheSimCommon.inl.
+//////////
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace CacheSim
+{
+  /// Function symbols of the .symtab section of an ELF file, addressed as in the file.
+  class ElfSymbolTable
+  {
+  public:
+    ElfSymbolTable() {}
+    ~ElfSymbolTable();
+
+    ElfSymbolTable(const ElfSymbolTable&) = delete;
+    ElfSymbolTable& operator=(const ElfSymbolTable&) = delete;
+
+    bool Load(const char* path);
+
+    /// Name of the function containing `address`, or null.
+    const char* Find(uint64_t address, uint64_t* symbol_address) const;
+
+  private:
+    struct Symbol
+    {
+      uint64_t    m_Address;
+      uint64_t    m_Size;
+      const char* m_Name;
+    };
+
+    void*               m_Map = nullptr;
+    size_t              m_MapSize = 0;
+    std::vector<Symbol> m_Symbols;
+  };
+
+  /// A module of the capture being symbolized, from its SerializedModuleEntry.
+  struct SymbolizeModule
+  {
+    uint64_t        m_Begin;          ///< Code range
+    uint64_t        m_End;
+    uint64_t        m_ImageBase;      ///< Load bias, added to the addresses in the file
+    uint32_t        m_Index;
+    const char*     m_Name;
+    ElfSymbolTable* m_Symbols;        ///< Loaded on first use
+    bool            m_Loaded;
+  };
+
+  static bool s_SymbolizeCaptures = false;
+  static std::thread* s_SymbolizeThread = nullptr;
+}
+
+CacheSim::ElfSymbolTable::~ElfSymbolTable()
+{
+  if (m_Map)
+    munmap(m_Map, m_MapSize);
+}
+
+bool CacheSim::ElfSymbolTable::Load(const char* path)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  void* map = MAP_FAILED;
+  if (0 == fstat(fd, &st) && size_t(st.st_size) >= sizeof(Elf64_Ehdr))
+  {
+    map = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+
+  if (MAP_FAILED == map)
+    return false;
+
+  m_Map = map;
+  m_MapSize = size_t(st.st_size);
+
+  const uint8_t* data = static_cast<const uint8_t*>(map);
+  const Elf64_Ehdr* ehdr = reinterpret_cast<const Elf64_Ehdr*>(data);
+  if (0 != memcmp(ehdr->e_ident, ELFMAG, SELFMAG) || ELFCLASS64 != ehdr->e_ident[EI_CLASS] ||
+      sizeof(Elf64_Shdr) != ehdr->e_shentsize || ehdr->e_shoff > m_MapSize ||
+      ehdr->e_shnum > (m_MapSize - ehdr->e_shoff) / sizeof(Elf64_Shdr))
+  {
+    return false;
+  }
+
+  auto in_file = [this](uint64_t offset, uint64_t size) -> bool
+  {
+    return offset <= m_MapSize && size <= m_MapSize - offset;
+  };
+
+  const Elf64_Shdr* sections = reinterpret_cast<const Elf64_Shdr*>(data + ehdr->e_shoff);
+  for (uint32_t i = 0; i < ehdr->e_shnum; ++i)
+  {
+    const Elf64_Shdr& symtab = sections[i];
+    if (SHT_SYMTAB != symtab.sh_type || symtab.sh_link >= ehdr->e_shnum)
+      continue;
+
+    const Elf64_Shdr& strtab = sections[symtab.sh_link];
+    if (!in_file(symtab.sh_offset, symtab.sh_size) || !in_file(strtab.sh_offset, strtab.sh_size) || !strtab.sh_size)
+      continue;
+
+    const Elf64_Sym* syms = reinterpret_cast<const Elf64_Sym*>(data + symtab.sh_offset);
+    const char* strings = reinterpret_cast<const char*>(data + strtab.sh_offset);
+    const size_t sym_count = symtab.sh_size / sizeof(Elf64_Sym);
+
+    // The string table must end in a terminator for the names to be used in place.
+    if (strings[strtab.sh_size - 1])
+      continue;
+
+    for (size_t s = 0; s < sym_count; ++s)
+    {
+      const Elf64_Sym& sym = syms[s];
+      const int type = ELF64_ST_TYPE(sym.st_info);
+      if ((STT_FUNC == type || STT_GNU_IFUNC == type) && SHN_UNDEF != sym.st_shndx && sym.st_value && sym.st_name < strtab.sh_size)
+      {
+        Symbol symbol = { sym.st_value, sym.st_size, strings + sym.st_name };
+        m_Symbols.push_back(symbol);
+      }
+    }
+  }
+
+  std::sort(m_Symbols.begin(), m_Symbols.end(), [](const Symbol& l, const Symbol& r)
+  {
+    return l.m_Address < r.m_Address;
+  });
+
+  return !m_Symbols.empty();
+}
+
+const char* CacheSim::ElfSymbolTable::Find(uint64_t address, uint64_t* symbol_address) const
+{
+  auto it = std::upper_bound(m_Symbols.begin(), m_Symbols.end(), address, [](uint64_t address, const Symbol& sym)
+  {
+    return address < sym.m_Address;
+  });
+
+  if (it == m_Symbols.begin())
+    return nullptr;
+
+  const Symbol& sym = *--it;
+  if (address != sym.m_Address && address - sym.m_Address >= sym.m_Size)
+    return nullptr;
+
+  *symbol_address = sym.m_Address;
+  return sym.m_Name;
+}
+
+// Appends a UTF-8 string and its terminator to UTF-16 string data, as the UI reads it.
+static uint32_t AppendUtf16(std::vector<uint16_t>* text, const char* str)
+{
+  const uint32_t offset = uint32_t(text->size());
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(str);
+
+  while (*p)
+  {
+    const uint8_t lead = *p++;
+    int extra = lead >= 0xf0 ? 3 : lead >= 0xe0 ? 2 : lead >= 0xc0 ? 1 : 0;
+    uint32_t cp = extra ? lead & (0x3f >> extra) : lead;
+    for (; extra && 0x80 == (*p & 0xc0); --extra)
+    {
+      cp = (cp << 6) | (*p++ & 0x3f);
+    }
+    if (extra || (lead >= 0x80 && lead < 0xc0))
+    {
+      // Truncated sequence or stray continuation byte.
+      cp = 0xfffd;
+    }
+
+    if (cp >= 0x10000)
+    {
+      cp -= 0x10000;
+      text->push_back(uint16_t(0xd800 + (cp >> 10)));
+      text->push_back(uint16_t(0xdc00 + (cp & 0x3ff)));
+    }
+    else
+    {
+      text->push_back(uint16_t(cp));
+    }
+  }
+
+  text->push_back(0);
+  return offset;
+}
+
+static bool WriteAt(int fd, const void* data, size_t size, uint64_t offset)
+{
+  const char* p = static_cast<const char*>(data);
+  while (size)
+  {
+    ssize_t written = pwrite(fd, p, size, off_t(offset));
+    if (written <= 0)
+    {
+      if (written < 0 && EINTR == errno)
+        continue;
+      return false;
+    }
+    p += written;
+    size -= size_t(written);
+    offset += uint64_t(written);
+  }
+  return true;
+}
+
+// Names `rip` like the UI's resolver would, or returns false if it isn't in a module.
+static bool SymbolizeRip(uintptr_t rip, std::vector<CacheSim::SymbolizeModule>& modules, std::string* name, uint32_t* module_index, uint32_t* displacement)
+{
+  using namespace CacheSim;
+
+  auto it = std::upper_bound(modules.begin(), modules.end(), rip, [](uintptr_t rip, const SymbolizeModule& module)
+  {
+    return rip < module.m_Begin;
+  });
+
+  if (it == modules.begin() || rip >= (it - 1)->m_End)
+    return false;
+
+  SymbolizeModule& module = *(it - 1);
+  if (!module.m_Loaded)
+  {
+    module.m_Loaded = true;
+    module.m_Symbols = new ElfSymbolTable;
+    if (!module.m_Symbols->Load(module.m_Name))
+    {
+      delete module.m_Symbols;
+      module.m_Symbols = nullptr;
+    }
+  }
+
+  const char* mangled = nullptr;
+  uintptr_t symbol_address = 0;
+
+  uint64_t file_address = 0;
+  if (module.m_Symbols)
+  {
+    if ((mangled = module.m_Symbols->Find(rip - module.m_ImageBase, &file_address)))
+    {
+      symbol_address = uintptr_t(file_address + module.m_ImageBase);
+    }
+  }
+
+  Dl_info info;
+  void* sym = nullptr;
+  if (!mangled && dladdr1(reinterpret_cast<void*>(rip), &info, &sym, RTLD_DL_SYMENT) && info.dli_sname && sym &&
+      rip - uintptr_t(info.dli_saddr) < std::max<uint64_t>(static_cast<const ElfW(Sym)*>(sym)->st_size, 1))
+  {
+    mangled = info.dli_sname;
+    symbol_address = uintptr_t(info.dli_saddr);
+  }
+
+  *module_index = module.m_Index;
+
+  if (!mangled)
+  {
+    char buffer[64];
+    snprintf(buffer, sizeof buffer, "[0x%016llx in ", (unsigned long long)rip);
+    *name = buffer;
+    *name += module.m_Name;
+    *name += "]";
+    *displacement = ~0u;
+    return true;
+  }
+
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+  *name = demangled ? demangled : mangled;
+  free(demangled);
+  *displacement = uint32_t(rip - symbol_address);
+  return true;
+}
+
+// Resolves the capture written to `fd` and appends the symbol sections, then closes it.
+static void SymbolizeCapture(int fd)
+{
+  using namespace CacheSim;
+
+  struct stat st;
+  void* map = MAP_FAILED;
+  if (0 == fstat(fd, &st) && size_t(st.st_size) >= sizeof(SerializedHeader))
+  {
+    map = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+  }
+
+  if (MAP_FAILED == map)
+  {
+    fprintf(stderr, "CacheSim: failed to map the capture for symbolization\n");
+    close(fd);
+    return;
+  }
+
+  const SerializedHeader* hdr = static_cast<const SerializedHeader*>(map);
+  const SerializedNode* nodes = hdr->GetStats();
+  const uintptr_t* frames = hdr->GetStacks();
+
+  // Every instruction with stats and every return address in the call stacks.
+  std::vector<uintptr_t> rips;
+  rips.reserve(hdr->GetStatCount() + hdr->GetStackCount());
+  for (uint32_t i = 0; i < hdr->GetStatCount(); ++i)
+  {
+    rips.push_back(nodes[i].m_Rip);
+  }
+  for (uint32_t i = 0; i < hdr->GetStackCount(); ++i)
+  {
+    if (frames[i])
+      rips.push_back(frames[i]);
+  }
+  std::sort(rips.begin(), rips.end());
+  rips.erase(std::unique(rips.begin(), rips.end()), rips.end());
+
+  std::vector<SymbolizeModule> modules;
+  for (uint32_t i = 0; i < hdr->GetModuleCount(); ++i)
+  {
+    const SerializedModuleEntry& entry = hdr->GetModules()[i];
+    const uint64_t begin = entry.m_ImageBase + entry.m_ImageSegmentOffset;
+    SymbolizeModule module = { begin, begin + entry.m_SizeBytes, entry.m_ImageBase, i, hdr->GetModuleName(entry), nullptr, false };
+    modules.push_back(module);
+  }
+  std::sort(modules.begin(), modules.end(), [](const SymbolizeModule& l, const SymbolizeModule& r)
+  {
+    return l.m_Begin < r.m_Begin;
+  });
+
+  std::vector<SerializedSymbol> symbols;
+  std::vector<uint16_t> text;
+  std::unordered_map<std::string, uint32_t> interned;
+  text.push_back(0);    // Zero offset strings point here.
+
+  std::string name;
+  for (uintptr_t rip : rips)
+  {
+    SerializedSymbol symbol;
+    memset(&symbol, 0, sizeof symbol);
+    symbol.m_Rip = rip;
+
+    if (!SymbolizeRip(rip, modules, &name, &symbol.m_ModuleIndex, &symbol.m_Displacement))
+      continue;
+
+    auto it = interned.find(name);
+    if (it == interned.end())
+    {
+      it = interned.insert(std::make_pair(name, AppendUtf16(&text, name.c_str()))).first;
+    }
+    symbol.m_SymbolName = it->second;
+    symbols.push_back(symbol);
+  }
+
+  for (SymbolizeModule& module : modules)
+  {
+    delete module.m_Symbols;
+  }
+
+  // Symbols are in address order, as the rips were.
+  auto find = [&symbols](uintptr_t rip) -> uint32_t
+  {
+    auto it = std::lower_bound(symbols.begin(), symbols.end(), rip, [](const SerializedSymbol& sym, uintptr_t rip)
+    {
+      return sym.m_Rip < rip;
+    });
+    return (it != symbols.end() && it->m_Rip == rip) ? uint32_t(it - symbols.begin()) : kNoSymbolIndex;
+  };
+
+  std::vector<uint32_t> node_symbols(hdr->GetStatCount());
+  std::vector<uint32_t> frame_symbols(hdr->GetStackCount());
+  for (uint32_t i = 0; i < hdr->GetStatCount(); ++i)
+  {
+    node_symbols[i] = find(nodes[i].m_Rip);
+  }
+  for (uint32_t i = 0; i < hdr->GetStackCount(); ++i)
+  {
+    frame_symbols[i] = frames[i] ? find(frames[i]) : kNoSymbolIndex;
+  }
+
+  // Same layout as the UI writes: symbols, string data, then the 8 byte aligned index.
+  const uint64_t symbol_offset = (uint64_t(st.st_size) + 7) & ~uint64_t(7);
+  const uint64_t text_offset = symbol_offset + symbols.size() * sizeof(SerializedSymbol);
+  const uint64_t node_offset = (text_offset + text.size() * sizeof(uint16_t) + 7) & ~uint64_t(7);
+  const uint64_t frame_offset = node_offset + node_symbols.size() * sizeof(uint32_t);
+  const uint64_t end_offset = frame_offset + frame_symbols.size() * sizeof(uint32_t);
+
+  munmap(map, size_t(st.st_size));
+
+  if (symbols.empty() || end_offset > UINT32_MAX)
+  {
+    fprintf(stderr, "CacheSim: %s, the capture was left unresolved\n", symbols.empty() ? "no symbols were found" : "the symbols don't fit in the file");
+    close(fd);
+    return;
+  }
+
+  const uint32_t node_frame_offsets[] = { uint32_t(node_offset), uint32_t(frame_offset) };
+  const uint32_t symbol_count = uint32_t(symbols.size());
+  const uint32_t symbol_offset32 = uint32_t(symbol_offset);
+  const uint32_t text_offset32 = uint32_t(text_offset);
+
+  // The symbol count goes in last, it's what marks the file as resolved.
+  bool ok = WriteAt(fd, symbols.data(), symbols.size() * sizeof(SerializedSymbol), symbol_offset) &&
+            WriteAt(fd, text.data(), text.size() * sizeof(uint16_t), text_offset) &&
+            WriteAt(fd, node_symbols.data(), node_symbols.size() * sizeof(uint32_t), node_offset) &&
+            WriteAt(fd, frame_symbols.data(), frame_symbols.size() * sizeof(uint32_t), frame_offset) &&
+            WriteAt(fd, node_frame_offsets, sizeof node_frame_offsets, offsetof(SerializedHeader, m_NodeSymbolOffset)) &&
+            WriteAt(fd, &symbol_offset32, sizeof symbol_offset32, offsetof(SerializedHeader, m_SymbolOffset)) &&
+            WriteAt(fd, &text_offset32, sizeof text_offset32, offsetof(SerializedHeader, m_SymbolTextOffset)) &&
+            0 == fdatasync(fd) &&
+            WriteAt(fd, &symbol_count, sizeof symbol_count, offsetof(SerializedHeader, m_SymbolCount));
+
+  if (!ok)
+  {
+    fprintf(stderr, "CacheSim: failed to write the capture's symbols: %s\n", strerror(errno));
+  }
+
+  close(fd);
+}
+
+// Called by CacheSimEndCapture() once a capture is written.
+static void OnCaptureSaved(const char* filename)
+{
+  using namespace CacheSim;
+
+  if (!s_SymbolizeCaptures)
+    return;
+
+  CacheSimWaitForSymbolization();
+
+  // Opened here, so the thread doesn't depend on the working directory staying put.
+  int fd = open(filename, O_RDWR | O_CLOEXEC);
+  if (fd < 0)
+  {
+    fprintf(stderr, "CacheSim: failed to reopen %s for symbolization\n", filename);
+    return;
+  }
+
+  s_SymbolizeThread = new std::thread(SymbolizeCapture, fd);
+}
+
+bool CacheSimSetCaptureSymbolization(bool enable)
+{
+  using namespace CacheSim;
+
+  if (g_TraceEnabled)
+    return false;
+
+  s_SymbolizeCaptures = enable;
+  return true;
+}
+
+void CacheSimWaitForSymbolization()
+{
+  using namespace CacheSim;
+
+  if (s_SymbolizeThread)
+  {
+    s_SymbolizeThread->join();
+    delete s_SymbolizeThread;
+    s_SymbolizeThread = nullptr;
+  }
+}
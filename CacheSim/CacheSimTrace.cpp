@@ -0,0 +1,707 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// cachesim-trace - out-of-process tracer.
+//
+// Runs a program under ptrace and single-steps every thread from the tracer process, so no code runs
+// inside the target's signal handlers and the simulated caches are never polluted by our own work.
+// Decoding and simulation reuse the same code path as the in-process backend (CacheSimCommon.inl);
+// this file only supplies the platform glue that fetches registers and memory from the tracee.
+//
+// Usage: cachesim-trace [-o output.csim] [-c core_count] [-x modules:cores:l2_kb]... [-r reuse_shift] -- program [args...]
+
+#include "Precompiled.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+#ifndef NT_X86_XSTATE
+#define NT_X86_XSTATE 0x202
+#endif
+
+struct CONTEXT
+{
+  int64_t Rax;
+  int64_t Rcx;
+  int64_t Rdx;
+  int64_t Rbx;
+  int64_t Rsp;
+  int64_t Rbp;
+  int64_t Rsi;
+  int64_t Rdi;
+  int64_t R8;
+  int64_t R9;
+  int64_t R10;
+  int64_t R11;
+  int64_t R12;
+  int64_t R13;
+  int64_t R14;
+  int64_t R15;
+  int64_t Rip;
+  pid_t Tid;            ///< Thread the registers belong to; vector registers are fetched from it on demand
+};
+
+static void DebugBreak()
+{
+  asm volatile("int $3\n");
+}
+
+// Must include this AFTER declaring CONTEXT
+// Sampling, core scheduling and address filters only run in-process, so their helpers go unused here.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "CacheSimCommon.inl"
+#pragma GCC diagnostic pop
+
+namespace CacheSim
+{
+  struct TraceeKey
+  {
+    TraceeKey() : m_Tid(0) {}
+    explicit TraceeKey(pid_t tid) : m_Tid(tid) {}
+    pid_t m_Tid;
+  };
+
+  bool operator==(const TraceeKey& l, const TraceeKey& r)
+  {
+    return l.m_Tid == r.m_Tid;
+  }
+
+  uint32_t HashTypeOverload(const TraceeKey& key)
+  {
+    return uint32_t(key.m_Tid);
+  }
+}
+
+namespace
+{
+  using CacheSim::TraceeKey;
+
+  struct TraceeState
+  {
+    TraceeState() : m_LogicalCoreIndex(-1), m_StackIndex(~0u), m_LastRsp(0), m_ThreadStack(), m_FiberId(0), m_Stepping(false), m_Attached(false) {}
+
+    int       m_LogicalCoreIndex;
+    uint32_t  m_StackIndex;               ///< Same meaning as ThreadState::m_StackIndex, swapped in around each step
+    uintptr_t m_LastRsp;                  ///< Same for ThreadState::m_LastRsp
+    CacheSim::AddressRange m_ThreadStack; ///< Same for ThreadState::m_ThreadStack
+    uint32_t  m_FiberId;                  ///< Same for ThreadState::m_FiberId
+    bool      m_Stepping;                 ///< Set once the thread has reached the traced program (after exec)
+    bool      m_Attached;                 ///< Set once the SIGSTOP the thread reports when it's first traced was seen
+  };
+
+  /// Per-thread state for every thread of the tracee, keyed by tid.
+  GenericHashTable<TraceeKey, TraceeState> s_Tracees;
+
+  pid_t       s_Leader;
+  int         s_CoreCount = 8;
+  int         s_NextCore = 0;
+  const char* s_OutputFilename = nullptr;
+  char        s_ExecutablePath[512];
+}
+
+static uintptr_t AdjustFsSegment(uintptr_t address)
+{
+  return CacheSim::s_ThreadState.m_FsBase + address;
+}
+
+static uintptr_t AdjustGsSegment(uintptr_t address)
+{
+  return CacheSim::s_ThreadState.m_GsBase + address;
+}
+
+// Reads remote memory, splitting the request at page boundaries so a read running into an unmapped page
+// still returns the mapped part. Returns the number of bytes read.
+static size_t ReadRemote(pid_t tid, uintptr_t addr, void* dest, size_t size)
+{
+  const uintptr_t kPageSize = 4096;
+  struct iovec local[2];
+  struct iovec remote[2];
+  int count = 0;
+
+  uintptr_t split = (addr + kPageSize) & ~(kPageSize - 1);
+  size_t first = split - addr < size ? split - addr : size;
+
+  local[count].iov_base = dest;
+  local[count].iov_len = first;
+  remote[count].iov_base = (void*)addr;
+  remote[count].iov_len = first;
+  ++count;
+
+  if (first < size)
+  {
+    local[count].iov_base = (uint8_t*)dest + first;
+    local[count].iov_len = size - first;
+    remote[count].iov_base = (void*)split;
+    remote[count].iov_len = size - first;
+    ++count;
+  }
+
+  ssize_t got = process_vm_readv(tid, local, count, remote, count, 0);
+  return got < 0 ? 0 : size_t(got);
+}
+
+static void ReadVectorReg(int reg_index, bool ymm, const CONTEXT* ctx, uint8_t out[32])
+{
+  // Standard format XSAVE image: legacy XMM registers at 160, upper YMM halves at 576.
+  uint8_t xsave[1024];
+  struct iovec iov = { xsave, sizeof xsave };
+  if (0 != ptrace(PTRACE_GETREGSET, ctx->Tid, (void*)NT_X86_XSTATE, &iov))
+    DebugBreak();
+
+  memcpy(out, xsave + 160 + 16 * reg_index, 16);
+  memset(out + 16, 0, 16);
+
+  if (ymm)
+  {
+    uint64_t xstate_bv;
+    memcpy(&xstate_bv, xsave + 512, sizeof xstate_bv);
+    if ((xstate_bv & 4) && iov.iov_len >= 576 + 256)
+    {
+      memcpy(out + 16, xsave + 576 + 16 * reg_index, 16);
+    }
+  }
+}
+
+static void ConvertToWinStyleContext(CONTEXT* out, const user_regs_struct& in, pid_t tid)
+{
+  out->Rax = in.rax;
+  out->Rcx = in.rcx;
+  out->Rdx = in.rdx;
+  out->Rbx = in.rbx;
+  out->Rsp = in.rsp;
+  out->Rbp = in.rbp;
+  out->Rsi = in.rsi;
+  out->Rdi = in.rdi;
+  out->R8 = in.r8;
+  out->R9 = in.r9;
+  out->R10 = in.r10;
+  out->R11 = in.r11;
+  out->R12 = in.r12;
+  out->R13 = in.r13;
+  out->R14 = in.r14;
+  out->R15 = in.r15;
+  out->Rip = in.rip;
+  out->Tid = tid;
+}
+
+// We can't run the unwinder against another process, so follow the frame pointer chain instead.
+// Code built without frame pointers will produce truncated stacks.
+static uint32_t RemoteBacktrace(pid_t tid, const user_regs_struct& regs, uintptr_t frames[], uint32_t max_frames)
+{
+  uint32_t count = 0;
+  frames[count++] = regs.rip;
+
+  uintptr_t fp = regs.rbp;
+  while (count < max_frames && fp && 0 == (fp & 7))
+  {
+    uintptr_t pair[2]; // saved rbp, return address
+    if (sizeof pair != ReadRemote(tid, fp, pair, sizeof pair) || !pair[1])
+      break;
+
+    frames[count++] = pair[1];
+
+    // Stacks grow down, so callers' frames must be at higher addresses.
+    if (pair[0] <= fp)
+      break;
+    fp = pair[0];
+  }
+
+  return count;
+}
+
+static void TraceStep(pid_t tid, TraceeState* state)
+{
+  using namespace CacheSim;
+
+  if (state->m_LogicalCoreIndex < 0)
+    return;
+
+  struct user_regs_struct regs;
+  if (0 != ptrace(PTRACE_GETREGS, tid, nullptr, &regs))
+    return;
+
+  CONTEXT context;
+  ConvertToWinStyleContext(&context, regs, tid);
+
+  // Swap the tracee's state into the thread state the common code works against.
+  s_ThreadState.m_LogicalCoreIndex = state->m_LogicalCoreIndex;
+  s_ThreadState.m_StackIndex = state->m_StackIndex;
+  s_ThreadState.m_LastRsp = state->m_LastRsp;
+  s_ThreadState.m_ThreadStack = state->m_ThreadStack;
+  s_ThreadState.m_FiberId = state->m_FiberId;
+  s_ThreadState.m_FsBase = regs.fs_base;
+  s_ThreadState.m_GsBase = regs.gs_base;
+
+  TrackFiberSwitch(regs.rsp);
+
+  if (~0u == s_ThreadState.m_StackIndex)
+  {
+    uintptr_t callstack[kMaxCalls];
+    uint32_t frame_count = RemoteBacktrace(tid, regs, callstack, kMaxCalls);
+    s_ThreadState.m_StackIndex = InsertStack(callstack, frame_count);
+  }
+
+  uint8_t code[16] = { 0 };
+  if (0 == ReadRemote(tid, regs.rip, code, sizeof code))
+    return;
+
+  ud_t* ud = &s_ThreadState.m_Disassembler;
+  ud_set_input_buffer(ud, code, sizeof code);
+  ud_set_pc(ud, regs.rip);
+  int ilen = ud_disassemble(ud);
+  GenerateMemoryAccesses(state->m_LogicalCoreIndex, ud, regs.rip, ilen, &context);
+
+  state->m_StackIndex = s_ThreadState.m_StackIndex;
+  state->m_LastRsp = s_ThreadState.m_LastRsp;
+  state->m_ThreadStack = s_ThreadState.m_ThreadStack;
+  state->m_FiberId = s_ThreadState.m_FiberId;
+}
+
+static TraceeState* AddTracee(pid_t tid)
+{
+  TraceeState* state = s_Tracees.Insert(TraceeKey(tid));
+  if (state->m_LogicalCoreIndex < 0)
+  {
+    state->m_LogicalCoreIndex = s_NextCore++ % s_CoreCount;
+  }
+  return state;
+}
+
+// Reads the load bias and executable segment of an ELF file mapped at `map_start` from file offset `map_offset`.
+static bool ReadModuleInfo(const char* path, uintptr_t map_start, uintptr_t map_offset, ModuleInfo* info)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  bool found = false;
+  Elf64_Ehdr ehdr;
+  if (sizeof ehdr == pread(fd, &ehdr, sizeof ehdr, 0) && 0 == memcmp(ehdr.e_ident, ELFMAG, SELFMAG) && ELFCLASS64 == ehdr.e_ident[EI_CLASS])
+  {
+    for (int i = 0; i < ehdr.e_phnum && !found; ++i)
+    {
+      Elf64_Phdr phdr;
+      if (sizeof phdr != pread(fd, &phdr, sizeof phdr, ehdr.e_phoff + i * ehdr.e_phentsize))
+        break;
+
+      if (PT_LOAD == phdr.p_type && (phdr.p_flags & PF_X) && phdr.p_offset >= map_offset)
+      {
+        uintptr_t bias = map_start + (phdr.p_offset - map_offset) - phdr.p_vaddr;
+        info->m_StartAddrInMemory = (void*)bias;
+        info->m_SegmentOffset = (void*)phdr.p_vaddr;
+        info->m_Length = phdr.p_memsz;
+        found = true;
+      }
+    }
+  }
+
+  close(fd);
+  return found;
+}
+
+static void SnapshotModuleList(pid_t pid, ModuleList* modules)
+{
+  char maps_path[64];
+  snprintf(maps_path, sizeof maps_path, "/proc/%d/maps", (int)pid);
+
+  FILE* f = fopen(maps_path, "r");
+  if (!f)
+    return;
+
+  modules->m_Count = 0;
+
+  char line[1024];
+  while (fgets(line, sizeof line, f))
+  {
+    unsigned long start, end, offset;
+    char perms[8];
+    int path_pos = 0;
+    if (4 != sscanf(line, "%lx-%lx %7s %lx %*s %*s %n", &start, &end, perms, &offset, &path_pos) || !path_pos)
+      continue;
+
+    char* path = line + path_pos;
+    path[strcspn(path, "\n")] = '\0';
+    if (perms[2] != 'x' || path[0] != '/')
+      continue;
+
+    if (modules->m_Count == ARRAY_SIZE(modules->m_Infos))
+    {
+      fprintf(stderr, "Cannot record additional modules. Increase the ModuleList::m_Infos buffer size.\n");
+      break;
+    }
+
+    ModuleInfo& info = modules->m_Infos[modules->m_Count];
+    if (strlen(path) >= ARRAY_SIZE(info.m_Filename) || !ReadModuleInfo(path, start, offset, &info))
+      continue;
+
+    strcpy(info.m_Filename, path);
+    modules->m_Count++;
+  }
+
+  fclose(f);
+}
+
+static bool s_HaveModuleSnapshot = false;
+
+static void DisableTrapFlag()
+{
+  // Nothing to do, the tracee is never left with TF set; we simply stop stepping it.
+}
+
+// The tracer assigns cores to the tracee's threads itself, in AddTracee().
+static uint64_t GetCurrentOsThreadId()
+{
+  return (uint64_t)syscall(SYS_gettid);
+}
+
+static bool GetThreadName(uint64_t thread_id, char* name, size_t name_size)
+{
+  (void)thread_id;
+  (void)name;
+  (void)name_size;
+  return false;
+}
+
+static int GetThreadFirstCpu(uint64_t thread_id)
+{
+  (void)thread_id;
+  return -1;
+}
+
+static int GetCurrentCpu()
+{
+  return -1;
+}
+
+// Stacks are recomputed by walking the frame pointers of whatever stack the fiber is on.
+static void SaveFiberShadowStack(uint32_t slot)
+{
+  (void)slot;
+}
+
+static void RestoreFiberShadowStack(int slot)
+{
+  (void)slot;
+}
+
+// The tracee's threads share its address space, so any of them can be looked up in the leader's maps. Their signal
+// stacks can't be read from here.
+static void GetThreadStacks(uintptr_t rsp, CacheSim::AddressRange* stack, CacheSim::AddressRange* signal_stack)
+{
+  memset(stack, 0, sizeof *stack);
+  memset(signal_stack, 0, sizeof *signal_stack);
+
+  char maps_path[64];
+  snprintf(maps_path, sizeof maps_path, "/proc/%d/maps", (int)s_Leader);
+
+  FILE* f = fopen(maps_path, "r");
+  if (!f)
+    return;
+
+  char line[1024];
+  while (fgets(line, sizeof line, f))
+  {
+    unsigned long start, end;
+    if (2 != sscanf(line, "%lx-%lx", &start, &end) || rsp < start || rsp >= end)
+      continue;
+
+    stack->m_Start = start;
+    stack->m_End = end;
+
+    // The main thread's stack grows down on demand. The tracee inherited our stack size limit.
+    struct rlimit limit;
+    if (strstr(line, "[stack]") && 0 == getrlimit(RLIMIT_STACK, &limit) && RLIM_INFINITY != limit.rlim_cur &&
+        limit.rlim_cur > end - start && limit.rlim_cur < end)
+    {
+      stack->m_Start = end - limit.rlim_cur;
+    }
+    break;
+  }
+
+  fclose(f);
+}
+
+static int CaptureAllocStack(uintptr_t frames[], int max_frames)
+{
+  (void)frames;
+  (void)max_frames;
+  // The tracee doesn't call into CacheSim, so it never reports allocations.
+  return 0;
+}
+
+static void GetFilenameForSave(char* filename, size_t bufferSize)
+{
+  if (s_OutputFilename)
+  {
+    snprintf(filename, bufferSize, "%s", s_OutputFilename);
+    return;
+  }
+
+  const char* executable_name = s_ExecutablePath;
+  if (const char* p = strrchr(s_ExecutablePath, '/'))
+  {
+    executable_name = p + 1;
+  }
+
+  snprintf(filename, bufferSize, "%s_%u.csim", executable_name, (uint32_t)time(nullptr));
+}
+
+static void GetModuleList(ModuleList* moduleList)
+{
+  (void)moduleList;
+  // The tracee is gone by the time the capture is written; the list was captured when the main thread exited.
+  if (!s_HaveModuleSnapshot)
+  {
+    fprintf(stderr, "cachesim-trace: no module list was captured, symbols will not resolve\n");
+  }
+}
+
+static void OnCaptureSaved(const char* filename)
+{
+  (void)filename;
+  // The tracee's modules aren't loaded here, so its capture is resolved in the UI.
+}
+
+static void Usage()
+{
+  fprintf(stderr, "usage: cachesim-trace [-o output.csim] [-c core_count] [-x modules:cores:l2_kb]... [-r reuse_shift] -- program [args...]\n");
+}
+
+int main(int argc, char* argv[])
+{
+  using namespace CacheSim;
+
+  int argi = 1;
+  for (; argi < argc; ++argi)
+  {
+    if (0 == strcmp(argv[argi], "--"))
+    {
+      ++argi;
+      break;
+    }
+    else if (0 == strcmp(argv[argi], "-o") && argi + 1 < argc)
+    {
+      s_OutputFilename = argv[++argi];
+    }
+    else if (0 == strcmp(argv[argi], "-c") && argi + 1 < argc)
+    {
+      s_CoreCount = atoi(argv[++argi]);
+      if (s_CoreCount < 1 || s_CoreCount > 8)
+      {
+        fprintf(stderr, "cachesim-trace: core count must be between 1 and 8\n");
+        return 1;
+      }
+    }
+    else if (0 == strcmp(argv[argi], "-x") && argi + 1 < argc)
+    {
+      // Also simulate the Jaguar L1s with a different module layout and L2 size.
+      CacheConfig config = JaguarCacheConfig();
+      uint32_t l2_kb = 0;
+      if (3 != sscanf(argv[++argi], "%u:%u:%u", &config.m_ModuleCount, &config.m_CoresPerModule, &l2_kb))
+      {
+        Usage();
+        return 1;
+      }
+
+      config.m_L2Size = l2_kb * 1024;
+      if (!CacheSimAddCacheConfig(&config))
+      {
+        fprintf(stderr, "cachesim-trace: invalid or too many cache configurations\n");
+        return 1;
+      }
+    }
+    else if (0 == strcmp(argv[argi], "-r") && argi + 1 < argc)
+    {
+      // Record reuse distances, see CacheSimSetReuseSampling().
+      if (!CacheSimSetReuseSampling(atoi(argv[++argi])))
+      {
+        Usage();
+        return 1;
+      }
+    }
+    else if (argv[argi][0] == '-')
+    {
+      Usage();
+      return 1;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if (argi >= argc)
+  {
+    Usage();
+    return 1;
+  }
+
+  pid_t child = fork();
+  if (child == 0)
+  {
+    ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+    raise(SIGSTOP);
+    execvp(argv[argi], argv + argi);
+    fprintf(stderr, "cachesim-trace: failed to run %s: %s\n", argv[argi], strerror(errno));
+    _exit(127);
+  }
+  else if (child < 0)
+  {
+    fprintf(stderr, "cachesim-trace: fork failed: %s\n", strerror(errno));
+    return 1;
+  }
+
+  s_Leader = child;
+
+  int status;
+  if (waitpid(child, &status, 0) != child || !WIFSTOPPED(status))
+  {
+    fprintf(stderr, "cachesim-trace: child did not stop\n");
+    return 1;
+  }
+
+  ptrace(PTRACE_SETOPTIONS, child, nullptr,
+         (void*)(PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_TRACEEXIT | PTRACE_O_EXITKILL));
+
+  g_Stats.Init();
+  g_Stacks.Init();
+  s_Tracees.Init();
+  memset(&g_StackData, 0, sizeof g_StackData);
+  g_Cache.Init();
+  StartConfigWorkers();
+
+  ud_init(&s_ThreadState.m_Disassembler);
+  ud_set_mode(&s_ThreadState.m_Disassembler, 64);
+
+  // Its first stop was the one we just waited for.
+  AddTracee(child)->m_Attached = true;
+  g_TraceEnabled = 1;
+
+  // Run up to the exec without stepping; we don't want to trace our own fork child.
+  ptrace(PTRACE_CONT, child, nullptr, nullptr);
+
+  for (;;)
+  {
+    pid_t tid = waitpid(-1, &status, __WALL);
+    if (tid < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break; // ECHILD: everything has exited
+    }
+
+    if (WIFEXITED(status) || WIFSIGNALED(status))
+    {
+      s_Tracees.Remove(TraceeKey(tid));
+      continue;
+    }
+
+    if (!WIFSTOPPED(status))
+      continue;
+
+    TraceeState* state = s_Tracees.Find(TraceeKey(tid));
+    if (!state)
+    {
+      // A new thread can report its initial stop before we see the clone event in its parent.
+      state = AddTracee(tid);
+      state->m_Stepping = true;
+    }
+
+    int sig = WSTOPSIG(status);
+    int deliver = 0;
+    const int event = status >> 16;
+
+    if (event == PTRACE_EVENT_EXEC)
+    {
+      char exe_link[64];
+      snprintf(exe_link, sizeof exe_link, "/proc/%d/exe", (int)tid);
+      ssize_t len = readlink(exe_link, s_ExecutablePath, sizeof s_ExecutablePath - 1);
+      s_ExecutablePath[len > 0 ? len : 0] = '\0';
+      state->m_Stepping = true;
+    }
+    else if (event == PTRACE_EVENT_CLONE)
+    {
+      unsigned long new_tid = 0;
+      ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &new_tid);
+      AddTracee((pid_t)new_tid)->m_Stepping = true;
+    }
+    else if (event == PTRACE_EVENT_EXIT)
+    {
+      if (tid == s_Leader)
+      {
+        SnapshotModuleList(tid, &g_ModuleList);
+        s_HaveModuleSnapshot = true;
+      }
+    }
+    else if (event == 0)
+    {
+      // Single steps report SIGTRAP with a positive si_code (TRAP_TRACE, or TRAP_BRKPT on some kernels).
+      // int3 reports SI_KERNEL and kill()/tgkill() report non-positive codes; those belong to the program.
+      siginfo_t info;
+      const bool has_siginfo = 0 == ptrace(PTRACE_GETSIGINFO, tid, nullptr, &info);
+
+      if (sig == SIGTRAP && has_siginfo && info.si_code > 0 && info.si_code != SI_KERNEL)
+      {
+        if (state->m_Stepping)
+        {
+          TraceStep(tid, state);
+        }
+      }
+      else if (!has_siginfo)
+      {
+        // A group-stop, after a stop signal was delivered. The signal isn't pending anymore, and a tracee that wasn't
+        // seized can't be kept stopped, so it's resumed like any other.
+      }
+      else if (sig == SIGSTOP && !state->m_Attached)
+      {
+        // New threads report a SIGSTOP when they're first traced, which isn't the program's.
+        state->m_Attached = true;
+      }
+      else
+      {
+        // Signals meant for the program (including breakpoints it raises itself and stop signals) are passed through.
+        deliver = sig;
+      }
+    }
+
+    ptrace(state->m_Stepping ? PTRACE_SINGLESTEP : PTRACE_CONT, tid, nullptr, (void*)(uintptr_t)deliver);
+  }
+
+  CacheSimEndCapture(true);
+  return 0;
+}
@@ -37,6 +37,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdarg.h>
 #include <time.h>
 #include <psapi.h>
+#include <tlhelp32.h>
 
 #include "CacheSimCommon.inl"
 /// By default we stomp ntdll!RtlpCallVectoredHandlers with a jump to our handler.
@@ -96,6 +97,21 @@ static uintptr_t AdjustGsSegment(uintptr_t address)
   }
 }
 
+static void ReadVectorReg(int reg_index, bool ymm, const CONTEXT* ctx, uint8_t out[32])
+{
+  memcpy(out, &(&ctx->Xmm0)[reg_index], 16);
+  memset(out + 16, 0, 16);
+
+  if (ymm)
+  {
+    DWORD length = 0;
+    const M128A* upper = (const M128A*)LocateXStateFeature(const_cast<CONTEXT*>(ctx), XSTATE_AVX, &length);
+    if (!upper)
+      DebugBreak();
+    memcpy(out + 16, &upper[reg_index], 16);
+  }
+}
+
 static void empty_func()
 {
 }
@@ -162,13 +178,18 @@ static LONG WINAPI StepFilter(PEXCEPTION_RECORD ExceptionRecord, PCONTEXT Contex
       ud_set_mode(ud, 64);
 
       s_ThreadState.m_LogicalCoreIndex = FindLogicalCoreIndex(GetCurrentThreadId());
+      s_ThreadState.m_CoreRetryCountdown = kNameRuleRetryInterval;
+      s_ThreadState.m_LastRsp = 0;
 
       s_ThreadState.m_Generation = curr_gen;
       InvalidateStack();
     }
+    else if (s_ThreadState.m_LogicalCoreIndex < 0 && ShouldRetryLogicalCore(&s_ThreadState.m_CoreRetryCountdown))
+    {
+      s_ThreadState.m_LogicalCoreIndex = FindLogicalCoreIndex(GetCurrentThreadId());
+    }
 
-
-    const int core_index = s_ThreadState.m_LogicalCoreIndex;
+    const int core_index = UpdateScheduledCore();
 
     // Only trace threads we've mapped to cores. Ignore all others.
     if (g_TraceEnabled && core_index >= 0)
@@ -184,7 +205,18 @@ static LONG WINAPI StepFilter(PEXCEPTION_RECORD ExceptionRecord, PCONTEXT Contex
         return EXCEPTION_CONTINUE_EXECUTION;
       }
 
-      if (~0u == s_ThreadState.m_StackIndex)
+      TrackFiberSwitch(ExcInfo->ContextRecord->Rsp);
+
+      const int action = GetFilterAction(rip);
+      if (kFilterSkip == action)
+      {
+        // Calls and returns aren't seen while skipping, so the stack must be recomputed afterwards.
+        InvalidateStack();
+        ExcInfo->ContextRecord->EFlags |= 0x100;
+        return EXCEPTION_CONTINUE_EXECUTION;
+      }
+
+      if (kFilterTrace == action && ~0u == s_ThreadState.m_StackIndex)
       {
         // Recompute call stack
         uintptr_t callstack[kMaxCalls];
@@ -202,7 +234,7 @@ static LONG WINAPI StepFilter(PEXCEPTION_RECORD ExceptionRecord, PCONTEXT Contex
       ud_set_input_buffer(ud, (const uint8_t*) rip, 16);
       ud_set_pc(ud, rip);
       int ilen = ud_disassemble(ud);
-      GenerateMemoryAccesses(core_index, ud, rip, ilen, ExcInfo->ContextRecord);
+      GenerateMemoryAccesses(core_index, ud, rip, ilen, ExcInfo->ContextRecord, kFilterTrace == action);
 
       // Keep trapping.
       ExcInfo->ContextRecord->EFlags |= 0x100;
@@ -275,6 +307,105 @@ static LONG WINAPI FindCallHandlers(struct _EXCEPTION_POINTERS* ExcInfo)
 }
 #endif
 
+static uint64_t GetCurrentOsThreadId()
+{
+  return GetCurrentThreadId();
+}
+
+static bool GetThreadName(uint64_t thread_id, char* name, size_t name_size)
+{
+  // GetThreadDescription() is only available on Windows 10 1607 and later.
+  typedef HRESULT (WINAPI *GetThreadDescriptionFn)(HANDLE, PWSTR*);
+  static GetThreadDescriptionFn get_description = (GetThreadDescriptionFn)GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetThreadDescription");
+  if (!get_description)
+    return false;
+
+  HANDLE h = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)thread_id);
+  if (!h)
+    return false;
+
+  PWSTR description = nullptr;
+  bool ok = SUCCEEDED(get_description(h, &description)) &&
+            0 != WideCharToMultiByte(CP_UTF8, 0, description, -1, name, int(name_size), nullptr, nullptr);
+  LocalFree(description);
+  CloseHandle(h);
+  return ok;
+}
+
+static int GetThreadFirstCpu(uint64_t thread_id)
+{
+  HANDLE h = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)thread_id);
+  if (!h)
+    return -1;
+
+  int cpu = -1;
+  GROUP_AFFINITY affinity;
+  if (GetThreadGroupAffinity(h, &affinity) && affinity.Mask)
+  {
+    unsigned long index;
+    _BitScanForward64(&index, affinity.Mask);
+    cpu = affinity.Group * 64 + int(index);
+  }
+
+  CloseHandle(h);
+  return cpu;
+}
+
+static int GetCurrentCpu()
+{
+  return int(GetCurrentProcessorNumber());
+}
+
+// Stacks are recomputed with RtlCaptureStackBackTrace(), which walks whatever stack the fiber is on.
+static void SaveFiberShadowStack(uint32_t slot)
+{
+}
+
+static void RestoreFiberShadowStack(int slot)
+{
+}
+
+// A stack is one reservation, committed from the top down to the page the stack pointer is in, so the committed
+// region holding it ends at the top of the stack. Windows has no alternate signal stacks.
+static void GetThreadStacks(uintptr_t rsp, CacheSim::AddressRange* stack, CacheSim::AddressRange* signal_stack)
+{
+  memset(stack, 0, sizeof *stack);
+  memset(signal_stack, 0, sizeof *signal_stack);
+
+  MEMORY_BASIC_INFORMATION info;
+  if (VirtualQuery((const void*)rsp, &info, sizeof info) && MEM_COMMIT == info.State)
+  {
+    stack->m_Start = uintptr_t(info.AllocationBase);
+    stack->m_End = uintptr_t(info.BaseAddress) + info.RegionSize;
+  }
+}
+
+// Gives the threads of the process a core by policy before they're set up for tracing. Windows threads don't
+// inherit the trap flag, so threads created during the capture aren't traced.
+static void AssignThreadCores()
+{
+  using namespace CacheSim;
+
+  if (kThreadCoreExplicit == s_ThreadCorePolicy)
+    return;
+
+  HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+  if (INVALID_HANDLE_VALUE == snapshot)
+    return;
+
+  const DWORD process_id = GetCurrentProcessId();
+  THREADENTRY32 entry;
+  entry.dwSize = sizeof entry;
+
+  for (BOOL ok = Thread32First(snapshot, &entry); ok; ok = Thread32Next(snapshot, &entry))
+  {
+    if (entry.th32OwnerProcessID == process_id)
+      AssignLogicalCore(entry.th32ThreadID);
+  }
+
+  CloseHandle(snapshot);
+}
+
 __declspec(dllexport)
 /*!
 \remarks
@@ -300,21 +431,30 @@ bool CacheSimStartCapture()
 
   // Reset.
   g_Cache.Init();
+  ResolveFilters();
+  StartConfigWorkers();
+  AssignThreadCores();
 
-  HANDLE thread_handles[ARRAY_SIZE(s_CoreMappings)];
+  HANDLE* thread_handles = nullptr;
   int thread_count = 0;
+  size_t thread_handles_size = 0;
 
   DWORD my_thread_id = GetCurrentThreadId();
-  for (int i = 0, count = s_CoreMappingCount; i < count; ++i)
   {
-    const auto& mapping = s_CoreMappings[i];
-    if (mapping.m_ThreadId == my_thread_id)
-      continue;
+    AutoSpinLock lock;
+    thread_handles_size = (CountMappedThreads() + 1) * sizeof(HANDLE);
+    thread_handles = (HANDLE*)VirtualMemoryAlloc(thread_handles_size);
 
-    if (HANDLE h = OpenThread(THREAD_ALL_ACCESS, FALSE, (DWORD)mapping.m_ThreadId))
+    ForEachMappedThread([&](uint64_t thread_id, int)
     {
-      thread_handles[thread_count++] = h;
-    }
+      if (thread_id == my_thread_id)
+        return;
+
+      if (HANDLE h = OpenThread(THREAD_ALL_ACCESS, FALSE, (DWORD)thread_id))
+      {
+        thread_handles[thread_count++] = h;
+      }
+    });
   }
 
   // Suspend all threads that aren't this thread.
@@ -427,6 +567,7 @@ bool CacheSimStartCapture()
   {
     CloseHandle(thread_handles[i]);
   }
+  VirtualMemoryFree(thread_handles, thread_handles_size);
 
   // Finally enable trap flag for calling thread.
   __writeeflags(__readeflags() | 0x100);
@@ -445,6 +586,13 @@ void DisableTrapFlag()
   Sleep(0);
 }
 
+// Must not be inlined, as it skips its own frame and CacheSimOnAlloc()'s.
+__declspec(noinline) static int CaptureAllocStack(uintptr_t frames[], int max_frames)
+{
+  static_assert(sizeof(PVOID) == sizeof(uintptr_t), "64-bit required");
+  return RtlCaptureStackBackTrace(2, DWORD(max_frames), (PVOID*)frames, nullptr);
+}
+
 void GetFilenameForSave(char* filename, size_t bufferSize)
 {
   char executable_filename[512];
@@ -465,6 +613,11 @@ void GetFilenameForSave(char* filename, size_t bufferSize)
   _snprintf_s(filename, bufferSize, bufferSize, "%s_%u.csim", executable_name, (uint32_t)time(nullptr));
 }
 
+static void OnCaptureSaved(const char* filename)
+{
+  // Windows captures are only resolved in the UI.
+}
+
 void GetModuleList(ModuleList* moduleList)
 {
   HMODULE modules[1024];
@@ -509,4 +662,30 @@ __declspec(dllexport)
 uint64_t CacheSimGetCurrentThreadId()
 {
   return GetCurrentThreadId();
-}
\ No newline at end of file
+}
+
+__declspec(dllexport)
+bool CacheSimSetCaptureEngine(int engine)
+{
+  // The code cache engine needs the Linux trampolines; Windows only single-steps.
+  return CacheSim::kCaptureEngineSingleStep == engine;
+}
+
+__declspec(dllexport)
+bool CacheSimSetSampling(uint32_t period_us, uint32_t warmup_instructions, uint32_t measure_instructions)
+{
+  // Sampling is driven by per-thread CPU time timers, which are only implemented on Linux.
+  return 0 == period_us;
+}
+
+__declspec(dllexport)
+bool CacheSimSetCaptureSymbolization(bool enable)
+{
+  // Captures are symbolized with dladdr() and the ELF symbol tables, so only on Linux.
+  return !enable;
+}
+
+__declspec(dllexport)
+void CacheSimWaitForSymbolization()
+{
+}
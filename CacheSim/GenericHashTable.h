@@ -215,19 +215,24 @@ public:
   /// Returns true if the key was found.
   bool Remove(const KeyType& key)
   {
+    if (!m_Table)
+    {
+      return false;
+    }
+
     const uint32_t hash = HashFunctions::Hash(key);
     uint32_t index = hash & (m_Capacity - 1);
 
     Elem** cloc = &m_Table[index];
 
-    for (;;)
+    while (Elem* e = *cloc)
     {
-      Elem* e = *cloc;
       if (e->m_Hash == hash && e->m_Key == key)
       {
         *cloc = e->m_Next;
         e->m_Value.~ValueType();
         m_Allocator.FreeElement(e);
+        --m_Count;
         return true;
       }
       cloc = &e->m_Next;
@@ -29,7 +29,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "CacheSim/CacheSim.h"
 #include <stdio.h>
 
-int main(int argc, char* argv[])
+int main()
 {
   CacheSim::DynamicLoader cachesim;
 
@@ -0,0 +1,138 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// SimBenchmark.cpp - measures how many accesses per second the Jaguar simulator makes, one at a time and in batches.
+//
+// The access stream looks like traced code: a code fetch from a small loop followed by a few data accesses,
+// spread over a working set much larger than the host's caches so the simulator's own tag arrays miss.
+// Usage: SimBenchmark [working_set_mb] [batch_size]
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CacheSim/CacheSimInternals.h"
+#include <vector>
+
+enum { kRunCount = 5 };
+
+static std::vector<CacheSim::CacheAccess> MakeAccesses(size_t count, uint64_t working_set)
+{
+  std::vector<CacheSim::CacheAccess> accesses(count);
+
+  uint64_t state = 1;
+  uint64_t rip = 0x400000;
+  for (size_t i = 0; i < count; ++i)
+  {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+
+    CacheSim::CacheAccess& access = accesses[i];
+    access.m_CoreIndex = uint8_t((i >> 12) & 7);
+    access.m_Observe = 0;
+
+    // One code fetch per three data accesses.
+    if (0 == (i & 3))
+    {
+      rip = 0x400000 + ((rip + 4) & 4095);
+      access.m_Addr = rip;
+      access.m_Size = 4;
+      access.m_Mode = CacheSim::kCodeRead;
+    }
+    else
+    {
+      access.m_Addr = 0x10000000 + ((state >> 16) % working_set);
+      access.m_Size = 8;
+      access.m_Mode = uint8_t(0 == ((state >> 60) & 3) ? CacheSim::kWrite : CacheSim::kRead);
+    }
+  }
+
+  return accesses;
+}
+
+int main(int argc, char* argv[])
+{
+  const uint64_t working_set = uint64_t(argc > 1 ? atoi(argv[1]) : 64) << 20;
+  const size_t batch_size = argc > 2 ? atoi(argv[2]) : 4;
+  const size_t count = 10000000;
+
+  if (!working_set || !batch_size)
+  {
+    fprintf(stderr, "usage: SimBenchmark [working_set_mb] [batch_size]\n");
+    return 1;
+  }
+
+  const std::vector<CacheSim::CacheAccess> accesses = MakeAccesses(count, working_set);
+  std::vector<CacheSim::AccessResult> single_results(count), batch_results(count);
+
+  CacheSim::JaguarCacheSim* sim = new CacheSim::JaguarCacheSim;
+
+  // Take the best of a few runs, as the first ones also pay for faulting in the simulator's pages.
+  double single_s = 1e30, batch_s = 1e30;
+  for (int run = 0; run < kRunCount; ++run)
+  {
+    sim->Init();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+      const CacheSim::CacheAccess& a = accesses[i];
+      single_results[i] = sim->Access(a.m_CoreIndex, a.m_Addr, a.m_Size, CacheSim::AccessMode(a.m_Mode));
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    single_s = std::min(single_s, std::chrono::duration<double>(end - start).count());
+
+    sim->Init();
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < count; i += batch_size)
+    {
+      const size_t n = count - i < batch_size ? count - i : batch_size;
+      sim->AccessBatch(&accesses[i], n, &batch_results[i]);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    batch_s = std::min(batch_s, std::chrono::duration<double>(end - start).count());
+  }
+
+  delete sim;
+
+  size_t mismatches = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    mismatches += single_results[i] != batch_results[i];
+  }
+
+  printf("%zu accesses over %llu MB\n", count, (unsigned long long)(working_set >> 20));
+  printf("Access():      %.1f M accesses/s\n", count / single_s / 1e6);
+  printf("AccessBatch(): %.1f M accesses/s (batches of %zu)\n", count / batch_s / 1e6, batch_size);
+
+  if (mismatches)
+  {
+    printf("%zu results differ\n", mismatches);
+    return 1;
+  }
+
+  return 0;
+}
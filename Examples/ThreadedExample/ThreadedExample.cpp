@@ -68,7 +68,7 @@ void DoSomeWork()
   while (canExit == false) { std::this_thread::yield(); }
 }
 
-int main(int argc, char* argv[])
+int main()
 {
 
   if (!cachesim.Init())
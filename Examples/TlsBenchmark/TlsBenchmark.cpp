@@ -0,0 +1,115 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// TlsBenchmark.cpp - times a traced loop that is dominated by thread-local (FS-relative) accesses.
+//
+// Every iteration reads and writes thread_local data, so each traced instruction needs the FS base to
+// compute its effective address. Run it untraced and traced to see the per-instruction cost of tracing.
+// Pass --code-cache to trace with the code cache engine instead of single stepping, or --sample to only
+// trace a short window every millisecond.
+
+#include "CacheSim/CacheSim.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static thread_local uint64_t t_Counters[64];
+static thread_local uint64_t t_Sum;
+
+static void TlsLoop(int iterations)
+{
+  for (int i = 0; i < iterations; ++i)
+  {
+    uint64_t& c = t_Counters[i & 63];
+    c += i;
+    t_Sum += c;
+  }
+}
+
+static double TimeLoop(int iterations)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  TlsLoop(iterations);
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+  int iterations = 100000;
+  bool code_cache = false;
+  bool sample = false;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (0 == strcmp(argv[i], "--code-cache"))
+      code_cache = true;
+    else if (0 == strcmp(argv[i], "--sample"))
+      sample = true;
+    else
+      iterations = atoi(argv[i]);
+  }
+
+  CacheSim::DynamicLoader cachesim;
+
+  if (!cachesim.Init())
+    return 1;
+
+  if (code_cache && !cachesim.SetCaptureEngine(CacheSim::kCaptureEngineCodeCache))
+  {
+    fprintf(stderr, "The code cache engine isn't supported here\n");
+    return 1;
+  }
+
+  if (sample && !cachesim.SetSampling(1000, 10000, 10000))
+  {
+    fprintf(stderr, "Sampling isn't supported here\n");
+    return 1;
+  }
+
+  cachesim.SetThreadCoreMapping(cachesim.GetCurrentThreadId(), 0);
+
+  double untraced_ms = TimeLoop(iterations);
+
+  cachesim.Start();
+  double traced_ms = TimeLoop(iterations);
+  cachesim.End();
+
+  printf("%d iterations: untraced %.3f ms, traced (%s) %.3f ms (%.1f us/iteration)\n",
+    iterations, untraced_ms, code_cache ? "code cache" : sample ? "sampled" : "single step", traced_ms, traced_ms * 1000.0 / iterations);
+  printf("checksum %llu\n", (unsigned long long)t_Sum);
+
+  CacheSim::SamplingSummary summary;
+  if (sample && cachesim.GetSamplingSummary(&summary))
+  {
+    printf("%u windows, %llu instructions measured, scale %.2f\n",
+      summary.m_WindowCount, (unsigned long long)summary.m_MeasuredInstructions, summary.m_Scale);
+    printf("L2 data misses per 1000 instructions: %.3f +- %.3f\n", summary.m_L2DMissesPerKI, summary.m_L2DMissesPerKIError);
+  }
+
+  return 0;
+}
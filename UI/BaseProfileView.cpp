@@ -79,6 +79,11 @@ void CacheSim::BaseProfileView::customContextMenuRequested(const QPoint &pos)
 
 QString CacheSim::BaseProfileView::selectedSymbol() const
 {
+  if (!m_ItemView)
+  {
+    return QString::null;
+  }
+
   QModelIndexList selection = m_ItemView->selectionModel()->selectedIndexes();
   if (selection.isEmpty())
   {
@@ -0,0 +1,257 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "CacheConfigModel.h"
+#include "TraceData.h"
+
+static QString SizeLabel(uint32_t bytes)
+{
+  if (bytes >= (1u << 20) && 0 == bytes % (1u << 20))
+    return QStringLiteral("%1 MB").arg(bytes >> 20);
+  return QStringLiteral("%1 KB").arg(bytes >> 10);
+}
+
+CacheSim::CacheConfigModel::Stats::Stats()
+{
+  memset(m_Stats, 0, sizeof m_Stats);
+}
+
+CacheSim::CacheConfigModel::CacheConfigModel(QObject* parent /*= nullptr*/)
+  : QAbstractListModel(parent)
+{
+}
+
+CacheSim::CacheConfigModel::~CacheConfigModel()
+{
+}
+
+QString CacheSim::CacheConfigModel::describe(const SerializedCacheConfig& config)
+{
+  return QStringLiteral("%1x%2 cores, %3 L2").arg(config.m_ModuleCount).arg(config.m_CoresPerModule).arg(SizeLabel(config.m_L2Size));
+}
+
+void CacheSim::CacheConfigModel::setData(const TraceData* data)
+{
+  if (m_Data)
+  {
+    disconnect(m_Data, &TraceData::memoryMappedDataChanged, this, &CacheConfigModel::dataStoreChanged);
+  }
+
+  m_Data = data;
+  dataStoreChanged();
+
+  if (m_Data)
+  {
+    connect(m_Data, &TraceData::memoryMappedDataChanged, this, &CacheConfigModel::dataStoreChanged);
+  }
+}
+
+void CacheSim::CacheConfigModel::setStatistic(AccessResult statistic)
+{
+  if (statistic == m_Statistic)
+    return;
+
+  m_Statistic = statistic;
+  if (!m_Rows.isEmpty())
+  {
+    Q_EMIT dataChanged(index(0, kColumnJaguar), index(m_Rows.count() - 1, columnCount() - 1));
+  }
+}
+
+int CacheSim::CacheConfigModel::rowCount(const QModelIndex &parent /*= QModelIndex()*/) const
+{
+  (void) parent;
+  return m_Rows.count();
+}
+
+int CacheSim::CacheConfigModel::columnCount(const QModelIndex &parent /*= QModelIndex()*/) const
+{
+  (void) parent;
+  return kColumnFirstConfig + 2 * m_ConfigNames.count();
+}
+
+QVariant CacheSim::CacheConfigModel::data(const QModelIndex &index, int role /*= Qt::DisplayRole*/) const
+{
+  int row = index.row();
+  if (row < 0 || row >= m_Rows.count())
+  {
+    return QVariant();
+  }
+
+  const Node& node = m_Rows[row];
+  const int column = index.column();
+
+  if (role == Qt::DisplayRole)
+  {
+    if (column == kColumnSymbol)
+      return node.m_SymbolName;
+    if (column == kColumnInstructions)
+      return quint64(node.m_Stats[0].m_Stats[kInstructionsExecuted]);
+    if (column == kColumnJaguar)
+      return quint64(node.m_Stats[0].m_Stats[m_Statistic]);
+
+    const int config = (column - kColumnFirstConfig) / 2;
+    const uint64_t value = node.m_Stats[config + 1].m_Stats[m_Statistic];
+    if (0 == (column - kColumnFirstConfig) % 2)
+      return quint64(value);
+
+    // Change relative to the Jaguar
+    const uint64_t base = node.m_Stats[0].m_Stats[m_Statistic];
+    return base ? 100.0 * (double(value) - double(base)) / base : 0.0;
+  }
+  else if (role == Qt::TextAlignmentRole)
+  {
+    if (column > kColumnSymbol)
+    {
+      return Qt::AlignRight;
+    }
+    return Qt::AlignLeft;
+  }
+  else if (role == Qt::ToolTipRole)
+  {
+    if (column == kColumnSymbol)
+    {
+      return node.m_SymbolName;
+    }
+  }
+
+  return QVariant();
+}
+
+QVariant CacheSim::CacheConfigModel::headerData(int section, Qt::Orientation orientation, int role /*= Qt::DisplayRole*/) const
+{
+  if (orientation != Qt::Horizontal)
+    return QVariant();
+
+  if (role == Qt::DisplayRole)
+  {
+    switch (section)
+    {
+    case kColumnSymbol: return QStringLiteral("Symbol");
+    case kColumnInstructions: return QStringLiteral("Instructions");
+    case kColumnJaguar: return QStringLiteral("Jaguar");
+    }
+
+    const int config = (section - kColumnFirstConfig) / 2;
+    if (0 == (section - kColumnFirstConfig) % 2)
+      return m_ConfigNames[config];
+    return QStringLiteral("Change %");
+  }
+  else if (role == Qt::ToolTipRole && section >= kColumnFirstConfig)
+  {
+    return m_ConfigDetails[(section - kColumnFirstConfig) / 2];
+  }
+
+  return QVariant();
+}
+
+void CacheSim::CacheConfigModel::dataStoreChanged()
+{
+  beginResetModel();
+
+  m_Rows.clear();
+  m_ConfigNames.clear();
+  m_ConfigDetails.clear();
+
+  const SerializedHeader* header = m_Data->header();
+  const uint32_t configCount = header->GetCacheConfigCount();
+  const SerializedCacheConfig* configs = header->GetCacheConfigs();
+
+  for (uint32_t c = 0; c < configCount; ++c)
+  {
+    const SerializedCacheConfig& config = configs[c];
+    m_ConfigNames << describe(config);
+    m_ConfigDetails << QStringLiteral("%1 modules of %2 cores. I1: %3, %4 way. D1: %5, %6 way. L2: %7, %8 way.")
+      .arg(config.m_ModuleCount).arg(config.m_CoresPerModule)
+      .arg(SizeLabel(config.m_I1Size)).arg(config.m_I1Ways)
+      .arg(SizeLabel(config.m_D1Size)).arg(config.m_D1Ways)
+      .arg(SizeLabel(config.m_L2Size)).arg(config.m_L2Ways);
+  }
+
+  m_Totals = QVector<Stats>(configCount + 1);
+
+  // Aggregate all instructions based on symbol name.
+  QHash<QString, int> symbolNameToRow;
+
+  auto addStats = [&](int hierarchy, uint64_t rip, const uint32_t (&stats)[kAccessResultCount])
+  {
+    QString symbolName;
+    if (header->FindSymbol(rip))
+    {
+      symbolName = m_Data->symbolNameForAddress(rip);
+    }
+    else
+    {
+      symbolName = QStringLiteral("[%1]").arg(rip, 16, 16, QLatin1Char('0'));
+    }
+
+    int row;
+    auto it = symbolNameToRow.find(symbolName);
+    if (it != symbolNameToRow.end())
+    {
+      row = it.value();
+    }
+    else
+    {
+      row = m_Rows.count();
+      m_Rows.push_back(Node());
+      m_Rows[row].m_SymbolName = symbolName;
+      m_Rows[row].m_Stats.resize(configCount + 1);
+      symbolNameToRow.insert(symbolName, row);
+    }
+
+    Stats& target = m_Rows[row].m_Stats[hierarchy];
+    for (int k = 0; k < kAccessResultCount; ++k)
+    {
+      target.m_Stats[k] += stats[k];
+      m_Totals[hierarchy].m_Stats[k] += stats[k];
+    }
+  };
+
+  // Captures without alternative configurations have nothing to compare.
+  if (configCount)
+  {
+    const SerializedNode* nodes = header->GetStats();
+    for (uint32_t i = 0, count = header->GetStatCount(); i < count; ++i)
+    {
+      addStats(0, nodes[i].m_Rip, nodes[i].m_Stats);
+    }
+
+    for (uint32_t c = 0; c < configCount; ++c)
+    {
+      const SerializedConfigStats* stats = header->GetConfigStats(configs[c]);
+      for (uint32_t i = 0; i < configs[c].m_StatsCount; ++i)
+      {
+        addStats(c + 1, stats[i].m_Rip, stats[i].m_Stats);
+      }
+    }
+  }
+
+  endResetModel();
+}
+
+#include "aux_CacheConfigModel.moc"
@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include "Precompiled.h"
+
+#include "CacheSim/CacheSimData.h"
+
+namespace CacheSim
+{
+  class TraceData;
+
+  /// Statistics of the Jaguar and of the alternative cache configurations simulated in the same capture,
+  /// aggregated by symbol, side by side. Shows one statistic at a time.
+  class CacheConfigModel final : public QAbstractListModel
+  {
+    Q_OBJECT;
+
+  public:
+    enum Column
+    {
+      kColumnSymbol,
+      kColumnInstructions,
+      kColumnJaguar,
+      kColumnFirstConfig,         ///< Followed by a value and a change column per configuration
+    };
+
+    struct Stats
+    {
+      Stats();
+      uint64_t m_Stats[kAccessResultCount];
+    };
+
+  public:
+    explicit CacheConfigModel(QObject* parent = nullptr);
+    ~CacheConfigModel();
+
+  public:
+    void setData(const TraceData* data);
+
+    /// The AccessResult shown for each configuration.
+    void setStatistic(AccessResult statistic);
+    AccessResult statistic() const { return m_Statistic; }
+
+    int configCount() const { return m_ConfigNames.count(); }
+    QString configName(int config) const { return m_ConfigNames[config]; }
+    /// Totals of the whole capture, with the Jaguar first.
+    const Stats& total(int hierarchy) const { return m_Totals[hierarchy]; }
+
+    /// Short description of a configuration, such as "1x8 cores, 4 MB L2".
+    static QString describe(const SerializedCacheConfig& config);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+  private:
+    Q_SLOT void dataStoreChanged();
+
+  private:
+    const TraceData* m_Data = nullptr;
+
+    struct Node
+    {
+      QString m_SymbolName;
+      QVector<Stats> m_Stats;               ///< Jaguar first, then each configuration
+    };
+
+    QVector<Node> m_Rows;
+    QVector<Stats> m_Totals;
+    QStringList m_ConfigNames;
+    QStringList m_ConfigDetails;
+    AccessResult m_Statistic = kL2DMiss;
+  };
+}
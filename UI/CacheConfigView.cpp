@@ -0,0 +1,118 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "CacheConfigView.h"
+#include "CacheConfigModel.h"
+#include "NumberFormatters.h"
+
+#include "ui_CacheConfigView.h"
+
+CacheSim::CacheConfigView::CacheConfigView(const TraceData* traceData, QWidget* parent /*= nullptr*/)
+  : BaseProfileView(parent)
+  , m_Model(new CacheConfigModel(this))
+  , m_FilterProxy(new QSortFilterProxyModel(this))
+  , ui(new Ui_CacheConfigView)
+{
+  ui->setupUi(this);
+
+  setItemView(ui->m_TableView);
+
+  ui->m_Statistic->addItem(QStringLiteral("L2 data misses"), int(kL2DMiss));
+  ui->m_Statistic->addItem(QStringLiteral("L2 instruction misses"), int(kL2IMiss));
+  ui->m_Statistic->addItem(QStringLiteral("L2 hits"), int(kL2Hit));
+  ui->m_Statistic->addItem(QStringLiteral("D1 hits"), int(kD1Hit));
+  ui->m_Statistic->addItem(QStringLiteral("I1 hits"), int(kI1Hit));
+
+  m_Model->setData(traceData);
+  m_FilterProxy->setSourceModel(m_Model);
+
+  DecimalFormatDelegate* decimalDelegate = new DecimalFormatDelegate(this);
+  IntegerFormatDelegate* integerDelegate = new IntegerFormatDelegate(this);
+  QTableView* tableView = ui->m_TableView;
+  tableView->setItemDelegateForColumn(CacheConfigModel::kColumnInstructions, integerDelegate);
+  tableView->setItemDelegateForColumn(CacheConfigModel::kColumnJaguar, integerDelegate);
+  for (int config = 0; config < m_Model->configCount(); ++config)
+  {
+    tableView->setItemDelegateForColumn(CacheConfigModel::kColumnFirstConfig + 2 * config, integerDelegate);
+    tableView->setItemDelegateForColumn(CacheConfigModel::kColumnFirstConfig + 2 * config + 1, decimalDelegate);
+  }
+
+  tableView->setModel(m_FilterProxy);
+  tableView->sortByColumn(CacheConfigModel::kColumnJaguar, Qt::DescendingOrder);
+
+  QHeaderView* verticalHeader = tableView->verticalHeader();
+  verticalHeader->sectionResizeMode(QHeaderView::Fixed);
+  verticalHeader->setDefaultSectionSize(tableView->viewport()->fontMetrics().height() * 1.25);
+
+  connect(ui->m_Filter, &QLineEdit::textChanged, this, &CacheConfigView::filterTextEdited);
+  connect(ui->m_Statistic, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, &CacheConfigView::statisticChanged);
+  connect(m_Model, &QAbstractItemModel::modelReset, this, &CacheConfigView::updateSummary);
+
+  updateSummary();
+}
+
+CacheSim::CacheConfigView::~CacheConfigView()
+{
+  delete ui;
+}
+
+void CacheSim::CacheConfigView::filterTextEdited()
+{
+  m_FilterProxy->setFilterFixedString(ui->m_Filter->text());
+}
+
+void CacheSim::CacheConfigView::statisticChanged(int index)
+{
+  m_Model->setStatistic(AccessResult(ui->m_Statistic->itemData(index).toInt()));
+  updateSummary();
+}
+
+void CacheSim::CacheConfigView::updateSummary()
+{
+  if (!m_Model->configCount())
+  {
+    ui->m_Summary->setText(QStringLiteral("This capture didn't simulate any other cache configurations. Add some with CacheSimAddCacheConfig()."));
+    return;
+  }
+
+  const AccessResult statistic = m_Model->statistic();
+  const uint64_t jaguar = m_Model->total(0).m_Stats[statistic];
+
+  QLocale locale;
+  QStringList parts;
+  parts << QStringLiteral("Jaguar: %1").arg(locale.toString(quint64(jaguar)));
+  for (int config = 0; config < m_Model->configCount(); ++config)
+  {
+    const uint64_t value = m_Model->total(config + 1).m_Stats[statistic];
+    QString change = jaguar ? QStringLiteral(" (%1%2%)").arg(value >= jaguar ? "+" : "").arg(100.0 * (double(value) - double(jaguar)) / jaguar, 0, 'f', 1) : QString();
+    parts << QStringLiteral("%1: %2%3").arg(m_Model->configName(config)).arg(locale.toString(quint64(value))).arg(change);
+  }
+
+  ui->m_Summary->setText(QStringLiteral("Whole capture - ") + parts.join(QStringLiteral(", ")));
+}
+
+#include "aux_CacheConfigView.moc"
@@ -0,0 +1,401 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// CacheSimReportMain.cpp - cachesim-report, which prints the profiles of a capture without the GUI, for scripts and
+// build machines.
+//
+// The profiles come from the same models as the UI's views, so they aggregate on all cores and the numbers match.
+// Unresolved captures are resolved first, which stores the symbols in the file like the UI does. Only the rows that
+// are printed are sorted, so trees of large captures are cheap to print a few levels of.
+//
+// Usage: cachesim-report [options] capture.csim, see --help.
+
+#include "Precompiled.h"
+#include "FlatModel.h"
+#include "TraceData.h"
+#include "TreeModel.h"
+#include "CacheSim/CacheSimData.h"
+
+using namespace CacheSim;
+
+enum ReportFormat
+{
+  kFormatText,
+  kFormatCsv,
+  kFormatJson,
+};
+
+struct ReportOptions
+{
+  int           m_FirstStatColumn;    // Columns before it are text: the symbol, and the file for trees
+  int           m_SortColumn;
+  int           m_Top;                // Rows per level, 0 for all
+  int           m_Depth;              // Levels of the tree, 1 for the flat profile
+  ReportFormat  m_Format;
+};
+
+// A printed row, with its depth in the tree.
+struct ReportRow
+{
+  QModelIndex   m_Index;
+  int           m_Depth;
+};
+
+// The `top` rows under `parent` with the largest values in the sort column, largest first.
+static QVector<QModelIndex> TopRows(const QAbstractItemModel& model, const QModelIndex& parent, const ReportOptions& options)
+{
+  const int count = model.rowCount(parent);
+
+  QVector<QPair<double, int>> rows(count);
+  for (int r = 0; r < count; ++r)
+  {
+    rows[r] = qMakePair(model.data(model.index(r, options.m_SortColumn, parent)).toDouble(), r);
+  }
+
+  const int top = options.m_Top > 0 ? std::min(options.m_Top, count) : count;
+  std::partial_sort(rows.begin(), rows.begin() + top, rows.end(), [](const QPair<double, int>& l, const QPair<double, int>& r)
+  {
+    return l.first > r.first || (l.first == r.first && l.second < r.second);
+  });
+
+  QVector<QModelIndex> result;
+  result.reserve(top);
+  for (int i = 0; i < top; ++i)
+  {
+    result.push_back(model.index(rows[i].second, 0, parent));
+  }
+  return result;
+}
+
+static void CollectRows(const QAbstractItemModel& model, const QModelIndex& parent, int depth, const ReportOptions& options, QVector<ReportRow>* rows)
+{
+  for (const QModelIndex& index : TopRows(model, parent, options))
+  {
+    rows->push_back({ index, depth });
+    if (depth + 1 < options.m_Depth)
+    {
+      CollectRows(model, index, depth + 1, options, rows);
+    }
+  }
+}
+
+static QVariant Cell(const QModelIndex& index, int column)
+{
+  return index.sibling(index.row(), column).data();
+}
+
+static QString FormatStat(const QVariant& value, char format, int precision)
+{
+  return QVariant::Double == value.type() ? QString::number(value.toDouble(), format, precision) : value.toString();
+}
+
+static QString CsvField(QString field)
+{
+  if (field.contains(QLatin1Char(',')) || field.contains(QLatin1Char('"')) || field.contains(QLatin1Char('\n')))
+  {
+    field.replace(QStringLiteral("\""), QStringLiteral("\"\""));
+    return QLatin1Char('"') + field + QLatin1Char('"');
+  }
+  return field;
+}
+
+// Stats first, then the symbol indented by depth and the file, so the numbers line up however long the names are.
+static void WriteText(const QAbstractItemModel& model, const QVector<ReportRow>& rows, const ReportOptions& options, QTextStream& out)
+{
+  const int columnCount = model.columnCount();
+
+  QVector<int> widths(columnCount, 0);
+  for (int c = options.m_FirstStatColumn; c < columnCount; ++c)
+  {
+    widths[c] = model.headerData(c, Qt::Horizontal).toString().size();
+    for (const ReportRow& row : rows)
+    {
+      widths[c] = std::max(widths[c], FormatStat(Cell(row.m_Index, c), 'f', 3).size());
+    }
+  }
+
+  for (int c = options.m_FirstStatColumn; c < columnCount; ++c)
+  {
+    out << model.headerData(c, Qt::Horizontal).toString().rightJustified(widths[c]) << "  ";
+  }
+  for (int c = 0; c < options.m_FirstStatColumn; ++c)
+  {
+    out << model.headerData(c, Qt::Horizontal).toString() << (c + 1 < options.m_FirstStatColumn ? "  " : "\n");
+  }
+
+  for (const ReportRow& row : rows)
+  {
+    for (int c = options.m_FirstStatColumn; c < columnCount; ++c)
+    {
+      out << FormatStat(Cell(row.m_Index, c), 'f', 3).rightJustified(widths[c]) << "  ";
+    }
+    out << QString(row.m_Depth * 2, QLatin1Char(' ')) << Cell(row.m_Index, 0).toString();
+    for (int c = 1; c < options.m_FirstStatColumn; ++c)
+    {
+      const QString text = Cell(row.m_Index, c).toString();
+      if (!text.isEmpty())
+        out << "  " << text;
+    }
+    out << "\n";
+  }
+}
+
+static void WriteCsv(const QAbstractItemModel& model, const QVector<ReportRow>& rows, const ReportOptions& options, QTextStream& out)
+{
+  const int columnCount = model.columnCount();
+  const bool tree = options.m_Depth > 1;
+
+  if (tree)
+  {
+    out << "Depth,";
+  }
+  for (int c = 0; c < columnCount; ++c)
+  {
+    out << CsvField(model.headerData(c, Qt::Horizontal).toString()) << (c + 1 < columnCount ? "," : "\n");
+  }
+
+  for (const ReportRow& row : rows)
+  {
+    if (tree)
+    {
+      out << row.m_Depth << ",";
+    }
+    for (int c = 0; c < columnCount; ++c)
+    {
+      out << CsvField(FormatStat(Cell(row.m_Index, c), 'g', 10)) << (c + 1 < columnCount ? "," : "\n");
+    }
+  }
+}
+
+static QJsonArray JsonRows(const QAbstractItemModel& model, const QModelIndex& parent, int depth, const ReportOptions& options)
+{
+  const int columnCount = model.columnCount();
+
+  QJsonArray result;
+  for (const QModelIndex& index : TopRows(model, parent, options))
+  {
+    QJsonObject row;
+    for (int c = 0; c < columnCount; ++c)
+    {
+      row.insert(model.headerData(c, Qt::Horizontal).toString(), QJsonValue::fromVariant(Cell(index, c)));
+    }
+    if (depth + 1 < options.m_Depth)
+    {
+      row.insert(QStringLiteral("Children"), JsonRows(model, index, depth + 1, options));
+    }
+    result.append(row);
+  }
+  return result;
+}
+
+// Finds a stat column by its header, ignoring case. A unique prefix will do, so "instructions" works for both models.
+static int FindStatColumn(const QAbstractItemModel& model, int firstStatColumn, QString name)
+{
+  int match = -1;
+  for (int c = firstStatColumn; c < model.columnCount(); ++c)
+  {
+    const QString label = model.headerData(c, Qt::Horizontal).toString();
+    if (0 == label.compare(name, Qt::CaseInsensitive))
+      return c;
+
+    if (label.startsWith(name, Qt::CaseInsensitive))
+      match = match == -1 ? c : -2;
+  }
+  return match;
+}
+
+static int Report(const QAbstractItemModel& model, ReportOptions options, QString sortName, QString title, QIODevice* output)
+{
+  options.m_SortColumn = FindStatColumn(model, options.m_FirstStatColumn, sortName);
+  if (options.m_SortColumn < 0)
+  {
+    fprintf(stderr, "cachesim-report: unknown sort column '%s'\n", qPrintable(sortName));
+    return 1;
+  }
+
+  QTextStream out(output);
+  out.setCodec("UTF-8");
+
+  if (kFormatJson == options.m_Format)
+  {
+    QJsonObject report;
+    report.insert(QStringLiteral("Profile"), title);
+    report.insert(QStringLiteral("Sort"), model.headerData(options.m_SortColumn, Qt::Horizontal).toString());
+    report.insert(QStringLiteral("Rows"), JsonRows(model, QModelIndex(), 0, options));
+    out << QJsonDocument(report).toJson(QJsonDocument::Indented);
+    return 0;
+  }
+
+  QVector<ReportRow> rows;
+  CollectRows(model, QModelIndex(), 0, options, &rows);
+
+  if (kFormatCsv == options.m_Format)
+  {
+    WriteCsv(model, rows, options, out);
+  }
+  else
+  {
+    out << title << ", by " << model.headerData(options.m_SortColumn, Qt::Horizontal).toString() << "\n\n";
+    WriteText(model, rows, options, out);
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName(QStringLiteral("cachesim-report"));
+
+  // The models log their progress, which would get in the way of the report.
+  QLoggingCategory::setFilterRules(QStringLiteral("*.debug=false"));
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(QStringLiteral("Prints the flat or tree profile of a CacheSim capture."));
+  parser.addHelpOption();
+  parser.addPositionalArgument(QStringLiteral("capture"), QStringLiteral("The .csim file to report on."));
+
+  const QCommandLineOption profileOption(QStringList() << QStringLiteral("p") << QStringLiteral("profile"),
+    QStringLiteral("flat or tree. Defaults to flat."), QStringLiteral("profile"), QStringLiteral("flat"));
+  const QCommandLineOption reverseOption(QStringList() << QStringLiteral("r") << QStringLiteral("reverse"),
+    QStringLiteral("Print the tree of the call stacks leading to <symbol>, like the UI's reverse view."), QStringLiteral("symbol"));
+  const QCommandLineOption sortOption(QStringList() << QStringLiteral("s") << QStringLiteral("sort"),
+    QStringLiteral("Stat column to sort by, as named in the UI. Defaults to Badness."), QStringLiteral("column"), QStringLiteral("Badness"));
+  const QCommandLineOption topOption(QStringList() << QStringLiteral("n") << QStringLiteral("top"),
+    QStringLiteral("Rows to print, per parent in trees; 0 for all. Defaults to 25."), QStringLiteral("count"), QStringLiteral("25"));
+  const QCommandLineOption depthOption(QStringList() << QStringLiteral("d") << QStringLiteral("depth"),
+    QStringLiteral("Tree levels to print. Defaults to 4."), QStringLiteral("levels"), QStringLiteral("4"));
+  const QCommandLineOption formatOption(QStringList() << QStringLiteral("f") << QStringLiteral("format"),
+    QStringLiteral("text, csv or json. Defaults to text."), QStringLiteral("format"), QStringLiteral("text"));
+  const QCommandLineOption outputOption(QStringList() << QStringLiteral("o") << QStringLiteral("output"),
+    QStringLiteral("Write the report to <file> instead of stdout."), QStringLiteral("file"));
+  const QCommandLineOption noResolveOption(QStringLiteral("no-resolve"),
+    QStringLiteral("Don't resolve the symbols of an unresolved capture, and never write to it. Its rows are instructions, named by address."));
+
+  parser.addOptions({ profileOption, reverseOption, sortOption, topOption, depthOption, formatOption, outputOption, noResolveOption });
+  parser.process(app);
+
+  if (parser.positionalArguments().size() != 1)
+  {
+    parser.showHelp(1);
+  }
+
+  ReportOptions options;
+  bool validNumbers = false;
+  options.m_Top = parser.value(topOption).toInt(&validNumbers);
+  if (validNumbers)
+  {
+    options.m_Depth = parser.value(depthOption).toInt(&validNumbers);
+  }
+
+  const QString profile = parser.value(profileOption);
+  const QString format = parser.value(formatOption);
+  const bool tree = parser.isSet(reverseOption) || profile == QStringLiteral("tree");
+
+  if (format == QStringLiteral("text"))
+    options.m_Format = kFormatText;
+  else if (format == QStringLiteral("csv"))
+    options.m_Format = kFormatCsv;
+  else if (format == QStringLiteral("json"))
+    options.m_Format = kFormatJson;
+  else
+    validNumbers = false;
+
+  if (!validNumbers || options.m_Top < 0 || options.m_Depth < 1 || (profile != QStringLiteral("flat") && profile != QStringLiteral("tree")))
+  {
+    parser.showHelp(1);
+  }
+
+  const QString fileName = parser.positionalArguments().first();
+
+  // Resolving saves the symbols into the capture, otherwise it's only read.
+  const bool resolve = !parser.isSet(noResolveOption);
+
+  TraceData data;
+  data.beginLoadTrace(fileName, /* readOnly=*/ !resolve);
+  if (!data.header() || 0xcace51afu != data.header()->m_Magic)
+  {
+    fprintf(stderr, "cachesim-report: failed to load %s\n", qPrintable(fileName));
+    return 1;
+  }
+
+  if (!data.isResolved() && resolve)
+  {
+    fprintf(stderr, "Resolving symbols...\n");
+
+    QEventLoop loop;
+    QObject::connect(&data, &TraceData::symbolResolutionCompleted, &loop, &QEventLoop::quit);
+    data.beginResolveSymbols();
+    loop.exec();
+
+    if (!data.isResolved())
+    {
+      fprintf(stderr, "cachesim-report: no symbols could be resolved\n");
+    }
+  }
+
+  QFile outputFile;
+  if (parser.isSet(outputOption))
+  {
+    outputFile.setFileName(parser.value(outputOption));
+    if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+      fprintf(stderr, "cachesim-report: failed to open %s for writing\n", qPrintable(outputFile.fileName()));
+      return 1;
+    }
+  }
+  else if (!outputFile.open(stdout, QIODevice::WriteOnly))
+  {
+    return 1;
+  }
+
+  const QString sortName = parser.value(sortOption);
+
+  // Both models are built in the background and reset when done.
+  if (tree)
+  {
+    const QString rootSymbol = parser.value(reverseOption);
+
+    TreeModel model;
+    QEventLoop loop;
+    QObject::connect(&model, &QAbstractItemModel::modelReset, &loop, &QEventLoop::quit);
+    model.setTraceData(&data, rootSymbol);
+    loop.exec();
+
+    options.m_FirstStatColumn = TreeModel::kColumnD1Hit;
+    const QString title = rootSymbol.isEmpty() ? QStringLiteral("Top-down tree") : QStringLiteral("Reverse: %1").arg(rootSymbol);
+    return Report(model, options, sortName, title, &outputFile);
+  }
+
+  FlatModel model;
+  QEventLoop loop;
+  QObject::connect(&model, &QAbstractItemModel::modelReset, &loop, &QEventLoop::quit);
+  model.setData(&data);
+  loop.exec();
+
+  options.m_FirstStatColumn = FlatModel::kColumnD1Hit;
+  options.m_Depth = 1;
+  return Report(model, options, sortName, QStringLiteral("Flat profile"), &outputFile);
+}
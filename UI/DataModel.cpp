@@ -0,0 +1,275 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "DataModel.h"
+#include "TraceData.h"
+#include "ObjectStack.h"
+
+#include "CacheSim/CacheSimInternals.h"
+#include "CacheSim/CacheSimData.h"
+
+static const QString kColumnLabels[CacheSim::DataModel::kColumnCount] =
+{
+  QStringLiteral("Tag / Allocated by"),
+  QStringLiteral("File"),
+  QStringLiteral("L2DMiss"),
+  QStringLiteral("% of L2DMiss"),
+};
+
+class CacheSim::DataModel::Node
+{
+public:
+  Node* m_Parent;
+  QString m_Name;
+  QString m_FileName;
+  uint64_t m_L2DMisses;
+  QVector<Node*> m_Children;
+  QHash<QString, Node*> m_ChildLookup;
+
+  explicit Node(Node* parent) : m_Parent(parent), m_L2DMisses(0)
+  {}
+
+  Node* child(QString name, bool* isNew, ObjectStack* stack)
+  {
+    if (Node* existing = m_ChildLookup.value(name))
+    {
+      *isNew = false;
+      return existing;
+    }
+
+    *isNew = true;
+    Node* node = stack->alloc<Node>(this);
+    node->m_Name = name;
+    m_Children.push_back(node);
+    m_ChildLookup.insert(name, node);
+    return node;
+  }
+
+  int rowInParentSpace() const
+  {
+    if (m_Parent)
+    {
+      return m_Parent->m_Children.indexOf(const_cast<Node*>(this));
+    }
+    return 0;
+  }
+};
+
+CacheSim::DataModel::DataModel(QObject* parent /*= nullptr*/)
+  : QAbstractItemModel(parent)
+  , m_Allocator(new ObjectStack)
+{
+}
+
+CacheSim::DataModel::~DataModel()
+{
+  m_RootNode = nullptr;
+  delete m_Allocator;
+}
+
+QModelIndex CacheSim::DataModel::index(int row, int column, const QModelIndex &parent /*= QModelIndex()*/) const
+{
+  Node* node = parent.isValid() ? static_cast<Node*>(parent.internalPointer()) : m_RootNode;
+
+  if (!node || row < 0 || row >= node->m_Children.size())
+    return QModelIndex();
+
+  return createIndex(row, column, node->m_Children[row]);
+}
+
+QModelIndex CacheSim::DataModel::parent(const QModelIndex &child) const
+{
+  if (!child.isValid())
+    return QModelIndex();
+
+  Node* p = static_cast<Node*>(child.internalPointer());
+  Node* parent = p->m_Parent;
+  if (!parent || parent == m_RootNode)
+    return QModelIndex();
+
+  return createIndex(parent->rowInParentSpace(), kColumnName, parent);
+}
+
+int CacheSim::DataModel::rowCount(const QModelIndex &parent /*= QModelIndex()*/) const
+{
+  Node* p = parent.isValid() ? static_cast<Node*>(parent.internalPointer()) : m_RootNode;
+
+  if (p && (!parent.isValid() || parent.column() == kColumnName))
+    return p->m_Children.count();
+
+  return 0;
+}
+
+int CacheSim::DataModel::columnCount(const QModelIndex &parent /*= QModelIndex()*/) const
+{
+  (void) parent;
+  return kColumnCount;
+}
+
+QVariant CacheSim::DataModel::data(const QModelIndex &index, int role /*= Qt::DisplayRole*/) const
+{
+  Node* node = static_cast<Node*>(index.internalPointer());
+  if (!node)
+    return QVariant();
+
+  if (role == Qt::DisplayRole)
+  {
+    switch (index.column())
+    {
+    case kColumnName: return node->m_Name;
+    case kColumnFileName: return node->m_FileName;
+    case kColumnL2DMiss: return quint64(node->m_L2DMisses);
+    case kColumnL2DMissPercent: return m_TotalL2DMisses ? 100.0 * node->m_L2DMisses / m_TotalL2DMisses : 0.0;
+    }
+  }
+  else if (role == Qt::TextAlignmentRole)
+  {
+    if (index.column() > kColumnFileName)
+    {
+      return Qt::AlignRight;
+    }
+    return Qt::AlignLeft;
+  }
+  else if (role == Qt::ToolTipRole)
+  {
+    if (index.column() == kColumnName)
+    {
+      return node->m_Name;
+    }
+    else if (index.column() == kColumnFileName)
+    {
+      return node->m_FileName;
+    }
+  }
+
+  return QVariant();
+}
+
+QVariant CacheSim::DataModel::headerData(int section, Qt::Orientation orientation, int role /*= Qt::DisplayRole*/) const
+{
+  if (role == Qt::DisplayRole && orientation == Qt::Horizontal && section >= 0 && section < kColumnCount)
+  {
+    return kColumnLabels[section];
+  }
+
+  return QVariant();
+}
+
+void CacheSim::DataModel::setTraceData(const TraceData* traceData)
+{
+  if (m_Data)
+  {
+    disconnect(m_Data, &TraceData::memoryMappedDataChanged, this, &DataModel::dataStoreChanged);
+  }
+
+  m_Data = traceData;
+  dataStoreChanged();
+
+  if (m_Data)
+  {
+    connect(m_Data, &TraceData::memoryMappedDataChanged, this, &DataModel::dataStoreChanged);
+  }
+}
+
+void CacheSim::DataModel::dataStoreChanged()
+{
+  beginResetModel();
+
+  m_Allocator->reset();
+  m_RootNode = m_Allocator->alloc<Node>(nullptr);
+  m_TotalL2DMisses = 0;
+
+  if (!m_Data)
+  {
+    endResetModel();
+    return;
+  }
+
+  const SerializedHeader* header = m_Data->header();
+
+  const SerializedNode* nodes = header->GetStats();
+  for (uint32_t i = 0, count = header->GetStatCount(); i < count; ++i)
+  {
+    m_TotalL2DMisses += nodes[i].m_Stats[CacheSim::kL2DMiss];
+  }
+
+  const SerializedDataTag* tags = header->GetDataTags();
+  const uint32_t tagCount = header->GetDataTagCount();
+
+  // Tags first, so ones without misses still show up.
+  QVector<Node*> tagNodes;
+  tagNodes.reserve(tagCount);
+  for (uint32_t i = 0; i < tagCount; ++i)
+  {
+    bool isNew;
+    Node* node = m_RootNode->child(QString::fromUtf8(header->GetDataTagName(tags[i])), &isNew, m_Allocator);
+    node->m_L2DMisses += tags[i].m_L2DMisses;
+    tagNodes.push_back(node);
+  }
+
+  const SerializedDataSite* sites = header->GetDataSites();
+  const uintptr_t* stackFrames = header->GetStacks();
+
+  for (uint32_t i = 0, count = header->GetDataSiteCount(); i < count; ++i)
+  {
+    const SerializedDataSite& site = sites[i];
+    if (site.m_Tag >= tagCount)
+      continue;
+
+    Node* branch = tagNodes[site.m_Tag];
+
+    const uintptr_t* fp = stackFrames + site.m_StackIndex;
+    while (uintptr_t rip = *fp)
+    {
+      QString symbolName;
+
+      const SerializedSymbol* sym = m_Data->frameSymbol(uint32_t(fp++ - stackFrames));
+      if (sym)
+      {
+        symbolName = m_Data->internedSymbolString(sym->m_SymbolName);
+      }
+      else
+      {
+        symbolName = QStringLiteral("[%1]").arg(rip, 16, 16, QLatin1Char('0'));
+      }
+
+      bool isNew;
+      branch = branch->child(symbolName, &isNew, m_Allocator);
+
+      if (isNew && sym)
+      {
+        branch->m_FileName = m_Data->internedSymbolString(sym->m_FileName);
+      }
+
+      branch->m_L2DMisses += site.m_L2DMisses;
+    }
+  }
+
+  endResetModel();
+}
+
+#include "aux_DataModel.moc"
@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include "Precompiled.h"
+
+namespace CacheSim
+{
+  class TraceData;
+  class ObjectStack;
+
+  /// Breaks down L2 data misses by the allocation tag and the allocating call stack of the data that missed.
+  /// Top level rows are tags, below them are the allocating functions, innermost first.
+  class DataModel : public QAbstractItemModel
+  {
+    Q_OBJECT;
+
+  public:
+    enum Column
+    {
+      kColumnName,
+      kColumnFileName,
+      kColumnL2DMiss,
+      kColumnL2DMissPercent,
+      kColumnCount
+    };
+
+  public:
+    explicit DataModel(QObject* parent = nullptr);
+    ~DataModel();
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role /*= Qt::DisplayRole*/) const override;
+
+  public:
+    void setTraceData(const TraceData* traceData);
+
+  private:
+    Q_SLOT void dataStoreChanged();
+
+  private:
+    class Node;
+
+    const TraceData* m_Data = nullptr;
+    ObjectStack* m_Allocator = nullptr;
+    Node* m_RootNode = nullptr;
+    uint64_t m_TotalL2DMisses = 0;    ///< Of the whole capture, including misses outside tracked allocations
+  };
+
+}
@@ -0,0 +1,69 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "DataProfileView.h"
+#include "DataModel.h"
+#include "NumberFormatters.h"
+
+#include "ui_DataProfileView.h"
+
+CacheSim::DataProfileView::DataProfileView(const TraceData* traceData, QWidget* parent /*= nullptr*/)
+  : BaseProfileView(parent)
+  , m_Model(new DataModel(this))
+  , m_FilterProxy(new QSortFilterProxyModel(this))
+  , ui(new Ui_DataProfileView)
+{
+  ui->setupUi(this);
+
+  setItemView(ui->m_TreeView);
+
+  m_Model->setTraceData(traceData);
+  m_FilterProxy->setSourceModel(m_Model);
+
+  DecimalFormatDelegate* decimalDelegate = new DecimalFormatDelegate(this);
+  IntegerFormatDelegate* integerDelegate = new IntegerFormatDelegate(this);
+  QTreeView* treeView = ui->m_TreeView;
+  treeView->setItemDelegateForColumn(DataModel::kColumnL2DMiss, integerDelegate);
+  treeView->setItemDelegateForColumn(DataModel::kColumnL2DMissPercent, decimalDelegate);
+
+  treeView->setModel(m_FilterProxy);
+  treeView->sortByColumn(DataModel::kColumnL2DMiss, Qt::DescendingOrder);
+
+  connect(ui->m_Filter, &QLineEdit::textChanged, this, &DataProfileView::filterTextEdited);
+}
+
+CacheSim::DataProfileView::~DataProfileView()
+{
+  delete ui;
+}
+
+void CacheSim::DataProfileView::filterTextEdited()
+{
+  m_FilterProxy->setFilterFixedString(ui->m_Filter->text());
+}
+
+#include "aux_DataProfileView.moc"
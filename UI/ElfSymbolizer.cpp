@@ -0,0 +1,1070 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "ElfSymbolizer.h"
+
+#include <cxxabi.h>
+#include <elf.h>
+#include <stdlib.h>
+
+namespace
+{
+  // The parts of the DWARF constants needed to find line tables, from the DWARF 5 standard.
+  enum : uint64_t
+  {
+    DW_UT_type = 0x02,
+    DW_UT_skeleton = 0x04,
+    DW_UT_split_compile = 0x05,
+    DW_UT_split_type = 0x06,
+
+    DW_AT_stmt_list = 0x10,
+    DW_AT_comp_dir = 0x1b,
+    DW_AT_str_offsets_base = 0x72,
+
+    DW_FORM_addr = 0x01,
+    DW_FORM_block2 = 0x03,
+    DW_FORM_block4 = 0x04,
+    DW_FORM_data2 = 0x05,
+    DW_FORM_data4 = 0x06,
+    DW_FORM_data8 = 0x07,
+    DW_FORM_string = 0x08,
+    DW_FORM_block = 0x09,
+    DW_FORM_block1 = 0x0a,
+    DW_FORM_data1 = 0x0b,
+    DW_FORM_flag = 0x0c,
+    DW_FORM_sdata = 0x0d,
+    DW_FORM_strp = 0x0e,
+    DW_FORM_udata = 0x0f,
+    DW_FORM_ref_addr = 0x10,
+    DW_FORM_ref1 = 0x11,
+    DW_FORM_ref2 = 0x12,
+    DW_FORM_ref4 = 0x13,
+    DW_FORM_ref8 = 0x14,
+    DW_FORM_ref_udata = 0x15,
+    DW_FORM_indirect = 0x16,
+    DW_FORM_sec_offset = 0x17,
+    DW_FORM_exprloc = 0x18,
+    DW_FORM_flag_present = 0x19,
+    DW_FORM_strx = 0x1a,
+    DW_FORM_addrx = 0x1b,
+    DW_FORM_ref_sup4 = 0x1c,
+    DW_FORM_strp_sup = 0x1d,
+    DW_FORM_data16 = 0x1e,
+    DW_FORM_line_strp = 0x1f,
+    DW_FORM_ref_sig8 = 0x20,
+    DW_FORM_implicit_const = 0x21,
+    DW_FORM_loclistx = 0x22,
+    DW_FORM_rnglistx = 0x23,
+    DW_FORM_ref_sup8 = 0x24,
+    DW_FORM_strx1 = 0x25,
+    DW_FORM_strx2 = 0x26,
+    DW_FORM_strx3 = 0x27,
+    DW_FORM_strx4 = 0x28,
+    DW_FORM_addrx1 = 0x29,
+    DW_FORM_addrx2 = 0x2a,
+    DW_FORM_addrx3 = 0x2b,
+    DW_FORM_addrx4 = 0x2c,
+
+    DW_LNS_copy = 0x01,
+    DW_LNS_advance_pc = 0x02,
+    DW_LNS_advance_line = 0x03,
+    DW_LNS_set_file = 0x04,
+    DW_LNS_set_column = 0x05,
+    DW_LNS_const_add_pc = 0x08,
+    DW_LNS_fixed_advance_pc = 0x09,
+
+    DW_LNE_end_sequence = 0x01,
+    DW_LNE_set_address = 0x02,
+    DW_LNE_define_file = 0x03,
+
+    DW_LNCT_path = 0x1,
+    DW_LNCT_directory_index = 0x2,
+  };
+
+  // Bounds checked reader for ELF notes and DWARF sections. Reading past the end yields zeros and clears m_Ok.
+  struct Cursor
+  {
+    const uchar* m_Pos;
+    const uchar* m_End;
+    bool         m_Ok = true;
+
+    Cursor(const QByteArray& data, uint64_t offset = 0)
+      : m_Pos(reinterpret_cast<const uchar*>(data.constData()))
+      , m_End(m_Pos + data.size())
+    {
+      skip(offset);
+    }
+
+    Cursor(const uchar* begin, const uchar* end)
+      : m_Pos(begin)
+      , m_End(end)
+    {
+    }
+
+    bool has(uint64_t n)
+    {
+      if (m_Ok && uint64_t(m_End - m_Pos) >= n)
+        return true;
+      m_Ok = false;
+      m_Pos = m_End;
+      return false;
+    }
+
+    bool atEnd() const
+    {
+      return m_Pos >= m_End;
+    }
+
+    void skip(uint64_t n)
+    {
+      if (has(n))
+        m_Pos += n;
+    }
+
+    uint64_t u(int size)
+    {
+      uint64_t v = 0;
+      if (has(size))
+      {
+        for (int i = 0; i < size; ++i)
+        {
+          v |= uint64_t(m_Pos[i]) << (8 * i);
+        }
+        m_Pos += size;
+      }
+      return v;
+    }
+
+    uint64_t offset(bool dwarf64)
+    {
+      return u(dwarf64 ? 8 : 4);
+    }
+
+    uint64_t uleb()
+    {
+      uint64_t v = 0;
+      int shift = 0;
+      while (has(1))
+      {
+        uchar b = *m_Pos++;
+        if (shift < 64)
+          v |= uint64_t(b & 0x7f) << shift;
+        shift += 7;
+        if (0 == (b & 0x80))
+          break;
+      }
+      return v;
+    }
+
+    int64_t sleb()
+    {
+      int64_t v = 0;
+      int shift = 0;
+      uchar b = 0;
+      while (has(1))
+      {
+        b = *m_Pos++;
+        if (shift < 64)
+          v |= int64_t(b & 0x7f) << shift;
+        shift += 7;
+        if (0 == (b & 0x80))
+          break;
+      }
+      if (shift < 64 && (b & 0x40))
+        v |= -(int64_t(1) << shift);
+      return v;
+    }
+
+    const char* str()
+    {
+      const uchar* s = m_Pos;
+      const uchar* e = static_cast<const uchar*>(memchr(s, 0, m_End - s));
+      if (!e)
+      {
+        m_Ok = false;
+        m_Pos = m_End;
+        return "";
+      }
+      m_Pos = e + 1;
+      return reinterpret_cast<const char*>(s);
+    }
+
+    // Reads the length of a unit and returns the cursor it spans, along with whether it's in 64-bit DWARF.
+    Cursor unit(bool* dwarf64)
+    {
+      uint64_t length = u(4);
+      *dwarf64 = length == 0xffffffff;
+      if (*dwarf64)
+        length = u(8);
+
+      const uchar* begin = m_Pos;
+      skip(length);
+      return m_Ok ? Cursor(begin, m_Pos) : Cursor(m_End, m_End);
+    }
+  };
+
+  const char* SectionString(const QByteArray& section, uint64_t offset)
+  {
+    if (offset >= uint64_t(section.size()) || !memchr(section.constData() + offset, 0, section.size() - offset))
+      return "";
+    return section.constData() + offset;
+  }
+
+  QString JoinPath(const QString& dir, const QString& name)
+  {
+    if (dir.isEmpty() || name.startsWith(QLatin1Char('/')))
+      return name;
+    if (dir.endsWith(QLatin1Char('/')))
+      return dir + name;
+    return dir + QLatin1Char('/') + name;
+  }
+
+  // Attribute value read by ReadForm(). Strings in other sections are returned as their offset or index.
+  struct FormValue
+  {
+    enum Kind
+    {
+      kValue,
+      kString,
+      kStrOffset,
+      kLineStrOffset,
+      kStrIndex,
+    };
+
+    Kind        m_Kind = kValue;
+    uint64_t    m_Value = 0;
+    const char* m_String = "";
+  };
+
+  struct UnitInfo
+  {
+    bool m_Dwarf64;
+    int  m_Version;
+    int  m_AddressSize;
+  };
+
+  FormValue ReadForm(Cursor& c, uint64_t form, int64_t implicitConst, const UnitInfo& unit)
+  {
+    FormValue v;
+    switch (form)
+    {
+    case DW_FORM_addr:            v.m_Value = c.u(unit.m_AddressSize); break;
+    case DW_FORM_block2:          c.skip(c.u(2)); break;
+    case DW_FORM_block4:          c.skip(c.u(4)); break;
+    case DW_FORM_data2:           v.m_Value = c.u(2); break;
+    case DW_FORM_data4:           v.m_Value = c.u(4); break;
+    case DW_FORM_data8:           v.m_Value = c.u(8); break;
+    case DW_FORM_string:          v.m_Kind = FormValue::kString; v.m_String = c.str(); break;
+    case DW_FORM_block:           c.skip(c.uleb()); break;
+    case DW_FORM_block1:          c.skip(c.u(1)); break;
+    case DW_FORM_data1:           v.m_Value = c.u(1); break;
+    case DW_FORM_flag:            v.m_Value = c.u(1); break;
+    case DW_FORM_sdata:           v.m_Value = uint64_t(c.sleb()); break;
+    case DW_FORM_strp:            v.m_Kind = FormValue::kStrOffset; v.m_Value = c.offset(unit.m_Dwarf64); break;
+    case DW_FORM_udata:           v.m_Value = c.uleb(); break;
+    case DW_FORM_ref_addr:        v.m_Value = unit.m_Version <= 2 ? c.u(unit.m_AddressSize) : c.offset(unit.m_Dwarf64); break;
+    case DW_FORM_ref1:            v.m_Value = c.u(1); break;
+    case DW_FORM_ref2:            v.m_Value = c.u(2); break;
+    case DW_FORM_ref4:            v.m_Value = c.u(4); break;
+    case DW_FORM_ref8:            v.m_Value = c.u(8); break;
+    case DW_FORM_ref_udata:       v.m_Value = c.uleb(); break;
+    case DW_FORM_indirect:        return ReadForm(c, c.uleb(), implicitConst, unit);
+    case DW_FORM_sec_offset:      v.m_Value = c.offset(unit.m_Dwarf64); break;
+    case DW_FORM_exprloc:         c.skip(c.uleb()); break;
+    case DW_FORM_flag_present:    v.m_Value = 1; break;
+    case DW_FORM_strx:            v.m_Kind = FormValue::kStrIndex; v.m_Value = c.uleb(); break;
+    case DW_FORM_addrx:           v.m_Value = c.uleb(); break;
+    case DW_FORM_ref_sup4:        v.m_Value = c.u(4); break;
+    case DW_FORM_strp_sup:        v.m_Value = c.offset(unit.m_Dwarf64); break;
+    case DW_FORM_data16:          c.skip(16); break;
+    case DW_FORM_line_strp:       v.m_Kind = FormValue::kLineStrOffset; v.m_Value = c.offset(unit.m_Dwarf64); break;
+    case DW_FORM_ref_sig8:        v.m_Value = c.u(8); break;
+    case DW_FORM_implicit_const:  v.m_Value = uint64_t(implicitConst); break;
+    case DW_FORM_loclistx:        v.m_Value = c.uleb(); break;
+    case DW_FORM_rnglistx:        v.m_Value = c.uleb(); break;
+    case DW_FORM_ref_sup8:        v.m_Value = c.u(8); break;
+    case DW_FORM_strx1:           v.m_Kind = FormValue::kStrIndex; v.m_Value = c.u(1); break;
+    case DW_FORM_strx2:           v.m_Kind = FormValue::kStrIndex; v.m_Value = c.u(2); break;
+    case DW_FORM_strx3:           v.m_Kind = FormValue::kStrIndex; v.m_Value = c.u(3); break;
+    case DW_FORM_strx4:           v.m_Kind = FormValue::kStrIndex; v.m_Value = c.u(4); break;
+    case DW_FORM_addrx1:          v.m_Value = c.u(1); break;
+    case DW_FORM_addrx2:          v.m_Value = c.u(2); break;
+    case DW_FORM_addrx3:          v.m_Value = c.u(3); break;
+    case DW_FORM_addrx4:          v.m_Value = c.u(4); break;
+    default:
+      // Can't tell how big it is, so nothing after it can be read.
+      c.m_Ok = false;
+      c.m_Pos = c.m_End;
+      break;
+    }
+    return v;
+  }
+
+  QString Demangle(const char* name)
+  {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (!demangled)
+      return QString::fromUtf8(name);
+
+    QString result = QString::fromUtf8(demangled);
+    free(demangled);
+    return result;
+  }
+}
+
+// Memory mapped ELF file and its section headers.
+class CacheSim::ElfSymbolizer::ElfFile
+{
+public:
+  bool open(const QString& path)
+  {
+    m_File.setFileName(path);
+    if (!m_File.open(QIODevice::ReadOnly))
+      return false;
+
+    m_Size = uint64_t(m_File.size());
+    m_Data = m_File.map(0, m_Size);
+    if (!m_Data || m_Size < sizeof(Elf64_Ehdr))
+      return false;
+
+    const Elf64_Ehdr* ehdr = reinterpret_cast<const Elf64_Ehdr*>(m_Data);
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64 || ehdr->e_ident[EI_DATA] != ELFDATA2LSB)
+      return false;
+
+    if (ehdr->e_shentsize != sizeof(Elf64_Shdr) || ehdr->e_shoff > m_Size || ehdr->e_shnum > (m_Size - ehdr->e_shoff) / sizeof(Elf64_Shdr))
+      return false;
+
+    m_Sections = reinterpret_cast<const Elf64_Shdr*>(m_Data + ehdr->e_shoff);
+    m_SectionCount = ehdr->e_shnum;
+
+    if (ehdr->e_shstrndx < m_SectionCount)
+    {
+      m_SectionNames = rawSection(m_Sections[ehdr->e_shstrndx]);
+    }
+
+    return true;
+  }
+
+  QString path() const
+  {
+    return m_File.fileName();
+  }
+
+  int sectionCount() const
+  {
+    return m_SectionCount;
+  }
+
+  const Elf64_Shdr& sectionHeader(int index) const
+  {
+    return m_Sections[index];
+  }
+
+  const Elf64_Shdr* findSection(const char* name) const
+  {
+    for (int i = 0; i < m_SectionCount; ++i)
+    {
+      if (0 == strcmp(SectionString(m_SectionNames, m_Sections[i].sh_name), name))
+        return &m_Sections[i];
+    }
+    return nullptr;
+  }
+
+  // Contents of a section, pointing into the mapping unless it has to be decompressed.
+  QByteArray sectionData(const Elf64_Shdr& shdr) const
+  {
+    QByteArray raw = rawSection(shdr);
+    if (0 == (shdr.sh_flags & SHF_COMPRESSED))
+      return raw;
+
+    if (uint64_t(raw.size()) < sizeof(Elf64_Chdr))
+      return QByteArray();
+
+    Elf64_Chdr chdr;
+    memcpy(&chdr, raw.constData(), sizeof chdr);
+    if (chdr.ch_type != ELFCOMPRESS_ZLIB)
+      return QByteArray();
+
+    return inflate(raw.mid(sizeof chdr), chdr.ch_size);
+  }
+
+  // Contents of a debug section, which may have been compressed the old way into a .zdebug section.
+  QByteArray debugSection(const char* name) const
+  {
+    if (const Elf64_Shdr* shdr = findSection(name))
+      return sectionData(*shdr);
+
+    QByteArray zname = QByteArray(".z") + (name + 1);
+    if (const Elf64_Shdr* shdr = findSection(zname.constData()))
+    {
+      QByteArray raw = rawSection(*shdr);
+      if (raw.size() < 12 || !raw.startsWith("ZLIB"))
+        return QByteArray();
+
+      uint64_t size = 0;
+      for (int i = 4; i < 12; ++i)
+      {
+        size = (size << 8) | uchar(raw[i]);
+      }
+      return inflate(raw.mid(12), size);
+    }
+
+    return QByteArray();
+  }
+
+  QByteArray buildId() const
+  {
+    const Elf64_Shdr* shdr = findSection(".note.gnu.build-id");
+    if (!shdr)
+      return QByteArray();
+
+    QByteArray notes = sectionData(*shdr);
+    Cursor c(notes);
+    while (!c.atEnd() && c.m_Ok)
+    {
+      uint32_t nameSize = uint32_t(c.u(4));
+      uint32_t descSize = uint32_t(c.u(4));
+      uint32_t type = uint32_t(c.u(4));
+      const uchar* name = c.m_Pos;
+      c.skip((uint64_t(nameSize) + 3) & ~3ull);
+      const uchar* desc = c.m_Pos;
+      c.skip((uint64_t(descSize) + 3) & ~3ull);
+
+      if (c.m_Ok && type == NT_GNU_BUILD_ID && nameSize == 4 && 0 == memcmp(name, "GNU", 4))
+        return QByteArray(reinterpret_cast<const char*>(desc), int(descSize)).toHex();
+    }
+    return QByteArray();
+  }
+
+  QString debugLink() const
+  {
+    const Elf64_Shdr* shdr = findSection(".gnu_debuglink");
+    if (!shdr)
+      return QString();
+
+    QByteArray data = sectionData(*shdr);
+    return QString::fromUtf8(SectionString(data, 0));
+  }
+
+private:
+  QByteArray rawSection(const Elf64_Shdr& shdr) const
+  {
+    if (shdr.sh_type == SHT_NOBITS || shdr.sh_offset > m_Size || shdr.sh_size > m_Size - shdr.sh_offset)
+      return QByteArray();
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(m_Data + shdr.sh_offset), int(shdr.sh_size));
+  }
+
+  static QByteArray inflate(const QByteArray& compressed, uint64_t size)
+  {
+    if (size > 0x7fffffffu)
+      return QByteArray();
+
+    // qUncompress() wants the zlib stream prefixed with its big endian uncompressed size.
+    QByteArray input(4, 0);
+    input[0] = char(size >> 24);
+    input[1] = char(size >> 16);
+    input[2] = char(size >> 8);
+    input[3] = char(size);
+    input += compressed;
+    return qUncompress(input);
+  }
+
+  QFile             m_File;
+  const uchar*      m_Data = nullptr;
+  uint64_t          m_Size = 0;
+  const Elf64_Shdr* m_Sections = nullptr;
+  int               m_SectionCount = 0;
+  QByteArray        m_SectionNames;
+};
+
+QString CacheSim::ElfSymbolizer::findDebugFile(const ElfFile& module, const QString& modulePath, const QByteArray& buildId)
+{
+  // Look for a separate debug file the same places gdb does, plus the same path under /usr/lib/debug.
+  const QString realPath = QFileInfo(modulePath).canonicalFilePath();
+  const QString dir = QFileInfo(realPath).path();
+  const QString debugRoot = QStringLiteral("/usr/lib/debug");
+
+  QStringList candidates;
+  if (buildId.size() > 2)
+  {
+    candidates << QStringLiteral("%1/.build-id/%2/%3.debug").arg(debugRoot, QString::fromLatin1(buildId.left(2)), QString::fromLatin1(buildId.mid(2)));
+  }
+
+  const QString debugLink = module.debugLink();
+  if (!debugLink.isEmpty())
+  {
+    candidates << dir + QLatin1Char('/') + debugLink;
+    candidates << dir + QStringLiteral("/.debug/") + debugLink;
+    candidates << debugRoot + dir + QLatin1Char('/') + debugLink;
+  }
+
+  if (!realPath.isEmpty())
+  {
+    candidates << debugRoot + realPath;
+  }
+
+  Q_FOREACH(const QString& candidate, candidates)
+  {
+    if (candidate == realPath || !QFileInfo(candidate).isFile())
+      continue;
+
+    ElfFile file;
+    if (!file.open(candidate))
+      continue;
+
+    // A debug file for another build of the module would give wrong answers, so skip it.
+    const QByteArray id = file.buildId();
+    if (!buildId.isEmpty() && !id.isEmpty() && id != buildId)
+      continue;
+
+    return candidate;
+  }
+
+  return QString();
+}
+
+bool CacheSim::ElfSymbolizer::identify(const QString& modulePath, QByteArray* buildId, QString* debugFilePath)
+{
+  ElfFile module;
+  if (!module.open(modulePath))
+    return false;
+
+  *buildId = module.buildId();
+  *debugFilePath = findDebugFile(module, modulePath, *buildId);
+  return true;
+}
+
+bool CacheSim::ElfSymbolizer::load(const QString& modulePath)
+{
+  ElfFile module;
+  if (!module.open(modulePath))
+    return false;
+
+  m_BuildId = module.buildId();
+  m_DebugFilePath = findDebugFile(module, modulePath, m_BuildId);
+
+  QScopedPointer<ElfFile> debug;
+  if (!m_DebugFilePath.isEmpty())
+  {
+    debug.reset(new ElfFile);
+    if (!debug->open(m_DebugFilePath))
+    {
+      debug.reset();
+      m_DebugFilePath.clear();
+    }
+  }
+
+  readSymbols(module);
+  if (debug)
+  {
+    readSymbols(*debug);
+  }
+
+  if (debug && (debug->findSection(".debug_line") || debug->findSection(".zdebug_line")))
+  {
+    readLines(*debug);
+  }
+  else
+  {
+    readLines(module);
+  }
+
+  finish();
+  return true;
+}
+
+void CacheSim::ElfSymbolizer::readSymbols(const ElfFile& elf)
+{
+  for (int s = 0; s < elf.sectionCount(); ++s)
+  {
+    const Elf64_Shdr& shdr = elf.sectionHeader(s);
+    if ((shdr.sh_type != SHT_SYMTAB && shdr.sh_type != SHT_DYNSYM) || shdr.sh_link >= uint32_t(elf.sectionCount()))
+      continue;
+
+    const QByteArray symbols = elf.sectionData(shdr);
+    const QByteArray strings = elf.sectionData(elf.sectionHeader(int(shdr.sh_link)));
+    const Elf64_Sym* syms = reinterpret_cast<const Elf64_Sym*>(symbols.constData());
+
+    for (int i = 0, count = int(symbols.size() / sizeof(Elf64_Sym)); i < count; ++i)
+    {
+      const Elf64_Sym& sym = syms[i];
+      const int type = ELF64_ST_TYPE(sym.st_info);
+      if ((type != STT_FUNC && type != STT_GNU_IFUNC) || sym.st_shndx == SHN_UNDEF || !sym.st_value)
+        continue;
+
+      const char* name = SectionString(strings, sym.st_name);
+      if (!*name)
+        continue;
+
+      Symbol out;
+      out.m_Address = sym.st_value;
+      out.m_Size = sym.st_size;
+      out.m_Name = uint32_t(m_Names.size());
+      out.m_Global = ELF64_ST_BIND(sym.st_info) != STB_LOCAL;
+      m_Names.append(name, int(strlen(name)) + 1);
+      m_Symbols.push_back(out);
+    }
+  }
+}
+
+void CacheSim::ElfSymbolizer::readLines(const ElfFile& elf)
+{
+  const QByteArray info = elf.debugSection(".debug_info");
+  const QByteArray abbrev = elf.debugSection(".debug_abbrev");
+  const QByteArray line = elf.debugSection(".debug_line");
+  const QByteArray str = elf.debugSection(".debug_str");
+  const QByteArray lineStr = elf.debugSection(".debug_line_str");
+  const QByteArray strOffsets = elf.debugSection(".debug_str_offsets");
+
+  if (line.isEmpty())
+    return;
+
+  auto formString = [&](const FormValue& v, const UnitInfo& unit, uint64_t strOffsetsBase) -> const char*
+  {
+    switch (v.m_Kind)
+    {
+    case FormValue::kString:
+      return v.m_String;
+    case FormValue::kStrOffset:
+      return SectionString(str, v.m_Value);
+    case FormValue::kLineStrOffset:
+      return SectionString(lineStr, v.m_Value);
+    case FormValue::kStrIndex:
+      {
+        const int size = unit.m_Dwarf64 ? 8 : 4;
+        Cursor c(strOffsets, strOffsetsBase + v.m_Value * size);
+        uint64_t offset = c.u(size);
+        return c.m_Ok ? SectionString(str, offset) : "";
+      }
+    default:
+      return "";
+    }
+  };
+
+  // Relative paths in the line tables are relative to the compilation directory, which only the compilation units in
+  // .debug_info know. Read it from the first DIE of each unit.
+  QHash<uint64_t, QString> compDirs;
+
+  Cursor units(info);
+  while (!units.atEnd() && units.m_Ok)
+  {
+    UnitInfo unit;
+    Cursor c = units.unit(&unit.m_Dwarf64);
+    unit.m_Version = int(c.u(2));
+
+    uint64_t abbrevOffset;
+    if (unit.m_Version >= 5)
+    {
+      const int unitType = int(c.u(1));
+      unit.m_AddressSize = int(c.u(1));
+      abbrevOffset = c.offset(unit.m_Dwarf64);
+      if (unitType == DW_UT_skeleton || unitType == DW_UT_split_compile)
+        c.skip(8);
+      else if (unitType == DW_UT_type || unitType == DW_UT_split_type)
+        c.skip(8 + (unit.m_Dwarf64 ? 8 : 4));
+    }
+    else
+    {
+      abbrevOffset = c.offset(unit.m_Dwarf64);
+      unit.m_AddressSize = int(c.u(1));
+    }
+
+    const uint64_t code = c.uleb();
+    if (!c.m_Ok || !code)
+      continue;
+
+    // Find the abbreviation of the unit DIE.
+    Cursor a(abbrev, abbrevOffset);
+    while (a.m_Ok && !a.atEnd())
+    {
+      const uint64_t entryCode = a.uleb();
+      if (!entryCode)
+      {
+        a.m_Ok = false;
+        break;
+      }
+
+      a.uleb(); // tag
+      a.u(1);   // children
+
+      if (entryCode == code)
+        break;
+
+      for (;;)
+      {
+        const uint64_t attr = a.uleb();
+        const uint64_t form = a.uleb();
+        if (form == DW_FORM_implicit_const)
+          a.sleb();
+        if ((!attr && !form) || !a.m_Ok)
+          break;
+      }
+    }
+
+    bool haveStmtList = false;
+    uint64_t stmtList = 0;
+    uint64_t strOffsetsBase = unit.m_Dwarf64 ? 16 : 8;
+    FormValue compDir;
+    compDir.m_Kind = FormValue::kValue;
+
+    while (a.m_Ok && c.m_Ok)
+    {
+      const uint64_t attr = a.uleb();
+      const uint64_t form = a.uleb();
+      const int64_t implicitConst = form == DW_FORM_implicit_const ? a.sleb() : 0;
+      if (!attr && !form)
+        break;
+
+      const FormValue v = ReadForm(c, form, implicitConst, unit);
+      if (attr == DW_AT_stmt_list)
+      {
+        haveStmtList = true;
+        stmtList = v.m_Value;
+      }
+      else if (attr == DW_AT_comp_dir)
+      {
+        compDir = v;
+      }
+      else if (attr == DW_AT_str_offsets_base)
+      {
+        strOffsetsBase = v.m_Value;
+      }
+    }
+
+    if (haveStmtList && compDir.m_Kind != FormValue::kValue)
+    {
+      compDirs.insert(stmtList, QString::fromUtf8(formString(compDir, unit, strOffsetsBase)));
+    }
+  }
+
+  QHash<QString, uint32_t> fileIndices;
+  QVector<LineRow> sequence;
+
+  Cursor programs(line);
+  while (!programs.atEnd() && programs.m_Ok)
+  {
+    const uint64_t unitOffset = uint64_t(programs.m_Pos - reinterpret_cast<const uchar*>(line.constData()));
+
+    UnitInfo unit;
+    Cursor c = programs.unit(&unit.m_Dwarf64);
+    unit.m_Version = int(c.u(2));
+    unit.m_AddressSize = 8;
+
+    if (unit.m_Version < 2 || unit.m_Version > 5)
+      continue;
+
+    if (unit.m_Version >= 5)
+    {
+      unit.m_AddressSize = int(c.u(1));
+      c.u(1); // segment_selector_size
+    }
+
+    const uint64_t headerLength = c.offset(unit.m_Dwarf64);
+    Cursor program(c.m_Pos + std::min<uint64_t>(headerLength, uint64_t(c.m_End - c.m_Pos)), c.m_End);
+
+    const int minInstructionLength = int(c.u(1));
+    if (unit.m_Version >= 4)
+      c.u(1); // maximum_operations_per_instruction
+    c.u(1); // default_is_stmt
+    const int lineBase = int(int8_t(c.u(1)));
+    const int lineRange = int(c.u(1));
+    const int opcodeBase = int(c.u(1));
+
+    uchar opcodeLengths[256] = {};
+    for (int i = 1; i < opcodeBase; ++i)
+    {
+      opcodeLengths[i] = uchar(c.u(1));
+    }
+
+    const QString compDir = compDirs.value(unitOffset);
+    QVector<QString> dirs;
+    QVector<QString> files;
+
+    auto addDir = [&](const QString& name)
+    {
+      dirs.push_back(dirs.isEmpty() ? name : JoinPath(compDir, name));
+    };
+
+    auto addFile = [&](const QString& name, uint64_t dir)
+    {
+      files.push_back(JoinPath(dir < uint64_t(dirs.size()) ? dirs[int(dir)] : compDir, name));
+    };
+
+    if (unit.m_Version >= 5)
+    {
+      // Directory and file entries are described by lists of (content type, form) pairs.
+      auto readEntries = [&](bool isFile)
+      {
+        QVector<QPair<uint64_t, uint64_t>> format;
+        for (int i = 0, count = int(c.u(1)); i < count; ++i)
+        {
+          const uint64_t type = c.uleb();
+          format.push_back(qMakePair(type, c.uleb()));
+        }
+
+        for (uint64_t i = 0, count = c.uleb(); i < count && c.m_Ok; ++i)
+        {
+          QString name;
+          uint64_t dir = 0;
+          for (const QPair<uint64_t, uint64_t>& f : format)
+          {
+            const FormValue v = ReadForm(c, f.second, 0, unit);
+            if (f.first == DW_LNCT_path)
+              name = QString::fromUtf8(formString(v, unit, 0));
+            else if (f.first == DW_LNCT_directory_index)
+              dir = v.m_Value;
+          }
+
+          if (isFile)
+            addFile(name, dir);
+          else
+            addDir(name);
+        }
+      };
+
+      readEntries(false);
+      readEntries(true);
+    }
+    else
+    {
+      // Directory 0 and file 0 are implicit before version 5, the former being the compilation directory.
+      addDir(compDir);
+      while (const char* name = c.str())
+      {
+        if (!*name)
+          break;
+        addDir(QString::fromUtf8(name));
+      }
+
+      files.push_back(QString());
+      while (const char* name = c.str())
+      {
+        if (!*name)
+          break;
+        const uint64_t dir = c.uleb();
+        c.uleb(); // mtime
+        c.uleb(); // length
+        addFile(QString::fromUtf8(name), dir);
+      }
+    }
+
+    if (!c.m_Ok || !lineRange)
+      continue;
+
+    // Files are only added to the module's list once a row refers to them.
+    QVector<uint32_t> globalFiles(files.size(), kEndSequence);
+    auto globalFile = [&](uint64_t file) -> uint32_t
+    {
+      if (file >= uint64_t(files.size()))
+        return kEndSequence;
+
+      uint32_t& index = globalFiles[int(file)];
+      if (index == kEndSequence)
+      {
+        auto it = fileIndices.constFind(files[int(file)]);
+        if (it != fileIndices.constEnd())
+        {
+          index = it.value();
+        }
+        else
+        {
+          index = uint32_t(m_Files.size());
+          m_Files.push_back(files[int(file)]);
+          fileIndices.insert(files[int(file)], index);
+        }
+      }
+      return index;
+    };
+
+    uint64_t address = 0;
+    uint64_t file = 1;
+    int64_t lineNo = 1;
+    sequence.clear();
+
+    auto emitRow = [&]()
+    {
+      LineRow row;
+      row.m_Address = address;
+      row.m_File = globalFile(file);
+      row.m_Line = int32_t(lineNo);
+      if (row.m_File != kEndSequence)
+        sequence.push_back(row);
+    };
+
+    auto endSequence = [&]()
+    {
+      // Sequences of functions the linker discarded start at 0 (or ~0 with some linkers), drop them.
+      if (!sequence.isEmpty() && sequence.first().m_Address != 0 && sequence.first().m_Address < ~0ull - 0xffff)
+      {
+        LineRow end;
+        end.m_Address = address;
+        end.m_File = kEndSequence;
+        end.m_Line = 0;
+        m_Lines += sequence;
+        m_Lines.push_back(end);
+      }
+
+      sequence.clear();
+      address = 0;
+      file = 1;
+      lineNo = 1;
+    };
+
+    while (!program.atEnd() && program.m_Ok)
+    {
+      const int opcode = int(program.u(1));
+      if (opcode >= opcodeBase)
+      {
+        const int adjusted = opcode - opcodeBase;
+        address += uint64_t(adjusted / lineRange) * minInstructionLength;
+        lineNo += lineBase + adjusted % lineRange;
+        emitRow();
+        continue;
+      }
+
+      switch (opcode)
+      {
+      case 0:
+        {
+          const uint64_t length = program.uleb();
+          const uchar* next = program.m_Pos + std::min<uint64_t>(length, uint64_t(program.m_End - program.m_Pos));
+          const int subOpcode = length ? int(program.u(1)) : 0;
+          if (subOpcode == DW_LNE_end_sequence)
+          {
+            endSequence();
+          }
+          else if (subOpcode == DW_LNE_set_address)
+          {
+            address = program.u(int(std::min<uint64_t>(length - 1, 8)));
+          }
+          else if (subOpcode == DW_LNE_define_file)
+          {
+            const QString name = QString::fromUtf8(program.str());
+            const uint64_t dir = program.uleb();
+            addFile(name, dir);
+            globalFiles.push_back(kEndSequence);
+          }
+          program.m_Pos = next;
+        }
+        break;
+      case DW_LNS_copy:
+        emitRow();
+        break;
+      case DW_LNS_advance_pc:
+        address += program.uleb() * minInstructionLength;
+        break;
+      case DW_LNS_advance_line:
+        lineNo += program.sleb();
+        break;
+      case DW_LNS_set_file:
+        file = program.uleb();
+        break;
+      case DW_LNS_set_column:
+        program.uleb();
+        break;
+      case DW_LNS_const_add_pc:
+        address += uint64_t((255 - opcodeBase) / lineRange) * minInstructionLength;
+        break;
+      case DW_LNS_fixed_advance_pc:
+        address += program.u(2);
+        break;
+      default:
+        for (int i = 0; i < opcodeLengths[opcode]; ++i)
+        {
+          program.uleb();
+        }
+        break;
+      }
+    }
+  }
+}
+
+void CacheSim::ElfSymbolizer::finish()
+{
+  // Where several symbols start at the same address, prefer sized and global ones.
+  std::sort(m_Symbols.begin(), m_Symbols.end(), [](const Symbol& l, const Symbol& r)
+  {
+    if (l.m_Address != r.m_Address)
+      return l.m_Address < r.m_Address;
+    if ((l.m_Size != 0) != (r.m_Size != 0))
+      return l.m_Size != 0;
+    return l.m_Global && !r.m_Global;
+  });
+
+  m_Symbols.erase(std::unique(m_Symbols.begin(), m_Symbols.end(), [](const Symbol& l, const Symbol& r)
+  {
+    return l.m_Address == r.m_Address;
+  }), m_Symbols.end());
+
+  // The end of one sequence may be where the next one starts, so order ends first.
+  std::stable_sort(m_Lines.begin(), m_Lines.end(), [](const LineRow& l, const LineRow& r)
+  {
+    if (l.m_Address != r.m_Address)
+      return l.m_Address < r.m_Address;
+    return l.m_File == kEndSequence && r.m_File != kEndSequence;
+  });
+
+  m_Symbols.squeeze();
+  m_Lines.squeeze();
+}
+
+bool CacheSim::ElfSymbolizer::lookup(uint64_t address, Location* out) const
+{
+  *out = Location();
+
+  auto sym = std::upper_bound(m_Symbols.constBegin(), m_Symbols.constEnd(), address, [](uint64_t address, const Symbol& s)
+  {
+    return address < s.m_Address;
+  });
+
+  if (sym != m_Symbols.constBegin())
+  {
+    --sym;
+    if (!sym->m_Size || address < sym->m_Address + sym->m_Size)
+    {
+      out->m_SymbolName = Demangle(m_Names.constData() + sym->m_Name);
+    }
+  }
+
+  auto row = std::upper_bound(m_Lines.constBegin(), m_Lines.constEnd(), address, [](uint64_t address, const LineRow& r)
+  {
+    return address < r.m_Address;
+  });
+
+  if (row != m_Lines.constBegin())
+  {
+    --row;
+    if (row->m_File != kEndSequence)
+    {
+      out->m_FileName = m_Files[int(row->m_File)];
+      out->m_LineNumber = row->m_Line;
+    }
+  }
+
+  return !out->m_SymbolName.isEmpty() || !out->m_FileName.isEmpty();
+}
@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "Precompiled.h"
+
+namespace CacheSim
+{
+  // Function symbols and DWARF line tables of one ELF module, read in process. Debug information is taken from a
+  // separate debug file when there is one, found by build ID or .gnu_debuglink like gdb does.
+  //
+  // Addresses are module relative, i.e. the ELF virtual addresses. Once loaded, lookups are const and may be done from
+  // any number of threads.
+  class ElfSymbolizer
+  {
+  public:
+    struct Location
+    {
+      QString m_SymbolName;   // Demangled, empty if no symbol covers the address
+      QString m_FileName;     // Empty if there's no line information for the address
+      int     m_LineNumber = 0;
+    };
+
+    // Loads the module and its debug file. Returns false if the module is not a 64-bit ELF file.
+    bool load(const QString& modulePath);
+
+    bool lookup(uint64_t address, Location* out) const;
+
+    // Debug file that was found for the module, empty if its debug information is all in the module itself.
+    QString debugFilePath() const { return m_DebugFilePath; }
+
+    // Hex encoded build ID of the module, empty if it has none.
+    QByteArray buildId() const { return m_BuildId; }
+
+    // Build ID of a module and the separate debug file load() would read, without reading any symbols.
+    static bool identify(const QString& modulePath, QByteArray* buildId, QString* debugFilePath);
+
+  private:
+    struct Symbol
+    {
+      uint64_t m_Address;
+      uint64_t m_Size;
+      uint32_t m_Name;        // Offset into m_Names
+      bool     m_Global;
+    };
+
+    struct LineRow
+    {
+      uint64_t m_Address;
+      uint32_t m_File;        // Index into m_Files, kEndSequence past the last row of a sequence
+      int32_t  m_Line;
+    };
+
+    static constexpr uint32_t kEndSequence = ~0u;
+
+    class ElfFile;
+
+    static QString findDebugFile(const ElfFile& module, const QString& modulePath, const QByteArray& buildId);
+    void readSymbols(const ElfFile& elf);
+    void readLines(const ElfFile& elf);
+    void finish();
+
+    QVector<Symbol>     m_Symbols;
+    QByteArray          m_Names;
+    QVector<LineRow>    m_Lines;
+    QVector<QString>    m_Files;
+    QString             m_DebugFilePath;
+    QByteArray          m_BuildId;
+  };
+}
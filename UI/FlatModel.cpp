@@ -135,48 +135,106 @@ QVariant CacheSim::FlatModel::headerData(int section, Qt::Orientation orientatio
 
 void CacheSim::FlatModel::dataStoreChanged()
 {
-  beginResetModel();
+  // Aggregate on the thread pool so large captures don't block the UI. The old rows stay until the new ones are ready.
+  const int generation = ++m_Generation;
 
-  m_Rows.clear();
+  if (!m_Data)
+  {
+    beginResetModel();
+    m_Rows.clear();
+    endResetModel();
+    return;
+  }
 
-  // Aggregate all symbols based on name.
-  QHash<QString, int> symbolNameToRow;
+  QFutureWatcher<QVector<Node>>* watcher = new QFutureWatcher<QVector<Node>>(this);
+
+  connect(watcher, &QFutureWatcher<QVector<Node>>::finished, this, [this, watcher, generation]()
+  {
+    if (generation == m_Generation)
+    {
+      beginResetModel();
+      m_Rows = watcher->result();
+      endResetModel();
+    }
+    watcher->deleteLater();
+  });
 
-  const SerializedHeader* header = m_Data->header();
-  uint32_t count = header->GetStatCount();
+  // The task works on a snapshot, so it doesn't matter if the data or this model are gone before it finishes.
+  watcher->setFuture(QtConcurrent::run([data = m_Data->snapshot()]()
+  {
+    return aggregate(data);
+  }));
+}
+
+QVector<CacheSim::FlatModel::Node> CacheSim::FlatModel::aggregate(const TraceData::Snapshot& data)
+{
+  const SerializedHeader* header = data.header();
+  const uint32_t count = header->GetStatCount();
   const SerializedNode* nodes = header->GetStats();
 
-  for (uint32_t i = 0; i < count; ++i)
+  // Aggregate all symbols based on name, which is interned so its offset identifies it. Nodes without a symbol, such
+  // as all of them in an unresolved capture, are aggregated by address like the tree does. Ranges of nodes are summed
+  // up in parallel and then merged.
+  static constexpr uint64_t kUnresolvedKey = 1ull << 63;
+
+  struct Range
+  {
+    uint32_t m_Begin;
+    uint32_t m_End;
+    QHash<quint64, Node> m_Stats;
+  };
+
+  static constexpr uint32_t kMinNodesPerRange = 16384;
+  const uint32_t rangeCount = qBound(1u, count / kMinNodesPerRange, uint32_t(QThread::idealThreadCount()));
+
+  QVector<Range> ranges(rangeCount);
+  for (uint32_t i = 0; i < rangeCount; ++i)
+  {
+    ranges[i].m_Begin = uint32_t(uint64_t(count) * i / rangeCount);
+    ranges[i].m_End = uint32_t(uint64_t(count) * (i + 1) / rangeCount);
+  }
+
+  QtConcurrent::blockingMap(ranges, [&data, nodes](Range& range)
   {
-    const SerializedNode& node = nodes[i];
-    if (const SerializedSymbol* symbol = header->FindSymbol(node.m_Rip))
+    for (uint32_t i = range.m_Begin; i < range.m_End; ++i)
     {
-      int row;
-      QString symbolName = m_Data->symbolNameForAddress(node.m_Rip);
-      auto it = symbolNameToRow.find(symbolName);
-      if (it != symbolNameToRow.end())
-      {
-        row = it.value();
-      }
-      else
+      const SerializedNode& node = nodes[i];
+      const SerializedSymbol* symbol = data.nodeSymbol(i);
+
+      Node& target = range.m_Stats[symbol ? symbol->m_SymbolName : kUnresolvedKey | node.m_Rip];
+      for (int k = 0; k < CacheSim::kAccessResultCount; ++k)
       {
-        row = m_Rows.count();
-        m_Rows.push_back(Node());
-        m_Rows[row].m_SymbolName = symbolName;
-        symbolNameToRow.insert(symbolName, row);
+        target.m_Stats[k] += node.m_Stats[k];
       }
+    }
+  });
 
-      Node& target = m_Rows[row];
-
+  QHash<quint64, Node>& merged = ranges[0].m_Stats;
+  for (int r = 1; r < ranges.size(); ++r)
+  {
+    for (auto it = ranges[r].m_Stats.constBegin(); it != ranges[r].m_Stats.constEnd(); ++it)
+    {
+      Node& target = merged[it.key()];
       for (int k = 0; k < CacheSim::kAccessResultCount; ++k)
       {
-        target.m_Stats[k] += node.m_Stats[k];
+        target.m_Stats[k] += it.value().m_Stats[k];
       }
     }
   }
 
-  qDebug() << "collapsed" << count << "nodes to" << m_Rows.count() << "flat entries based on symbol";
-  endResetModel();
+  QVector<Node> rows;
+  rows.reserve(merged.size());
+  for (auto it = merged.constBegin(); it != merged.constEnd(); ++it)
+  {
+    rows.push_back(it.value());
+    if (it.key() & kUnresolvedKey)
+      rows.last().m_SymbolName = QStringLiteral("[%1]").arg(it.key() & ~kUnresolvedKey, 16, 16, QLatin1Char('0'));
+    else
+      rows.last().m_SymbolName = data.symbolString(uint32_t(it.key()));
+  }
+
+  qDebug() << "collapsed" << count << "nodes to" << rows.count() << "flat entries based on symbol or address";
+  return rows;
 }
 
 CacheSim::FlatModel::Node::Node()
@@ -26,11 +26,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 #include "Precompiled.h"
+#include "TraceData.h"
 #include "CacheSim/CacheSimInternals.h"
 
 namespace CacheSim
 {
-  class TraceData;
 
   class FlatModel final : public QAbstractListModel
   {
@@ -77,7 +77,10 @@ namespace CacheSim
       uint32_t m_Stats[CacheSim::kAccessResultCount];
     };
 
+    static QVector<Node> aggregate(const TraceData::Snapshot& data);
+
     QVector<Node> m_Rows;
+    int m_Generation = 0;     // Results of aggregations started before the last data change are dropped
   };
 
 }
@@ -0,0 +1,178 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "HeatmapProfileView.h"
+#include "HeatmapWidget.h"
+#include "TraceData.h"
+#include "NumberFormatters.h"
+
+#include "CacheSim/CacheSimData.h"
+
+#include "ui_HeatmapProfileView.h"
+
+CacheSim::HeatmapProfileView::HeatmapProfileView(const TraceData* traceData, QWidget* parent /*= nullptr*/)
+  : BaseProfileView(parent)
+  , m_TraceData(traceData)
+  , m_Heatmap(new HeatmapWidget)
+  , m_RipModel(new QStandardItemModel(0, kRipColumnCount, this))
+  , ui(new Ui_HeatmapProfileView)
+{
+  ui->setupUi(this);
+
+  setItemView(ui->m_RipView);
+
+  m_RipModel->setHorizontalHeaderLabels({ QStringLiteral("Symbol"), QStringLiteral("File"), QStringLiteral("Accesses"), QStringLiteral("L2 Misses") });
+
+  IntegerFormatDelegate* integerDelegate = new IntegerFormatDelegate(this);
+  ui->m_RipView->setItemDelegateForColumn(kRipColumnAccesses, integerDelegate);
+  ui->m_RipView->setItemDelegateForColumn(kRipColumnL2Misses, integerDelegate);
+  ui->m_RipView->setModel(m_RipModel);
+  ui->m_RipView->sortByColumn(kRipColumnAccesses, Qt::DescendingOrder);
+
+  // The cells are copied out of the trace, so they don't need reloading when symbol resolution remaps it.
+  const SerializedHeader* header = traceData->header();
+  QVector<HeatmapCell> cells;
+  cells.reserve(header->GetHeatmapCellCount());
+
+  HeatmapReader reader = header->GetHeatmap();
+  HeatmapCell cell;
+  while (reader.Next(&cell))
+  {
+    cells.push_back(cell);
+  }
+
+  ui->m_HeatmapScroll->setWidget(m_Heatmap);
+  m_Heatmap->setCells(cells, header->GetHeatmapCellShift());
+  m_Heatmap->setMetric(ui->m_Metric->currentIndex());
+
+  ui->m_CellPixels->setRange(HeatmapWidget::kMinCellPixels, HeatmapWidget::kMaxCellPixels);
+  ui->m_CellPixels->setValue(m_Heatmap->cellPixels());
+
+  connect(ui->m_Metric, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), m_Heatmap, &HeatmapWidget::setMetric);
+  connect(ui->m_CellPixels, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), m_Heatmap, &HeatmapWidget::setCellPixels);
+  connect(m_Heatmap, &HeatmapWidget::cellPixelsChanged, ui->m_CellPixels, &QSpinBox::setValue);
+  connect(m_Heatmap, &HeatmapWidget::selectionChanged, this, &HeatmapProfileView::selectionChanged);
+  connect(traceData, &TraceData::memoryMappedDataChanged, this, &HeatmapProfileView::updateRips);
+
+  if (cells.isEmpty())
+  {
+    ui->m_SelectionLabel->setText(reader.HasError() ? QStringLiteral("The heatmap in this capture is damaged.") : QStringLiteral("This capture has no heatmap."));
+  }
+  else
+  {
+    updateRips();
+  }
+}
+
+CacheSim::HeatmapProfileView::~HeatmapProfileView()
+{
+  delete ui;
+}
+
+void CacheSim::HeatmapProfileView::selectionChanged(int first, int last)
+{
+  m_SelectionFirst = first;
+  m_SelectionLast = last;
+  updateRips();
+}
+
+void CacheSim::HeatmapProfileView::updateRips()
+{
+  m_RipModel->removeRows(0, m_RipModel->rowCount());
+
+  if (m_SelectionFirst < 0)
+  {
+    if (!m_Heatmap->cells().isEmpty())
+    {
+      ui->m_SelectionLabel->setText(QStringLiteral("Click a cell, shift+click to select a range. Ctrl+wheel zooms."));
+    }
+    return;
+  }
+
+  struct RipTotals
+  {
+    quint64 m_Accesses;
+    quint64 m_L2Misses;
+  };
+
+  QHash<uint64_t, RipTotals> rips;
+  quint64 accesses = 0, misses = 0, evictions = 0;
+
+  const QVector<HeatmapCell>& cells = m_Heatmap->cells();
+  for (int i = m_SelectionFirst; i <= m_SelectionLast; ++i)
+  {
+    const HeatmapCell& cell = cells[i];
+    accesses += cell.m_Accesses;
+    misses += cell.m_L2Misses;
+    evictions += cell.m_Evictions;
+
+    for (uint32_t r = 0; r < cell.m_RipCount; ++r)
+    {
+      RipTotals& totals = rips[cell.m_Rips[r]];
+      totals.m_Accesses += cell.m_RipAccesses[r];
+      totals.m_L2Misses += cell.m_RipL2Misses[r];
+    }
+  }
+
+  const uint64_t start = cells[m_SelectionFirst].m_Address;
+  const uint64_t end = cells[m_SelectionLast].m_Address + m_Heatmap->cellSize();
+  ui->m_SelectionLabel->setText(QStringLiteral("%1 - %2: %3 accesses, %4 L2 misses, %5 evictions")
+    .arg(start, 16, 16, QLatin1Char('0'))
+    .arg(end, 16, 16, QLatin1Char('0'))
+    .arg(accesses)
+    .arg(misses)
+    .arg(evictions));
+
+  const SerializedHeader* header = m_TraceData->header();
+
+  for (auto it = rips.constBegin(); it != rips.constEnd(); ++it)
+  {
+    QString symbolName, fileName;
+    if (const SerializedSymbol* sym = header->FindSymbol(it.key()))
+    {
+      symbolName = m_TraceData->internedSymbolString(sym->m_SymbolName);
+      fileName = QStringLiteral("%1:%2").arg(m_TraceData->internedSymbolString(sym->m_FileName)).arg(sym->m_LineNumber);
+    }
+    else
+    {
+      symbolName = QStringLiteral("[%1]").arg(it.key(), 16, 16, QLatin1Char('0'));
+    }
+
+    QStandardItem* accessesItem = new QStandardItem;
+    accessesItem->setData(it.value().m_Accesses, Qt::DisplayRole);
+    QStandardItem* missesItem = new QStandardItem;
+    missesItem->setData(it.value().m_L2Misses, Qt::DisplayRole);
+    accessesItem->setTextAlignment(Qt::AlignRight);
+    missesItem->setTextAlignment(Qt::AlignRight);
+
+    m_RipModel->appendRow({ new QStandardItem(symbolName), new QStandardItem(fileName), accessesItem, missesItem });
+  }
+
+  m_RipModel->sort(ui->m_RipView->header()->sortIndicatorSection(), ui->m_RipView->header()->sortIndicatorOrder());
+}
+
+#include "aux_HeatmapProfileView.moc"
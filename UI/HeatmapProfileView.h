@@ -0,0 +1,70 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include "Precompiled.h"
+#include "BaseProfileView.h"
+
+class Ui_HeatmapProfileView;
+
+namespace CacheSim
+{
+  class TraceData;
+  class HeatmapWidget;
+
+  /// Heatmap of cache traffic over the address space, with the instructions touching the selected cells.
+  class HeatmapProfileView : public BaseProfileView
+  {
+    Q_OBJECT;
+
+  public:
+    enum RipColumn
+    {
+      kRipColumnSymbol,
+      kRipColumnFileName,
+      kRipColumnAccesses,
+      kRipColumnL2Misses,
+      kRipColumnCount
+    };
+
+  public:
+    explicit HeatmapProfileView(const TraceData* traceData, QWidget* parent = nullptr);
+    ~HeatmapProfileView();
+
+  private:
+    Q_SLOT void selectionChanged(int first, int last);
+    Q_SLOT void updateRips();
+
+  private:
+    const TraceData* m_TraceData = nullptr;
+    HeatmapWidget* m_Heatmap = nullptr;
+    QStandardItemModel* m_RipModel = nullptr;
+    int m_SelectionFirst = -1;
+    int m_SelectionLast = -1;
+    Ui_HeatmapProfileView* ui;
+  };
+
+}
@@ -0,0 +1,321 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "HeatmapWidget.h"
+
+static const int kGapHeight = 7;       ///< Between rows that aren't adjacent in memory
+static const int kLabelMargin = 6;
+
+CacheSim::HeatmapWidget::HeatmapWidget(QWidget* parent /*= nullptr*/)
+  : QWidget(parent)
+{
+  setMouseTracking(false);
+  setFocusPolicy(Qt::ClickFocus);
+  setBackgroundRole(QPalette::Base);
+  setAutoFillBackground(true);
+}
+
+CacheSim::HeatmapWidget::~HeatmapWidget()
+{
+}
+
+void CacheSim::HeatmapWidget::setCells(const QVector<HeatmapCell>& cells, uint32_t cellShift)
+{
+  m_Cells = cells;
+  m_CellShift = cellShift;
+  m_SelectionAnchor = m_SelectionFirst = m_SelectionLast = -1;
+
+  layoutRows();
+  Q_EMIT selectionChanged(-1, -1);
+}
+
+void CacheSim::HeatmapWidget::setMetric(int metric)
+{
+  if (metric < 0 || metric >= kMetricCount || metric == m_Metric)
+    return;
+
+  m_Metric = metric;
+
+  m_MaxValue = 0;
+  for (const HeatmapCell& cell : m_Cells)
+  {
+    m_MaxValue = std::max(m_MaxValue, cellValue(cell));
+  }
+
+  update();
+}
+
+void CacheSim::HeatmapWidget::setCellPixels(int pixels)
+{
+  pixels = qBound(int(kMinCellPixels), pixels, int(kMaxCellPixels));
+  if (pixels == m_CellPixels)
+    return;
+
+  m_CellPixels = pixels;
+  layoutRows();
+  Q_EMIT cellPixelsChanged(pixels);
+}
+
+QSize CacheSim::HeatmapWidget::sizeHint() const
+{
+  return QSize(m_LabelWidth + kCellsPerRow * m_CellPixels + 1, m_Height);
+}
+
+void CacheSim::HeatmapWidget::layoutRows()
+{
+  m_Rows.clear();
+  m_MaxValue = 0;
+
+  int y = 0;
+  for (int i = 0, count = m_Cells.count(); i < count; ++i)
+  {
+    const HeatmapCell& cell = m_Cells[i];
+    const uint64_t rowIndex = (cell.m_Address >> m_CellShift) / kCellsPerRow;
+
+    m_MaxValue = std::max(m_MaxValue, cellValue(cell));
+
+    if (!m_Rows.isEmpty() && m_Rows.last().m_Index == rowIndex)
+    {
+      m_Rows.last().m_CellCount += 1;
+      continue;
+    }
+
+    if (!m_Rows.isEmpty())
+    {
+      y += m_CellPixels;
+      if (m_Rows.last().m_Index + 1 != rowIndex)
+        y += kGapHeight;
+    }
+
+    Row row;
+    row.m_Index = rowIndex;
+    row.m_FirstCell = i;
+    row.m_CellCount = 1;
+    row.m_Y = y;
+    m_Rows.push_back(row);
+  }
+
+  m_Height = m_Rows.isEmpty() ? 0 : y + m_CellPixels;
+  m_LabelWidth = fontMetrics().width(QStringLiteral("0000000000000000")) + kLabelMargin;
+
+  resize(sizeHint());
+  updateGeometry();
+  update();
+}
+
+uint32_t CacheSim::HeatmapWidget::cellValue(const HeatmapCell& cell) const
+{
+  switch (m_Metric)
+  {
+  case kMetricAccesses: return cell.m_Accesses;
+  case kMetricL2Misses: return cell.m_L2Misses;
+  case kMetricEvictions: return cell.m_Evictions;
+  }
+  return 0;
+}
+
+QColor CacheSim::HeatmapWidget::cellColor(const HeatmapCell& cell) const
+{
+  // Log scale, so a few very hot cells don't wash out everything else. Yellow is cold, dark red is hot.
+  double t = m_MaxValue ? std::log1p(double(cellValue(cell))) / std::log1p(double(m_MaxValue)) : 0.0;
+  return QColor::fromHsvF(0.16 * (1.0 - t), 0.15 + 0.85 * t, 1.0 - 0.4 * t);
+}
+
+QRect CacheSim::HeatmapWidget::cellRect(const Row& row, const HeatmapCell& cell) const
+{
+  const int column = int((cell.m_Address >> m_CellShift) % kCellsPerRow);
+  return QRect(m_LabelWidth + column * m_CellPixels, row.m_Y, m_CellPixels, m_CellPixels);
+}
+
+int CacheSim::HeatmapWidget::rowAt(int y) const
+{
+  // Last row starting at or above y.
+  auto it = std::upper_bound(m_Rows.begin(), m_Rows.end(), y, [](int y, const Row& row) -> bool
+  {
+    return y < row.m_Y;
+  });
+
+  if (it == m_Rows.begin())
+    return -1;
+
+  return int(it - m_Rows.begin()) - 1;
+}
+
+int CacheSim::HeatmapWidget::cellAt(const QPoint& pos) const
+{
+  int rowIndex = rowAt(pos.y());
+  if (rowIndex < 0 || pos.x() < m_LabelWidth)
+    return -1;
+
+  const Row& row = m_Rows[rowIndex];
+  if (pos.y() >= row.m_Y + m_CellPixels)
+    return -1;
+
+  const uint64_t column = uint64_t(pos.x() - m_LabelWidth) / m_CellPixels;
+  if (column >= kCellsPerRow)
+    return -1;
+
+  const uint64_t cellIndex = row.m_Index * kCellsPerRow + column;
+  for (int i = row.m_FirstCell, end = row.m_FirstCell + row.m_CellCount; i < end; ++i)
+  {
+    if ((m_Cells[i].m_Address >> m_CellShift) == cellIndex)
+      return i;
+  }
+
+  return -1;
+}
+
+bool CacheSim::HeatmapWidget::event(QEvent* event)
+{
+  if (event->type() == QEvent::ToolTip)
+  {
+    QHelpEvent* helpEvent = static_cast<QHelpEvent*>(event);
+    int index = cellAt(helpEvent->pos());
+    if (index >= 0)
+    {
+      const HeatmapCell& cell = m_Cells[index];
+      QToolTip::showText(helpEvent->globalPos(), QStringLiteral("%1 - %2\nAccesses: %3\nL2 misses: %4\nEvictions: %5")
+        .arg(cell.m_Address, 16, 16, QLatin1Char('0'))
+        .arg(cell.m_Address + cellSize() - 1, 16, 16, QLatin1Char('0'))
+        .arg(cell.m_Accesses)
+        .arg(cell.m_L2Misses)
+        .arg(cell.m_Evictions));
+    }
+    else
+    {
+      QToolTip::hideText();
+      event->ignore();
+    }
+    return true;
+  }
+
+  return QWidget::event(event);
+}
+
+void CacheSim::HeatmapWidget::paintEvent(QPaintEvent* event)
+{
+  QPainter painter(this);
+
+  const QRect dirty = event->rect();
+  const QPalette& pal = palette();
+
+  // Label every labelStride-th row with its address, and each row after a gap, so the labels don't overlap.
+  const int labelStride = (fontMetrics().height() + m_CellPixels - 1) / m_CellPixels;
+
+  // Start a label's height early, as labels are taller than rows.
+  int first = std::max(rowAt(dirty.top() - fontMetrics().height()), 0);
+  for (int r = first, count = m_Rows.count(); r < count; ++r)
+  {
+    const Row& row = m_Rows[r];
+    if (row.m_Y > dirty.bottom())
+      break;
+
+    // Mark collapsed address ranges.
+    if (r > 0 && m_Rows[r - 1].m_Index + 1 != row.m_Index)
+    {
+      const int gapY = row.m_Y - kGapHeight / 2 - 1;
+      painter.setPen(QPen(pal.color(QPalette::Mid), 1, Qt::DashLine));
+      painter.drawLine(0, gapY, width(), gapY);
+    }
+
+    if (row.m_Index % labelStride == 0 || r == 0 || m_Rows[r - 1].m_Index + 1 != row.m_Index)
+    {
+      const uint64_t address = (row.m_Index * kCellsPerRow) << m_CellShift;
+      painter.setPen(pal.color(QPalette::Text));
+      painter.drawText(QRect(0, row.m_Y, m_LabelWidth - kLabelMargin, fontMetrics().height()), Qt::AlignRight | Qt::AlignTop,
+        QStringLiteral("%1").arg(address, 0, 16));
+    }
+
+    for (int i = row.m_FirstCell, end = row.m_FirstCell + row.m_CellCount; i < end; ++i)
+    {
+      painter.fillRect(cellRect(row, m_Cells[i]), cellColor(m_Cells[i]));
+    }
+  }
+
+  if (m_SelectionFirst >= 0)
+  {
+    painter.setPen(QPen(pal.color(QPalette::Highlight), 1));
+    painter.setBrush(Qt::NoBrush);
+    for (int r = first, count = m_Rows.count(); r < count; ++r)
+    {
+      const Row& row = m_Rows[r];
+      if (row.m_Y > dirty.bottom())
+        break;
+
+      for (int i = std::max(row.m_FirstCell, m_SelectionFirst), end = std::min(row.m_FirstCell + row.m_CellCount - 1, m_SelectionLast); i <= end; ++i)
+      {
+        painter.drawRect(cellRect(row, m_Cells[i]).adjusted(0, 0, -1, -1));
+      }
+    }
+  }
+}
+
+void CacheSim::HeatmapWidget::mousePressEvent(QMouseEvent* event)
+{
+  if (event->button() != Qt::LeftButton)
+  {
+    QWidget::mousePressEvent(event);
+    return;
+  }
+
+  int index = cellAt(event->pos());
+
+  if (index < 0)
+  {
+    m_SelectionAnchor = m_SelectionFirst = m_SelectionLast = -1;
+  }
+  else if ((event->modifiers() & Qt::ShiftModifier) && m_SelectionAnchor >= 0)
+  {
+    m_SelectionFirst = std::min(m_SelectionAnchor, index);
+    m_SelectionLast = std::max(m_SelectionAnchor, index);
+  }
+  else
+  {
+    m_SelectionAnchor = m_SelectionFirst = m_SelectionLast = index;
+  }
+
+  update();
+  Q_EMIT selectionChanged(m_SelectionFirst, m_SelectionLast);
+}
+
+void CacheSim::HeatmapWidget::wheelEvent(QWheelEvent* event)
+{
+  if (!(event->modifiers() & Qt::ControlModifier))
+  {
+    QWidget::wheelEvent(event);
+    return;
+  }
+
+  const int steps = event->angleDelta().y() / 120;
+  if (steps)
+  {
+    setCellPixels(m_CellPixels + steps);
+  }
+  event->accept();
+}
+
+#include "aux_HeatmapWidget.moc"
@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include "Precompiled.h"
+
+#include "CacheSim/CacheSimData.h"
+
+namespace CacheSim
+{
+  /// Paints heatmap cells in address order, a row of cells per line. Runs of rows without any recorded cells
+  /// are collapsed into a gap, so sparse address spaces stay compact.
+  class HeatmapWidget : public QWidget
+  {
+    Q_OBJECT;
+
+  public:
+    enum Metric
+    {
+      kMetricAccesses,
+      kMetricL2Misses,
+      kMetricEvictions,
+      kMetricCount
+    };
+
+    enum
+    {
+      kCellsPerRow = 64,
+      kMinCellPixels = 1,
+      kMaxCellPixels = 32,
+    };
+
+  public:
+    explicit HeatmapWidget(QWidget* parent = nullptr);
+    ~HeatmapWidget();
+
+  public:
+    void setCells(const QVector<HeatmapCell>& cells, uint32_t cellShift);
+    const QVector<HeatmapCell>& cells() const { return m_Cells; }
+    uint64_t cellSize() const { return uint64_t(1) << m_CellShift; }
+
+    void setMetric(int metric);
+    int metric() const { return m_Metric; }
+
+    void setCellPixels(int pixels);
+    int cellPixels() const { return m_CellPixels; }
+
+    QSize sizeHint() const override;
+
+    /// Range of selected cells, inclusive. Both are -1 when nothing is selected.
+    Q_SIGNAL void selectionChanged(int first, int last);
+    Q_SIGNAL void cellPixelsChanged(int pixels);
+
+  protected:
+    bool event(QEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+
+  private:
+    struct Row
+    {
+      uint64_t  m_Index;          ///< Cell index (address >> cell shift) of the first cell in the row, divided by kCellsPerRow
+      int       m_FirstCell;      ///< Into m_Cells
+      int       m_CellCount;
+      int       m_Y;
+    };
+
+    void layoutRows();
+    uint32_t cellValue(const HeatmapCell& cell) const;
+    QColor cellColor(const HeatmapCell& cell) const;
+    QRect cellRect(const Row& row, const HeatmapCell& cell) const;
+    int rowAt(int y) const;
+    int cellAt(const QPoint& pos) const;
+
+  private:
+    QVector<HeatmapCell> m_Cells;
+    QVector<Row> m_Rows;
+    uint32_t m_CellShift = 6;
+    int m_Metric = kMetricL2Misses;
+    int m_CellPixels = 6;
+    uint32_t m_MaxValue = 0;
+    int m_LabelWidth = 0;
+    int m_Height = 0;
+    int m_SelectionAnchor = -1;
+    int m_SelectionFirst = -1;
+    int m_SelectionLast = -1;
+  };
+
+}
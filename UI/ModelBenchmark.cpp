@@ -0,0 +1,246 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// ModelBenchmark.cpp - measures how long the profile models take to build on a large synthetic capture.
+//
+// The capture is written to a temporary file and has resolved symbols, with call stacks that share prefixes the way
+// real ones do. The models aggregate on all cores. Usage: ModelBenchmark [node_count] [stack_count]
+
+#include "Precompiled.h"
+#include "FlatModel.h"
+#include "TraceData.h"
+#include "TreeModel.h"
+#include "CacheSim/CacheSimData.h"
+
+using namespace CacheSim;
+
+enum
+{
+  kRunCount = 3,
+  kRipCount = 200000,
+  kRipsPerSymbol = 8,
+  kMaxStackDepth = 40,
+};
+
+static uint64_t NextRandom(uint64_t* state)
+{
+  *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+  return *state >> 24;
+}
+
+static uintptr_t RipAt(uint32_t index)
+{
+  return 0x400000 + uintptr_t(index) * 16;
+}
+
+static bool WriteCapture(QFile* file, uint32_t nodeCount, uint32_t stackCount)
+{
+  uint64_t state = 1;
+
+  // Each stack continues a random prefix of an earlier one, outermost frame first.
+  QVector<uintptr_t> frames;
+  QVector<uint32_t> stackIndices;
+  QVector<QVector<uint32_t>> paths;
+  paths.reserve(stackCount);
+
+  for (uint32_t i = 0; i < stackCount; ++i)
+  {
+    QVector<uint32_t> path;
+    if (!paths.isEmpty())
+    {
+      const QVector<uint32_t>& prefix = paths[int(NextRandom(&state) % paths.size())];
+      path = prefix.mid(0, 1 + int(NextRandom(&state) % prefix.size()));
+    }
+    else
+    {
+      path.push_back(0);
+    }
+
+    const int depth = 4 + int(NextRandom(&state) % (kMaxStackDepth - 4));
+    while (path.size() < depth)
+    {
+      path.push_back(uint32_t(NextRandom(&state) % kRipCount));
+    }
+
+    stackIndices.push_back(frames.size());
+    for (int f = path.size() - 1; f >= 0; --f)
+    {
+      frames.push_back(RipAt(path[f]));
+    }
+    frames.push_back(0);
+    paths.push_back(path);
+  }
+
+  QVector<SerializedNode> nodes(nodeCount);
+  for (SerializedNode& node : nodes)
+  {
+    memset(&node, 0, sizeof node);
+    node.m_Rip = RipAt(uint32_t(NextRandom(&state) % kRipCount));
+    node.m_StackIndex = stackIndices[int(NextRandom(&state) % stackCount)];
+    node.m_Stats[kInstructionsExecuted] = 1 + uint32_t(NextRandom(&state) % 1000);
+    node.m_Stats[kD1Hit] = uint32_t(NextRandom(&state) % 1000);
+    node.m_Stats[kL2DMiss] = uint32_t(NextRandom(&state) % 16);
+  }
+
+  // Interned strings are UTF-16 and the zero offset is the empty string.
+  QVector<QChar> text;
+  text.push_back(QChar(0));
+
+  auto intern = [&text](QString s) -> uint32_t
+  {
+    uint32_t offset = text.size();
+    Q_FOREACH(QChar ch, s)
+    {
+      text.push_back(ch);
+    }
+    text.push_back(QChar(0));
+    return offset;
+  };
+
+  QVector<SerializedSymbol> symbols(kRipCount);
+  for (uint32_t i = 0; i < kRipCount; ++i)
+  {
+    SerializedSymbol& sym = symbols[i];
+    memset(&sym, 0, sizeof sym);
+    sym.m_Rip = RipAt(i);
+    sym.m_LineNumber = i % kRipsPerSymbol;
+
+    if (0 == i % kRipsPerSymbol)
+    {
+      sym.m_SymbolName = intern(QStringLiteral("Namespace::Class%1::Function%2").arg(i / 256).arg(i));
+      sym.m_FileName = intern(QStringLiteral("Source/Class%1.cpp").arg(i / 256));
+    }
+    else
+    {
+      sym.m_SymbolName = symbols[i - 1].m_SymbolName;
+      sym.m_FileName = symbols[i - 1].m_FileName;
+    }
+  }
+
+  SerializedHeader hdr;
+  memset(&hdr, 0, sizeof hdr);
+  hdr.m_Magic = 0xcace51afu;
+  hdr.m_Version = kCurrentVersion;
+  hdr.m_FrameOffset = sizeof hdr;
+  hdr.m_FrameCount = frames.size();
+  hdr.m_StatsOffset = hdr.m_FrameOffset + frames.size() * sizeof(uintptr_t);
+  hdr.m_StatsCount = nodeCount;
+  hdr.m_SymbolOffset = hdr.m_StatsOffset + nodeCount * sizeof(SerializedNode);
+  hdr.m_SymbolCount = kRipCount;
+  hdr.m_SymbolTextOffset = hdr.m_SymbolOffset + kRipCount * sizeof(SerializedSymbol);
+  hdr.m_ModuleOffset = hdr.m_ModuleStringOffset = hdr.m_SymbolTextOffset + text.size() * sizeof(QChar);
+
+  file->write(reinterpret_cast<const char*>(&hdr), sizeof hdr);
+  file->write(reinterpret_cast<const char*>(frames.constData()), frames.size() * sizeof(uintptr_t));
+  file->write(reinterpret_cast<const char*>(nodes.constData()), nodes.size() * sizeof(SerializedNode));
+  file->write(reinterpret_cast<const char*>(symbols.constData()), symbols.size() * sizeof(SerializedSymbol));
+  file->write(reinterpret_cast<const char*>(text.constData()), text.size() * sizeof(QChar));
+  return file->flush();
+}
+
+template <typename Fn>
+static double BestOf(Fn fn)
+{
+  double best = 1e30;
+  for (int run = 0; run < kRunCount; ++run)
+  {
+    QElapsedTimer timer;
+    timer.start();
+    fn();
+    best = std::min(best, timer.nsecsElapsed() / 1e9);
+  }
+  return best;
+}
+
+int main(int argc, char* argv[])
+{
+  QCoreApplication app(argc, argv);
+
+  const uint32_t nodeCount = argc > 1 ? uint32_t(atoi(argv[1])) : 2000000;
+  const uint32_t stackCount = argc > 2 ? uint32_t(atoi(argv[2])) : 200000;
+
+  if (!nodeCount || !stackCount)
+  {
+    fprintf(stderr, "usage: ModelBenchmark [node_count] [stack_count]\n");
+    return 1;
+  }
+
+  QTemporaryFile file;
+  if (!file.open() || !WriteCapture(&file, nodeCount, stackCount))
+  {
+    fprintf(stderr, "Failed to write the capture\n");
+    return 1;
+  }
+
+  TraceData data;
+  data.beginLoadTrace(file.fileName());
+  if (!data.header())
+  {
+    fprintf(stderr, "Failed to load the capture\n");
+    return 1;
+  }
+
+  printf("%u nodes, %u call stacks, %u frames\n", nodeCount, stackCount, data.header()->GetStackCount());
+
+  int rows = 0;
+  const double flatSeconds = BestOf([&]()
+  {
+    // Flat profiles are aggregated in the background and reset the model when done.
+    FlatModel model;
+    QEventLoop loop;
+    QObject::connect(&model, &QAbstractItemModel::modelReset, &loop, &QEventLoop::quit);
+    model.setData(&data);
+    loop.exec();
+    rows = model.rowCount();
+  });
+  printf("FlatModel:          %.3f s (%d rows)\n", flatSeconds, rows);
+
+  // So are trees.
+  auto buildTree = [&](QString rootSymbol)
+  {
+    TreeModel model;
+    QEventLoop loop;
+    QObject::connect(&model, &QAbstractItemModel::modelReset, &loop, &QEventLoop::quit);
+    model.setTraceData(&data, rootSymbol);
+    loop.exec();
+    rows = model.rowCount();
+  };
+
+  const double treeSeconds = BestOf([&]()
+  {
+    buildTree(QString());
+  });
+  printf("TreeModel:          %.3f s (%d top level rows)\n", treeSeconds, rows);
+
+  const QString symbol = data.symbolNameForAddress(RipAt(kRipsPerSymbol * 7));
+  const double reverseSeconds = BestOf([&]()
+  {
+    buildTree(symbol);
+  });
+  printf("TreeModel reversed: %.3f s (%d top level rows)\n", reverseSeconds, rows);
+
+  return 0;
+}
@@ -68,6 +68,8 @@ void CacheSim::ObjectStack::reset()
 
 void* CacheSim::ObjectStack::allocRaw(size_t byte_count)
 {
+  byte_count = (byte_count + 15) & ~15ull;
+
   if (!m_CurrentPage || m_CurrentPage->avail() < byte_count)
   {
     m_CurrentPage = allocPage(byte_count, m_CurrentPage);
@@ -75,14 +77,14 @@ void* CacheSim::ObjectStack::allocRaw(size_t byte_count)
 
   char* dest = m_CurrentPage->m_Data + m_CurrentPage->m_Allocated;
 
-  m_CurrentPage->m_Allocated += (byte_count + 15) & ~15ull;
+  m_CurrentPage->m_Allocated += byte_count;
 
   return dest;
 }
 
 void* CacheSim::ObjectStack::allocFinalized(size_t byte_count, size_t elem_count, void (*dtor)(void*))
 {
-  Finalizer* f = (Finalizer*) allocRaw(byte_count + sizeof(Finalizer));
+  Finalizer* f = (Finalizer*) allocRaw(byte_count * elem_count + sizeof(Finalizer));
   f->m_Next = m_FinalizerChain;
   f->m_Destructor = dtor;
   f->m_ElemSize = byte_count;
@@ -97,7 +99,7 @@ CacheSim::ObjectStack::Page* CacheSim::ObjectStack::allocPage(size_t min_size, P
 
   size_t size = std::max(sizeof(Page) + min_size, kDefaultPageSize);
   Page* p = (Page*) new char[size];
-  p->m_Size = size;
+  p->m_Size = size - sizeof(Page);
   p->m_Allocated = 0;
   p->m_Next = next;
   return p;
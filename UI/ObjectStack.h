@@ -83,10 +83,10 @@ namespace CacheSim
     }
 
   public:
-    template <typename T>
-    T* alloc()
+    template <typename T, typename... Args>
+    T* alloc(Args&&... args)
     {
-      return new (allocStorage<T>(1)) T;
+      return new (allocStorage<T>(1)) T(std::forward<Args>(args)...);
     }
 
     template <typename T>
@@ -100,11 +100,5 @@ namespace CacheSim
 
       return base;
     }
-
-    template <typename T, typename... Args>
-    T* alloc(Args&&... args)
-    {
-      return new (allocStorage<T>(1)) T(std::forward<Args>(args)...);
-    }
   };
 }
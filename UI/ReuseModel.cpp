@@ -0,0 +1,238 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "ReuseModel.h"
+#include "TraceData.h"
+
+static const QString kColumnLabels[CacheSim::ReuseModel::kColumnCount] =
+{
+  QStringLiteral("Symbol"),
+  QStringLiteral("Accesses"),
+  QStringLiteral("Cold Misses"),
+  QStringLiteral("Misses"),
+  QStringLiteral("Miss %"),
+  QStringLiteral("90% Reuse Within (KB)"),
+};
+
+static uint64_t HistogramTotal(const CacheSim::ReuseModel::Histogram& histogram)
+{
+  uint64_t total = 0;
+  for (uint64_t count : histogram.m_Buckets)
+  {
+    total += count;
+  }
+  return total;
+}
+
+// Smallest power of two cache, in lines, that would hit 90% of the accesses that aren't first accesses.
+static uint64_t ReuseSize90(const CacheSim::ReuseModel::Histogram& histogram)
+{
+  const uint64_t reuses = HistogramTotal(histogram) - histogram.m_Buckets[CacheSim::kReuseColdBucket];
+  if (!reuses)
+    return 0;
+
+  uint64_t hits = 0;
+  for (uint32_t i = 0; i < CacheSim::kReuseColdBucket; ++i)
+  {
+    hits += histogram.m_Buckets[i];
+    if (hits * 10 >= reuses * 9)
+      return uint64_t(1) << i;
+  }
+  return uint64_t(1) << (CacheSim::kReuseColdBucket - 1);
+}
+
+CacheSim::ReuseModel::Histogram::Histogram()
+{
+  memset(m_Buckets, 0, sizeof m_Buckets);
+}
+
+CacheSim::ReuseModel::ReuseModel(QObject* parent /*= nullptr*/)
+  : QAbstractListModel(parent)
+{
+}
+
+CacheSim::ReuseModel::~ReuseModel()
+{
+}
+
+void CacheSim::ReuseModel::setData(const TraceData* data)
+{
+  if (m_Data)
+  {
+    disconnect(m_Data, &TraceData::memoryMappedDataChanged, this, &ReuseModel::dataStoreChanged);
+  }
+
+  m_Data = data;
+  dataStoreChanged();
+
+  if (m_Data)
+  {
+    connect(m_Data, &TraceData::memoryMappedDataChanged, this, &ReuseModel::dataStoreChanged);
+  }
+}
+
+void CacheSim::ReuseModel::setCacheLinesLog2(uint32_t cacheLinesLog2)
+{
+  if (cacheLinesLog2 == m_CacheLinesLog2)
+    return;
+
+  m_CacheLinesLog2 = cacheLinesLog2;
+  if (!m_Rows.isEmpty())
+  {
+    Q_EMIT dataChanged(index(0, kColumnMisses), index(m_Rows.count() - 1, kColumnMissRatio));
+  }
+}
+
+const CacheSim::ReuseModel::Histogram& CacheSim::ReuseModel::histogram(const QModelIndex& index) const
+{
+  if (index.isValid() && index.row() < m_Rows.count())
+  {
+    return m_Rows[index.row()].m_Histogram;
+  }
+  return m_Total;
+}
+
+int CacheSim::ReuseModel::rowCount(const QModelIndex &parent /*= QModelIndex()*/) const
+{
+  (void) parent;
+  return m_Rows.count();
+}
+
+int CacheSim::ReuseModel::columnCount(const QModelIndex &parent /*= QModelIndex()*/) const
+{
+  (void) parent;
+  return kColumnCount;
+}
+
+QVariant CacheSim::ReuseModel::data(const QModelIndex &index, int role /*= Qt::DisplayRole*/) const
+{
+  int row = index.row();
+  if (row < 0 || row >= m_Rows.count())
+  {
+    return QVariant();
+  }
+
+  const Node& node = m_Rows[row];
+
+  if (role == Qt::DisplayRole)
+  {
+    const uint64_t total = HistogramTotal(node.m_Histogram);
+
+    switch (index.column())
+    {
+    case kColumnSymbol: return node.m_SymbolName;
+    case kColumnAccesses: return quint64(total * m_SampleScale);
+    case kColumnColdMisses: return quint64(node.m_Histogram.m_Buckets[kReuseColdBucket] * m_SampleScale);
+    case kColumnMisses: return quint64(ReuseMisses(node.m_Histogram.m_Buckets, m_CacheLinesLog2) * m_SampleScale);
+    case kColumnMissRatio: return total ? 100.0 * ReuseMisses(node.m_Histogram.m_Buckets, m_CacheLinesLog2) / total : 0.0;
+    case kColumnReuseSize: return quint64(ReuseSize90(node.m_Histogram) * 64 / 1024);
+    }
+  }
+  else if (role == Qt::TextAlignmentRole)
+  {
+    if (index.column() > kColumnSymbol)
+    {
+      return Qt::AlignRight;
+    }
+    return Qt::AlignLeft;
+  }
+  else if (role == Qt::ToolTipRole)
+  {
+    if (index.column() == kColumnSymbol)
+    {
+      return node.m_SymbolName;
+    }
+  }
+
+  return QVariant();
+}
+
+QVariant CacheSim::ReuseModel::headerData(int section, Qt::Orientation orientation, int role /*= Qt::DisplayRole*/) const
+{
+  if (role == Qt::DisplayRole && orientation == Qt::Horizontal)
+  {
+    return kColumnLabels[section];
+  }
+
+  return QVariant();
+}
+
+void CacheSim::ReuseModel::dataStoreChanged()
+{
+  beginResetModel();
+
+  m_Rows.clear();
+  m_Total = Histogram();
+
+  // Aggregate all instructions based on symbol name.
+  QHash<QString, int> symbolNameToRow;
+
+  const SerializedHeader* header = m_Data->header();
+  const uint32_t count = header->GetReuseHistogramCount();
+  const SerializedReuseHistogram* histograms = header->GetReuseHistograms();
+  m_SampleScale = 1u << header->GetReuseSampleShift();
+
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    const SerializedReuseHistogram& histogram = histograms[i];
+
+    QString symbolName;
+    if (header->FindSymbol(histogram.m_Rip))
+    {
+      symbolName = m_Data->symbolNameForAddress(histogram.m_Rip);
+    }
+    else
+    {
+      symbolName = QStringLiteral("[%1]").arg(histogram.m_Rip, 16, 16, QLatin1Char('0'));
+    }
+
+    int row;
+    auto it = symbolNameToRow.find(symbolName);
+    if (it != symbolNameToRow.end())
+    {
+      row = it.value();
+    }
+    else
+    {
+      row = m_Rows.count();
+      m_Rows.push_back(Node());
+      m_Rows[row].m_SymbolName = symbolName;
+      symbolNameToRow.insert(symbolName, row);
+    }
+
+    Node& target = m_Rows[row];
+    for (uint32_t k = 0; k < kReuseBucketCount; ++k)
+    {
+      target.m_Histogram.m_Buckets[k] += histogram.m_Buckets[k];
+      m_Total.m_Buckets[k] += histogram.m_Buckets[k];
+    }
+  }
+
+  endResetModel();
+}
+
+#include "aux_ReuseModel.moc"
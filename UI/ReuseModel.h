@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include "Precompiled.h"
+#include "CacheSim/CacheSimData.h"
+
+namespace CacheSim
+{
+  class TraceData;
+
+  /// Reuse distance histograms of the capture, aggregated by symbol, with the misses they predict for a
+  /// fully associative LRU cache of a given size.
+  class ReuseModel final : public QAbstractListModel
+  {
+    Q_OBJECT;
+
+  public:
+    enum Column
+    {
+      kColumnSymbol,
+      kColumnAccesses,
+      kColumnColdMisses,
+      kColumnMisses,
+      kColumnMissRatio,
+      kColumnReuseSize,
+      kColumnCount
+    };
+
+    struct Histogram
+    {
+      Histogram();
+
+      uint64_t m_Buckets[kReuseBucketCount];
+    };
+
+  public:
+    explicit ReuseModel(QObject* parent = nullptr);
+    ~ReuseModel();
+
+  public:
+    void setData(const TraceData* data);
+
+    /// Size of the cache the miss columns are predicted for.
+    void setCacheLinesLog2(uint32_t cacheLinesLog2);
+    uint32_t cacheLinesLog2() const { return m_CacheLinesLog2; }
+
+    /// Histogram of a row, or of the whole capture for an invalid index.
+    const Histogram& histogram(const QModelIndex& index) const;
+    /// Accesses each recorded access stands for.
+    uint32_t sampleScale() const { return m_SampleScale; }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+  private:
+    Q_SLOT void dataStoreChanged();
+
+  private:
+    const TraceData* m_Data = nullptr;
+
+    struct Node
+    {
+      QString m_SymbolName;
+      Histogram m_Histogram;
+    };
+
+    QVector<Node> m_Rows;
+    Histogram m_Total;
+    uint32_t m_CacheLinesLog2 = 15;     ///< 2 MB, the Jaguar L2
+    uint32_t m_SampleScale = 1;
+  };
+
+}
@@ -0,0 +1,217 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "ReuseProfileView.h"
+#include "ReuseModel.h"
+#include "NumberFormatters.h"
+
+#include "ui_ReuseProfileView.h"
+
+// Smallest and largest cache sizes offered, as log2 of the line count.
+static const uint32_t kMinCacheLinesLog2 = 4;     // 1 KB
+static const uint32_t kMaxCacheLinesLog2 = 24;    // 1 GB
+
+static QString CacheSizeLabel(uint32_t cacheLinesLog2)
+{
+  const uint64_t bytes = uint64_t(64) << cacheLinesLog2;
+  if (bytes >= (1u << 30))
+    return QStringLiteral("%1 GB").arg(bytes >> 30);
+  if (bytes >= (1u << 20))
+    return QStringLiteral("%1 MB").arg(bytes >> 20);
+  return QStringLiteral("%1 KB").arg(bytes >> 10);
+}
+
+/// Plots the miss ratio of a fully associative LRU cache against its size, on a log scale.
+class CacheSim::MissRatioCurve : public QWidget
+{
+public:
+  explicit MissRatioCurve(QWidget* parent = nullptr) : QWidget(parent)
+  {
+    setMinimumHeight(160);
+    setBackgroundRole(QPalette::Base);
+    setAutoFillBackground(true);
+  }
+
+  void setHistogram(const ReuseModel::Histogram& histogram, QString title, uint32_t markerLinesLog2)
+  {
+    m_Histogram = histogram;
+    m_Title = title;
+    m_MarkerLinesLog2 = markerLinesLog2;
+    update();
+  }
+
+protected:
+  void paintEvent(QPaintEvent* event) override
+  {
+    (void) event;
+
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    const QPalette& pal = palette();
+    const QFontMetrics fm = fontMetrics();
+    const QRect plot = rect().adjusted(fm.width(QStringLiteral("100%")) + 8, fm.height() + 8, -16, -(fm.height() + 8));
+    if (plot.width() <= 0 || plot.height() <= 0)
+      return;
+
+    auto xFor = [&](uint32_t linesLog2) -> int
+    {
+      return plot.left() + int(plot.width() * double(linesLog2 - kMinCacheLinesLog2) / (kMaxCacheLinesLog2 - kMinCacheLinesLog2));
+    };
+    auto yFor = [&](double ratio) -> int
+    {
+      return plot.bottom() - int(plot.height() * ratio);
+    };
+
+    painter.setPen(pal.color(QPalette::Text));
+    painter.drawText(QRect(0, 0, width(), fm.height() + 4), Qt::AlignCenter, m_Title);
+
+    // Grid and axis labels
+    painter.setPen(QPen(pal.color(QPalette::Mid), 1, Qt::DotLine));
+    for (int percent = 0; percent <= 100; percent += 25)
+    {
+      const int y = yFor(percent / 100.0);
+      painter.drawLine(plot.left(), y, plot.right(), y);
+      painter.drawText(QRect(0, y - fm.height() / 2, plot.left() - 4, fm.height()), Qt::AlignRight | Qt::AlignVCenter, QStringLiteral("%1%").arg(percent));
+    }
+    for (uint32_t log2 = kMinCacheLinesLog2; log2 <= kMaxCacheLinesLog2; log2 += 2)
+    {
+      const int x = xFor(log2);
+      painter.drawLine(x, plot.top(), x, plot.bottom());
+      painter.drawText(QRect(x - 40, plot.bottom() + 4, 80, fm.height()), Qt::AlignHCenter | Qt::AlignTop, CacheSizeLabel(log2));
+    }
+
+    uint64_t total = 0;
+    for (uint64_t count : m_Histogram.m_Buckets)
+    {
+      total += count;
+    }
+
+    if (!total)
+    {
+      painter.setPen(pal.color(QPalette::Text));
+      painter.drawText(plot, Qt::AlignCenter, QStringLiteral("No reuse distances were recorded. Turn them on with CacheSimSetReuseSampling()."));
+      return;
+    }
+
+    QPolygon curve;
+    for (uint32_t log2 = kMinCacheLinesLog2; log2 <= kMaxCacheLinesLog2; ++log2)
+    {
+      curve << QPoint(xFor(log2), yFor(double(ReuseMisses(m_Histogram.m_Buckets, log2)) / total));
+    }
+
+    painter.setPen(QPen(pal.color(QPalette::Highlight), 2));
+    painter.drawPolyline(curve);
+
+    if (m_MarkerLinesLog2 >= kMinCacheLinesLog2 && m_MarkerLinesLog2 <= kMaxCacheLinesLog2)
+    {
+      const int x = xFor(m_MarkerLinesLog2);
+      painter.setPen(QPen(pal.color(QPalette::Text), 1, Qt::DashLine));
+      painter.drawLine(x, plot.top(), x, plot.bottom());
+    }
+  }
+
+private:
+  ReuseModel::Histogram m_Histogram;
+  QString m_Title;
+  uint32_t m_MarkerLinesLog2 = 0;
+};
+
+CacheSim::ReuseProfileView::ReuseProfileView(const TraceData* traceData, QWidget* parent /*= nullptr*/)
+  : BaseProfileView(parent)
+  , m_Model(new ReuseModel(this))
+  , m_FilterProxy(new QSortFilterProxyModel(this))
+  , ui(new Ui_ReuseProfileView)
+{
+  ui->setupUi(this);
+
+  setItemView(ui->m_TableView);
+
+  m_Curve = new MissRatioCurve(ui->m_CurveHost);
+  QVBoxLayout* curveLayout = new QVBoxLayout(ui->m_CurveHost);
+  curveLayout->setContentsMargins(0, 0, 0, 0);
+  curveLayout->addWidget(m_Curve);
+
+  for (uint32_t log2 = kMinCacheLinesLog2; log2 <= kMaxCacheLinesLog2; ++log2)
+  {
+    ui->m_CacheSize->addItem(CacheSizeLabel(log2), log2);
+  }
+
+  m_Model->setData(traceData);
+  m_FilterProxy->setSourceModel(m_Model);
+
+  DecimalFormatDelegate* decimalDelegate = new DecimalFormatDelegate(this);
+  IntegerFormatDelegate* integerDelegate = new IntegerFormatDelegate(this);
+  QTableView* tableView = ui->m_TableView;
+  tableView->setItemDelegateForColumn(ReuseModel::kColumnAccesses, integerDelegate);
+  tableView->setItemDelegateForColumn(ReuseModel::kColumnColdMisses, integerDelegate);
+  tableView->setItemDelegateForColumn(ReuseModel::kColumnMisses, integerDelegate);
+  tableView->setItemDelegateForColumn(ReuseModel::kColumnMissRatio, decimalDelegate);
+  tableView->setItemDelegateForColumn(ReuseModel::kColumnReuseSize, integerDelegate);
+
+  tableView->setModel(m_FilterProxy);
+  tableView->sortByColumn(ReuseModel::kColumnMisses, Qt::DescendingOrder);
+
+  QHeaderView* verticalHeader = tableView->verticalHeader();
+  verticalHeader->sectionResizeMode(QHeaderView::Fixed);
+  verticalHeader->setDefaultSectionSize(tableView->viewport()->fontMetrics().height() * 1.25);
+
+  connect(ui->m_Filter, &QLineEdit::textChanged, this, &ReuseProfileView::filterTextEdited);
+  connect(ui->m_CacheSize, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, &ReuseProfileView::cacheSizeChanged);
+  connect(tableView->selectionModel(), &QItemSelectionModel::selectionChanged, this, &ReuseProfileView::updateCurve);
+  connect(m_Model, &QAbstractItemModel::modelReset, this, &ReuseProfileView::updateCurve);
+
+  ui->m_CacheSize->setCurrentIndex(ui->m_CacheSize->findData(m_Model->cacheLinesLog2()));
+  updateCurve();
+}
+
+CacheSim::ReuseProfileView::~ReuseProfileView()
+{
+  delete ui;
+}
+
+void CacheSim::ReuseProfileView::filterTextEdited()
+{
+  m_FilterProxy->setFilterFixedString(ui->m_Filter->text());
+}
+
+void CacheSim::ReuseProfileView::cacheSizeChanged(int index)
+{
+  m_Model->setCacheLinesLog2(ui->m_CacheSize->itemData(index).toUInt());
+  updateCurve();
+}
+
+void CacheSim::ReuseProfileView::updateCurve()
+{
+  QModelIndexList selection = ui->m_TableView->selectionModel()->selectedRows();
+  QModelIndex source = selection.isEmpty() ? QModelIndex() : m_FilterProxy->mapToSource(selection[0]);
+  QString title = source.isValid() ? m_Model->data(m_Model->index(source.row(), ReuseModel::kColumnSymbol)).toString() : QStringLiteral("Whole capture");
+
+  m_Curve->setHistogram(m_Model->histogram(source), QStringLiteral("Miss ratio of a fully associative LRU cache: %1").arg(title), m_Model->cacheLinesLog2());
+}
+
+#include "aux_ReuseProfileView.moc"
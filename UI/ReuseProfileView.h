@@ -0,0 +1,60 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include "Precompiled.h"
+#include "BaseProfileView.h"
+
+class Ui_ReuseProfileView;
+
+namespace CacheSim
+{
+  class TraceData;
+  class ReuseModel;
+  class MissRatioCurve;
+
+  /// Reuse distances by symbol, and the miss ratio curve of the selected symbol or the whole capture.
+  class ReuseProfileView : public BaseProfileView
+  {
+    Q_OBJECT;
+
+  public:
+    explicit ReuseProfileView(const TraceData* traceData, QWidget* parent = nullptr);
+    ~ReuseProfileView();
+
+  private:
+    Q_SLOT void filterTextEdited();
+    Q_SLOT void cacheSizeChanged(int index);
+    Q_SLOT void updateCurve();
+
+  private:
+    ReuseModel* m_Model = nullptr;
+    QSortFilterProxyModel* m_FilterProxy = nullptr;
+    MissRatioCurve* m_Curve = nullptr;
+    Ui_ReuseProfileView* ui;
+  };
+
+}
@@ -0,0 +1,149 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// SymbolBenchmark.cpp - measures how long it takes to find the unique addresses of a capture and their modules, which
+// symbol resolution does before resolving anything.
+//
+// Every unique address shows up twice among the frames, in random order. Usage: SymbolBenchmark [unique_rips] [module_count]
+
+#include "Precompiled.h"
+#include "SymbolResolver.h"
+#include "CacheSim/CacheSimData.h"
+
+using namespace CacheSim;
+
+enum
+{
+  kRunCount = 3,
+  kFramesPerRip = 2,
+};
+
+static uint64_t NextRandom(uint64_t* state)
+{
+  *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+  return *state >> 24;
+}
+
+template <typename Fn>
+static double BestOf(Fn fn)
+{
+  double best = 1e30;
+  for (int run = 0; run < kRunCount; ++run)
+  {
+    QElapsedTimer timer;
+    timer.start();
+    fn();
+    best = std::min(best, timer.nsecsElapsed() / 1e9);
+  }
+  return best;
+}
+
+int main(int argc, char* argv[])
+{
+  QCoreApplication app(argc, argv);
+
+  const uint32_t ripCount = argc > 1 ? uint32_t(atoi(argv[1])) : 10000000;
+  const uint32_t moduleCount = argc > 2 ? uint32_t(atoi(argv[2])) : 300;
+
+  if (!ripCount || !moduleCount)
+  {
+    fprintf(stderr, "usage: SymbolBenchmark [unique_rips] [module_count]\n");
+    return 1;
+  }
+
+  uint64_t state = 1;
+
+  // Modules are laid out in random order with gaps between them, big enough to hold their share of addresses.
+  const uint64_t minModuleSize = std::max<uint64_t>(1 << 20, uint64_t(ripCount / moduleCount + 1) * 16);
+  QVector<SerializedModuleEntry> modules(moduleCount);
+  QVector<uint32_t> order(moduleCount);
+  for (uint32_t i = 0; i < moduleCount; ++i)
+  {
+    order[i] = i;
+  }
+  for (uint32_t i = moduleCount - 1; i > 0; --i)
+  {
+    std::swap(order[i], order[uint32_t(NextRandom(&state) % (i + 1))]);
+  }
+
+  uint64_t base = 0x400000;
+  for (uint32_t i = 0; i < moduleCount; ++i)
+  {
+    SerializedModuleEntry& module = modules[order[i]];
+    memset(&module, 0, sizeof module);
+    module.m_ImageBase = base;
+    module.m_ImageSegmentOffset = 0x1000;
+    module.m_SizeBytes = uint32_t(minModuleSize + NextRandom(&state) % (16 << 20));
+    base += (module.m_ImageSegmentOffset + module.m_SizeBytes + 0x200000) & ~0xfffull;
+  }
+
+  QVector<uintptr_t> frames;
+  frames.reserve(ripCount * kFramesPerRip);
+  for (uint32_t i = 0; i < ripCount; ++i)
+  {
+    const SerializedModuleEntry& module = modules[int(i % moduleCount)];
+    const uintptr_t rip = module.m_ImageBase + module.m_ImageSegmentOffset + uintptr_t(i / moduleCount) * 16;
+    for (int k = 0; k < kFramesPerRip; ++k)
+    {
+      frames.push_back(rip);
+    }
+  }
+  for (int i = frames.size() - 1; i > 0; --i)
+  {
+    std::swap(frames[i], frames[int(NextRandom(&state) % uint64_t(i + 1))]);
+  }
+
+  printf("%u unique addresses, %d frames, %u modules\n", ripCount, frames.size(), moduleCount);
+
+  uint32_t found = 0;
+  const double seconds = BestOf([&]()
+  {
+    const ModuleIndex moduleIndex(modules.constData(), moduleCount);
+    AddressSet ripLookup;
+    QVector<QVector<uintptr_t>> moduleFrames(moduleCount);
+
+    for (uintptr_t rip : frames)
+    {
+      if (ripLookup.insert(rip))
+      {
+        const int module = moduleIndex.find(rip);
+        if (module >= 0)
+        {
+          moduleFrames[module].push_back(rip);
+        }
+      }
+    }
+
+    found = 0;
+    for (const QVector<uintptr_t>& f : moduleFrames)
+    {
+      found += f.size();
+    }
+  });
+  printf("AddressSet + ModuleIndex:  %.3f s (%u addresses in modules)\n", seconds, found);
+
+  return found == ripCount ? 0 : 1;
+}
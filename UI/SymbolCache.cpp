@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "SymbolCache.h"
+
+static constexpr quint32 kSymbolCacheMagic = 0x43535943; // 'CSYC'
+static constexpr quint32 kSymbolCacheVersion = 1;
+
+CacheSim::SymbolCache::SymbolCache(const QByteArray& buildId, const QString& debugFilePath)
+  : m_DebugFilePath(debugFilePath)
+{
+  if (buildId.isEmpty())
+    return;
+
+  const QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/cachesim/symbols");
+  m_Path = dir + QLatin1Char('/') + QString::fromLatin1(buildId) + QStringLiteral(".cache");
+
+  QFile file(m_Path);
+  if (!file.open(QIODevice::ReadOnly))
+    return;
+
+  QDataStream in(&file);
+  in.setVersion(QDataStream::Qt_5_0);
+
+  quint32 magic = 0, version = 0, count = 0;
+  QString cachedDebugFilePath;
+  in >> magic >> version >> cachedDebugFilePath >> count;
+  if (magic != kSymbolCacheMagic || version != kSymbolCacheVersion || cachedDebugFilePath != debugFilePath)
+    return;
+
+  m_Entries.reserve(int(count));
+  for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+  {
+    quint64 address;
+    qint32 lineNumber;
+    ElfSymbolizer::Location location;
+    in >> address >> location.m_SymbolName >> location.m_FileName >> lineNumber;
+    location.m_LineNumber = lineNumber;
+    m_Entries.insert(address, location);
+  }
+
+  if (in.status() != QDataStream::Ok)
+  {
+    m_Entries.clear();
+  }
+}
+
+bool CacheSim::SymbolCache::lookup(uint64_t address, ElfSymbolizer::Location* out) const
+{
+  auto it = m_Entries.constFind(address);
+  if (it == m_Entries.constEnd())
+    return false;
+
+  *out = it.value();
+  return true;
+}
+
+void CacheSim::SymbolCache::insert(uint64_t address, const ElfSymbolizer::Location& location)
+{
+  if (m_Path.isEmpty())
+    return;
+
+  m_Entries.insert(address, location);
+  m_Dirty = true;
+}
+
+bool CacheSim::SymbolCache::save()
+{
+  if (!m_Dirty)
+    return true;
+
+  QDir().mkpath(QFileInfo(m_Path).path());
+
+  // Written to the side and renamed, so other instances resolving the same module never read a partial file.
+  QSaveFile file(m_Path);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+
+  QDataStream out(&file);
+  out.setVersion(QDataStream::Qt_5_0);
+  out << kSymbolCacheMagic << kSymbolCacheVersion << m_DebugFilePath << quint32(m_Entries.size());
+
+  for (auto it = m_Entries.constBegin(); it != m_Entries.constEnd(); ++it)
+  {
+    out << quint64(it.key()) << it.value().m_SymbolName << it.value().m_FileName << qint32(it.value().m_LineNumber);
+  }
+
+  m_Dirty = false;
+  return file.commit();
+}
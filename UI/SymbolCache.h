@@ -0,0 +1,58 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "Precompiled.h"
+#include "ElfSymbolizer.h"
+
+namespace CacheSim
+{
+  // Resolved locations of one module build, kept on disk under the user's cache directory so captures of the same
+  // build don't have to read its debug information again. Keyed by build ID and module relative address.
+  //
+  // The cache is dropped when the module's debug file changes, e.g. when debug symbols get installed after the first
+  // resolve.
+  class SymbolCache
+  {
+  public:
+    // Opens the cache of a module build. Modules without a build ID can't be told apart from other builds, so their
+    // cache stays empty and is never saved.
+    SymbolCache(const QByteArray& buildId, const QString& debugFilePath);
+
+    bool lookup(uint64_t address, ElfSymbolizer::Location* out) const;
+    void insert(uint64_t address, const ElfSymbolizer::Location& location);
+
+    // Writes the cache back if anything was inserted.
+    bool save();
+
+  private:
+    QString                                     m_Path;
+    QString                                     m_DebugFilePath;
+    QHash<quint64, ElfSymbolizer::Location>     m_Entries;
+    bool                                        m_Dirty = false;
+  };
+}
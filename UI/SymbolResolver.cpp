@@ -0,0 +1,116 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "SymbolResolver.h"
+
+CacheSim::AddressSet::AddressSet(uint32_t expectedCount)
+{
+  uint32_t slotCount = 1024;
+  while (slotCount < expectedCount * 2)
+  {
+    slotCount *= 2;
+  }
+  rehash(slotCount);
+}
+
+bool CacheSim::AddressSet::insert(uintptr_t address)
+{
+  if (!address)
+    return false;
+
+  // Kept at most half full, so probe sequences stay short.
+  if (2 * (m_Count + 1) > uint32_t(m_Slots.size()))
+  {
+    rehash(2 * m_Slots.size());
+  }
+
+  const uint32_t mask = m_Slots.size() - 1;
+  uintptr_t* slots = m_Slots.data();
+  for (uint32_t i = uint32_t((address * 0x9e3779b97f4a7c15ull) >> m_Shift); ; i = (i + 1) & mask)
+  {
+    if (slots[i] == address)
+      return false;
+
+    if (!slots[i])
+    {
+      slots[i] = address;
+      ++m_Count;
+      return true;
+    }
+  }
+}
+
+void CacheSim::AddressSet::rehash(uint32_t slotCount)
+{
+  QVector<uintptr_t> old;
+  old.swap(m_Slots);
+  m_Slots.fill(0, slotCount);
+  m_Count = 0;
+
+  m_Shift = 64;
+  for (uint32_t n = slotCount; n > 1; n >>= 1)
+  {
+    --m_Shift;
+  }
+
+  for (uintptr_t address : old)
+  {
+    if (address)
+    {
+      insert(address);
+    }
+  }
+}
+
+CacheSim::ModuleIndex::ModuleIndex(const SerializedModuleEntry* modules, uint32_t moduleCount)
+{
+  m_Ranges.reserve(moduleCount);
+  for (uint32_t i = 0; i < moduleCount; ++i)
+  {
+    const uintptr_t begin = modules[i].m_ImageBase + modules[i].m_ImageSegmentOffset;
+    m_Ranges.push_back({ begin, begin + modules[i].m_SizeBytes, int(i) });
+  }
+
+  std::sort(m_Ranges.begin(), m_Ranges.end(), [](const Range& l, const Range& r)
+  {
+    return l.m_Begin < r.m_Begin;
+  });
+}
+
+int CacheSim::ModuleIndex::find(uintptr_t address) const
+{
+  auto it = std::upper_bound(m_Ranges.constBegin(), m_Ranges.constEnd(), address, [](uintptr_t address, const Range& r)
+  {
+    return address < r.m_Begin;
+  });
+
+  if (it == m_Ranges.constBegin())
+    return -1;
+
+  --it;
+  return address < it->m_End ? it->m_Module : -1;
+}
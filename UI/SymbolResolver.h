@@ -30,5 +30,45 @@ namespace CacheSim
 
   using SymbolResolveProgressCallbackType = std::function<void(int, int)>;
 
+  // Set of addresses with open addressing, for finding the unique addresses among the millions of frames in a capture.
+  // Zero is never a member.
+  class AddressSet
+  {
+  public:
+    explicit AddressSet(uint32_t expectedCount = 0);
+
+    // Returns true if the address wasn't in the set yet.
+    bool insert(uintptr_t address);
+
+    uint32_t size() const { return m_Count; }
+
+  private:
+    void rehash(uint32_t slotCount);
+
+    QVector<uintptr_t>  m_Slots;
+    uint32_t            m_Count = 0;
+    uint32_t            m_Shift = 0;
+  };
+
+  // Finds the module whose code contains an address, by binary search over the code ranges of the modules.
+  class ModuleIndex
+  {
+  public:
+    ModuleIndex(const SerializedModuleEntry* modules, uint32_t moduleCount);
+
+    // Index into the modules passed to the constructor, or -1 if no module contains the address.
+    int find(uintptr_t address) const;
+
+  private:
+    struct Range
+    {
+      uintptr_t m_Begin;
+      uintptr_t m_End;
+      int       m_Module;
+    };
+
+    QVector<Range> m_Ranges;
+  };
+
   bool ResolveSymbols(const UnresolvedAddressData& input, QVector<ResolvedSymbol>* resolvedSymbolsOut, SymbolResolveProgressCallbackType reportProgress);
 }
\ No newline at end of file
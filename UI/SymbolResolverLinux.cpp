@@ -1,65 +1,8 @@
 #include "Precompiled.h"
 #include "SymbolResolver.h"
 #include "CacheSim/CacheSimData.h"
-#include <sstream>
-#include <unistd.h>
-
-static bool ResolveSymbolViaObjdump(char** symbolNameOut, size_t* bufferSizeOut, const char* module, uintptr_t address)
-{
-    std::stringstream command;
-
-    command << "objdump " << module << " ";
-    command << std::showbase << std::hex;
-    command << "-C -d --start-address=" << address;
-    command << " --stop-address=" << (address + 1);
-
-    FILE* fd = popen(command.str().c_str(), "r");
-    if ( fd == nullptr )
-    {
-      qDebug() << "Cannot find function info with addr2line or objdump either.";
-      pclose(fd);
-      return false;
-    }
-
-    char* buffer = nullptr;
-    size_t length;
-    while (getline(&buffer, &length, fd) != -1)
-    {
-      char* symbolStart = strchr(buffer, '<');
-      if ( symbolStart == nullptr )
-      {
-        continue;
-      }
-      symbolStart++; // Start /after/ the '<'
-      char* symbolEnd = strrchr(symbolStart, '>');
-      if ( symbolEnd == nullptr || symbolEnd < symbolStart )
-      {
-        continue;
-      }
-
-      *symbolEnd = '\0';
-      symbolEnd = strpbrk(symbolStart, "+-");
-      if ( symbolEnd )
-      {
-        *symbolEnd = '\0';
-      }
-
-      size_t symbolLength = strlen(symbolStart) + 1;
-      if ( symbolLength > *bufferSizeOut )
-      {
-        *symbolNameOut = (char*)realloc(*symbolNameOut, symbolLength);
-        *bufferSizeOut = symbolLength;
-      }
-
-      strcpy(*symbolNameOut, symbolStart);
-      pclose(fd);
-      free(buffer);
-      return true;
-    }
-    pclose(fd);
-    free(buffer);
-    return false;
-}
+#include "ElfSymbolizer.h"
+#include "SymbolCache.h"
 
 #define DebugBreak() asm volatile("int $3")
 bool CacheSim::ResolveSymbols(const UnresolvedAddressData& input, QVector<ResolvedSymbol>* resolvedSymbolsOut, SymbolResolveProgressCallbackType reportProgress)
@@ -68,6 +11,7 @@ bool CacheSim::ResolveSymbols(const UnresolvedAddressData& input, QVector<Resolv
   {
       const SerializedModuleEntry* m_Entry;
       QVector<uintptr_t> m_Frames;
+      QVector<ResolvedSymbol> m_Symbols;
   };
 
   QVector<ModuleFrames> moduleFrameList;
@@ -78,46 +22,27 @@ bool CacheSim::ResolveSymbols(const UnresolvedAddressData& input, QVector<Resolv
       moduleFrameList.push_back(frames);
   }
 
-  std::sort(moduleFrameList.begin(), moduleFrameList.end(), [](const ModuleFrames& l, const ModuleFrames& r) -> bool
-    {
-      return l.m_Entry->m_ImageBase < r.m_Entry->m_ImageBase;
-    });
-
-
-  int resolve_count = 0;
+  const ModuleIndex moduleIndex(input.m_Modules, input.m_ModuleCount);
+  AddressSet ripLookup;
   int fail_count = 0;
 
-  QSet<uintptr_t> ripLookup;  
   const auto& addRipToModuleFrames = [&](uintptr_t rip) -> void
   {
-    if ( ripLookup.contains(rip) )
+    if ( !ripLookup.insert(rip) )
     {
       return;
     }
-    ripLookup.insert(rip);
 
-    for ( int i = 0; i < input.m_ModuleCount; i++ )
+    const int module = moduleIndex.find(rip);
+    if ( module < 0 )
     {
-      ModuleFrames& module = moduleFrameList[i];
-      if ( rip >= module.m_Entry->m_ImageBase + module.m_Entry->m_ImageSegmentOffset)
-      {
-        if ( rip < (module.m_Entry->m_ImageBase + module.m_Entry->m_ImageSegmentOffset + module.m_Entry->m_SizeBytes) )
-        {
-          module.m_Frames.push_back(rip);
-          break;
-        }
-        else
-          continue;
-      }
-      else
-      {
-        qDebug() << "Failed to find module for address " << rip;
-        fail_count++;
-      }
+      fail_count++;
+      return;
     }
+
+    moduleFrameList[module].m_Frames.push_back(rip);
   };
 
-  
   int total = 2 * (input.m_StackCount + input.m_NodeCount); // Two passes, once to sort the data and once to process it
   int completed = 0;
 
@@ -129,7 +54,7 @@ bool CacheSim::ResolveSymbols(const UnresolvedAddressData& input, QVector<Resolv
       addRipToModuleFrames(rip);
     }
 
-    if (0 == (completed & 0x400))
+    if (0 == (completed & 0x3ff))
     {
       reportProgress(completed, total);
     }
@@ -140,7 +65,7 @@ bool CacheSim::ResolveSymbols(const UnresolvedAddressData& input, QVector<Resolv
   {
     addRipToModuleFrames(input.m_Nodes[i].m_Rip);
 
-    if (0 == (completed & 0x400))
+    if (0 == (completed & 0x3ff))
     {
       reportProgress(completed, total);
     }
@@ -148,115 +73,92 @@ bool CacheSim::ResolveSymbols(const UnresolvedAddressData& input, QVector<Resolv
 
   reportProgress(completed, total);
 
-  for ( int i = 0; i < moduleFrameList.count(); i++ )
+  if ( fail_count )
+  {
+    qDebug() << fail_count << "addresses are outside of all modules";
+  }
+
+  // Modules are resolved in parallel, each looking in its on-disk cache first and only reading its symbols if some
+  // address was missing there.
+  QAtomicInt resolved(completed);
+  QtConcurrent::blockingMap(moduleFrameList, [&](ModuleFrames& module)
   {
-    if ( moduleFrameList[i].m_Frames.count() == 0 )
+    if ( module.m_Frames.count() == 0 )
     {
-        continue;
+      return;
     }
 
-    ptrdiff_t moduleIndex = moduleFrameList[i].m_Entry - input.m_Modules;
+    const ptrdiff_t index = module.m_Entry - input.m_Modules;
+    const QString& moduleName = input.m_ModuleNames[index];
 
-    // Figure out the actual file with the debug info. If there's anything in /usr/lib/debug, use that version instead
-    // resolve any symlinks
-    char resolvedBaseFilename[1024];
-    if ( realpath(input.m_ModuleNames[moduleIndex].toLatin1().data(), resolvedBaseFilename) == nullptr )
+    QByteArray buildId;
+    QString debugFilePath;
+    const bool readable = ElfSymbolizer::identify(moduleName, &buildId, &debugFilePath);
+    if ( !readable )
     {
-      strcpy(resolvedBaseFilename, input.m_ModuleNames[moduleIndex].toLatin1().data());
+      qDebug() << "Cannot read symbols from" << moduleName;
     }
 
-    const char* debugLibBase = "/usr/lib/debug";
-    std::stringstream symbolFilename;
-    symbolFilename << debugLibBase;
-    symbolFilename << resolvedBaseFilename;
-    if ( access(symbolFilename.str().c_str(), R_OK) == -1 )
-    {
-      // Didn't find a special symbol library, so use the code library
-      symbolFilename.str(input.m_ModuleNames[moduleIndex].toLatin1().data());
-    }
-    
-    int frameIndex = 0;
-    do
-    {
-      std::stringstream command;
-      command << "addr2line -C -f -e " << symbolFilename.str() << " ";
-      command << std::showbase << std::hex;
-  
-      uintptr_t imageBase = moduleFrameList[i].m_Entry->m_ImageBase;
-      const int numFramesPerStep = 1000; // popen has an undocumented maximum string length. This ensures we don't exceed it
-      const int maxFrameIndex = std::min(frameIndex + numFramesPerStep, moduleFrameList[i].m_Frames.count()); 
+    // Symbols are only read on the first miss in the cache, and dropped again once the module is done.
+    SymbolCache cache(readable ? buildId : QByteArray(), debugFilePath);
+    QScopedPointer<ElfSymbolizer> symbolizer;
+    bool loadFailed = !readable;
 
-      for ( int j = frameIndex; j < maxFrameIndex; j++ )
-      {
-        command << (moduleFrameList[i].m_Frames[j] - imageBase) << " ";
-      }
-      FILE* fd = popen(command.str().c_str(), "r");
-  
-      if ( fd == nullptr )
-      {
-        qDebug() << "Cannot resolve symbols. addr2line not found.";
-        pclose(fd);
-        return false;
-      }
+    const uintptr_t imageBase = module.m_Entry->m_ImageBase;
+    module.m_Symbols.reserve(module.m_Frames.count());
+    for ( uintptr_t rip : module.m_Frames )
+    {
+      const uint64_t address = rip - imageBase;
 
-      char* symbolBuffer = nullptr;
-      size_t symbolBufferSize;
-      while ( getline(&symbolBuffer, &symbolBufferSize, fd) != -1 )
+      ElfSymbolizer::Location location;
+      if ( !cache.lookup(address, &location) && !loadFailed )
       {
-        if ( strcmp(symbolBuffer, "??\n") == 0 )
+        if ( !symbolizer )
         {
-          // Attempt to use objdump to get the data
-          if ( !ResolveSymbolViaObjdump(&symbolBuffer, &symbolBufferSize, input.m_ModuleNames[moduleIndex].toLatin1().data(), moduleFrameList[i].m_Frames[frameIndex] - moduleFrameList[i].m_Entry->m_ImageBase))
+          symbolizer.reset(new ElfSymbolizer);
+          if ( !symbolizer->load(moduleName) )
           {
-            int needed = snprintf(symbolBuffer, symbolBufferSize, "[0x%016lx in %s]", moduleFrameList[i].m_Frames[frameIndex], symbolFilename.str().c_str());
-            if ( needed >= symbolBufferSize )
-            {
-              symbolBufferSize = needed + 1;
-              symbolBuffer = (char*)realloc(symbolBuffer, symbolBufferSize);
-              snprintf(symbolBuffer, symbolBufferSize, "[%016lx in %s]", moduleFrameList[i].m_Frames[frameIndex], symbolFilename.str().c_str());
-            }
+            symbolizer.reset();
+            loadFailed = true;
           }
         }
-
-        char* lineBuffer = nullptr;
-        size_t length;
-        getline(&lineBuffer, &length, fd);
-        
-        char* filename = nullptr;
-        int lineNumber;   
-        int elementsFilled = sscanf(lineBuffer, "%m[^:]:%d %*s", &filename, &lineNumber);
-        free(lineBuffer);
-        if ( elementsFilled == 0 )
-        {
-          qDebug() << "Unexpected response from addr2line. Aborting.";
-          pclose(fd);
-          return false;
-        }
-        else if ( elementsFilled == 1 )
-        {
-          lineNumber = -1;
-        }
-  
-        ResolvedSymbol out_sym;
-        out_sym.m_Rip = moduleFrameList[i].m_Frames[frameIndex];
-        out_sym.m_SymbolName = symbolBuffer;
-        out_sym.m_FileName = filename;
-        out_sym.m_LineNumber = lineNumber;
-        out_sym.m_ModuleIndex = i;
-        out_sym.m_Displacement = -1;
-        resolvedSymbolsOut->push_back(out_sym);
-        ++frameIndex;
-        ++resolve_count;
-        ++completed;
-        free(filename);
-        if (0 == (completed & 0x400))
+        if ( symbolizer )
         {
-          reportProgress(completed, total);
+          symbolizer->lookup(address, &location);
+          cache.insert(address, location);
         }
       }
-      free(symbolBuffer);    
-      pclose(fd);
-    } while ( frameIndex < moduleFrameList[i].m_Frames.count() );
+
+      if ( location.m_SymbolName.isEmpty() )
+      {
+        location.m_SymbolName = QStringLiteral("[0x%1 in %2]").arg(rip, 16, 16, QLatin1Char('0')).arg(moduleName);
+      }
+
+      ResolvedSymbol out_sym;
+      out_sym.m_Rip = rip;
+      out_sym.m_SymbolName = location.m_SymbolName;
+      out_sym.m_FileName = location.m_FileName;
+      out_sym.m_LineNumber = location.m_LineNumber;
+      out_sym.m_ModuleIndex = uint32_t(index);
+      out_sym.m_Displacement = -1;
+      module.m_Symbols.push_back(out_sym);
+
+      const int done = resolved.fetchAndAddRelaxed(1) + 1;
+      if (0 == (done & 0x3ff))
+      {
+        reportProgress(done, total);
+      }
+    }
+
+    if ( !cache.save() )
+    {
+      qDebug() << "Cannot write the symbol cache of" << moduleName;
+    }
+  });
+
+  for ( const ModuleFrames& module : moduleFrameList )
+  {
+    *resolvedSymbolsOut += module.m_Symbols;
   }
 
   return true;
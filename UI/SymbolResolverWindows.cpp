@@ -57,13 +57,14 @@ bool CacheSim::ResolveSymbols(const UnresolvedAddressData& input, QVector<Resolv
 
   SYMBOL_INFO* sym = static_cast<SYMBOL_INFO*>(malloc(sizeof(SYMBOL_INFO) + 1024 * sizeof sym->Name[0]));
 
-  QSet<uintptr_t> ripLookup;
+  const ModuleIndex moduleIndex(input.m_Modules, input.m_ModuleCount);
+  AddressSet ripLookup;
   int resolve_count = 0;
   int fail_count = 0;
 
   auto resolve_symbol = [&](uintptr_t rip) -> void
   {
-    if (ripLookup.contains(rip))
+    if (!ripLookup.insert(rip))
       return;
 
     ++resolve_count;
@@ -96,19 +97,8 @@ bool CacheSim::ResolveSymbols(const UnresolvedAddressData& input, QVector<Resolv
       ++fail_count;
     }
 
-    // Try to find the module..
-    out_sym.m_ModuleIndex = ~0u;
-    for (uint32_t i = 0; i < input.m_ModuleCount; ++i)
-    {
-      const SerializedModuleEntry& mod = input.m_Modules[i];
-      if (rip >= mod.m_ImageBase && rip <= mod.m_ImageBase + mod.m_SizeBytes)
-      {
-        out_sym.m_ModuleIndex = i;
-        break;
-      }
-    }
+    out_sym.m_ModuleIndex = uint32_t(moduleIndex.find(rip));
 
-    ripLookup.insert(rip);
     resolvedSymbolsOut->push_back(out_sym);
   };
 
@@ -124,7 +114,7 @@ bool CacheSim::ResolveSymbols(const UnresolvedAddressData& input, QVector<Resolv
       resolve_symbol(rip);
     }
 
-    if (0 == (completed & 0x400))
+    if (0 == (completed & 0x3ff))
     {
       reportProgress(completed, total);
     }
@@ -135,7 +125,7 @@ bool CacheSim::ResolveSymbols(const UnresolvedAddressData& input, QVector<Resolv
   {
     resolve_symbol(input.m_Nodes[i].m_Rip);
 
-    if (0 == (completed & 0x400))
+    if (0 == (completed & 0x3ff))
     {
       reportProgress(completed, total);
     }
@@ -31,6 +31,63 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 Q_DECLARE_METATYPE(CacheSim::TraceData::ResolveResult);
 
+// Looks up the symbol of every node and every entry of the call stack data, in parallel. `symbols` is sorted by address.
+static void BuildSymbolIndex(const CacheSim::SerializedHeader* hdr, const CacheSim::SerializedSymbol* symbols, uint32_t symbolCount,
+                             QVector<uint32_t>* nodeSymbols, QVector<uint32_t>* frameSymbols)
+{
+  using namespace CacheSim;
+
+  auto find = [symbols, symbolCount](uintptr_t rip) -> uint32_t
+  {
+    const SerializedSymbol* e = symbols + symbolCount;
+    const SerializedSymbol* s = std::lower_bound(symbols, e, rip, [](const SerializedSymbol& sym, uintptr_t rip) -> bool
+    {
+      return sym.m_Rip < rip;
+    });
+    return (s != e && s->m_Rip == rip) ? uint32_t(s - symbols) : kNoSymbolIndex;
+  };
+
+  const SerializedNode* nodes = hdr->GetStats();
+  const uintptr_t* frames = hdr->GetStacks();
+
+  nodeSymbols->resize(hdr->GetStatCount());
+  frameSymbols->resize(hdr->GetStackCount());
+
+  struct Range
+  {
+    QVector<uint32_t>* m_Out;
+    uint32_t m_Begin;
+    uint32_t m_End;
+  };
+
+  QVector<Range> ranges;
+  const uint32_t rangeCount = uint32_t(QThread::idealThreadCount());
+  for (QVector<uint32_t>* out : { nodeSymbols, frameSymbols })
+  {
+    const uint32_t count = out->size();
+    for (uint32_t i = 0; i < rangeCount; ++i)
+    {
+      ranges.push_back({ out, uint32_t(uint64_t(count) * i / rangeCount), uint32_t(uint64_t(count) * (i + 1) / rangeCount) });
+    }
+  }
+
+  QtConcurrent::blockingMap(ranges, [&](const Range& range)
+  {
+    uint32_t* out = range.m_Out->data();
+    for (uint32_t i = range.m_Begin; i < range.m_End; ++i)
+    {
+      if (range.m_Out == nodeSymbols)
+      {
+        out[i] = find(nodes[i].m_Rip);
+      }
+      else
+      {
+        out[i] = frames[i] ? find(frames[i]) : kNoSymbolIndex;
+      }
+    }
+  });
+}
+
 CacheSim::TraceData::TraceData(QObject* parent /*= nullptr*/)
   : QObject(parent)
   , m_Watcher(new QFutureWatcher<ResolveResult>(this))
@@ -48,7 +105,7 @@ bool CacheSim::TraceData::isResolved() const
   return header()->m_SymbolCount > 0;
 }
 
-void CacheSim::TraceData::beginLoadTrace(QString fn)
+void CacheSim::TraceData::beginLoadTrace(QString fn, bool readOnly)
 {
   // Could make this fully async later.
 
@@ -61,24 +118,26 @@ void CacheSim::TraceData::beginLoadTrace(QString fn)
   m_SymbolStringCache.clear();
   m_StringToSymbolNameIndex.clear();
 
-  m_File.close();
-  m_File.setFileName(fn);
+  m_File.reset(new QFile(fn));
+  m_ReadOnly = readOnly;
 
-  if (!m_File.open(QIODevice::ReadWrite))
+  if (!m_File->open(readOnly ? QIODevice::ReadOnly : QIODevice::ReadWrite))
   {
     emitLoadFailure(QStringLiteral("Failed to open file"));
-    m_File.close();
+    m_File->close();
     return;
   }
 
-  m_DataSize = m_File.size();
-  if (nullptr == (m_Data = (char*) m_File.map(0, m_DataSize)))
+  m_DataSize = m_File->size();
+  if (nullptr == (m_Data = (char*) m_File->map(0, m_DataSize)))
   {
     emitLoadFailure(QStringLiteral("Failed to memory map file"));
-    m_File.close();
+    m_File->close();
     return;
   }
 
+  updateSymbolIndex();
+
   Q_EMIT memoryMappedDataChanged();
 
   QTimer::singleShot(0, [p = QPointer<TraceData>(this)]()
@@ -92,6 +151,12 @@ void CacheSim::TraceData::beginLoadTrace(QString fn)
 
 void CacheSim::TraceData::beginResolveSymbols()
 {
+  if (m_ReadOnly)
+  {
+    Q_EMIT symbolResolutionFailed(QStringLiteral("The trace file was loaded read only"));
+    return;
+  }
+
   m_Watcher->setFuture(QtConcurrent::run(this, &TraceData::symbolResolveTask));
 }
 
@@ -126,25 +191,94 @@ QString CacheSim::TraceData::internedSymbolString(uint32_t offset) const
     return it.value();
 
   const SerializedHeader* hdr = header();
-
   QString result(reinterpret_cast<const QChar*>(m_Data + hdr->m_SymbolTextOffset + sizeof(QChar) * offset));
   m_SymbolStringCache.insert(offset, result);
   m_StringToSymbolNameIndex.insert(result, offset);
   return result;
 }
 
+static uint32_t FindSymbolNameId(const CacheSim::SerializedSymbol* symbols, uint32_t count, const QChar* text, const QString& name)
+{
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    const QChar* str = text + symbols[i].m_SymbolName;
+
+    int len = 0;
+    while (len < name.size() && str[len] == name[len])
+    {
+      ++len;
+    }
+
+    if (len == name.size() && str[len].isNull())
+    {
+      return symbols[i].m_SymbolName;
+    }
+  }
+
+  return 0;
+}
+
+uint32_t CacheSim::TraceData::symbolNameId(QString name) const
+{
+  const SerializedHeader* hdr = header();
+  return FindSymbolNameId(hdr->GetSymbols(), hdr->GetSymbolCount(), reinterpret_cast<const QChar*>(m_Data + hdr->m_SymbolTextOffset), name);
+}
+
+CacheSim::TraceData::Snapshot CacheSim::TraceData::snapshot() const
+{
+  if (!m_Data)
+  {
+    return Snapshot();
+  }
+
+  const SerializedHeader* hdr = header();
+
+  // Symbols are resolved into a new part of the file and the header is rewritten in place, so everything found
+  // through the header is looked up now.
+  Snapshot result;
+  result.m_File = m_File;
+  result.m_Header = hdr;
+  result.m_Symbols = hdr->GetSymbols();
+  result.m_SymbolCount = hdr->GetSymbolCount();
+  result.m_SymbolText = reinterpret_cast<const QChar*>(m_Data + hdr->m_SymbolTextOffset);
+  result.m_NodeSymbolStorage = m_NodeSymbolStorage;
+  result.m_FrameSymbolStorage = m_FrameSymbolStorage;
+  result.m_NodeSymbols = m_NodeSymbolStorage.isEmpty() ? m_NodeSymbols : result.m_NodeSymbolStorage.constData();
+  result.m_FrameSymbols = m_FrameSymbolStorage.isEmpty() ? m_FrameSymbols : result.m_FrameSymbolStorage.constData();
+  return result;
+}
+
+QString CacheSim::TraceData::Snapshot::symbolString(uint32_t offset) const
+{
+  return QString(m_SymbolText + offset);
+}
+
+uint32_t CacheSim::TraceData::Snapshot::symbolNameId(QString name) const
+{
+  return FindSymbolNameId(m_Symbols, m_SymbolCount, m_SymbolText, name);
+}
+
 CacheSim::TraceData::FileInfo CacheSim::TraceData::findFileData(QString symbol) const
 {
+  // Names shown in the views have been interned already, so usually this avoids scanning the symbols.
   uint32_t stringIndex = m_StringToSymbolNameIndex.value(symbol);
+  if (stringIndex == 0)
+  {
+    stringIndex = symbolNameId(symbol);
+  }
 
   if (stringIndex == 0)
   {
     return FileInfo();
   }
 
-  const SerializedHeader* hdr = header();
-  const SerializedNode* nodes = hdr->GetStats();
-  const uint32_t nodeCount = hdr->GetStatCount();
+  if (m_SymbolNodes.isEmpty())
+  {
+    buildSymbolNodeIndex();
+  }
+
+  const SerializedNode* nodes = header()->GetStats();
+  const QPair<uint32_t, uint32_t> range = m_SymbolNodeRanges.value(stringIndex);
 
   int minLine = INT_MAX;
   int maxLine = INT_MIN;
@@ -153,33 +287,29 @@ CacheSim::TraceData::FileInfo CacheSim::TraceData::findFileData(QString symbol)
 
   QHash<int, LineData> lineStats;
 
-  for (uint32_t i = 0; i < nodeCount; ++i)
+  for (uint32_t n = range.first; n < range.second; ++n)
   {
+    const uint32_t i = m_SymbolNodes[n];
     const SerializedNode& node = nodes[i];
+    const SerializedSymbol* sym = nodeSymbol(i);
 
-    if (const SerializedSymbol* sym = hdr->FindSymbol(node.m_Rip))
+    if (fileName.isEmpty())
     {
-      if (internedSymbolString(sym->m_SymbolName) == symbol)
-      {
-        if (fileName.isEmpty())
-        {
-          fileName = internedSymbolString(sym->m_FileName);
-        }
-
-        int lineNo = sym->m_LineNumber;
+      fileName = internedSymbolString(sym->m_FileName);
+    }
 
-        LineData& data = lineStats[lineNo];
+    int lineNo = sym->m_LineNumber;
 
-        data.m_LineNumber = lineNo;
-        for (int k = 0; k < kAccessResultCount; ++k)
-        {
-          data.m_Stats[k] += node.m_Stats[k];
-        }
+    LineData& data = lineStats[lineNo];
 
-        minLine = std::min(minLine, lineNo);
-        maxLine = std::max(maxLine, lineNo);
-      }
+    data.m_LineNumber = lineNo;
+    for (int k = 0; k < kAccessResultCount; ++k)
+    {
+      data.m_Stats[k] += node.m_Stats[k];
     }
+
+    minLine = std::min(minLine, lineNo);
+    maxLine = std::max(maxLine, lineNo);
   }
 
   QVector<LineData> lineData;
@@ -201,6 +331,40 @@ CacheSim::TraceData::FileInfo CacheSim::TraceData::findFileData(QString symbol)
   return result;
 }
 
+void CacheSim::TraceData::buildSymbolNodeIndex() const
+{
+  const uint32_t nodeCount = header()->GetStatCount();
+
+  m_SymbolNodeRanges.clear();
+  m_SymbolNodes.clear();
+
+  // Count the nodes of each symbol name to lay out their ranges, then fill them in node order.
+  for (uint32_t i = 0; i < nodeCount; ++i)
+  {
+    if (const SerializedSymbol* sym = nodeSymbol(i))
+    {
+      ++m_SymbolNodeRanges[sym->m_SymbolName].second;
+    }
+  }
+
+  uint32_t offset = 0;
+  for (QPair<uint32_t, uint32_t>& range : m_SymbolNodeRanges)
+  {
+    range.first = offset;
+    offset += range.second;
+    range.second = range.first;
+  }
+
+  m_SymbolNodes.resize(offset);
+  for (uint32_t i = 0; i < nodeCount; ++i)
+  {
+    if (const SerializedSymbol* sym = nodeSymbol(i))
+    {
+      m_SymbolNodes[m_SymbolNodeRanges[sym->m_SymbolName].second++] = i;
+    }
+  }
+}
+
 void CacheSim::TraceData::symbolsResolved()
 {
   ResolveResult result = m_Watcher->future().result();
@@ -217,31 +381,87 @@ void CacheSim::TraceData::symbolsResolved()
 
   uint32_t totalSize = newHeader.m_SymbolTextOffset + result.m_StringData.size() * sizeof(QChar);
 
-  //uint32_t oldSize = m_File.size();
-  m_File.resize(totalSize);
+  // Files older than the symbol index have no room in the header for it, so theirs is only kept in memory.
+  const bool writeIndex = newHeader.m_Version >= 8;
+  if (writeIndex)
+  {
+    newHeader.m_NodeSymbolOffset = (totalSize + 7) & ~7u;
+    newHeader.m_FrameSymbolOffset = newHeader.m_NodeSymbolOffset + result.m_NodeSymbols.size() * sizeof(uint32_t);
+    totalSize = newHeader.m_FrameSymbolOffset + result.m_FrameSymbols.size() * sizeof(uint32_t);
+  }
+
+  //uint32_t oldSize = m_File->size();
+  m_File->resize(totalSize);
   m_DataSize = totalSize;
-  m_File.unmap((uchar*)(m_Data));
-  m_Data = (char*)(m_File.map(0, m_DataSize));
+  // The old mapping stays until the file is closed, snapshots taken before this still read from it.
+  m_Data = (char*)(m_File->map(0, m_DataSize));
   m_SymbolStringCache.clear();
   m_StringToSymbolNameIndex.clear();
 
-  Q_EMIT memoryMappedDataChanged();
-
   memcpy(m_Data + newHeader.m_SymbolOffset, reinterpret_cast<const char*>(result.m_Symbols.constData()), result.m_Symbols.size() * sizeof(SerializedSymbol));
   memcpy(m_Data + newHeader.m_SymbolTextOffset, reinterpret_cast<const char*>(result.m_StringData.constData()), result.m_StringData.size() * sizeof(QChar));
-  memcpy(m_Data, &newHeader, sizeof newHeader);
+  if (writeIndex)
+  {
+    memcpy(m_Data + newHeader.m_NodeSymbolOffset, result.m_NodeSymbols.constData(), result.m_NodeSymbols.size() * sizeof(uint32_t));
+    memcpy(m_Data + newHeader.m_FrameSymbolOffset, result.m_FrameSymbols.constData(), result.m_FrameSymbols.size() * sizeof(uint32_t));
+  }
+  memcpy(m_Data, &newHeader, newHeader.GetSize());
+
+  if (writeIndex)
+  {
+    updateSymbolIndex();
+  }
+  else
+  {
+    resetSymbolIndex();
+    m_NodeSymbolStorage = result.m_NodeSymbols;
+    m_FrameSymbolStorage = result.m_FrameSymbols;
+    m_NodeSymbols = m_NodeSymbolStorage.constData();
+    m_FrameSymbols = m_FrameSymbolStorage.constData();
+  }
 
-  //m_File.write(reinterpret_cast<const char*>(result.m_Symbols.constData()), result.m_Symbols.size() * sizeof(SerializedSymbol));
-  //m_File.write(reinterpret_cast<const char*>(result.m_StringData.constData()), result.m_StringData.size() * sizeof(QChar));
+  //m_File->write(reinterpret_cast<const char*>(result.m_Symbols.constData()), result.m_Symbols.size() * sizeof(SerializedSymbol));
+  //m_File->write(reinterpret_cast<const char*>(result.m_StringData.constData()), result.m_StringData.size() * sizeof(QChar));
 
   //temp.write(reinterpret_cast<const char*>(&newHeader), sizeof newHeader);
   //temp.write(reinterpret_cast<const char*>(m_Data) + sizeof newHeader, m_DataSize - sizeof newHeader);
 
-  m_File.flush();
+  m_File->flush();
 
+  // Only now that the symbols are in place, so the models pick them up.
+  Q_EMIT memoryMappedDataChanged();
   Q_EMIT symbolResolutionCompleted();
 }
 
+void CacheSim::TraceData::resetSymbolIndex()
+{
+  m_NodeSymbols = nullptr;
+  m_FrameSymbols = nullptr;
+  m_NodeSymbolStorage.clear();
+  m_FrameSymbolStorage.clear();
+  m_SymbolNodeRanges.clear();
+  m_SymbolNodes.clear();
+}
+
+void CacheSim::TraceData::updateSymbolIndex()
+{
+  const SerializedHeader* hdr = header();
+
+  resetSymbolIndex();
+
+  if (hdr->HasSymbolIndex())
+  {
+    m_NodeSymbols = hdr->GetNodeSymbolIndex();
+    m_FrameSymbols = hdr->GetFrameSymbolIndex();
+  }
+  else if (hdr->GetSymbolCount())
+  {
+    BuildSymbolIndex(hdr, hdr->GetSymbols(), hdr->GetSymbolCount(), &m_NodeSymbolStorage, &m_FrameSymbolStorage);
+    m_NodeSymbols = m_NodeSymbolStorage.constData();
+    m_FrameSymbols = m_FrameSymbolStorage.constData();
+  }
+}
+
 void CacheSim::TraceData::emitLoadFailure(QString errorMessage)
 {
   QTimer::singleShot(0, [p = QPointer<TraceData>(this), msg = errorMessage]()
@@ -337,6 +557,8 @@ CacheSim::TraceData::ResolveResult CacheSim::TraceData::symbolResolveTask()
     return l.m_Rip < r.m_Rip;
   });
 
+  BuildSymbolIndex(hdr, result.m_Symbols.constData(), result.m_Symbols.size(), &result.m_NodeSymbols, &result.m_FrameSymbols);
+
   qDebug() << "resolve result ready";
 
   return result;
@@ -40,6 +40,8 @@ namespace CacheSim
     {
       QVector<QChar> m_StringData;
       QVector<SerializedSymbol> m_Symbols;
+      QVector<uint32_t> m_NodeSymbols;
+      QVector<uint32_t> m_FrameSymbols;
     };
 
   public:
@@ -50,7 +52,8 @@ namespace CacheSim
     bool isResolved() const;
 
   public:
-    Q_SLOT void beginLoadTrace(QString fn);
+    // A capture loaded read only is never written to, so its symbols can't be resolved.
+    Q_SLOT void beginLoadTrace(QString fn, bool readOnly = false);
     Q_SLOT void beginResolveSymbols();
 
     Q_SIGNAL void traceLoadSucceeded();
@@ -63,11 +66,68 @@ namespace CacheSim
 
     const SerializedHeader* header() const { return reinterpret_cast<const SerializedHeader*>(m_Data); }
 
+    // What models need to aggregate the profile on other threads. It keeps the file mapped and the symbols it was
+    // taken with for as long as it lives, even if the TraceData is destroyed or symbols are resolved again meanwhile.
+    class Snapshot
+    {
+    public:
+      // Only the node and call stack data are read through this, symbol resolution doesn't move them.
+      const SerializedHeader* header() const { return m_Header; }
+
+      const SerializedSymbol* nodeSymbol(uint32_t nodeIndex) const
+      {
+        return m_NodeSymbols ? symbolAtIndex(m_NodeSymbols[nodeIndex]) : nullptr;
+      }
+
+      const SerializedSymbol* frameSymbol(uint32_t frameIndex) const
+      {
+        return m_FrameSymbols ? symbolAtIndex(m_FrameSymbols[frameIndex]) : nullptr;
+      }
+
+      QString symbolString(uint32_t offset) const;
+      uint32_t symbolNameId(QString name) const;
+
+    private:
+      friend class TraceData;
+
+      const SerializedSymbol* symbolAtIndex(uint32_t index) const
+      {
+        return index != kNoSymbolIndex ? m_Symbols + index : nullptr;
+      }
+
+      QSharedPointer<QFile> m_File;
+      const SerializedHeader* m_Header = nullptr;
+      const SerializedSymbol* m_Symbols = nullptr;
+      uint32_t m_SymbolCount = 0;
+      const QChar* m_SymbolText = nullptr;
+      const uint32_t* m_NodeSymbols = nullptr;
+      const uint32_t* m_FrameSymbols = nullptr;
+      QVector<uint32_t> m_NodeSymbolStorage;
+      QVector<uint32_t> m_FrameSymbolStorage;
+    };
+
+    Snapshot snapshot() const;
+
   public:
     QString symbolNameForAddress(uintptr_t rip) const;
     QString fileNameForAddress(uintptr_t rip) const;
     QString internedSymbolString(uint32_t offset) const;
 
+    // Symbol of a node, or of an entry of the call stack data, or null if it has none. These are array lookups in the
+    // symbol index, which is read from the file or built once when the file doesn't have one.
+    const SerializedSymbol* nodeSymbol(uint32_t nodeIndex) const
+    {
+      return m_NodeSymbols ? symbolAtIndex(m_NodeSymbols[nodeIndex]) : nullptr;
+    }
+
+    const SerializedSymbol* frameSymbol(uint32_t frameIndex) const
+    {
+      return m_FrameSymbols ? symbolAtIndex(m_FrameSymbols[frameIndex]) : nullptr;
+    }
+
+    // Interned offset of a symbol name, which identifies the symbol, or 0 if no symbol has that name.
+    uint32_t symbolNameId(QString name) const;
+
     struct LineData
     {
       int m_LineNumber;
@@ -93,14 +153,34 @@ namespace CacheSim
 
     ResolveResult symbolResolveTask();
 
+    // Drops the symbol index and the nodes grouped by symbol that were built from it.
+    void resetSymbolIndex();
+    void updateSymbolIndex();
+    void buildSymbolNodeIndex() const;
+
+    const SerializedSymbol* symbolAtIndex(uint32_t index) const
+    {
+      return index != kNoSymbolIndex ? header()->GetSymbols() + index : nullptr;
+    }
+
   private:
-    QFile           m_File;
+    QSharedPointer<QFile> m_File;     // Shared with snapshots, which need the mapping to stay
     char*           m_Data = nullptr;
+    bool            m_ReadOnly = false;
     uint64_t        m_DataSize = 0;
 
     QFutureWatcher<ResolveResult>* m_Watcher = nullptr;
     mutable QHash<uint32_t, QString> m_SymbolStringCache;
     mutable QHash<QString, uint32_t> m_StringToSymbolNameIndex;
+
+    const uint32_t* m_NodeSymbols = nullptr;
+    const uint32_t* m_FrameSymbols = nullptr;
+    QVector<uint32_t> m_NodeSymbolStorage;    // Used when the file has symbols but no index
+    QVector<uint32_t> m_FrameSymbolStorage;
+
+    // Nodes grouped by symbol name, built when source annotation is first needed.
+    mutable QHash<uint32_t, QPair<uint32_t, uint32_t>> m_SymbolNodeRanges;  // Name offset -> [begin, end) in m_SymbolNodes
+    mutable QVector<uint32_t> m_SymbolNodes;
   };
 
 }
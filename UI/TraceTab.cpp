@@ -30,6 +30,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "FlatProfileView.h"
 #include "TreeProfileView.h"
 #include "TreeModel.h"
+#include "DataProfileView.h"
+#include "HeatmapProfileView.h"
+#include "ReuseProfileView.h"
+#include "WorkingSetView.h"
+#include "CacheConfigView.h"
 #include "AnnotationView.h"
 
 #include "ui_TraceTab.h"
@@ -43,8 +48,6 @@ CacheSim::TraceTab::TraceTab(QString fileName, QWidget* parent /*= nullptr*/)
 {
   ui->setupUi(this);
 
-  connect(this, &TraceTab::treeModelReady, this, &TraceTab::createViewFromTreeModel, Qt::QueuedConnection);
-
   connect(m_Data, &TraceData::traceLoadSucceeded, this, &TraceTab::traceLoadSucceeded);
   connect(m_Data, &TraceData::traceLoadFailed, this, &TraceTab::traceLoadFailed);
   connect(m_Data, &TraceData::symbolResolutionProgressed, this, &TraceTab::symbolResolutionProgressed);
@@ -59,6 +62,11 @@ CacheSim::TraceTab::TraceTab(QString fileName, QWidget* parent /*= nullptr*/)
 
   connect(ui->m_FlatProfileButton, &QPushButton::clicked, this, &TraceTab::openFlatProfile);
   connect(ui->m_TreeProfileButton, &QPushButton::clicked, this, &TraceTab::openTreeProfile);
+  connect(ui->m_DataProfileButton, &QPushButton::clicked, this, &TraceTab::openDataProfile);
+  connect(ui->m_HeatmapButton, &QPushButton::clicked, this, &TraceTab::openHeatmap);
+  connect(ui->m_ReuseProfileButton, &QPushButton::clicked, this, &TraceTab::openReuseProfile);
+  connect(ui->m_WorkingSetButton, &QPushButton::clicked, this, &TraceTab::openWorkingSet);
+  connect(ui->m_CacheConfigButton, &QPushButton::clicked, this, &TraceTab::openCacheConfigs);
 
   m_CloseTabAction = new QAction(QStringLiteral("Close tab"), this);
   this->addAction(m_CloseTabAction);
@@ -83,6 +91,56 @@ void CacheSim::TraceTab::openFlatProfile()
   ui->m_TabWidget->setCurrentIndex(m_FlatProfileTabIndex);
 }
 
+void CacheSim::TraceTab::openDataProfile()
+{
+  if (-1 == m_DataProfileTabIndex)
+  {
+    m_DataProfileTabIndex = addProfileView(new DataProfileView(m_Data), QStringLiteral("Data Profile"));
+  }
+
+  ui->m_TabWidget->setCurrentIndex(m_DataProfileTabIndex);
+}
+
+void CacheSim::TraceTab::openHeatmap()
+{
+  if (-1 == m_HeatmapTabIndex)
+  {
+    m_HeatmapTabIndex = addProfileView(new HeatmapProfileView(m_Data), QStringLiteral("Heatmap"));
+  }
+
+  ui->m_TabWidget->setCurrentIndex(m_HeatmapTabIndex);
+}
+
+void CacheSim::TraceTab::openReuseProfile()
+{
+  if (-1 == m_ReuseProfileTabIndex)
+  {
+    m_ReuseProfileTabIndex = addProfileView(new ReuseProfileView(m_Data), QStringLiteral("Reuse Profile"));
+  }
+
+  ui->m_TabWidget->setCurrentIndex(m_ReuseProfileTabIndex);
+}
+
+void CacheSim::TraceTab::openWorkingSet()
+{
+  if (-1 == m_WorkingSetTabIndex)
+  {
+    m_WorkingSetTabIndex = addProfileView(new WorkingSetView(m_Data), QStringLiteral("Working Set"));
+  }
+
+  ui->m_TabWidget->setCurrentIndex(m_WorkingSetTabIndex);
+}
+
+void CacheSim::TraceTab::openCacheConfigs()
+{
+  if (-1 == m_CacheConfigTabIndex)
+  {
+    m_CacheConfigTabIndex = addProfileView(new CacheConfigView(m_Data), QStringLiteral("Cache Configurations"));
+  }
+
+  ui->m_TabWidget->setCurrentIndex(m_CacheConfigTabIndex);
+}
+
 void CacheSim::TraceTab::openTreeProfile()
 {
   if (-1 != m_TreeProfileTabIndex)
@@ -186,6 +244,26 @@ void CacheSim::TraceTab::tabCloseRequested(int index)
   {
     m_TreeProfileTabIndex = -1;
   }
+  else if (index == m_DataProfileTabIndex)
+  {
+    m_DataProfileTabIndex = -1;
+  }
+  else if (index == m_HeatmapTabIndex)
+  {
+    m_HeatmapTabIndex = -1;
+  }
+  else if (index == m_ReuseProfileTabIndex)
+  {
+    m_ReuseProfileTabIndex = -1;
+  }
+  else if (index == m_WorkingSetTabIndex)
+  {
+    m_WorkingSetTabIndex = -1;
+  }
+  else if (index == m_CacheConfigTabIndex)
+  {
+    m_CacheConfigTabIndex = -1;
+  }
 }
 
 void CacheSim::TraceTab::closeCurrentTab()
@@ -206,15 +284,19 @@ void CacheSim::TraceTab::doCreateTreeView(QString rootSymbolOpt, QString title)
 
   ++m_PendingJobs;
 
-  QtConcurrent::run([self = this, data = m_Data, tr = QThread::currentThread(), id = id, title = title, sym=rootSymbolOpt]()
+  // The model builds the tree on the thread pool and resets once it's done. It belongs to the tab until then, so
+  // closing the tab early just drops it.
+  TreeModel* model = new TreeModel(this);
+
+  connect(model, &QAbstractItemModel::modelReset, this, [this, model, id, title, isMain = rootSymbolOpt.isEmpty()]()
   {
-    TreeModel* model = new TreeModel(nullptr);
-    model->setTraceData(data, sym);
-    model->moveToThread(tr);
-    Q_EMIT self->treeModelReady(model, title, /* isMain=*/sym.isEmpty());
-    Q_EMIT self->endLongTask(id);
-    --self->m_PendingJobs;
+    disconnect(model, &QAbstractItemModel::modelReset, this, nullptr);
+    createViewFromTreeModel(model, title, isMain);
+    Q_EMIT endLongTask(id);
+    --m_PendingJobs;
   });
+
+  model->setTraceData(m_Data, rootSymbolOpt);
 }
 
 int CacheSim::TraceTab::addProfileView(BaseProfileView* view, QString label)
@@ -46,6 +46,11 @@ namespace CacheSim
   public:
     Q_SLOT void openFlatProfile();
     Q_SLOT void openTreeProfile();
+    Q_SLOT void openDataProfile();
+    Q_SLOT void openHeatmap();
+    Q_SLOT void openReuseProfile();
+    Q_SLOT void openWorkingSet();
+    Q_SLOT void openCacheConfigs();
     Q_SLOT void openReverseViewForSymbol(QString symbol);
     Q_SLOT void openAnnotationForSymbol(QString symbol);
     Q_SIGNAL void closeTrace();
@@ -61,7 +66,6 @@ namespace CacheSim
     Q_SLOT void symbolResolutionFailed(QString reason);
     Q_SLOT void tabCloseRequested(int index);
     Q_SLOT void closeCurrentTab();
-    Q_SIGNAL void treeModelReady(TreeModel* model, QString title, bool isMainView);
     Q_SLOT void createViewFromTreeModel(TreeModel* model, QString title, bool isMainView);
 
     void updateSymbolStatus();
@@ -74,6 +78,11 @@ namespace CacheSim
 
     int m_FlatProfileTabIndex = -1;
     int m_TreeProfileTabIndex = -1;
+    int m_DataProfileTabIndex = -1;
+    int m_HeatmapTabIndex = -1;
+    int m_ReuseProfileTabIndex = -1;
+    int m_WorkingSetTabIndex = -1;
+    int m_CacheConfigTabIndex = -1;
     QAtomicInt m_PendingJobs;
     QAtomicInt m_JobCounter;
     Ui_TraceTab* ui;
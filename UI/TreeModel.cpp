@@ -46,61 +46,48 @@ static const QString kColumnLabels[CacheSim::TreeModel::kColumnCount] =
   QStringLiteral("PF-L2"),
 };
 
+// Nodes are keyed by the interned name of the symbol they stand for, which is the same for all addresses in it.
+// Addresses without a symbol and fiber groups get keys no string offset can have.
+static constexpr uint64_t kUnresolvedKey = 1ull << 63;
+static constexpr uint64_t kFiberKey = 1ull << 62;
+
+// Fewer nodes than this aren't worth another thread.
+static constexpr uint32_t kMinNodesPerRange = 16384;
+
 class CacheSim::TreeModel::Node
 {
 public:
   Node* m_Parent;
-  QString m_SymbolName;
-  QString m_FileName;
+  uint64_t m_Key;
+  uintptr_t m_Rip;        // The first address seen for the node, which names it
+  int m_Row;
   uint32_t m_Stats[CacheSim::kAccessResultCount];
   QVector<Node*> m_Children;
 
-  explicit Node(Node* parent) : m_Parent(parent), m_Stats { 0 }
+  explicit Node(Node* parent, uint64_t key = 0, uintptr_t rip = 0)
+    : m_Parent(parent), m_Key(key), m_Rip(rip), m_Row(parent ? parent->m_Children.size() : 0), m_Stats { 0 }
   {}
 
   ~Node()
   {
   }
 
-  Node* child(QString name, bool* isNew, ObjectStack* stack)
-  {
-    Q_FOREACH(Node* n, m_Children)
-    {
-      if (n->m_SymbolName == name)
-      {
-        *isNew = false;
-        return n;
-      }
-    }
-
-    *isNew = true;
-    Node* node = stack->alloc<Node>(this);
-    node->m_SymbolName = name;
-    m_Children.push_back(node);
-    return node;
-  }
-
   int rowInParentSpace() const
   {
-    if (m_Parent)
-    {
-      return m_Parent->m_Children.indexOf(const_cast<Node*>(this));
-    }
-    return 0;
+    return m_Row;
   }
 
 };
 
 CacheSim::TreeModel::TreeModel(QObject* parent /*= nullptr*/)
   : QAbstractItemModel(parent)
-  , m_Allocator(new ObjectStack)
+  , m_Tree(emptyTree())
+  , m_RootNode(m_Tree.m_Root)
 {
 }
 
 CacheSim::TreeModel::~TreeModel()
 {
-  m_RootNode = nullptr;
-  delete m_Allocator;
 }
 
 QModelIndex CacheSim::TreeModel::index(int row, int column, const QModelIndex &parent /*= QModelIndex()*/) const
@@ -157,8 +144,8 @@ QVariant CacheSim::TreeModel::data(const QModelIndex &index, int role /*= Qt::Di
   {
     switch (index.column())
     {
-    case kColumnSymbol: return node->m_SymbolName;
-    case kColumnFileName: return node->m_FileName;
+    case kColumnSymbol: return symbolName(node);
+    case kColumnFileName: return fileName(node);
     case kColumnD1Hit: return node->m_Stats[CacheSim::kD1Hit];
     case kColumnI1Hit: return node->m_Stats[CacheSim::kI1Hit];
     case kColumnL2IMiss: return node->m_Stats[CacheSim::kL2IMiss];
@@ -181,11 +168,11 @@ QVariant CacheSim::TreeModel::data(const QModelIndex &index, int role /*= Qt::Di
   {
     if (index.column() == kColumnSymbol)
     {
-      return node->m_SymbolName;
+      return symbolName(node);
     }
     else if (index.column() == kColumnFileName)
     {
-      return node->m_FileName;
+      return fileName(node);
     }
   }
 
@@ -205,88 +192,258 @@ QVariant CacheSim::TreeModel::headerData(int section, Qt::Orientation orientatio
 
 void CacheSim::TreeModel::setTraceData(const TraceData* traceData, QString rootSymbol)
 {
-  beginResetModel();
+  const int generation = ++m_Generation;
 
-  m_Allocator->reset();
-  m_RootNode = nullptr;
+  QFutureWatcher<Tree>* watcher = new QFutureWatcher<Tree>(this);
 
-  m_RootNode = createTree(traceData, rootSymbol);
+  connect(watcher, &QFutureWatcher<Tree>::finished, this, [this, watcher, generation, traceData]()
+  {
+    if (generation == m_Generation)
+    {
+      beginResetModel();
+      m_Tree = watcher->result();
+      m_RootNode = m_Tree.m_Root;
+      m_Data = traceData;
+      endResetModel();
+    }
+    watcher->deleteLater();
+  });
 
-  endResetModel();
+  // The task works on a snapshot, so it doesn't matter if the data or this model are gone before it finishes. Trees
+  // that are dropped free their nodes with the last copy of them.
+  watcher->setFuture(QtConcurrent::run([data = traceData->snapshot(), rootSymbol]()
+  {
+    return createTree(data, rootSymbol);
+  }));
 }
 
-CacheSim::TreeModel::Node* CacheSim::TreeModel::createTree(const TraceData* traceData, QString rootSymbol)
+QString CacheSim::TreeModel::symbolName(const Node* node) const
 {
-  const SerializedNode* nodes = traceData->header()->GetStats();
-  const uint32_t nodeCount = traceData->header()->GetStatCount();
+  if (node->m_Key & kFiberKey)
+  {
+    return QStringLiteral("Fiber %1").arg(uint32_t(node->m_Key));
+  }
 
-  const uintptr_t* stackFrames = traceData->header()->GetStacks();
+  if (0 == (node->m_Key & kUnresolvedKey))
+  {
+    QString name = m_Data->symbolNameForAddress(node->m_Rip);
+    if (!name.isNull())
+      return name;
+  }
 
-  QVector<uintptr_t> frames;
+  return QStringLiteral("[%1]").arg(node->m_Rip, 16, 16, QLatin1Char('0'));
+}
 
-  Node* root = m_Allocator->alloc<Node>(nullptr);
+QString CacheSim::TreeModel::fileName(const Node* node) const
+{
+  if (node->m_Key & (kFiberKey | kUnresolvedKey))
+    return QString();
 
-  for (uint32_t i = 0; i < nodeCount; ++i)
+  return m_Data->fileNameForAddress(node->m_Rip);
+}
+
+CacheSim::TreeModel::Tree CacheSim::TreeModel::emptyTree()
+{
+  Tree tree;
+  tree.m_Allocators.push_back(QSharedPointer<ObjectStack>(new ObjectStack));
+  tree.m_Root = tree.m_Allocators.last()->alloc<Node>(nullptr);
+  return tree;
+}
+
+CacheSim::TreeModel::Tree CacheSim::TreeModel::createTree(const TraceData::Snapshot& data, QString rootSymbol)
+{
+  const SerializedHeader* hdr = data.header();
+  const uint32_t nodeCount = hdr->GetStatCount();
+
+  // Top down, unless we're looking at a specific symbol in which case we'll reverse the tree.
+  const bool reverse = !rootSymbol.isEmpty();
+  const uint32_t rootSymbolId = reverse ? data.symbolNameId(rootSymbol) : 0;
+
+  if (reverse && !rootSymbolId)
   {
-    frames.clear();
+    return emptyTree();
+  }
 
-    const SerializedNode& node = nodes[i];
+  // Each range of nodes is aggregated into a tree of its own on the thread pool, then the trees are merged pairwise.
+  struct PartialTree
+  {
+    ObjectStack* m_Allocator;
+    uint32_t m_Begin;
+    uint32_t m_End;
+    Node* m_Root;
+  };
 
-    // If we're trying to limit the tree to a particular root symbol, do that.
-    if (!rootSymbol.isEmpty())
+  const uint32_t rangeCount = qBound(1u, nodeCount / kMinNodesPerRange, uint32_t(QThread::idealThreadCount()));
+
+  Tree tree;
+  QVector<PartialTree> partials;
+  for (uint32_t i = 0; i < rangeCount; ++i)
+  {
+    tree.m_Allocators.push_back(QSharedPointer<ObjectStack>(new ObjectStack));
+    partials.push_back({ tree.m_Allocators.last().data(), uint32_t(uint64_t(nodeCount) * i / rangeCount), uint32_t(uint64_t(nodeCount) * (i + 1) / rangeCount), nullptr });
+  }
+
+  QtConcurrent::blockingMap(partials, [&data, rootSymbolId](PartialTree& partial)
+  {
+    partial.m_Root = buildTree(partial.m_Allocator, data, partial.m_Begin, partial.m_End, rootSymbolId);
+  });
+
+  for (int step = 1; step < partials.size(); step *= 2)
+  {
+    QVector<QPair<Node*, Node*>> merges;
+    for (int i = 0; i + step < partials.size(); i += 2 * step)
     {
-      if (rootSymbol != traceData->symbolNameForAddress(node.m_Rip))
-      {
-        continue;
-      }
+      merges.push_back(qMakePair(partials[i].m_Root, partials[i + step].m_Root));
     }
 
-    frames.push_back(node.m_Rip);
+    QtConcurrent::blockingMap(merges, [](QPair<Node*, Node*>& merge)
+    {
+      mergeTree(merge.first, merge.second);
+    });
+  }
+
+  tree.m_Root = partials[0].m_Root;
+  return tree;
+}
+
+CacheSim::TreeModel::Node* CacheSim::TreeModel::buildTree(ObjectStack* allocator, const TraceData::Snapshot& data, uint32_t begin, uint32_t end, uint32_t rootSymbolId)
+{
+  const SerializedHeader* hdr = data.header();
+  const SerializedNode* nodes = hdr->GetStats();
+  const uintptr_t* stackFrames = hdr->GetStacks();
+  const bool reverse = rootSymbolId != 0;
+
+  Node* root = allocator->alloc<Node>(nullptr);
+
+  // In creation order, so children come after their parents.
+  QVector<Node*> created;
+  QHash<QPair<Node*, quint64>, Node*> childIndex;
 
-    const uintptr_t* fp = stackFrames + node.m_StackIndex;
-    while (uintptr_t rip = *fp++)
+  auto child = [&](Node* parent, uint64_t key, uintptr_t rip) -> Node*
+  {
+    Node*& n = childIndex[qMakePair(parent, quint64(key))];
+    if (!n)
     {
-      frames.push_back(rip);
+      n = allocator->alloc<Node>(parent, key, rip);
+      parent->m_Children.push_back(n);
+      created.push_back(n);
     }
+    return n;
+  };
+
+  auto symbolKey = [](const SerializedSymbol* sym, uintptr_t rip) -> uint64_t
+  {
+    return sym ? sym->m_SymbolName : kUnresolvedKey | rip;
+  };
 
-    if (rootSymbol.isEmpty()) // top down, unless we're looking at a specific symbol in which case we'll reverse the tree
+  // Many nodes share a call stack, which always leads to the same branch. Top down that's the parent of the node's own
+  // row, reversed it's the end of the path as the root symbol is the same for all nodes.
+  QHash<quint64, Node*> stackBranches;
+  QVector<uint32_t> frames;
+
+  for (uint32_t i = begin; i < end; ++i)
+  {
+    const SerializedNode& node = nodes[i];
+    const uint64_t key = symbolKey(data.nodeSymbol(i), node.m_Rip);
+
+    // If we're trying to limit the tree to a particular root symbol, do that.
+    if (reverse && key != rootSymbolId)
     {
-      std::reverse(frames.begin(), frames.end());
+      continue;
     }
 
-    Node* branch = root;
+    // Work tagged with CacheSimFiberSwitch() is grouped under its fiber in the top down view.
+    const uint32_t fiberId = reverse ? 0 : node.m_FiberId;
+    const quint64 branchKey = (quint64(fiberId) << 32) | node.m_StackIndex;
 
-    Q_FOREACH(uintptr_t rip, frames)
+    Node* branch = stackBranches.value(branchKey);
+    if (!branch)
     {
-      QString symbolName;
-
-      const SerializedSymbol* sym = traceData->header()->FindSymbol(rip);
+      frames.clear();
 
-      if (sym)
+      for (uint32_t f = node.m_StackIndex; stackFrames[f]; ++f)
       {
-        symbolName = traceData->internedSymbolString(sym->m_SymbolName);
+        frames.push_back(f);
       }
-      else
+
+      auto frameChild = [&](Node* parent, uint32_t f) -> Node*
       {
-        symbolName = QStringLiteral("[%1]").arg(rip, 16, 16, QLatin1Char('0'));
-      }
+        return child(parent, symbolKey(data.frameSymbol(f), stackFrames[f]), stackFrames[f]);
+      };
 
-      bool isNew;
-      branch = branch->child(symbolName, &isNew, m_Allocator);
+      branch = root;
 
-      if (isNew && sym)
+      if (reverse)
       {
-        branch->m_FileName = traceData->internedSymbolString(sym->m_FileName);
+        branch = child(branch, key, node.m_Rip);
+        for (int f = 0; f < frames.size(); ++f)
+        {
+          branch = frameChild(branch, frames[f]);
+        }
       }
-
-      for (int k = 0; k < CacheSim::kAccessResultCount; ++k)
+      else
       {
-        branch->m_Stats[k] += node.m_Stats[k];
+        if (fiberId)
+        {
+          branch = child(branch, kFiberKey | fiberId, 0);
+        }
+        for (int f = frames.size() - 1; f >= 0; --f)
+        {
+          branch = frameChild(branch, frames[f]);
+        }
       }
+
+      stackBranches.insert(branchKey, branch);
+    }
+
+    Node* leaf = reverse ? branch : child(branch, key, node.m_Rip);
+
+    for (int k = 0; k < CacheSim::kAccessResultCount; ++k)
+    {
+      leaf->m_Stats[k] += node.m_Stats[k];
+    }
+  }
+
+  // Each node's stats were only added where its path ends, so sum them up towards the root.
+  for (int i = created.size() - 1; i >= 0; --i)
+  {
+    Node* n = created[i];
+    for (int k = 0; k < CacheSim::kAccessResultCount; ++k)
+    {
+      n->m_Parent->m_Stats[k] += n->m_Stats[k];
     }
   }
 
   return root;
 }
 
+void CacheSim::TreeModel::mergeTree(Node* into, Node* from)
+{
+  for (int k = 0; k < CacheSim::kAccessResultCount; ++k)
+  {
+    into->m_Stats[k] += from->m_Stats[k];
+  }
+
+  // Children only in one tree are moved over along with their subtrees.
+  QHash<quint64, Node*> index;
+  for (Node* c : into->m_Children)
+  {
+    index.insert(c->m_Key, c);
+  }
+
+  for (Node* c : from->m_Children)
+  {
+    if (Node* match = index.value(c->m_Key))
+    {
+      mergeTree(match, c);
+    }
+    else
+    {
+      c->m_Parent = into;
+      c->m_Row = into->m_Children.size();
+      into->m_Children.push_back(c);
+    }
+  }
+}
+
 #include "aux_TreeModel.moc"
@@ -26,10 +26,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 #include "Precompiled.h"
+#include "TraceData.h"
 
 namespace CacheSim
 {
-  class TraceData;
   class ObjectStack;
 
   class TreeModel : public QAbstractItemModel
@@ -64,16 +64,33 @@ namespace CacheSim
     QVariant headerData(int section, Qt::Orientation orientation, int role /*= Qt::DisplayRole*/) const override;
 
   public:
+    // Builds the tree on the thread pool and resets the model when it's done. Until then the model keeps the rows it
+    // had, which are none the first time.
     void setTraceData(const TraceData* traceData, QString rootSymbol = QString::null);
 
   private:
     class Node;
-    Node* createTree(const TraceData* traceData, QString rootSymbol);
 
+    struct Tree
+    {
+      QVector<QSharedPointer<ObjectStack>> m_Allocators;   // The nodes of each of the trees built in parallel
+      Node* m_Root = nullptr;
+    };
+
+    static Tree emptyTree();
+    static Tree createTree(const TraceData::Snapshot& data, QString rootSymbol);
+    static Node* buildTree(ObjectStack* allocator, const TraceData::Snapshot& data, uint32_t begin, uint32_t end, uint32_t rootSymbolId);
+    static void mergeTree(Node* into, Node* from);
+
+    // Names are only looked up for the rows that are displayed.
+    QString symbolName(const Node* node) const;
+    QString fileName(const Node* node) const;
 
   private:
-    ObjectStack* m_Allocator = nullptr;
+    Tree m_Tree;
     Node* m_RootNode = nullptr;
+    const TraceData* m_Data = nullptr;
+    int m_Generation = 0;     // Trees started before the last setTraceData() are dropped
   };
 
 }
@@ -0,0 +1,314 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Precompiled.h"
+#include "WorkingSetView.h"
+#include "TraceData.h"
+#include "NumberFormatters.h"
+
+#include "CacheSim/CacheSimData.h"
+
+#include "ui_WorkingSetView.h"
+
+#include <functional>
+
+static quint64 LinesToKB(uint32_t lines)
+{
+  return (quint64(lines) * 64 + 1023) / 1024;
+}
+
+static QColor CoreColor(int core)
+{
+  return QColor::fromHsv(core * 360 / CacheSim::kWorkingSetCoreCount, 160, 200);
+}
+
+/// Plots the working set of every interval, for all cores and for each core that touched memory.
+class CacheSim::WorkingSetChart : public QWidget
+{
+public:
+  explicit WorkingSetChart(QWidget* parent = nullptr) : QWidget(parent)
+  {
+    setMinimumHeight(160);
+    setBackgroundRole(QPalette::Base);
+    setAutoFillBackground(true);
+  }
+
+  void setIntervals(QVector<SerializedWorkingSet> intervals, uint32_t coreMask)
+  {
+    m_Intervals = intervals;
+    m_CoreMask = coreMask;
+    m_MaxLines = 1;
+    for (const SerializedWorkingSet& interval : m_Intervals)
+    {
+      m_MaxLines = qMax(m_MaxLines, interval.m_Lines);
+    }
+    update();
+  }
+
+  void setSelectedInterval(int interval)
+  {
+    m_Selected = interval;
+    update();
+  }
+
+  std::function<void(int)> m_OnClicked;
+
+protected:
+  QRect plotRect() const
+  {
+    const QFontMetrics fm = fontMetrics();
+    return rect().adjusted(fm.width(QStringLiteral("1000000 KB")) + 8, 2 * fm.height() + 8, -16, -(fm.height() + 8));
+  }
+
+  int intervalAt(int x) const
+  {
+    const QRect plot = plotRect();
+    if (m_Intervals.isEmpty() || plot.width() <= 0)
+      return -1;
+    const int last = m_Intervals.size() - 1;
+    return last ? qBound(0, int(double(x - plot.left()) * last / plot.width() + 0.5), last) : 0;
+  }
+
+  void mousePressEvent(QMouseEvent* event) override
+  {
+    const int interval = intervalAt(event->pos().x());
+    if (interval >= 0 && m_OnClicked)
+    {
+      m_OnClicked(interval);
+    }
+  }
+
+  void paintEvent(QPaintEvent* event) override
+  {
+    (void) event;
+
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    const QPalette& pal = palette();
+    const QFontMetrics fm = fontMetrics();
+    const QRect plot = plotRect();
+    if (plot.width() <= 0 || plot.height() <= 0)
+      return;
+
+    if (m_Intervals.isEmpty())
+    {
+      painter.setPen(pal.color(QPalette::Text));
+      painter.drawText(plot, Qt::AlignCenter, QStringLiteral("This capture has no working set sizes"));
+      return;
+    }
+
+    const int last = m_Intervals.size() - 1;
+    auto xFor = [&](int interval) -> int
+    {
+      return plot.left() + (last ? int(double(plot.width()) * interval / last) : plot.width() / 2);
+    };
+    auto yFor = [&](uint32_t lines) -> int
+    {
+      return plot.bottom() - int(double(plot.height()) * lines / m_MaxLines);
+    };
+
+    // Legend
+    int legendX = plot.left();
+    auto legend = [&](const QColor& color, const QString& text)
+    {
+      painter.fillRect(legendX, fm.height() / 2, fm.height(), fm.height() / 2, color);
+      legendX += fm.height() + 4;
+      painter.setPen(pal.color(QPalette::Text));
+      painter.drawText(QRect(legendX, 0, fm.width(text), fm.height()), Qt::AlignLeft, text);
+      legendX += fm.width(text) + 12;
+    };
+    legend(pal.color(QPalette::Highlight), QStringLiteral("All cores"));
+    for (int core = 0; core < kWorkingSetCoreCount; ++core)
+    {
+      if (m_CoreMask & (1u << core))
+        legend(CoreColor(core), QStringLiteral("Core %1").arg(core));
+    }
+
+    // Grid and axis labels
+    painter.setPen(QPen(pal.color(QPalette::Mid), 1, Qt::DotLine));
+    for (int quarter = 0; quarter <= 4; ++quarter)
+    {
+      const uint32_t lines = uint32_t(quint64(m_MaxLines) * quarter / 4);
+      const int y = yFor(lines);
+      painter.drawLine(plot.left(), y, plot.right(), y);
+      painter.drawText(QRect(0, y - fm.height() / 2, plot.left() - 4, fm.height()), Qt::AlignRight | Qt::AlignVCenter, QStringLiteral("%1 KB").arg(LinesToKB(lines)));
+    }
+    painter.drawText(QRect(plot.left(), plot.bottom() + 4, plot.width(), fm.height()), Qt::AlignHCenter | Qt::AlignTop,
+      QStringLiteral("Interval (%1 intervals)").arg(m_Intervals.size()));
+
+    auto plotLine = [&](const QPen& pen, std::function<uint32_t(const SerializedWorkingSet&)> value)
+    {
+      QPolygon line;
+      for (int i = 0; i <= last; ++i)
+      {
+        line << QPoint(xFor(i), yFor(value(m_Intervals[i])));
+      }
+      painter.setPen(pen);
+      if (last)
+        painter.drawPolyline(line);
+      else
+        painter.drawEllipse(line[0], 2, 2);
+    };
+
+    for (int core = 0; core < kWorkingSetCoreCount; ++core)
+    {
+      if (m_CoreMask & (1u << core))
+        plotLine(QPen(CoreColor(core), 1), [core](const SerializedWorkingSet& interval) { return interval.m_CoreLines[core]; });
+    }
+    plotLine(QPen(pal.color(QPalette::Highlight), 2), [](const SerializedWorkingSet& interval) { return interval.m_Lines; });
+
+    if (m_Selected >= 0 && m_Selected <= last)
+    {
+      const int x = xFor(m_Selected);
+      painter.setPen(QPen(pal.color(QPalette::Text), 1, Qt::DashLine));
+      painter.drawLine(x, plot.top(), x, plot.bottom());
+    }
+  }
+
+private:
+  QVector<SerializedWorkingSet> m_Intervals;
+  uint32_t m_CoreMask = 0;
+  uint32_t m_MaxLines = 1;
+  int m_Selected = -1;
+};
+
+CacheSim::WorkingSetView::WorkingSetView(const TraceData* traceData, QWidget* parent /*= nullptr*/)
+  : BaseProfileView(parent)
+  , m_Model(new QStandardItemModel(this))
+  , ui(new Ui_WorkingSetView)
+{
+  ui->setupUi(this);
+
+  m_Chart = new WorkingSetChart(ui->m_ChartHost);
+  QVBoxLayout* chartLayout = new QVBoxLayout(ui->m_ChartHost);
+  chartLayout->setContentsMargins(0, 0, 0, 0);
+  chartLayout->addWidget(m_Chart);
+
+  // The intervals are copied out of the trace, so they don't need reloading when symbol resolution remaps it.
+  const SerializedHeader* header = traceData->header();
+  const SerializedWorkingSet* intervals = header->GetWorkingSets();
+  QVector<SerializedWorkingSet> copy;
+  copy.reserve(header->GetWorkingSetCount());
+
+  uint32_t coreMask = 0;
+  for (uint32_t i = 0; i < header->GetWorkingSetCount(); ++i)
+  {
+    copy.push_back(intervals[i]);
+    for (int core = 0; core < kWorkingSetCoreCount; ++core)
+    {
+      if (intervals[i].m_CoreLines[core])
+        coreMask |= 1u << core;
+    }
+  }
+
+  QStringList labels = { QStringLiteral("Interval"), QStringLiteral("First Instruction"), QStringLiteral("Instructions"), QStringLiteral("Working Set (KB)") };
+  QVector<int> cores;
+  for (int core = 0; core < kWorkingSetCoreCount; ++core)
+  {
+    if (coreMask & (1u << core))
+    {
+      labels << QStringLiteral("Core %1 (KB)").arg(core);
+      cores.push_back(core);
+    }
+  }
+  m_Model->setHorizontalHeaderLabels(labels);
+
+  auto numberItem = [](quint64 value) -> QStandardItem*
+  {
+    QStandardItem* item = new QStandardItem;
+    item->setData(value, Qt::DisplayRole);
+    item->setTextAlignment(Qt::AlignRight);
+    return item;
+  };
+
+  quint64 firstInstruction = 0;
+  for (int i = 0; i < copy.size(); ++i)
+  {
+    const SerializedWorkingSet& interval = copy[i];
+    QList<QStandardItem*> row = { numberItem(i), numberItem(firstInstruction), numberItem(interval.m_Instructions), numberItem(LinesToKB(interval.m_Lines)) };
+    for (int core : cores)
+    {
+      row << numberItem(LinesToKB(interval.m_CoreLines[core]));
+    }
+    m_Model->appendRow(row);
+    firstInstruction += interval.m_Instructions;
+  }
+
+  IntegerFormatDelegate* integerDelegate = new IntegerFormatDelegate(this);
+  QTableView* tableView = ui->m_TableView;
+  for (int column = kColumnFirstInstruction; column < labels.size(); ++column)
+  {
+    tableView->setItemDelegateForColumn(column, integerDelegate);
+  }
+  tableView->setModel(m_Model);
+  tableView->sortByColumn(kColumnInterval, Qt::AscendingOrder);
+
+  QHeaderView* verticalHeader = tableView->verticalHeader();
+  verticalHeader->sectionResizeMode(QHeaderView::Fixed);
+  verticalHeader->setDefaultSectionSize(tableView->viewport()->fontMetrics().height() * 1.25);
+
+  m_Chart->setIntervals(copy, coreMask);
+  m_Chart->m_OnClicked = [this](int interval) { chartIntervalClicked(interval); };
+
+  if (copy.isEmpty())
+  {
+    ui->m_Summary->setText(QStringLiteral("This capture has no working set sizes."));
+  }
+  else
+  {
+    ui->m_Summary->setText(QStringLiteral("%1 instructions per interval. Sizes are estimates of the distinct lines touched by data accesses, within about 3%.")
+      .arg(header->GetWorkingSetInterval()));
+  }
+
+  connect(tableView->selectionModel(), &QItemSelectionModel::selectionChanged, this, &WorkingSetView::tableSelectionChanged);
+}
+
+CacheSim::WorkingSetView::~WorkingSetView()
+{
+  delete ui;
+}
+
+void CacheSim::WorkingSetView::tableSelectionChanged()
+{
+  QModelIndexList selection = ui->m_TableView->selectionModel()->selectedRows(kColumnInterval);
+  m_Chart->setSelectedInterval(selection.isEmpty() ? -1 : selection[0].data().toInt());
+}
+
+void CacheSim::WorkingSetView::chartIntervalClicked(int interval)
+{
+  for (int row = 0; row < m_Model->rowCount(); ++row)
+  {
+    if (m_Model->item(row, kColumnInterval)->data(Qt::DisplayRole).toInt() == interval)
+    {
+      ui->m_TableView->selectRow(row);
+      ui->m_TableView->scrollTo(m_Model->index(row, kColumnInterval));
+      return;
+    }
+  }
+}
+
+#include "aux_WorkingSetView.moc"
@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2017, Insomniac Games
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include "Precompiled.h"
+#include "BaseProfileView.h"
+
+class Ui_WorkingSetView;
+
+namespace CacheSim
+{
+  class TraceData;
+  class WorkingSetChart;
+
+  /// Estimated working set sizes over the course of a capture, for all cores and for each core.
+  class WorkingSetView : public BaseProfileView
+  {
+    Q_OBJECT;
+
+  public:
+    enum Column
+    {
+      kColumnInterval,
+      kColumnFirstInstruction,
+      kColumnInstructions,
+      kColumnWorkingSet,
+      kColumnFirstCore,
+    };
+
+  public:
+    explicit WorkingSetView(const TraceData* traceData, QWidget* parent = nullptr);
+    ~WorkingSetView();
+
+  private:
+    Q_SLOT void tableSelectionChanged();
+    Q_SLOT void chartIntervalClicked(int interval);
+
+  private:
+    QStandardItemModel* m_Model = nullptr;
+    WorkingSetChart* m_Chart = nullptr;
+    Ui_WorkingSetView* ui;
+  };
+
+}
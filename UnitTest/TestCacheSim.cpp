@@ -2,6 +2,9 @@
 #include "gtest-all.cc"
 
 #include "CacheSim/CacheSimInternals.h"
+#include "CacheSim/CacheSimData.h"
+#include <algorithm>
+#include <vector>
 extern "C"
 {
 #include "udis86/udis86.h"
@@ -104,6 +107,322 @@ TEST_F(CacheTest, FullAssoc)
   EXPECT_EQ(CacheSim::kL2Hit, cache.Access(0, base, 8, CacheSim::kRead));
 }
 
+namespace
+{
+  class LineCounter : public CacheSim::LineObserver
+  {
+  public:
+    void OnLineAccess(uint64_t line_addr, CacheSim::AccessResult, uint64_t) override
+    {
+      if (0 == m_Count)
+        m_First = line_addr;
+      m_Last = line_addr;
+      ++m_Count;
+    }
+
+    int       m_Count = 0;
+    uint64_t  m_First = 0;
+    uint64_t  m_Last = 0;
+  };
+
+  // Returns the number of lines an access touches, and checks they are the lines holding its first and last bytes.
+  int CountLines(uintptr_t addr, size_t size)
+  {
+    CacheSim::JaguarCacheSim* cache = new CacheSim::JaguarCacheSim;
+    cache->Init();
+    LineCounter counter;
+    cache->Access(0, addr, size, CacheSim::kRead, &counter);
+    delete cache;
+
+    EXPECT_EQ(addr & ~63ull, counter.m_First);
+    EXPECT_EQ((addr + (size ? size - 1 : 0)) & ~63ull, counter.m_Last);
+    return counter.m_Count;
+  }
+}
+
+TEST(JaguarCacheSim, LineBoundaries)
+{
+  EXPECT_EQ(1, CountLines(0x1000, 1));
+  EXPECT_EQ(1, CountLines(0x1000, 0));
+  EXPECT_EQ(1, CountLines(0x103f, 1));
+  EXPECT_EQ(1, CountLines(0x1038, 8));      // Ends on the last byte of the line
+  EXPECT_EQ(2, CountLines(0x1039, 8));
+  EXPECT_EQ(1, CountLines(0x1000, 64));     // An aligned AVX-512 store, or a whole line
+  EXPECT_EQ(2, CountLines(0x1020, 64));
+  EXPECT_EQ(1, CountLines(0x1020, 32));     // An aligned AVX store
+  EXPECT_EQ(8, CountLines(0x1000, 512));    // FXSAVE
+  EXPECT_EQ(9, CountLines(0x1010, 512));
+  EXPECT_EQ(13, CountLines(0x1000, 512 + 64 + 256));  // XSAVE of the state Jaguar has
+}
+
+TEST_F(CacheTest, AlignedLineDoesNotTouchNext)
+{
+  // A 64 byte access of one line leaves the next line cold.
+  EXPECT_EQ(CacheSim::kL2DMiss, cache.Access(0, 0x1000, 64, CacheSim::kRead));
+  EXPECT_EQ(CacheSim::kL2DMiss, cache.Access(0, 0x1040, 8, CacheSim::kRead));
+
+  // A straddling access misses if either line does, and brings in both.
+  EXPECT_EQ(CacheSim::kL2DMiss, cache.Access(0, 0x107c, 8, CacheSim::kRead));
+  EXPECT_EQ(CacheSim::kD1Hit, cache.Access(0, 0x1080, 8, CacheSim::kRead));
+  EXPECT_EQ(CacheSim::kD1Hit, cache.Access(0, 0x1040, 128, CacheSim::kRead));
+  EXPECT_EQ(CacheSim::kL2DMiss, cache.Access(0, 0x1040, 129, CacheSim::kRead));
+}
+
+TEST(ConfigurableCacheSim, LineBoundaries)
+{
+  CacheSim::ConfigurableCacheSim* cache = new CacheSim::ConfigurableCacheSim;
+  cache->Init(CacheSim::JaguarCacheConfig());
+
+  EXPECT_EQ(CacheSim::kL2DMiss, cache->Access(0, 0x1000, 64, CacheSim::kRead));
+  EXPECT_EQ(CacheSim::kL2DMiss, cache->Access(0, 0x1040, 8, CacheSim::kRead));
+  EXPECT_EQ(CacheSim::kL2DMiss, cache->Access(0, 0x107c, 8, CacheSim::kRead));
+  EXPECT_EQ(CacheSim::kD1Hit, cache->Access(0, 0x1080, 8, CacheSim::kRead));
+  EXPECT_EQ(CacheSim::kD1Hit, cache->Access(0, 0x1000, 512 - 320, CacheSim::kRead));
+
+  cache->Free();
+  delete cache;
+}
+
+TEST(JaguarCacheSim, BatchMatchesSingleAccesses)
+{
+  CacheSim::JaguarCacheSim* single = new CacheSim::JaguarCacheSim;
+  CacheSim::JaguarCacheSim* batched = new CacheSim::JaguarCacheSim;
+  single->Init();
+  batched->Init();
+
+  CacheSim::CacheAccess batch[13];
+  CacheSim::AccessResult results[13];
+
+  uint64_t state = 1;
+  for (int i = 0; i < 20000; ++i)
+  {
+    for (CacheSim::CacheAccess& access : batch)
+    {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      access.m_Addr = 0x10000000 + ((state >> 20) & ((8 << 20) - 1));
+      access.m_Size = 1 + ((state >> 50) & 31);
+      access.m_CoreIndex = uint8_t(state >> 61);
+      access.m_Mode = uint8_t((state >> 40) % 3);
+      access.m_Observe = 0;
+    }
+
+    batched->AccessBatch(batch, 13, results);
+    for (int k = 0; k < 13; ++k)
+    {
+      ASSERT_EQ(single->Access(batch[k].m_CoreIndex, batch[k].m_Addr, batch[k].m_Size, CacheSim::AccessMode(batch[k].m_Mode)), results[k]);
+    }
+  }
+
+  delete batched;
+  delete single;
+}
+
+TEST(ConfigurableCacheSim, MatchesJaguar)
+{
+  CacheSim::CacheConfig config = CacheSim::JaguarCacheConfig();
+  ASSERT_TRUE(CacheSim::ConfigurableCacheSim::IsValid(config));
+
+  CacheSim::JaguarCacheSim* jaguar = new CacheSim::JaguarCacheSim;
+  CacheSim::ConfigurableCacheSim* configurable = new CacheSim::ConfigurableCacheSim;
+  jaguar->Init();
+  configurable->Init(config);
+
+  // Random accesses over 8 MB from all cores, so every level misses and evicts.
+  uint64_t state = 1;
+  for (int i = 0; i < 200000; ++i)
+  {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    const int core = int(state >> 61);
+    const uintptr_t addr = 0x10000000 + ((state >> 20) & ((8 << 20) - 1));
+    const CacheSim::AccessMode mode = CacheSim::AccessMode((state >> 40) % 3);
+    ASSERT_EQ(jaguar->Access(core, addr, 8, mode), configurable->Access(core, addr, 8, mode));
+  }
+
+  configurable->Free();
+  delete configurable;
+  delete jaguar;
+
+  config.m_L2Size = 3 * 1024 * 1024;
+  EXPECT_FALSE(CacheSim::ConfigurableCacheSim::IsValid(config));
+}
+
+TEST(ConfigurableCacheSim, ShardsMatchWhole)
+{
+  const CacheSim::CacheConfig config = CacheSim::JaguarCacheConfig();
+  const uint32_t shard_shift = 2;
+  ASSERT_TRUE(CacheSim::ConfigurableCacheSim::IsValid(config, shard_shift));
+
+  CacheSim::ConfigurableCacheSim* whole = new CacheSim::ConfigurableCacheSim;
+  CacheSim::ConfigurableCacheSim* shards = new CacheSim::ConfigurableCacheSim[1 << shard_shift];
+  whole->Init(config);
+  for (int i = 0; i < (1 << shard_shift); ++i)
+    shards[i].Init(config, shard_shift);
+
+  // Each line goes to the shard its low bits select, one line at a time, as the capture splits accesses.
+  uint64_t state = 1;
+  for (int i = 0; i < 200000; ++i)
+  {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    const int core = int(state >> 61);
+    const uintptr_t addr = 0x10000000 + ((state >> 20) & ((8 << 20) - 64));
+    const CacheSim::AccessMode mode = CacheSim::AccessMode((state >> 40) % 3);
+    CacheSim::ConfigurableCacheSim& shard = shards[(addr >> 6) & ((1 << shard_shift) - 1)];
+    ASSERT_EQ(whole->Access(core, addr, 1, mode), shard.Access(core, addr, 1, mode));
+  }
+
+  for (int i = 0; i < (1 << shard_shift); ++i)
+    shards[i].Free();
+  whole->Free();
+  delete[] shards;
+  delete whole;
+
+  // A 2 way, 4 KB L1 has 32 sets.
+  CacheSim::CacheConfig small = config;
+  small.m_D1Size = 4096;
+  small.m_D1Ways = 2;
+  EXPECT_TRUE(CacheSim::ConfigurableCacheSim::IsValid(small, 5));
+  EXPECT_FALSE(CacheSim::ConfigurableCacheSim::IsValid(small, 6));
+}
+
+TEST(ReuseDistance, Buckets)
+{
+  EXPECT_EQ(0u, CacheSim::ReuseDistanceBucket(0));
+  EXPECT_EQ(1u, CacheSim::ReuseDistanceBucket(1));
+  EXPECT_EQ(2u, CacheSim::ReuseDistanceBucket(2));
+  EXPECT_EQ(2u, CacheSim::ReuseDistanceBucket(3));
+  EXPECT_EQ(13u, CacheSim::ReuseDistanceBucket(4096));
+  EXPECT_EQ(CacheSim::kReuseColdBucket - 1, CacheSim::ReuseDistanceBucket(~0ull));
+
+  // A 512 line cache hits distances up to 511, which are in buckets 0 to 9.
+  uint32_t histogram[CacheSim::kReuseBucketCount] = { 0 };
+  histogram[CacheSim::ReuseDistanceBucket(511)] += 1;
+  histogram[CacheSim::ReuseDistanceBucket(512)] += 2;
+  histogram[CacheSim::kReuseColdBucket] += 4;
+  EXPECT_EQ(6u, CacheSim::ReuseMisses(histogram, 9));
+  EXPECT_EQ(4u, CacheSim::ReuseMisses(histogram, 10));
+}
+
+namespace
+{
+  // Feeds the lines to a ReuseTree the way the capture does, skipping lines outside the sample, and returns the
+  // distances of the sampled accesses.
+  std::vector<uint64_t> ReuseDistances(const std::vector<uint64_t>& lines, uint32_t sample_shift)
+  {
+    std::vector<uint64_t> distinct;
+    std::vector<uint64_t> times;
+    std::vector<uint64_t> distances;
+
+    CacheSim::ReuseTree tree;
+    memset(&tree, 0, sizeof tree);
+
+    for (uint64_t line : lines)
+    {
+      if (!CacheSim::ReuseTree::IsSampled(line, sample_shift))
+        continue;
+
+      size_t i = std::find(distinct.begin(), distinct.end(), line) - distinct.begin();
+      if (i == distinct.size())
+      {
+        distinct.push_back(line);
+        times.push_back(0);
+      }
+
+      uint64_t distance;
+      times[i] = tree.Access(times[i], sample_shift, &distance);
+      distances.push_back(distance);
+    }
+
+    tree.Free();
+    return distances;
+  }
+}
+
+TEST(ReuseDistance, ExactDistances)
+{
+  const uint64_t a = 0x1000, b = 0x2000, c = 0x3000;
+  const uint64_t cold = CacheSim::ReuseTree::kColdDistance;
+
+  const std::vector<uint64_t> expected = { cold, cold, cold, 2, 2, 1, 0 };
+  EXPECT_EQ(expected, ReuseDistances({ a, b, c, a, b, a, a }, 0));
+
+  // Against the LRU stack itself, over enough lines for the treap to be several levels deep.
+  std::vector<uint64_t> lines;
+  uint32_t seed = 12345;
+  for (int i = 0; i < 4000; ++i)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    lines.push_back((seed >> 16) % 300);
+  }
+
+  std::vector<uint64_t> stack;
+  std::vector<uint64_t> stack_distances;
+  for (uint64_t line : lines)
+  {
+    auto it = std::find(stack.begin(), stack.end(), line);
+    stack_distances.push_back(it == stack.end() ? cold : uint64_t(it - stack.begin()));
+    if (it != stack.end())
+      stack.erase(it);
+    stack.insert(stack.begin(), line);
+  }
+  EXPECT_EQ(stack_distances, ReuseDistances(lines, 0));
+}
+
+TEST(ReuseDistance, ShardsSampling)
+{
+  const uint32_t shift = 2;
+
+  // Close to a quarter of the lines are sampled.
+  std::vector<uint64_t> sampled, unsampled;
+  for (uint64_t line = 0; line < 4096; ++line)
+  {
+    (CacheSim::ReuseTree::IsSampled(line, shift) ? sampled : unsampled).push_back(line);
+  }
+  EXPECT_GT(sampled.size(), 900u);
+  EXPECT_LT(sampled.size(), 1150u);
+
+  // Lines outside the sample aren't counted, and distances within it are scaled by 2^shift.
+  const uint64_t a = sampled[0], b = sampled[1], c = sampled[2];
+  const uint64_t x = unsampled[0], y = unsampled[1];
+  const uint64_t cold = CacheSim::ReuseTree::kColdDistance;
+
+  const std::vector<uint64_t> expected = { cold, cold, cold, 8, 8, 4 };
+  EXPECT_EQ(expected, ReuseDistances({ a, x, b, y, c, x, a, y, b, x, a }, shift));
+}
+
+TEST(FiberSwitch, LargeFrameIsNotASwitch)
+{
+  const CacheSim::AddressRange thread_stack = { 0x7f0000000000ull, 0x7f0000800000ull };
+  const CacheSim::AddressRange no_signal_stack = { 0, 0 };
+
+  // A 1MB frame, and returning from it.
+  const uintptr_t top = thread_stack.m_End - 0x1000;
+  EXPECT_FALSE(CacheSim::IsStackSwitch(top, top - 0x100000, false, thread_stack, no_signal_stack));
+  EXPECT_FALSE(CacheSim::IsStackSwitch(top - 0x100000, top, false, thread_stack, no_signal_stack));
+
+  // Without known bounds the same move looks like a switch.
+  EXPECT_TRUE(CacheSim::IsStackSwitch(top, top - 0x100000, false, no_signal_stack, no_signal_stack));
+}
+
+TEST(FiberSwitch, StackBounds)
+{
+  const CacheSim::AddressRange thread_stack = { 0x7f0000000000ull, 0x7f0000800000ull };
+  const CacheSim::AddressRange signal_stack = { 0x600000000000ull, 0x600000010000ull };
+  const uintptr_t rsp = thread_stack.m_End - 0x1000;
+  const uintptr_t fiber_rsp = 0x500000008000ull;
+
+  // Signal handlers on the alternate stack aren't switches, leaving the thread's stack is.
+  EXPECT_FALSE(CacheSim::IsStackSwitch(rsp, signal_stack.m_End - 0x100, false, thread_stack, signal_stack));
+  EXPECT_FALSE(CacheSim::IsStackSwitch(signal_stack.m_End - 0x100, rsp, false, thread_stack, signal_stack));
+  EXPECT_TRUE(CacheSim::IsStackSwitch(rsp, fiber_rsp, false, thread_stack, signal_stack));
+  EXPECT_TRUE(CacheSim::IsStackSwitch(fiber_rsp, rsp, false, thread_stack, signal_stack));
+
+  // Between fiber stacks only large moves are, unless CacheSimFiberSwitch() announced one.
+  EXPECT_FALSE(CacheSim::IsStackSwitch(fiber_rsp, fiber_rsp + 0x10000, false, thread_stack, signal_stack));
+  EXPECT_TRUE(CacheSim::IsStackSwitch(fiber_rsp, fiber_rsp + 0x10000, true, thread_stack, signal_stack));
+  EXPECT_TRUE(CacheSim::IsStackSwitch(fiber_rsp, fiber_rsp + 0x100000, false, thread_stack, signal_stack));
+  EXPECT_FALSE(CacheSim::IsStackSwitch(fiber_rsp, fiber_rsp + 0x800, true, thread_stack, signal_stack));
+}
+
 TEST(Disassembler, Movhps)
 {
   static const uint8_t insn[] = { 0x0f, 0x16, 0x0f };
@@ -124,6 +443,66 @@ TEST(Disassembler, Movhps)
   ASSERT_EQ(64, ud.operand[1].size);
 }
 
+TEST(Disassembler, VmovntdqYmm)
+{
+  // vmovntdq [rdi], ymm0
+  static const uint8_t insn[] = { 0xc5, 0xfd, 0xe7, 0x07 };
+  struct ud ud;
+  ud_init(&ud);
+  ud_set_mode(&ud, 64);
+  ud_set_input_buffer(&ud, (const uint8_t*)insn, 16);
+  int ilen = ud_disassemble(&ud);
+  ASSERT_EQ(4, ilen);
+
+  ASSERT_EQ(UD_Ivmovntdq, ud.mnemonic);
+  ASSERT_EQ(UD_OP_MEM, ud.operand[0].type);
+  ASSERT_EQ(256, ud.operand[0].size);
+  ASSERT_EQ(UD_OP_ACCESS_WRITE, ud.operand[0].access);
+}
+
+TEST(Disassembler, Vgatherdps)
+{
+  // vgatherdps ymm0, dword [r15+ymm9*4], ymm2
+  static const uint8_t insn[] = { 0xc4, 0x82, 0x6d, 0x92, 0x04, 0x8f };
+  struct ud ud;
+  ud_init(&ud);
+  ud_set_mode(&ud, 64);
+  ud_set_input_buffer(&ud, (const uint8_t*)insn, 16);
+  int ilen = ud_disassemble(&ud);
+  ASSERT_EQ(6, ilen);
+
+  ASSERT_EQ(UD_Ivgatherdps, ud.mnemonic);
+  ASSERT_EQ(UD_OP_REG, ud.operand[0].type);
+  ASSERT_EQ(UD_R_YMM0, ud.operand[0].base);
+
+  ASSERT_EQ(UD_OP_MEM, ud.operand[1].type);
+  ASSERT_EQ(UD_R_R15, ud.operand[1].base);
+  ASSERT_EQ(UD_R_YMM9, ud.operand[1].index);
+  ASSERT_EQ(4, ud.operand[1].scale);
+  ASSERT_EQ(32, ud.operand[1].size);
+
+  ASSERT_EQ(UD_OP_REG, ud.operand[2].type);
+  ASSERT_EQ(UD_R_YMM2, ud.operand[2].base);
+}
+
+TEST(Disassembler, VgatherqpsIndexWidth)
+{
+  // vgatherqps xmm0, dword [rdi+ymm1*8], xmm2 -- the destination stays 128 bits wide with a 256 bit index.
+  static const uint8_t insn[] = { 0xc4, 0xe2, 0x6d, 0x93, 0x04, 0xcf };
+  struct ud ud;
+  ud_init(&ud);
+  ud_set_mode(&ud, 64);
+  ud_set_input_buffer(&ud, (const uint8_t*)insn, 16);
+  int ilen = ud_disassemble(&ud);
+  ASSERT_EQ(6, ilen);
+
+  ASSERT_EQ(UD_Ivgatherqps, ud.mnemonic);
+  ASSERT_EQ(UD_R_XMM0, ud.operand[0].base);
+  ASSERT_EQ(UD_R_YMM1, ud.operand[1].index);
+  ASSERT_EQ(8, ud.operand[1].scale);
+  ASSERT_EQ(UD_R_XMM2, ud.operand[2].base);
+}
+
 #if 0
 TEST(RunTheThing, Minimal)
 {
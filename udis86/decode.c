@@ -591,8 +591,17 @@ decode_modrm_rm(struct ud         *u,
       
       op->base  = (ud_type_t) (UD_R_RAX + (SIB_B(inp_curr(u)) | (REX_B(u->_rex) << 3)));
       op->index = (ud_type_t) (UD_R_RAX + (SIB_I(inp_curr(u)) | (REX_X(u->_rex) << 3)));
-      /* special conditions for base reference */
-      if (op->index == UD_R_RSP) {
+      if (op->_oprcode == OP_VSIB || op->_oprcode == OP_VSIBX) {
+        /* 
+         * VSIB: the index is a vector register, one address per lane. 
+         * There is no "no index" encoding.
+         */
+        int idx = SIB_I(inp_curr(u)) | (REX_X(u->_rex) << 3);
+        int wide = op->_oprcode == OP_VSIB && 
+                   resolve_operand_size(u, SZ_X) == SZ_QQ;
+        op->index = (ud_type_t) (idx + (wide ? UD_R_YMM0 : UD_R_XMM0));
+        op->scale = (1 << SIB_S(inp_curr(u))) & ~1;
+      } else if (op->index == UD_R_RSP) {
         op->index = UD_NONE;
         op->scale = UD_NONE;
       } else {
@@ -634,7 +643,11 @@ decode_modrm_rm(struct ud         *u,
       op->index = (ud_type_t) (UD_R_EAX + (SIB_I(inp_curr(u)) | (REX_X(u->pfx_rex) << 3)));
       op->base  = (ud_type_t) (UD_R_EAX + (SIB_B(inp_curr(u)) | (REX_B(u->pfx_rex) << 3)));
 
-      if (op->index == UD_R_ESP) {
+      if (op->_oprcode == OP_VSIB || op->_oprcode == OP_VSIBX) {
+        int wide = op->_oprcode == OP_VSIB && 
+                   resolve_operand_size(u, SZ_X) == SZ_QQ;
+        op->index = (ud_type_t) (SIB_I(inp_curr(u)) + (wide ? UD_R_YMM0 : UD_R_XMM0));
+      } else if (op->index == UD_R_ESP) {
         op->index = UD_NONE;
         op->scale = UD_NONE;
       }
@@ -741,6 +754,13 @@ decode_operand(struct ud           *u,
     case OP_A :
       decode_a(u, operand);
       break;
+    case OP_VSIB:
+    case OP_VSIBX:
+      if (MODRM_MOD(modrm(u)) == 3 || MODRM_RM(modrm(u)) != 4) {
+        UDERR(u, "expected vsib memory operand\n");
+      }
+      decode_modrm_rm(u, operand, REGCLASS_GPR, size);
+      break;
     case OP_MR:
       decode_modrm_rm(u, operand, REGCLASS_GPR, 
                       MODRM_MOD(modrm(u)) == 3 ? 
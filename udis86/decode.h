@@ -98,7 +98,9 @@ enum ud_operand_code {
 
     OP_R,      OP_C,      OP_D,       
 
-    OP_MR
+    OP_MR,
+
+    OP_VSIB,   OP_VSIBX
 } UD_ATTR_PACKED;
 
 
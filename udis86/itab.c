@@ -1957,7 +1957,7 @@ static const uint16_t ud_itab__357[] = {
   /* 84 */     INVALID,     INVALID,     INVALID,     INVALID,
   /* 88 */     INVALID,     INVALID,     INVALID,     INVALID,
   /* 8c */     INVALID,     INVALID,     INVALID,     INVALID,
-  /* 90 */     INVALID,     INVALID,     INVALID,     INVALID,
+  /* 90 */  GROUP(447),  GROUP(448),  GROUP(449),  GROUP(450),
   /* 94 */     INVALID,     INVALID,     INVALID,     INVALID,
   /* 98 */     INVALID,     INVALID,     INVALID,     INVALID,
   /* 9c */     INVALID,     INVALID,     INVALID,     INVALID,
@@ -2674,6 +2674,22 @@ static const uint16_t ud_itab__446[] = {
 };
 
 
+static const uint16_t ud_itab__447[] = {
+  /*  0 */        1760,        1761,
+};
+
+static const uint16_t ud_itab__448[] = {
+  /*  0 */        1762,        1763,
+};
+
+static const uint16_t ud_itab__449[] = {
+  /*  0 */        1764,        1765,
+};
+
+static const uint16_t ud_itab__450[] = {
+  /*  0 */        1766,        1767,
+};
+
 struct ud_lookup_table_list_entry ud_lookup_table_list[] = {
     /* 000 */ { ud_itab__0, UD_TAB__OPC_TABLE, "opctbl" },
     /* 001 */ { ud_itab__1, UD_TAB__OPC_MODE, "/m" },
@@ -3122,6 +3138,10 @@ struct ud_lookup_table_list_entry ud_lookup_table_list[] = {
     /* 444 */ { ud_itab__444, UD_TAB__OPC_REG, "/reg" },
     /* 445 */ { ud_itab__445, UD_TAB__OPC_REG, "/reg" },
     /* 446 */ { ud_itab__446, UD_TAB__OPC_MODE, "/m" },
+    /* 447 */ { ud_itab__447, UD_TAB__OPC_VEX_W, "/vexw" },
+    /* 448 */ { ud_itab__448, UD_TAB__OPC_VEX_W, "/vexw" },
+    /* 449 */ { ud_itab__449, UD_TAB__OPC_VEX_W, "/vexw" },
+    /* 450 */ { ud_itab__450, UD_TAB__OPC_VEX_W, "/vexw" },
 };
 
 /* itab entry operand definitions (for readability) */
@@ -3157,6 +3177,7 @@ struct ud_lookup_table_list_entry ud_lookup_table_list[] = {
 #define O_Gy      { OP_G,        SZ_Y     }
 #define O_Gz      { OP_G,        SZ_Z     }
 #define O_H       { OP_H,        SZ_X     }
+#define O_Hdq     { OP_H,        SZ_DQ    }
 #define O_Hqq     { OP_H,        SZ_QQ    }
 #define O_Hx      { OP_H,        SZ_X     }
 #define O_I1      { OP_I1,       SZ_NA    }
@@ -3189,6 +3210,7 @@ struct ud_lookup_table_list_entry ud_lookup_table_list[] = {
 #define O_MwRv    { OP_MR,       SZ_WV    }
 #define O_MwRy    { OP_MR,       SZ_WY    }
 #define O_MwU     { OP_MU,       SZ_WO    }
+#define O_Mx      { OP_M,        SZ_X     }
 #define O_N       { OP_N,        SZ_Q     }
 #define O_NONE    { OP_NONE,     SZ_NA    }
 #define O_Ob      { OP_O,        SZ_B     }
@@ -3250,6 +3272,9 @@ struct ud_lookup_table_list_entry ud_lookup_table_list[] = {
 #define O_U       { OP_U,        SZ_O     }
 #define O_Ux      { OP_U,        SZ_X     }
 #define O_V       { OP_V,        SZ_DQ    }
+#define O_VSIBd   { OP_VSIB,     SZ_D     }
+#define O_VSIBq   { OP_VSIB,     SZ_Q     }
+#define O_VSIBXq  { OP_VSIBX,    SZ_Q     }
 #define O_Vdq     { OP_V,        SZ_DQ    }
 #define O_Vqq     { OP_V,        SZ_QQ    }
 #define O_Vsd     { OP_V,        SZ_Q     }
@@ -4173,12 +4198,12 @@ struct ud_itab_entry ud_itab[] = {
   /* 0900 */ { UD_Imovmskps, O_Gd, O_U, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_oso|P_rexr|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0901 */ { UD_Ivmovmskps, O_Gd, O_Ux, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_oso|P_rexr|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0902 */ { UD_Imovntdq, O_M, O_V, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
-  /* 0903 */ { UD_Ivmovntdq, O_M, O_Vx, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 0903 */ { UD_Ivmovntdq, O_Mx, O_Vx, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0904 */ { UD_Imovnti, O_M, O_Gy, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0905 */ { UD_Imovntpd, O_M, O_V, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
-  /* 0906 */ { UD_Ivmovntpd, O_M, O_Vx, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 0906 */ { UD_Ivmovntpd, O_Mx, O_Vx, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0907 */ { UD_Imovntps, O_M, O_V, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
-  /* 0908 */ { UD_Ivmovntps, O_M, O_Vx, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 0908 */ { UD_Ivmovntps, O_Mx, O_Vx, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0909 */ { UD_Imovntq, O_M, O_P, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0910 */ { UD_Imovq, O_P, O_Eq, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0911 */ { UD_Imovq, O_V, O_Eq, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
@@ -4187,9 +4212,9 @@ struct ud_itab_entry ud_itab[] = {
   /* 0914 */ { UD_Imovq, O_Eq, O_V, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0915 */ { UD_Ivmovq, O_Eq, O_Vx, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0916 */ { UD_Imovq, O_V, O_W, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
-  /* 0917 */ { UD_Ivmovq, O_Vx, O_Wx, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 0917 */ { UD_Ivmovq, O_Vx, O_Wsd, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0918 */ { UD_Imovq, O_W, O_V, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
-  /* 0919 */ { UD_Ivmovq, O_Wx, O_Vx, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 0919 */ { UD_Ivmovq, O_Wsd, O_Vx, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0920 */ { UD_Imovq, O_P, O_Q, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0921 */ { UD_Imovq, O_Q, O_P, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexw|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 0922 */ { UD_Imovsb, O_NONE, O_NONE, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_str|P_seg, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_TESTED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_R_RSI, UD_NONE}, {UD_R_RSI, UD_NONE} },
@@ -4951,7 +4976,7 @@ struct ud_itab_entry ud_itab[] = {
   /* 1678 */ { UD_Impsadbw, O_V, O_W, O_Ib, O_NONE, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1679 */ { UD_Ivmpsadbw, O_Vx, O_Hx, O_Wx, O_Ib, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1680 */ { UD_Imovntdqa, O_V, O_M, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexw|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
-  /* 1681 */ { UD_Ivmovntdqa, O_Vx, O_M, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexw|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1681 */ { UD_Ivmovntdqa, O_Vx, O_Mx, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexw|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1682 */ { UD_Ipackusdw, O_V, O_W, O_NONE, O_NONE, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexw|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1683 */ { UD_Ivpackusdw, O_Vx, O_Hx, O_Wx, O_NONE, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexw|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1684 */ { UD_Ipmovsxbw, O_V, O_MqU, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexw|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
@@ -5000,10 +5025,10 @@ struct ud_itab_entry ud_itab[] = {
   /* 1727 */ { UD_Ivbroadcastsd, O_Vqq, O_Mq, O_NONE, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1728 */ { UD_Ivextractf128, O_Wdq, O_Vqq, O_Ib, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1729 */ { UD_Ivinsertf128, O_Vqq, O_Hqq, O_Wdq, O_Ib, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
-  /* 1730 */ { UD_Ivmaskmovps, O_V, O_H, O_M, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
-  /* 1731 */ { UD_Ivmaskmovps, O_M, O_H, O_V, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
-  /* 1732 */ { UD_Ivmaskmovpd, O_V, O_H, O_M, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
-  /* 1733 */ { UD_Ivmaskmovpd, O_M, O_H, O_V, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1730 */ { UD_Ivmaskmovps, O_V, O_H, O_Mx, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1731 */ { UD_Ivmaskmovps, O_Mx, O_H, O_V, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1732 */ { UD_Ivmaskmovpd, O_V, O_H, O_Mx, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1733 */ { UD_Ivmaskmovpd, O_Mx, O_H, O_V, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1734 */ { UD_Ivpermilpd, O_Vx, O_Hx, O_Wx, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1735 */ { UD_Ivpermilpd, O_V, O_W, O_Ib, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1736 */ { UD_Ivpermilps, O_Vx, O_Hx, O_Wx, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
@@ -5030,6 +5055,14 @@ struct ud_itab_entry ud_itab[] = {
   /* 1757 */ { UD_Ivpslld, O_H, O_V, O_W, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1758 */ { UD_Ivpsllq, O_V, O_H, O_W, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
   /* 1759 */ { UD_Ivpsllq, O_H, O_V, O_W, O_NONE, UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1760 */ { UD_Ivpgatherdd, O_Vx, O_VSIBd, O_Hx, O_NONE, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1761 */ { UD_Ivpgatherdq, O_Vx, O_VSIBXq, O_Hx, O_NONE, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1762 */ { UD_Ivpgatherqd, O_Vdq, O_VSIBd, O_Hdq, O_NONE, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1763 */ { UD_Ivpgatherqq, O_Vx, O_VSIBq, O_Hx, O_NONE, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1764 */ { UD_Ivgatherdps, O_Vx, O_VSIBd, O_Hx, O_NONE, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1765 */ { UD_Ivgatherdpd, O_Vx, O_VSIBXq, O_Hx, O_NONE, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1766 */ { UD_Ivgatherqps, O_Vdq, O_VSIBd, O_Hdq, O_NONE, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
+  /* 1767 */ { UD_Ivgatherqpd, O_Vx, O_VSIBq, O_Hx, O_NONE, UD_OP_ACCESS_READ | UD_OP_ACCESS_WRITE, UD_OP_ACCESS_READ, P_aso|P_rexr|P_rexx|P_rexb|P_vexl, {UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED, UD_FLAG_UNCHANGED}, {UD_NONE}, {UD_NONE} },
 };
 
 
@@ -5699,6 +5732,10 @@ const char* ud_mnemonics_str[] = {
     "verw",
     "vextractf128",
     "vextractps",
+    "vgatherdpd",
+    "vgatherdps",
+    "vgatherqpd",
+    "vgatherqps",
     "vhaddpd",
     "vhaddps",
     "vhsubpd",
@@ -5805,6 +5842,10 @@ const char* ud_mnemonics_str[] = {
     "vpextrd",
     "vpextrq",
     "vpextrw",
+    "vpgatherdd",
+    "vpgatherdq",
+    "vpgatherqd",
+    "vpgatherqq",
     "vphaddd",
     "vphaddsw",
     "vphaddw",
@@ -688,6 +688,10 @@ enum ud_mnemonic_code {
     UD_Iverw,
     UD_Ivextractf128,
     UD_Ivextractps,
+    UD_Ivgatherdpd,
+    UD_Ivgatherdps,
+    UD_Ivgatherqpd,
+    UD_Ivgatherqps,
     UD_Ivhaddpd,
     UD_Ivhaddps,
     UD_Ivhsubpd,
@@ -794,6 +798,10 @@ enum ud_mnemonic_code {
     UD_Ivpextrd,
     UD_Ivpextrq,
     UD_Ivpextrw,
+    UD_Ivpgatherdd,
+    UD_Ivpgatherdq,
+    UD_Ivpgatherqd,
+    UD_Ivpgatherqq,
     UD_Ivphaddd,
     UD_Ivphaddsw,
     UD_Ivphaddw,